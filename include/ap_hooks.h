@@ -138,6 +138,100 @@
         APR_IMPLEMENT_EXTERNAL_HOOK_RUN_FIRST(ap,AP,ret,name,args_decl, \
                                               args_use,decline)
 
+/**
+ * Implement an Apache core hook like AP_IMPLEMENT_HOOK_RUN_ALL, which for
+ * each call only runs the functions not left out for the server it is
+ * made for, see ap_hook_skip_for_server().
+ *
+ * @param ret The return type of the hook (and the hook runner)
+ * @param name The name of the hook
+ * @param args_decl The declaration of the arguments for the hook, for example
+ * "(request_rec *r)"
+ * @param args_use The arguments for the hook as used in a call, for example
+ * "(r)"
+ * @param server The server the call is made for, in terms of the arguments,
+ * for example "r->server"
+ * @param ok The "ok" return value
+ * @param decline The "decline" return value
+ * @return ok, decline or an error.
+ * @note The file implementing the hook must include http_config.h.
+ */
+#define AP_IMPLEMENT_SERVER_HOOK_RUN_ALL(ret,name,args_decl,args_use,server, \
+                                         ok,decline) \
+    AP_IMPLEMENT_HOOK_BASE(name) \
+    AP_DECLARE(ret) ap_run_##name args_decl \
+    { \
+        const apr_array_header_t *links; \
+        ap_LINK_##name##_t *pHook; \
+        int n; \
+        ret rv = ok; \
+        APR_HOOK_INT_DCL_UD; \
+        APR_HOOK_PROBE_ENTRY(ud, ap, name, args_use); \
+        links = ap_hook_server_links(server, _hooks.link_##name); \
+        if (links) { \
+            pHook = (ap_LINK_##name##_t *)links->elts; \
+            for (n = 0; n < links->nelts; ++n) { \
+                APR_HOOK_PROBE_INVOKE(ud, ap, name, (char *)pHook[n].szName, \
+                                      args_use); \
+                rv = pHook[n].pFunc args_use; \
+                APR_HOOK_PROBE_COMPLETE(ud, ap, name, \
+                                        (char *)pHook[n].szName, rv, \
+                                        args_use); \
+                if (rv != ok && rv != decline) \
+                    break; \
+                rv = ok; \
+            } \
+        } \
+        APR_HOOK_PROBE_RETURN(ud, ap, name, rv, args_use); \
+        return rv; \
+    }
+
+/**
+ * Implement an Apache core hook like AP_IMPLEMENT_HOOK_RUN_FIRST, which for
+ * each call only runs the functions not left out for the server it is
+ * made for, see ap_hook_skip_for_server().
+ *
+ * @param ret The return type of the hook (and the hook runner)
+ * @param name The name of the hook
+ * @param args_decl The declaration of the arguments for the hook, for example
+ * "(request_rec *r)"
+ * @param args_use The arguments for the hook as used in a call, for example
+ * "(r)"
+ * @param server The server the call is made for, in terms of the arguments,
+ * for example "r->server"
+ * @param decline The "decline" return value
+ * @return decline or an error.
+ * @note The file implementing the hook must include http_config.h.
+ */
+#define AP_IMPLEMENT_SERVER_HOOK_RUN_FIRST(ret,name,args_decl,args_use, \
+                                           server,decline) \
+    AP_IMPLEMENT_HOOK_BASE(name) \
+    AP_DECLARE(ret) ap_run_##name args_decl \
+    { \
+        const apr_array_header_t *links; \
+        ap_LINK_##name##_t *pHook; \
+        int n; \
+        ret rv = decline; \
+        APR_HOOK_INT_DCL_UD; \
+        APR_HOOK_PROBE_ENTRY(ud, ap, name, args_use); \
+        links = ap_hook_server_links(server, _hooks.link_##name); \
+        if (links) { \
+            pHook = (ap_LINK_##name##_t *)links->elts; \
+            for (n = 0; n < links->nelts; ++n) { \
+                APR_HOOK_PROBE_INVOKE(ud, ap, name, (char *)pHook[n].szName, \
+                                      args_use); \
+                rv = pHook[n].pFunc args_use; \
+                APR_HOOK_PROBE_COMPLETE(ud, ap, name, \
+                                        (char *)pHook[n].szName, rv, \
+                                        args_use); \
+                if (rv != decline) \
+                    break; \
+            } \
+        } \
+        APR_HOOK_PROBE_RETURN(ud, ap, name, rv, args_use); \
+        return rv; \
+    }
+
 /* Note that the other optional hook implementations are straightforward but
  * have not yet been needed
  */
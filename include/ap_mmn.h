@@ -549,6 +549,22 @@
  * 20161018.1 (2.5.0-dev)  Dropped ap_has_cntrls(), ap_scan_http_uri_safe(),
  *                         ap_get_http_token() and http_stricturi conf member.
  *                         Added ap_scan_vchar_obstext()
+ * 20161018.2 (2.5.0-dev)  Added ap_vhost_find_given_name()
+ * 20161018.3 (2.5.0-dev)  Added ap_htaccess_cache_init() and access_cache,
+ *                         access_cache_size and access_cache_revalidate to
+ *                         core_server_config
+ * 20161018.4 (2.5.0-dev)  Added ap_merge_per_dir_configs_cached(),
+ *                         ap_merge_cache_init() and merge_cache_size to
+ *                         core_server_config
+ * 20161018.5 (2.5.0-dev)  Added config_reload_cache to core_server_config
+ * 20161018.6 (2.5.0-dev)  Added ap_hook_skip_for_server(),
+ *                         ap_hook_server_links(),
+ *                         AP_IMPLEMENT_SERVER_HOOK_RUN_ALL/_FIRST and
+ *                         hook_links to core_server_config
+ * 20161018.7 (2.5.0-dev)  Added ap_filter_chain_t, ap_filter_chain_make(),
+ *                         ap_add_filter_chain() and output_filter_chain,
+ *                         input_filter_chain to core_dir_config
+ * 20161018.8 (2.5.0-dev)  Added ap_proxy_request_resumed() to mod_proxy.h
  */
 
 #define MODULE_MAGIC_COOKIE 0x41503235UL /* "AP25" */
@@ -556,7 +572,7 @@
 #ifndef MODULE_MAGIC_NUMBER_MAJOR
 #define MODULE_MAGIC_NUMBER_MAJOR 20161018
 #endif
-#define MODULE_MAGIC_NUMBER_MINOR 1                 /* 0...n */
+#define MODULE_MAGIC_NUMBER_MINOR 8                 /* 0...n */
 
 /**
  * Determine if the server's current MODULE_MAGIC_NUMBER is at least a
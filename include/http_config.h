@@ -1079,6 +1079,30 @@ AP_CORE_DECLARE(ap_conf_vector_t*) ap_merge_per_dir_configs(apr_pool_t *p,
                                            ap_conf_vector_t *base,
                                            ap_conf_vector_t *new_conf);
 
+/**
+ * Merge per dir configs for a request like ap_merge_per_dir_configs(),
+ * reusing the result of an earlier request of the child process for the
+ * same pair of configs if MergeCacheSize is set. Only configs living as
+ * long as the server configuration and results of this function qualify,
+ * anything else is merged into the request's pool.
+ * @param r The current request
+ * @param base The base directory config structure
+ * @param new_conf The new directory config structure
+ * @return The merged config, which must not be modified
+ */
+AP_CORE_DECLARE(ap_conf_vector_t *) ap_merge_per_dir_configs_cached(
+                                           request_rec *r,
+                                           ap_conf_vector_t *base,
+                                           ap_conf_vector_t *new_conf);
+
+/**
+ * Set up the per child cache of merged per dir configs, if enabled with
+ * MergeCacheSize
+ * @param pchild The pool of the child process
+ * @param s The main server
+ */
+AP_CORE_DECLARE(void) ap_merge_cache_init(apr_pool_t *pchild, server_rec *s);
+
 /**
  * Allocate new ap_logconf and make (deep) copy of old ap_logconf
  * @param p The pool to alloc from
@@ -1126,6 +1150,15 @@ AP_CORE_DECLARE(int) ap_parse_htaccess(ap_conf_vector_t **result,
                                        const char *path,
                                        const char *access_name);
 
+/**
+ * Set up the per child cache of parsed htaccess files, if enabled with
+ * AccessFileCache
+ * @param pchild The pool of the child process
+ * @param s The main server
+ */
+AP_CORE_DECLARE(void) ap_htaccess_cache_init(apr_pool_t *pchild,
+                                             server_rec *s);
+
 /**
  * Setup a virtual host
  * @param p The pool to allocate all memory from
@@ -1248,6 +1281,39 @@ AP_CORE_DECLARE(void *) ap_set_config_vectors(server_rec *server,
 
   /* Hooks */
 
+/**
+ * Leave the functions a module registered for a hook out of the calls
+ * made for a server, because they have nothing to do there (for example
+ * mod_rewrite's translate_name function with the rewrite engine off in
+ * the server and its Location sections).  Only hooks implemented with
+ * AP_IMPLEMENT_SERVER_HOOK_RUN_ALL or AP_IMPLEMENT_SERVER_HOOK_RUN_FIRST
+ * take this into account: translate_name, map_to_storage, check_user_id,
+ * fixups, type_checker, access_checker, access_checker_ex, auth_checker,
+ * force_authn, post_perdir_config, post_read_request, header_parser and
+ * log_transaction.
+ * @param p The pool of the configuration (pconf)
+ * @param s The server
+ * @param links The functions registered for the hook, as returned by
+ *              ap_hook_get_<i>name</i>()
+ * @param m The module
+ * @note To be called from a post_config hook, when all functions are
+ * registered and sorted.
+ */
+AP_DECLARE(void) ap_hook_skip_for_server(apr_pool_t *p, server_rec *s,
+                                         const apr_array_header_t *links,
+                                         const module *m);
+
+/**
+ * Get the functions of a hook to call for a server, i.e. those not left
+ * out by ap_hook_skip_for_server().
+ * @param s The server
+ * @param links The functions registered for the hook
+ * @return The functions to call
+ */
+AP_DECLARE(const apr_array_header_t *) ap_hook_server_links(
+                                           const server_rec *s,
+                                           const apr_array_header_t *links);
+
 /**
  * Run the header parser functions for each module
  * @param r The current request
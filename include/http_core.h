@@ -676,6 +676,10 @@ typedef struct {
 
     /** Table of rules for building CGI variables, NULL if none configured */
     apr_hash_t *cgi_var_rules;
+
+    /** output_filters and input_filters, resolved */
+    ap_filter_chain_t *output_filter_chain;
+    ap_filter_chain_t *input_filter_chain;
 } core_dir_config;
 
 /* macro to implement off by default behaviour */
@@ -758,8 +762,38 @@ typedef struct {
     int protocols_honor_order;
     int async_filter;
     unsigned int async_filter_set:1;
+
+    /** Whether parsed htaccess files are cached per child process
+     * (AccessFileCache, global only) */
+    int access_cache;
+    /** Maximum number of cached htaccess files */
+    int access_cache_size;
+    /** How long a cached htaccess file is used before it is stat()ed again */
+    apr_interval_time_t access_cache_revalidate;
+
+    /** Maximum number of merged per-dir configs cached per child process,
+     * 0 to disable (MergeCacheSize, global only) */
+    int merge_cache_size;
+
+    /** Whether parsed configuration files are kept for the next time the
+     * configuration is read (ConfigReloadCache, global only) */
+    int config_reload_cache;
+
+    /** The hooks with functions left out for this server, see
+     * ap_hook_skip_for_server() */
+    apr_array_header_t *hook_links;
 } core_server_config;
 
+/** Default maximum number of htaccess files cached per child process */
+#ifndef AP_DEFAULT_ACCESS_CACHE_SIZE
+#define AP_DEFAULT_ACCESS_CACHE_SIZE 1000
+#endif
+
+/** Default seconds before a cached htaccess file is checked for changes */
+#ifndef AP_DEFAULT_ACCESS_CACHE_REVALIDATE
+#define AP_DEFAULT_ACCESS_CACHE_REVALIDATE 5
+#endif
+
 /* for AddOutputFiltersByType in core.c */
 void ap_add_output_filters_by_type(request_rec *r);
 
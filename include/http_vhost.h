@@ -86,6 +86,18 @@ AP_DECLARE(int) ap_vhost_iterate_given_conn(conn_rec *conn,
                                             ap_vhost_iterate_conn_cb func_cb,
                                             void* baton);
 
+/**
+ * Find the virtual host on this connection whose ServerName or one of
+ * whose ServerAlias matches the given name, the first one in configuration
+ * order like for the Host of a request.  Unlike for requests, the names
+ * from the VirtualHost lines are not considered.
+ * @param conn The current connection
+ * @param name The host name, e.g. from the TLS SNI extension
+ * @return The matching server, or NULL if none matches
+ */
+AP_DECLARE(server_rec *) ap_vhost_find_given_name(conn_rec *conn,
+                                                  const char *name);
+
 /**
  * given an ip address only, give our best guess as to what vhost it is
  * @param conn The current connection
@@ -491,6 +491,39 @@ AP_DECLARE(ap_filter_t *) ap_add_output_filter_handle(ap_filter_rec_t *f,
  */
 AP_DECLARE(ap_filter_rec_t *) ap_get_output_filter_handle(const char *name);
 
+/**
+ * A list of filters, as configured by name, resolved once so that it
+ * can be added to each request without looking the filters up again.
+ */
+typedef struct ap_filter_chain_t ap_filter_chain_t;
+
+/**
+ * Resolve a ';' separated list of filter names into a chain, for use
+ * with ap_add_filter_chain().  Filters not registered yet when the chain
+ * is made are looked up by name each time the chain is added.
+ * @param p The pool to allocate the chain from, which must not outlive
+ *          the filters' registration
+ * @param names The filter names
+ * @param direction Whether the names are of input or output filters
+ * @return The chain
+ */
+AP_DECLARE(ap_filter_chain_t *) ap_filter_chain_make(apr_pool_t *p,
+                                            const char *names,
+                                            ap_filter_direction_e direction);
+
+/**
+ * Add the filters of a chain, in order and without context, as
+ * ap_add_input_filter() or ap_add_output_filter() would for each of
+ * its names.  When all of them are known request filters, they are
+ * allocated at once from a copy of the chain's template.
+ * @param chain The chain, as returned by ap_filter_chain_make()
+ * @param r The request to add the filters for (or NULL if it isn't
+ *          associated with a request)
+ * @param c The connection to add the filters for
+ */
+AP_DECLARE(void) ap_add_filter_chain(const ap_filter_chain_t *chain,
+                                     request_rec *r, conn_rec *c);
+
 /**
  * Remove an input filter from either the request or connection stack
  * it is associated with.
@@ -23,6 +23,7 @@ h2_alt_svc.lo dnl
 h2_bucket_beam.lo dnl
 h2_bucket_eoc.lo dnl
 h2_bucket_eos.lo dnl
+h2_coalesce.lo dnl
 h2_config.lo dnl
 h2_conn.lo dnl
 h2_conn_io.lo dnl
@@ -157,6 +158,13 @@ dnl # nghttp2 >= 1.5.0: changing stream priorities
 dnl # nghttp2 >= 1.14.0: invalid header callback
       AC_CHECK_FUNCS([nghttp2_session_callbacks_set_on_invalid_header_callback], 
         [APR_ADDTO(MOD_CPPFLAGS, ["-DH2_NG2_INVALID_HEADER_CB"])], [])
+dnl # nghttp2 >= 1.17.0: header fields nghttp2 uses without copying
+      AC_CHECK_DECL([NGHTTP2_NV_FLAG_NO_COPY_NAME], 
+        [APR_ADDTO(MOD_CPPFLAGS, ["-DH2_NG2_NO_COPY"])], [],
+        [#include <nghttp2/nghttp2.h>])
+dnl # limit on the size of the HPACK table for sending
+      AC_CHECK_FUNCS([nghttp2_option_set_max_deflate_dynamic_table_size], 
+        [APR_ADDTO(MOD_CPPFLAGS, ["-DH2_NG2_DEFLATE_TABLE_SIZE"])], [])
     else
       AC_MSG_WARN([nghttp2 version is too old])
     fi
@@ -234,25 +234,63 @@ static void leave_yellow(h2_bucket_beam *beam, h2_beam_lock *pbl)
     }
 }
 
-static void report_consumption(h2_bucket_beam *beam, int force)
+static void mutex_leave(void *ctx, apr_thread_mutex_t *lock)
 {
-    if (force || beam->received_bytes != beam->reported_consumed_bytes) {
-        if (beam->consumed_fn) { 
-            beam->consumed_fn(beam->consumed_ctx, beam, beam->received_bytes
-                              - beam->reported_consumed_bytes);
-        }
+    apr_thread_mutex_unlock(lock);
+}
+
+static apr_status_t mutex_enter(void *ctx, h2_beam_lock *pbl)
+{
+    h2_bucket_beam *beam = ctx;
+    pbl->mutex = beam->lock;
+    pbl->leave = mutex_leave;
+    pbl->leave_ctx = beam;
+    return apr_thread_mutex_lock(pbl->mutex);
+}
+
+/* The io callbacks lock the h2_mplx or talk to the session. They are 
+ * invoked with the beam unlocked (if pbl is given, we are inside the
+ * yellow zone and leave it for the call), so that the beam's lock is
+ * never held while taking another one. */
+static void report_consumption(h2_bucket_beam *beam, h2_beam_lock *pbl,
+                               int force)
+{
+    apr_off_t len = beam->received_bytes - beam->reported_consumed_bytes;
+    h2_beam_io_callback *cb = beam->consumed_fn;
+    
+    if (force || len) {
         beam->reported_consumed_bytes = beam->received_bytes;
+        if (cb) {
+            void *ctx = beam->consumed_ctx;
+            if (pbl) {
+                leave_yellow(beam, pbl);
+            }
+            cb(ctx, beam, len);
+            if (pbl) {
+                enter_yellow(beam, pbl);
+            }
+        }
     }
 }
 
-static void report_production(h2_bucket_beam *beam, int force)
+static void report_production(h2_bucket_beam *beam, h2_beam_lock *pbl,
+                              int force)
 {
-    if (force || beam->sent_bytes != beam->reported_produced_bytes) {
-        if (beam->produced_fn) { 
-            beam->produced_fn(beam->produced_ctx, beam, beam->sent_bytes
-                              - beam->reported_produced_bytes);
-        }
+    apr_off_t len = beam->sent_bytes - beam->reported_produced_bytes;
+    h2_beam_io_callback *cb = beam->produced_fn;
+    
+    if (force || len) {
         beam->reported_produced_bytes = beam->sent_bytes;
+        if (cb) {
+            void *ctx = beam->produced_ctx;
+            if (pbl) {
+                leave_yellow(beam, pbl);
+            }
+            cb(ctx, beam, len);
+            if (pbl) {
+                enter_yellow(beam, pbl);
+            }
+        }
     }
 }
 
@@ -266,7 +304,7 @@ static apr_size_t calc_buffered(h2_bucket_beam *beam)
         if (b->length == ((apr_size_t)-1)) {
             /* do not count */
         }
-        else if (APR_BUCKET_IS_FILE(b)) {
+        else if (APR_BUCKET_IS_FILE(b) || APR_BUCKET_IS_MMAP(b)) {
             /* if unread, has no real mem footprint. how to test? */
         }
         else {
@@ -309,16 +347,25 @@ static apr_status_t wait_cond(h2_bucket_beam *beam, apr_thread_mutex_t *lock)
 static apr_status_t r_wait_space(h2_bucket_beam *beam, apr_read_type_e block,
                                  h2_beam_lock *pbl, apr_size_t *premain) 
 {
+    int nudged = 0;
+    
     *premain = calc_space_left(beam);
     while (!beam->aborted && *premain <= 0 
            && (block == APR_BLOCK_READ) && pbl->mutex) {
-        apr_status_t status;
-        report_production(beam, 1);
-        status = wait_cond(beam, pbl->mutex);
-        if (APR_STATUS_IS_TIMEUP(status)) {
-            return status;
+        if (!nudged) {
+            /* make sure the receiver knows there is something to take.
+             * That happens unlocked, so look at the space again before
+             * we wait. */
+            report_production(beam, pbl, 1);
+            nudged = 1;
+        }
+        else {
+            apr_status_t status = wait_cond(beam, pbl->mutex);
+            if (APR_STATUS_IS_TIMEUP(status)) {
+                return status;
+            }
+            nudged = 0;
         }
-        r_purge_sent(beam);
         *premain = calc_space_left(beam);
     }
     return beam->aborted? APR_ECONNABORTED : APR_SUCCESS;
@@ -444,7 +491,7 @@ static apr_status_t beam_send_cleanup(void *data)
     /* sender has gone away, clear up all references to its memory */
     r_purge_sent(beam);
     h2_blist_cleanup(&beam->send_list);
-    report_consumption(beam, 0);
+    report_consumption(beam, NULL, 0);
     while (!H2_BPROXY_LIST_EMPTY(&beam->proxies)) {
         h2_beam_proxy *proxy = H2_BPROXY_LIST_FIRST(&beam->proxies);
         H2_BPROXY_REMOVE(proxy);
@@ -544,10 +591,16 @@ apr_status_t h2_beam_create(h2_bucket_beam **pbeam, apr_pool_t *pool,
     H2_BLIST_INIT(&beam->purge_list);
     H2_BPROXY_LIST_INIT(&beam->proxies);
     beam->max_buf_size = max_buf_size;
-    apr_pool_pre_cleanup_register(pool, beam, beam_cleanup);
-
-    *pbeam = beam;
     
+    status = apr_thread_mutex_create(&beam->lock, APR_THREAD_MUTEX_NESTED,
+                                     pool);
+    if (status == APR_SUCCESS) {
+        status = apr_thread_cond_create(&beam->change, pool);
+    }
+    if (status == APR_SUCCESS) {
+        apr_pool_pre_cleanup_register(pool, beam, beam_cleanup);
+        *pbeam = beam;
+    }
     return status;
 }
 
@@ -573,17 +626,26 @@ apr_size_t h2_beam_buffer_size_get(h2_bucket_beam *beam)
     return buffer_size;
 }
 
-void h2_beam_mutex_set(h2_bucket_beam *beam, 
-                       h2_beam_mutex_enter m_enter,
-                       apr_thread_cond_t *cond,
-                       void *m_ctx)
+void h2_beam_mutex_enable(h2_bucket_beam *beam)
+{
+    h2_beam_lock bl;
+    
+    if (enter_yellow(beam, &bl) == APR_SUCCESS) {
+        beam->m_enter = mutex_enter;
+        beam->m_ctx   = beam;
+        beam->m_cond  = beam->change;
+        leave_yellow(beam, &bl);
+    }
+}
+
+void h2_beam_mutex_disable(h2_bucket_beam *beam)
 {
     h2_beam_lock bl;
     
     if (enter_yellow(beam, &bl) == APR_SUCCESS) {
-        beam->m_enter = m_enter;
-        beam->m_ctx   = m_ctx;
-        beam->m_cond  = cond;
+        beam->m_enter = NULL;
+        beam->m_ctx   = NULL;
+        beam->m_cond  = NULL;
         leave_yellow(beam, &bl);
     }
 }
@@ -619,7 +681,7 @@ void h2_beam_abort(h2_bucket_beam *beam)
             beam->aborted = 1;
             r_purge_sent(beam);
             h2_blist_cleanup(&beam->send_list);
-            report_consumption(beam, 0);
+            report_consumption(beam, &bl, 0);
         }
         if (beam->m_cond) {
             apr_thread_cond_broadcast(beam->m_cond);
@@ -635,7 +697,7 @@ apr_status_t h2_beam_close(h2_bucket_beam *beam)
     if (enter_yellow(beam, &bl) == APR_SUCCESS) {
         r_purge_sent(beam);
         beam_close(beam);
-        report_consumption(beam, 0);
+        report_consumption(beam, &bl, 0);
         leave_yellow(beam, &bl);
     }
     return beam->aborted? APR_ECONNABORTED : APR_SUCCESS;
@@ -675,50 +737,41 @@ static void move_to_hold(h2_bucket_beam *beam,
     }
 }
 
-static apr_status_t append_bucket(h2_bucket_beam *beam, 
-                                  apr_bucket *b,
-                                  apr_read_type_e block,
-                                  h2_beam_lock *pbl)
+/* Make a sender bucket safe to be read from the receiver thread and move
+ * it to the ready list. This is where data gets read, copied or set
+ * aside, so it is done outside the yellow zone. Only beam members that
+ * belong to the sender are touched here. Returns APR_EAGAIN when the
+ * bucket needs buffer space and there is none left.
+ */
+static apr_status_t r_prepare_bucket(h2_bucket_beam *beam, apr_bucket *b,
+                                     h2_blist *ready, apr_size_t *pspace)
 {
     const char *data;
     apr_size_t len;
-    apr_size_t space_left = 0;
+    apr_size_t space_left = *pspace;
     apr_status_t status;
     
     if (APR_BUCKET_IS_METADATA(b)) {
-        if (APR_BUCKET_IS_EOS(b)) {
-            beam->closed = 1;
-        }
         APR_BUCKET_REMOVE(b);
-        H2_BLIST_INSERT_TAIL(&beam->send_list, b);
+        H2_BLIST_INSERT_TAIL(ready, b);
         return APR_SUCCESS;
     }
-    else if (APR_BUCKET_IS_FILE(b)) {
-        /* file bucket lengths do not really count */
+    else if (APR_BUCKET_IS_FILE(b) || APR_BUCKET_IS_MMAP(b)) {
+        /* file and mmap bucket lengths do not really count */
     }
     else {
-        space_left = calc_space_left(beam);
         if (space_left > 0 && b->length == ((apr_size_t)-1)) {
-            const char *data;
             status = apr_bucket_read(b, &data, &len, APR_BLOCK_READ);
             if (status != APR_SUCCESS) {
                 return status;
             }
         }
-        
-        if (space_left < b->length) {
-            status = r_wait_space(beam, block, pbl, &space_left);
-            if (status != APR_SUCCESS) {
-                return status;
-            }
-            if (space_left <= 0) {
-                return APR_EAGAIN;
-            }
+        if (space_left <= 0 && b->length > 0) {
+            return APR_EAGAIN;
         }
         /* space available, maybe need bucket split */
     }
     
-
     /* The fundamental problem is that reading a red bucket from
      * a green thread is a total NO GO, because the bucket might use
      * its pool/bucket_alloc from a foreign thread and that will
@@ -736,6 +789,14 @@ static apr_status_t append_bucket(h2_bucket_beam *beam,
          * destroyed. */
         status = APR_SUCCESS;
     }
+    else if (APR_BUCKET_IS_MMAP(b)) {
+        /* Reading a mmap bucket does no allocation, the green side
+         * may read it directly and nothing gets copied. Setting it
+         * aside costs nothing when the mmap already lives as long as
+         * the sender pool, which is the usual case for files served
+         * by the request. */
+        status = apr_bucket_setaside(b, beam->send_pool);
+    }
     else if (APR_BUCKET_IS_POOL(b)) {
         /* pool buckets are bastards that register at pool cleanup
          * to morph themselves into heap buckets. That may happen anytime,
@@ -793,23 +854,52 @@ static apr_status_t append_bucket(h2_bucket_beam *beam,
     }
     
     APR_BUCKET_REMOVE(b);
-    H2_BLIST_INSERT_TAIL(&beam->send_list, b);
-    beam->sent_bytes += b->length;
-    
+    H2_BLIST_INSERT_TAIL(ready, b);
+    if (!APR_BUCKET_IS_FILE(b) && !APR_BUCKET_IS_MMAP(b)) {
+        *pspace = (*pspace > b->length)? (*pspace - b->length) : 0;
+    }
     return APR_SUCCESS;
 }
 
+static apr_status_t r_prepare(h2_bucket_beam *beam, 
+                              apr_bucket_brigade *red_brigade,
+                              h2_blist *ready, apr_size_t space_left, 
+                              apr_off_t *plen, int *pclosed)
+{
+    apr_status_t status = APR_SUCCESS;
+    apr_bucket *b;
+    
+    while (!APR_BRIGADE_EMPTY(red_brigade) && status == APR_SUCCESS) {
+        b = APR_BRIGADE_FIRST(red_brigade);
+        status = r_prepare_bucket(beam, b, ready, &space_left);
+        if (status == APR_SUCCESS) {
+            if (APR_BUCKET_IS_EOS(b)) {
+                *pclosed = 1;
+            }
+            else if (!APR_BUCKET_IS_METADATA(b)) {
+                *plen += b->length;
+            }
+        }
+    }
+    return status;
+}
+
 apr_status_t h2_beam_send(h2_bucket_beam *beam, 
                           apr_bucket_brigade *red_brigade, 
                           apr_read_type_e block)
 {
-    apr_bucket *b;
     apr_status_t status = APR_SUCCESS;
+    apr_size_t space_left;
+    apr_off_t len;
+    h2_blist ready, purge;
     h2_beam_lock bl;
+    int closed;
 
+    H2_BLIST_INIT(&ready);
+    H2_BLIST_INIT(&purge);
     /* Called from the red thread to add buckets to the beam */
     if (enter_yellow(beam, &bl) == APR_SUCCESS) {
-        r_purge_sent(beam);
+        H2_BLIST_CONCAT(&purge, &beam->purge_list);
         if (red_brigade) {
             beam_set_send_pool(beam, red_brigade->p);
         }
@@ -820,19 +910,46 @@ apr_status_t h2_beam_send(h2_bucket_beam *beam,
         }
         else if (red_brigade) {
             int force_report = !APR_BRIGADE_EMPTY(red_brigade); 
+            
+            space_left = calc_space_left(beam);
             while (!APR_BRIGADE_EMPTY(red_brigade)
                    && status == APR_SUCCESS) {
-                b = APR_BRIGADE_FIRST(red_brigade);
-                status = append_bucket(beam, b, block, &bl);
-            }
-            report_production(beam, force_report);
-            if (beam->m_cond) {
-                apr_thread_cond_broadcast(beam->m_cond);
+                /* Prepare what fits with the beam unlocked, the green
+                 * side only ever waits for the lists to be joined. */
+                leave_yellow(beam, &bl);
+                h2_blist_cleanup(&purge);
+                len = 0;
+                closed = 0;
+                status = r_prepare(beam, red_brigade, &ready, space_left,
+                                   &len, &closed);
+                enter_yellow(beam, &bl);
+                
+                H2_BLIST_CONCAT(&beam->send_list, &ready);
+                beam->sent_bytes += len;
+                if (closed) {
+                    beam->closed = 1;
+                }
+                if (beam->m_cond) {
+                    apr_thread_cond_broadcast(beam->m_cond);
+                }
+                
+                if (beam->aborted) {
+                    status = APR_ECONNABORTED;
+                }
+                else if (status == APR_EAGAIN) {
+                    status = r_wait_space(beam, block, &bl, &space_left);
+                    if (status == APR_SUCCESS && space_left <= 0) {
+                        status = APR_EAGAIN;
+                    }
+                }
+                H2_BLIST_CONCAT(&purge, &beam->purge_list);
             }
+            report_production(beam, &bl, force_report);
         }
-        report_consumption(beam, 0);
+        report_consumption(beam, &bl, 0);
         leave_yellow(beam, &bl);
     }
+    h2_blist_cleanup(&purge);
     return status;
 }
 
@@ -1080,7 +1197,7 @@ apr_off_t h2_beam_get_mem_used(h2_bucket_beam *beam)
         for (b = H2_BLIST_FIRST(&beam->send_list); 
             b != H2_BLIST_SENTINEL(&beam->send_list);
             b = APR_BUCKET_NEXT(b)) {
-            if (APR_BUCKET_IS_FILE(b)) {
+            if (APR_BUCKET_IS_FILE(b) || APR_BUCKET_IS_MMAP(b)) {
                 /* do not count */
             }
             else {
@@ -77,13 +77,15 @@ apr_size_t h2_util_bl_print(char *buffer, apr_size_t bmax,
  * via the h2_beam_send(). It gives the beam to the green thread which then
  * can receive buckets into its own brigade via h2_beam_receive().
  *
- * Sending and receiving can happen concurrently, if a thread mutex is set
- * for the beam, see h2_beam_mutex_set.
+ * Sending and receiving can happen concurrently, once the beam's own
+ * mutex is enabled, see h2_beam_mutex_enable. The mutex only guards the
+ * lists of the beam and is never held while buckets are read or set aside
+ * or while callbacks run, so the sender and receiver of one stream do not
+ * contend with those of others or with the h2_mplx.
  *
  * The beam can limit the amount of data it accepts via the buffer_size. This
- * can also be adjusted during its lifetime. When the beam not only gets a 
- * mutex but als a condition variable (in h2_beam_mutex_set()), sends and
- * receives can be done blocking. A timeout can be set for such blocks.
+ * can also be adjusted during its lifetime. With the mutex enabled, sends
+ * and receives can be done blocking. A timeout can be set for such blocks.
  *
  * Care needs to be taken when terminating the beam. The beam registers at
  * the pool it was created with and will cleanup after itself. However, if
@@ -103,6 +105,7 @@ apr_size_t h2_util_bl_print(char *buffer, apr_size_t bmax,
  *   - heap and pool buckets require no extra handling
  *   - buckets with indeterminate length are read on send
  *   - file buckets will transfer the file itself into a new bucket, if allowed
+ *   - mmap buckets are passed as they are, their data is never copied
  *   - all other buckets are read on send to make sure data is present
  *
  * This assures that when the red thread sends its red buckets, the data
@@ -201,6 +204,8 @@ struct h2_bucket_beam {
     unsigned int closed : 1;
     unsigned int close_sent : 1;
 
+    struct apr_thread_mutex_t *lock;
+    struct apr_thread_cond_t *change;
     void *m_ctx;
     h2_beam_mutex_enter *m_enter;
     struct apr_thread_cond_t *m_cond;
@@ -304,10 +309,16 @@ apr_status_t h2_beam_close(h2_bucket_beam *beam);
  */
 apr_status_t h2_beam_wait_empty(h2_bucket_beam *beam, apr_read_type_e block);
 
-void h2_beam_mutex_set(h2_bucket_beam *beam, 
-                       h2_beam_mutex_enter m_enter,
-                       struct apr_thread_cond_t *cond,
-                       void *m_ctx);
+/**
+ * Protect the beam against concurrent use by its sender and receiver
+ * thread. Until then, the beam does no locking at all.
+ */
+void h2_beam_mutex_enable(h2_bucket_beam *beam);
+
+/**
+ * Stop locking, when only one thread still uses the beam.
+ */
+void h2_beam_mutex_disable(h2_bucket_beam *beam);
 
 /** 
  * Set/get the timeout for blocking read/write operations. Only works
@@ -0,0 +1,446 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+
+#include <apr_hash.h>
+#include <apr_strings.h>
+#include <apr_thread_mutex.h>
+#include <apr_thread_cond.h>
+
+#include <httpd.h>
+#include <http_core.h>
+#include <http_config.h>
+#include <http_log.h>
+#include <http_protocol.h>
+#include <http_request.h>
+#include <util_filter.h>
+
+#include "h2_private.h"
+#include "h2.h"
+#include "h2_config.h"
+#include "h2_coalesce.h"
+
+typedef enum {
+    H2_CO_RUNNING,                 /* leader is processing the request */
+    H2_CO_DONE,                    /* response recorded completely */
+    H2_CO_FAILED,                  /* no response to share */
+} h2_co_state;
+
+typedef struct {
+    const char *data;
+    apr_size_t len;
+} h2_co_chunk;
+
+typedef struct h2_co_entry {
+    const char *key;
+    apr_pool_t *pool;              /* own allocator, used by leader only */
+    apr_thread_cond_t *done;       /* signalled when state leaves RUNNING */
+    h2_co_state state;
+    int refs;                      /* leader + waiting followers */
+
+    int status;
+    const char *content_type;
+    apr_table_t *headers;
+    apr_array_header_t *chunks;    /* h2_co_chunk of the response body */
+    apr_off_t len;
+    apr_off_t max_len;
+} h2_co_entry;
+
+/* Requests in flight, per child. The lock also protects the creation
+ * and destruction of entry pools below co_pool. */
+static apr_pool_t *co_pool;
+static apr_thread_mutex_t *co_lock;
+static apr_hash_t *co_inflight;
+static ap_filter_rec_t *co_filter_handle;
+
+/* Request headers that go into the key. A response varying on anything
+ * else is not shared. */
+static const char *const vary_headers[] = {
+    "Accept",
+    "Accept-Encoding",
+    "Accept-Language",
+    NULL
+};
+
+/* Requests carrying any of these are processed on their own, they are
+ * either personalized or ask for a response of their own. */
+static const char *const private_headers[] = {
+    "Authorization",
+    "Cookie",
+    "Range",
+    "If-Match",
+    "If-None-Match",
+    "If-Modified-Since",
+    "If-Unmodified-Since",
+    "If-Range",
+    NULL
+};
+
+apr_status_t h2_coalesce_child_init(apr_pool_t *pool, server_rec *s)
+{
+    apr_status_t status;
+
+    (void)s;
+    status = apr_pool_create(&co_pool, pool);
+    if (status == APR_SUCCESS) {
+        apr_pool_tag(co_pool, "h2_coalesce");
+        status = apr_thread_mutex_create(&co_lock, APR_THREAD_MUTEX_DEFAULT,
+                                         co_pool);
+    }
+    if (status == APR_SUCCESS) {
+        co_inflight = apr_hash_make(co_pool);
+    }
+    return status;
+}
+
+/*******************************************************************************
+ * in-flight entries, all called with co_lock held
+ ******************************************************************************/
+
+static h2_co_entry *entry_create(const char *key, apr_off_t max_len)
+{
+    apr_allocator_t *allocator;
+    apr_pool_t *pool;
+    h2_co_entry *entry;
+
+    if (apr_allocator_create(&allocator) != APR_SUCCESS) {
+        return NULL;
+    }
+    if (apr_pool_create_ex(&pool, co_pool, NULL, allocator) != APR_SUCCESS) {
+        apr_allocator_destroy(allocator);
+        return NULL;
+    }
+    apr_pool_tag(pool, "h2_coalesce_entry");
+    apr_allocator_owner_set(allocator, pool);
+
+    entry = apr_pcalloc(pool, sizeof(*entry));
+    entry->pool = pool;
+    entry->key = apr_pstrdup(pool, key);
+    entry->state = H2_CO_RUNNING;
+    entry->refs = 1;
+    entry->chunks = apr_array_make(pool, 16, sizeof(h2_co_chunk));
+    entry->max_len = max_len;
+    if (apr_thread_cond_create(&entry->done, pool) != APR_SUCCESS) {
+        apr_pool_destroy(pool);
+        return NULL;
+    }
+    apr_hash_set(co_inflight, entry->key, APR_HASH_KEY_STRING, entry);
+    return entry;
+}
+
+static void entry_finish(h2_co_entry *entry, h2_co_state state)
+{
+    if (entry->state == H2_CO_RUNNING) {
+        entry->state = state;
+        apr_hash_set(co_inflight, entry->key, APR_HASH_KEY_STRING, NULL);
+        apr_thread_cond_broadcast(entry->done);
+    }
+}
+
+static void entry_release(h2_co_entry *entry)
+{
+    if (--entry->refs == 0) {
+        apr_thread_cond_destroy(entry->done);
+        apr_pool_destroy(entry->pool);
+    }
+}
+
+/*******************************************************************************
+ * the leader: record the response
+ ******************************************************************************/
+
+static apr_status_t leader_cleanup(void *data)
+{
+    h2_co_entry *entry = data;
+
+    apr_thread_mutex_lock(co_lock);
+    entry_finish(entry, H2_CO_FAILED);
+    entry_release(entry);
+    apr_thread_mutex_unlock(co_lock);
+    return APR_SUCCESS;
+}
+
+static int copy_header(void *ctx, const char *key, const char *value)
+{
+    apr_table_add(ctx, key, value);
+    return 1;
+}
+
+static int is_keyed_vary(apr_pool_t *p, const char *vary)
+{
+    char *tok, *last;
+    int i;
+
+    for (tok = apr_strtok(apr_pstrdup(p, vary), ", \t", &last); tok;
+         tok = apr_strtok(NULL, ", \t", &last)) {
+        for (i = 0; vary_headers[i]; ++i) {
+            if (!strcasecmp(tok, vary_headers[i])) {
+                break;
+            }
+        }
+        if (!vary_headers[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int is_shareable(request_rec *r)
+{
+    const char *s;
+
+    if (r->status != HTTP_OK
+        || apr_table_get(r->headers_out, "Set-Cookie")
+        || apr_table_get(r->err_headers_out, "Set-Cookie")) {
+        return 0;
+    }
+    s = apr_table_get(r->headers_out, "Cache-Control");
+    if (s && (ap_find_token(r->pool, s, "private")
+              || ap_find_token(r->pool, s, "no-store"))) {
+        return 0;
+    }
+    s = apr_table_get(r->headers_out, "Vary");
+    return !s || is_keyed_vary(r->pool, s);
+}
+
+static apr_status_t stop_recording(ap_filter_t *f, apr_bucket_brigade *bb,
+                                   const char *reason)
+{
+    h2_co_entry *entry = f->ctx;
+
+    ap_log_rerror(APLOG_MARK, APLOG_TRACE1, 0, f->r,
+                  "h2_coalesce: not sharing response, %s", reason);
+    apr_thread_mutex_lock(co_lock);
+    entry_finish(entry, H2_CO_FAILED);
+    apr_thread_mutex_unlock(co_lock);
+
+    ap_remove_output_filter(f);
+    return ap_pass_brigade(f->next, bb);
+}
+
+/* Records the output of the leader's handler. On a follower, it only
+ * marks the spot where the recorded response is passed on. */
+static apr_status_t h2_coalesce_filter(ap_filter_t *f, apr_bucket_brigade *bb)
+{
+    h2_co_entry *entry = f->ctx;
+    request_rec *r = f->r;
+    apr_bucket *b;
+    h2_co_chunk *chunk;
+    const char *data;
+    apr_size_t len;
+
+    if (!entry) {
+        ap_remove_output_filter(f);
+        return ap_pass_brigade(f->next, bb);
+    }
+
+    if (!entry->headers) {
+        if (!is_shareable(r)) {
+            return stop_recording(f, bb, "response is not shareable");
+        }
+        entry->status = r->status;
+        entry->content_type = r->content_type?
+            apr_pstrdup(entry->pool, r->content_type) : NULL;
+        entry->headers = apr_table_make(entry->pool, 10);
+        apr_table_do(copy_header, entry->headers, r->headers_out, NULL);
+    }
+
+    for (b = APR_BRIGADE_FIRST(bb);
+         b != APR_BRIGADE_SENTINEL(bb);
+         b = APR_BUCKET_NEXT(b)) {
+        if (APR_BUCKET_IS_EOS(b)) {
+            ap_log_rerror(APLOG_MARK, APLOG_TRACE1, 0, r,
+                          "h2_coalesce: recorded %ld bytes response",
+                          (long)entry->len);
+            apr_thread_mutex_lock(co_lock);
+            entry_finish(entry, H2_CO_DONE);
+            apr_thread_mutex_unlock(co_lock);
+            ap_remove_output_filter(f);
+            break;
+        }
+        if (APR_BUCKET_IS_METADATA(b)) {
+            continue;
+        }
+        /* do not read large files in just to learn they are too large */
+        if (b->length != (apr_size_t)-1
+            && entry->len + (apr_off_t)b->length > entry->max_len) {
+            return stop_recording(f, bb, "response too large");
+        }
+        if (apr_bucket_read(b, &data, &len, APR_BLOCK_READ) != APR_SUCCESS) {
+            return stop_recording(f, bb, "error reading response");
+        }
+        if (entry->len + (apr_off_t)len > entry->max_len) {
+            return stop_recording(f, bb, "response too large");
+        }
+        if (len) {
+            chunk = apr_array_push(entry->chunks);
+            chunk->data = apr_pmemdup(entry->pool, data, len);
+            chunk->len = len;
+            entry->len += len;
+        }
+    }
+    return ap_pass_brigade(f->next, bb);
+}
+
+/*******************************************************************************
+ * followers: wait and replay
+ ******************************************************************************/
+
+static int replay(request_rec *r, h2_co_entry *entry)
+{
+    apr_bucket_brigade *bb;
+    apr_bucket_alloc_t *ba = r->connection->bucket_alloc;
+    ap_filter_t *f;
+    h2_co_chunk *chunk;
+    apr_status_t status;
+    int i;
+
+    r->status = entry->status;
+    if (entry->content_type) {
+        ap_set_content_type(r, apr_pstrdup(r->pool, entry->content_type));
+    }
+    /* the recorded headers include what was set before the handler ran,
+     * which is the same for this request */
+    r->headers_out = apr_table_make(r->pool, apr_table_elts(entry->headers)->nelts);
+    apr_table_do(copy_header, r->headers_out, entry->headers, NULL);
+
+    /* transient, so that anyone keeping the data makes a copy of it
+     * before we let go of the entry */
+    bb = apr_brigade_create(r->pool, ba);
+    for (i = 0; i < entry->chunks->nelts; ++i) {
+        chunk = &APR_ARRAY_IDX(entry->chunks, i, h2_co_chunk);
+        APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_transient_create(chunk->data,
+                                                                chunk->len, ba));
+    }
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_eos_create(ba));
+
+    /* pass it on where it was recorded, resource filters already
+     * had their go at it */
+    f = ap_add_output_filter_handle(co_filter_handle, NULL, r, r->connection);
+    status = ap_pass_brigade(f, bb);
+    apr_brigade_cleanup(bb);
+    return (status == APR_SUCCESS)? OK : AP_FILTER_ERROR;
+}
+
+static const char *make_key(request_rec *r)
+{
+    const char *key, *val;
+    int i;
+
+    key = apr_psprintf(r->pool, "%s %s://%s:%u%s", r->method,
+                       ap_http_scheme(r), r->hostname? r->hostname : "",
+                       ap_get_server_port(r), r->unparsed_uri);
+    for (i = 0; vary_headers[i]; ++i) {
+        val = apr_table_get(r->headers_in, vary_headers[i]);
+        key = apr_pstrcat(r->pool, key, "\n", val? val : "", NULL);
+    }
+    return key;
+}
+
+static int is_coalescable(request_rec *r)
+{
+    const h2_config *conf;
+    int i;
+
+    if (!co_inflight || !r->connection->master
+        || r->main || r->prev
+        || r->method_number != M_GET || r->header_only
+        || ap_request_has_body(r)
+        || (r->handler && !strcmp("http2-status", r->handler))) {
+        return 0;
+    }
+    conf = h2_config_rget(r);
+    if (!h2_config_geti(conf, H2_CONF_COALESCE)) {
+        return 0;
+    }
+    for (i = 0; private_headers[i]; ++i) {
+        if (apr_table_get(r->headers_in, private_headers[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int h2_coalesce_handler(request_rec *r)
+{
+    h2_co_entry *entry;
+    h2_co_state state;
+    const char *key;
+    apr_time_t now, until;
+    int rv = DECLINED;
+
+    if (!is_coalescable(r)) {
+        return DECLINED;
+    }
+
+    key = make_key(r);
+    apr_thread_mutex_lock(co_lock);
+    entry = apr_hash_get(co_inflight, key, APR_HASH_KEY_STRING);
+    if (!entry) {
+        entry = entry_create(key, h2_config_geti64(h2_config_rget(r),
+                                                   H2_CONF_COALESCE_MAX_SIZE));
+        apr_thread_mutex_unlock(co_lock);
+        if (entry) {
+            apr_pool_cleanup_register(r->pool, entry, leader_cleanup,
+                                      apr_pool_cleanup_null);
+            ap_add_output_filter_handle(co_filter_handle, entry,
+                                        r, r->connection);
+        }
+        return DECLINED;
+    }
+
+    ++entry->refs;
+    ap_log_rerror(APLOG_MARK, APLOG_TRACE1, 0, r,
+                  "h2_coalesce: waiting for in-flight request");
+    until = apr_time_now() + r->server->timeout;
+    while (entry->state == H2_CO_RUNNING) {
+        now = apr_time_now();
+        if (now >= until) {
+            break;
+        }
+        apr_thread_cond_timedwait(entry->done, co_lock, until - now);
+    }
+    state = entry->state;
+    apr_thread_mutex_unlock(co_lock);
+
+    if (state == H2_CO_DONE) {
+        ap_log_rerror(APLOG_MARK, APLOG_TRACE1, 0, r,
+                      "h2_coalesce: sending response of in-flight request");
+        rv = replay(r, entry);
+    }
+    else if (state == H2_CO_RUNNING) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(03491)
+                      "h2_coalesce: timeout waiting for in-flight request, "
+                      "processing it on its own");
+    }
+
+    apr_thread_mutex_lock(co_lock);
+    entry_release(entry);
+    apr_thread_mutex_unlock(co_lock);
+    return rv;
+}
+
+void h2_coalesce_register_hooks(void)
+{
+    /* Before any other handler, but after access checks and fixups. */
+    ap_hook_handler(h2_coalesce_handler, NULL, NULL, APR_HOOK_REALLY_FIRST);
+
+    /* Where mod_cache saves responses, after resource filters. */
+    co_filter_handle = ap_register_output_filter("H2_COALESCE",
+                                                 h2_coalesce_filter, NULL,
+                                                 AP_FTYPE_CONTENT_SET - 1);
+}
@@ -0,0 +1,43 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __mod_h2__h2_coalesce__
+#define __mod_h2__h2_coalesce__
+
+/**
+ * Coalescing of identical GET requests on HTTP/2 streams, across all
+ * connections of a child process.
+ *
+ * The first eligible request for a resource becomes the leader and is
+ * processed as usual, while the output of its handler gets recorded.
+ * Identical requests arriving while the leader is in flight wait for it
+ * and, if the response turned out shareable, send the recorded response
+ * instead of running the handler themselves. Otherwise, or if the leader
+ * takes longer than the server's timeout, they are processed on their own.
+ *
+ * Requests are identical when method, scheme, host, port and URI match
+ * and they agree on the request headers responses are allowed to vary on
+ * (Accept, Accept-Encoding and Accept-Language).
+ */
+
+/*
+ * One time, child process initialization.
+ */
+apr_status_t h2_coalesce_child_init(apr_pool_t *pool, server_rec *s);
+
+void h2_coalesce_register_hooks(void);
+
+#endif /* defined(__mod_h2__h2_coalesce__) */
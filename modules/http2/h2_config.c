@@ -62,11 +62,33 @@ static h2_config defconf = {
     NULL,                   /* map of content-type to priorities */
     256,                    /* push diary size */
     0,                      /* copy files across threads */
+    0,                      /* run tasks on MPM worker threads */
+    4096,                   /* HPACK table size, as in RFC 7541 */
+    NULL,                   /* header names never indexed */
+    0,                      /* coalesce identical requests */
+    1024*1024,              /* max size of coalesced response */
+    0,                      /* send 103 Early Hints */
+    NULL,                   /* resources to push */
+    1,                      /* weighted fair stream scheduling */
+};
+
+/* Headers that change with nearly every response only evict useful
+ * entries from the HPACK dynamic table. */
+static const char *const default_no_index[] = {
+    "date",
+    NULL
 };
 
 void h2_config_init(apr_pool_t *pool)
 {
-    (void)pool;
+    const char *const *name;
+    
+    if (!defconf.hpack_no_index) {
+        defconf.hpack_no_index = apr_array_make(pool, 5, sizeof(const char*));
+        for (name = default_no_index; *name; ++name) {
+            APR_ARRAY_PUSH(defconf.hpack_no_index, const char*) = *name;
+        }
+    }
 }
 
 static void *h2_config_create(apr_pool_t *pool,
@@ -96,6 +118,14 @@ static void *h2_config_create(apr_pool_t *pool,
     conf->priorities           = NULL;
     conf->push_diary_size      = DEF_VAL;
     conf->copy_files           = DEF_VAL;
+    conf->mpm_workers          = DEF_VAL;
+    conf->hpack_table_size     = DEF_VAL;
+    conf->hpack_no_index       = NULL;
+    conf->coalesce             = DEF_VAL;
+    conf->coalesce_max_size    = DEF_VAL;
+    conf->early_hints          = DEF_VAL;
+    conf->push_list            = NULL;
+    conf->weighted_sched       = DEF_VAL;
     
     return conf;
 }
@@ -143,6 +173,19 @@ void *h2_config_merge(apr_pool_t *pool, void *basev, void *addv)
     }
     n->push_diary_size      = H2_CONFIG_GET(add, base, push_diary_size);
     n->copy_files           = H2_CONFIG_GET(add, base, copy_files);
+    n->mpm_workers          = H2_CONFIG_GET(add, base, mpm_workers);
+    n->hpack_table_size     = H2_CONFIG_GET(add, base, hpack_table_size);
+    n->hpack_no_index       = add->hpack_no_index? add->hpack_no_index : base->hpack_no_index;
+    n->coalesce             = H2_CONFIG_GET(add, base, coalesce);
+    n->coalesce_max_size    = H2_CONFIG_GET(add, base, coalesce_max_size);
+    n->early_hints          = H2_CONFIG_GET(add, base, early_hints);
+    if (add->push_list && base->push_list) {
+        n->push_list        = apr_array_append(pool, base->push_list, add->push_list);
+    }
+    else {
+        n->push_list        = add->push_list? add->push_list : base->push_list;
+    }
+    n->weighted_sched       = H2_CONFIG_GET(add, base, weighted_sched);
     
     return n;
 }
@@ -189,6 +232,18 @@ apr_int64_t h2_config_geti64(const h2_config *conf, h2_config_var_t var)
             return H2_CONFIG_GET(conf, &defconf, push_diary_size);
         case H2_CONF_COPY_FILES:
             return H2_CONFIG_GET(conf, &defconf, copy_files);
+        case H2_CONF_MPM_WORKERS:
+            return H2_CONFIG_GET(conf, &defconf, mpm_workers);
+        case H2_CONF_HPACK_TABLE_SIZE:
+            return H2_CONFIG_GET(conf, &defconf, hpack_table_size);
+        case H2_CONF_COALESCE:
+            return H2_CONFIG_GET(conf, &defconf, coalesce);
+        case H2_CONF_COALESCE_MAX_SIZE:
+            return H2_CONFIG_GET(conf, &defconf, coalesce_max_size);
+        case H2_CONF_EARLY_HINTS:
+            return H2_CONFIG_GET(conf, &defconf, early_hints);
+        case H2_CONF_WEIGHTED_SCHED:
+            return H2_CONFIG_GET(conf, &defconf, weighted_sched);
         default:
             return DEF_VAL;
     }
@@ -202,6 +257,11 @@ const h2_config *h2_config_sget(server_rec *s)
     return cfg;
 }
 
+const apr_array_header_t *h2_config_get_hpack_no_index(const h2_config *conf)
+{
+    return conf->hpack_no_index? conf->hpack_no_index : defconf.hpack_no_index;
+}
+
 const struct h2_priority *h2_config_get_priority(const h2_config *conf, 
                                                  const char *content_type)
 {
@@ -361,6 +421,23 @@ static const char *h2_conf_set_direct(cmd_parms *parms,
     return "value must be On or Off";
 }
 
+static const char *h2_conf_set_mpm_workers(cmd_parms *parms,
+                                           void *arg, const char *value)
+{
+    h2_config *cfg = (h2_config *)h2_config_sget(parms->server);
+    if (!strcasecmp(value, "On")) {
+        cfg->mpm_workers = 1;
+        return NULL;
+    }
+    else if (!strcasecmp(value, "Off")) {
+        cfg->mpm_workers = 0;
+        return NULL;
+    }
+    
+    (void)arg;
+    return "value must be On or Off";
+}
+
 static const char *h2_conf_set_push(cmd_parms *parms,
                                     void *arg, const char *value)
 {
@@ -521,6 +598,137 @@ static const char *h2_conf_set_copy_files(cmd_parms *parms,
     return "value must be On or Off";
 }
 
+static const char *h2_conf_set_hpack_table_size(cmd_parms *parms,
+                                                void *arg, const char *value)
+{
+    h2_config *cfg = (h2_config *)h2_config_sget(parms->server);
+    (void)arg;
+    cfg->hpack_table_size = (int)apr_atoi64(value);
+    if (cfg->hpack_table_size < 0) {
+        return "value must be >= 0";
+    }
+    return NULL;
+}
+
+static const char *h2_conf_add_hpack_no_index(cmd_parms *parms,
+                                              void *arg, const char *value)
+{
+    h2_config *cfg = (h2_config *)h2_config_sget(parms->server);
+    char *name;
+    (void)arg;
+    
+    if (!cfg->hpack_no_index) {
+        cfg->hpack_no_index = apr_array_make(parms->pool, 5, sizeof(const char*));
+    }
+    if (!strcasecmp(value, "none")) {
+        if (cfg->hpack_no_index->nelts) {
+            return "'none' can not be combined with header names";
+        }
+        return NULL;
+    }
+    name = apr_pstrdup(parms->pool, value);
+    ap_str_tolower(name);
+    APR_ARRAY_PUSH(cfg->hpack_no_index, const char*) = name;
+    return NULL;
+}
+
+static const char *h2_conf_set_coalesce(cmd_parms *parms,
+                                        void *arg, const char *value)
+{
+    h2_config *cfg = (h2_config *)arg;
+    if (!strcasecmp(value, "On")) {
+        cfg->coalesce = 1;
+        return NULL;
+    }
+    else if (!strcasecmp(value, "Off")) {
+        cfg->coalesce = 0;
+        return NULL;
+    }
+    
+    (void)parms;
+    return "value must be On or Off";
+}
+
+static const char *h2_conf_set_coalesce_max_size(cmd_parms *parms,
+                                                 void *arg, const char *value)
+{
+    h2_config *cfg = (h2_config *)arg;
+    (void)parms;
+    cfg->coalesce_max_size = apr_atoi64(value);
+    if (cfg->coalesce_max_size < 0) {
+        return "value must be >= 0";
+    }
+    return NULL;
+}
+
+static const char *h2_conf_set_early_hints(cmd_parms *parms,
+                                           void *arg, const char *value)
+{
+    h2_config *cfg = (h2_config *)h2_config_sget(parms->server);
+    if (!strcasecmp(value, "On")) {
+        cfg->early_hints = 1;
+        return NULL;
+    }
+    else if (!strcasecmp(value, "Off")) {
+        cfg->early_hints = 0;
+        return NULL;
+    }
+    
+    (void)arg;
+    return "value must be On or Off";
+}
+
+static const char *h2_conf_set_weighted_sched(cmd_parms *parms,
+                                              void *arg, const char *value)
+{
+    h2_config *cfg = (h2_config *)h2_config_sget(parms->server);
+    if (!strcasecmp(value, "On")) {
+        cfg->weighted_sched = 1;
+        return NULL;
+    }
+    else if (!strcasecmp(value, "Off")) {
+        cfg->weighted_sched = 0;
+        return NULL;
+    }
+    
+    (void)arg;
+    return "value must be On or Off";
+}
+
+static const char *h2_conf_add_push_res(cmd_parms *cmd, void *dirconf,
+                                        const char *arg1, const char *arg2,
+                                        const char *arg3)
+{
+    h2_config *cfg = (h2_config *)dirconf;
+    const char *last = arg3;
+    h2_push_res *push;
+    
+    /* H2PushResource [add] uri-ref [critical] */
+    if (!strcasecmp("add", arg1)) {
+        arg1 = arg2;
+    }
+    else {
+        last = arg2;
+        if (arg3) {
+            return "too many parameters";
+        }
+    }
+    if (!arg1 || !*arg1) {
+        return "a resource to push must be given";
+    }
+    if (last && strcasecmp("critical", last)) {
+        return "unknown last parameter, only 'critical' is allowed";
+    }
+    
+    if (!cfg->push_list) {
+        cfg->push_list = apr_array_make(cmd->pool, 10, sizeof(h2_push_res));
+    }
+    push = apr_array_push(cfg->push_list);
+    push->uri_ref = arg1;
+    push->critical = (last != NULL);
+    return NULL;
+}
+
 #define AP_END_CMD     AP_INIT_TAKE1(NULL, NULL, NULL, RSRC_CONF, NULL)
 
 const command_rec h2_cmds[] = {
@@ -534,6 +742,8 @@ const command_rec h2_cmds[] = {
                   RSRC_CONF, "maximum number of worker threads per child"),
     AP_INIT_TAKE1("H2MaxWorkerIdleSeconds", h2_conf_set_max_worker_idle_secs, NULL,
                   RSRC_CONF, "maximum number of idle seconds before a worker shuts down"),
+    AP_INIT_TAKE1("H2MpmWorkers", h2_conf_set_mpm_workers, NULL,
+                  RSRC_CONF, "on to run requests on the MPM worker threads"),
     AP_INIT_TAKE1("H2StreamMaxMemSize", h2_conf_set_stream_max_mem_size, NULL,
                   RSRC_CONF, "maximum number of bytes buffered in memory for a stream"),
     AP_INIT_TAKE1("H2AltSvc", h2_add_alt_svc, NULL,
@@ -562,6 +772,20 @@ const command_rec h2_cmds[] = {
                   RSRC_CONF, "size of push diary"),
     AP_INIT_TAKE1("H2CopyFiles", h2_conf_set_copy_files, NULL,
                   OR_ALL, "on to perform copy of file data"),
+    AP_INIT_TAKE1("H2HpackTableSize", h2_conf_set_hpack_table_size, NULL,
+                  RSRC_CONF, "maximum size of the HPACK table for response headers"),
+    AP_INIT_ITERATE("H2HpackNoIndex", h2_conf_add_hpack_no_index, NULL,
+                  RSRC_CONF, "response header names never to be indexed by HPACK"),
+    AP_INIT_TAKE1("H2Coalesce", h2_conf_set_coalesce, NULL,
+                  RSRC_CONF|ACCESS_CONF, "on to share responses among identical requests in flight"),
+    AP_INIT_TAKE1("H2CoalesceMaxSize", h2_conf_set_coalesce_max_size, NULL,
+                  RSRC_CONF|ACCESS_CONF, "maximum size of a response shared among requests"),
+    AP_INIT_TAKE1("H2EarlyHints", h2_conf_set_early_hints, NULL,
+                  RSRC_CONF, "on to enable interim status 103 responses"),
+    AP_INIT_TAKE123("H2PushResource", h2_conf_add_push_res, NULL,
+                  OR_FILEINFO, "add a resource to be pushed in this location/on this server."),
+    AP_INIT_TAKE1("H2WeightedScheduling", h2_conf_set_weighted_sched, NULL,
+                  RSRC_CONF, "off to start streams in strict priority order"),
     AP_END_CMD
 };
 
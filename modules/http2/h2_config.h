@@ -41,11 +41,22 @@ typedef enum {
     H2_CONF_PUSH,
     H2_CONF_PUSH_DIARY_SIZE,
     H2_CONF_COPY_FILES,
+    H2_CONF_MPM_WORKERS,
+    H2_CONF_HPACK_TABLE_SIZE,
+    H2_CONF_COALESCE,
+    H2_CONF_COALESCE_MAX_SIZE,
+    H2_CONF_EARLY_HINTS,
+    H2_CONF_WEIGHTED_SCHED,
 } h2_config_var_t;
 
 struct apr_hash_t;
 struct h2_priority;
 
+typedef struct h2_push_res {
+    const char *uri_ref;
+    int critical;
+} h2_push_res;
+
 /* Apache httpd module configuration for h2. */
 typedef struct h2_config {
     const char *name;
@@ -70,6 +81,14 @@ typedef struct h2_config {
     
     int push_diary_size;          /* # of entries in push diary */
     int copy_files;               /* if files shall be copied vs setaside on output */
+    int mpm_workers;              /* run tasks on the MPM's worker threads */
+    int hpack_table_size;         /* max size of HPACK table for responses */
+    apr_array_header_t *hpack_no_index; /* header names never HPACK indexed */
+    int coalesce;                 /* share responses of identical requests */
+    apr_int64_t coalesce_max_size;/* max size of a shared response */
+    int early_hints;              /* send 103 Early Hints to clients */
+    apr_array_header_t *push_list;/* h2_push_res configured for location */
+    int weighted_sched;           /* schedule streams by weight, not strictly */
 } h2_config;
 
 
@@ -90,6 +109,8 @@ apr_int64_t h2_config_geti64(const h2_config *conf, h2_config_var_t var);
 
 void h2_config_init(apr_pool_t *pool);
 
+const apr_array_header_t *h2_config_get_hpack_no_index(const h2_config *conf);
+
 const struct h2_priority *h2_config_get_priority(const h2_config *conf, 
                                                  const char *content_type);
        
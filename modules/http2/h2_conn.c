@@ -101,7 +101,7 @@ apr_status_t h2_conn_child_init(apr_pool_t *pool, server_rec *s)
 {
     const h2_config *config = h2_config_sget(s);
     apr_status_t status = APR_SUCCESS;
-    int minw, maxw, max_tx_handles, n;
+    int minw, maxw, max_tx_handles, n, use_mpm;
     int max_threads_per_child = 0;
     int idle_secs = 0;
 
@@ -120,11 +120,36 @@ apr_status_t h2_conn_child_init(apr_pool_t *pool, server_rec *s)
     
     minw = h2_config_geti(config, H2_CONF_MIN_WORKERS);
     maxw = h2_config_geti(config, H2_CONF_MAX_WORKERS);    
-    if (minw <= 0) {
-        minw = max_threads_per_child;
+    
+    /* Tasks can share the MPM's threads only where the MPM runs timed
+     * callbacks on its workers. Elsewhere we keep our own threads. */
+    use_mpm = h2_config_geti(config, H2_CONF_MPM_WORKERS);
+    if (use_mpm && !(async_mpm && mpm_type == H2_MPM_EVENT)) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, 0, s, APLOGNO(03489)
+                     "H2MpmWorkers needs the event MPM, starting "
+                     "HTTP/2 worker threads of our own instead");
+        use_mpm = 0;
+    }
+    
+    if (use_mpm) {
+        /* The master connections with open streams hold an MPM thread
+         * each while they wait on their tasks. Leave half of the threads
+         * to them, or no task might get one. */
+        if (maxw <= 0 || maxw >= max_threads_per_child) {
+            maxw = max_threads_per_child / 2;
+        }
+        if (maxw <= 0) {
+            maxw = 1;
+        }
+        minw = maxw;
     }
-    if (maxw <= 0) {
-        maxw = minw;
+    else {
+        if (minw <= 0) {
+            minw = max_threads_per_child;
+        }
+        if (maxw <= 0) {
+            maxw = minw;
+        }
     }
     
     /* How many file handles is it safe to use for transfer
@@ -146,9 +171,10 @@ apr_status_t h2_conn_child_init(apr_pool_t *pool, server_rec *s)
     }
     
     ap_log_error(APLOG_MARK, APLOG_TRACE3, 0, s,
-                 "h2_workers: min=%d max=%d, mthrpchild=%d, tx_files=%d", 
-                 minw, maxw, max_threads_per_child, max_tx_handles);
-    workers = h2_workers_create(s, pool, minw, maxw, max_tx_handles);
+                 "h2_workers: min=%d max=%d, mthrpchild=%d, tx_files=%d, "
+                 "mpm=%d", minw, maxw, max_threads_per_child, max_tx_handles,
+                 use_mpm);
+    workers = h2_workers_create(s, pool, minw, maxw, max_tx_handles, use_mpm);
     
     idle_secs = h2_config_geti(config, H2_CONF_MAX_WORKER_IDLE_SECS);
     h2_workers_set_max_idle_secs(workers, idle_secs);
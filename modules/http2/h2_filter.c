@@ -386,16 +386,47 @@ static void add_out(apr_bucket_brigade *bb, h2_session *s, int last)
     bbout(bb, "    \"out\": {\n");
     bbout(bb, "      \"responses\": %d,\n", s->responses_submitted);
     bbout(bb, "      \"frames\": %ld,\n", (long)s->frames_sent);
+    bbout(bb, "      \"headers\": {\n");
+    bbout(bb, "        \"octets\": %"APR_UINT64_T_FMT",\n", s->hd_octets_raw);
+    bbout(bb, "        \"hpack\": %"APR_UINT64_T_FMT",\n", s->hd_octets_sent);
+    bbout(bb, "        \"cacheHits\": %"APR_UINT64_T_FMT",\n", s->hd_cache->hits);
+    bbout(bb, "        \"cacheMisses\": %"APR_UINT64_T_FMT",\n", s->hd_cache->misses);
+    bbout(bb, "        \"octetsSaved\": %"APR_UINT64_T_FMT"\n", s->hd_cache->octets_saved);
+    bbout(bb, "      },\n");
     bbout(bb, "      \"octets\": %"APR_UINT64_T_FMT"\n", s->io.bytes_written);
     bbout(bb, "    }%s\n", last? "" : ",");
 }
 
+static void add_sched(apr_bucket_brigade *bb, h2_session *s, int last) 
+{
+    h2_sched_stat stats[H2_SCHED_LEVELS];
+    int i, n = 0, wmax = NGHTTP2_MAX_WEIGHT / H2_SCHED_LEVELS;
+    
+    h2_mplx_sched_stats(s->mplx, stats);
+    bbout(bb, "    \"scheduler\": {\n");
+    bbout(bb, "      \"weighted\": %d,\n", s->mplx->weighted_sched);
+    bbout(bb, "      \"levels\": {");
+    for (i = H2_SCHED_LEVELS - 1; i >= 0; --i) {
+        if (stats[i].started) {
+            bbout(bb, "%s\n        \"%d-%d\": {", (n++? "," : ""), 
+                  i * wmax + 1, (i + 1) * wmax);
+            bbout(bb, " \"started\": %u,", stats[i].started);
+            bbout(bb, " \"delayAvg\": %f,", ((double)stats[i].delay_sum
+                                             / stats[i].started / 1000.0));
+            bbout(bb, " \"delayMax\": %f }", stats[i].delay_max / 1000.0);
+        }
+    }
+    bbout(bb, "\n      }\n");
+    bbout(bb, "    }%s\n", last? "" : ",");
+}
+
 static void add_stats(apr_bucket_brigade *bb, h2_session *s, 
                      h2_stream *stream, int last) 
 {
     bbout(bb, "  \"stats\": {\n");
     add_in(bb, s, 0);
     add_out(bb, s, 0);
+    add_sched(bb, s, 0);
     add_push(bb, s, stream, 1);
     bbout(bb, "  }%s\n", last? "" : ",");
 }
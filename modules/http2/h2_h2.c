@@ -714,6 +714,46 @@ static int h2_h2_post_read_req(request_rec *r)
     return DECLINED;
 }
 
+/* Announce the resources configured with H2PushResource in a 103 Early
+ * Hints response, before the handler starts working. This starts their
+ * pushes and, with H2EarlyHints on, lets the client preload them. */
+static void announce_pushes(request_rec *r)
+{
+    const h2_config *conf = h2_config_rget(r);
+    apr_table_t *headers_out;
+    const char *status_line;
+    int i, status;
+    
+    if (r->main || r->prev || r->expecting_100
+        || !conf->push_list || apr_is_empty_array(conf->push_list)) {
+        return;
+    }
+    ap_log_rerror(APLOG_MARK, APLOG_TRACE1, 0, r, 
+                  "early announcing %d resources for push", 
+                  conf->push_list->nelts);
+    
+    headers_out = r->headers_out;
+    r->headers_out = apr_table_make(r->pool, conf->push_list->nelts);
+    for (i = 0; i < conf->push_list->nelts; ++i) {
+        h2_push_res *push = &APR_ARRAY_IDX(conf->push_list, i, h2_push_res);
+        apr_table_addn(r->headers_out, "Link", 
+                       apr_psprintf(r->pool, "<%s>; rel=preload%s", 
+                                    push->uri_ref, 
+                                    push->critical? "; critical" : ""));
+    }
+    /* the final response carries them as well, for clients ignoring 103 */
+    headers_out = apr_table_overlay(r->pool, headers_out, r->headers_out);
+    
+    status = r->status;
+    status_line = r->status_line;
+    r->status = 103;
+    r->status_line = "103 Early Hints";
+    ap_send_interim_response(r, 1);
+    r->status = status;
+    r->status_line = status_line;
+    r->headers_out = headers_out;
+}
+
 static int h2_h2_late_fixups(request_rec *r)
 {
     /* slave connection? */
@@ -729,6 +769,7 @@ static int h2_h2_late_fixups(request_rec *r)
                               "h2_slave_out(%s): copy_files on", task->id);
                 h2_beam_on_file_beam(task->output.beam, h2_beam_no_files, NULL);
             }
+            announce_pushes(r);
         }
     }
     return DECLINED;
@@ -16,6 +16,7 @@
 #include <assert.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <apr_thread_mutex.h>
 #include <apr_thread_cond.h>
@@ -114,32 +115,20 @@ static void leave_mutex(h2_mplx *m, int acquired)
     }
 }
 
-static void beam_leave(void *ctx, apr_thread_mutex_t *lock)
-{
-    leave_mutex(ctx, 1);
-}
-
-static apr_status_t beam_enter(void *ctx, h2_beam_lock *pbl)
-{
-    h2_mplx *m = ctx;
-    int acquired;
-    apr_status_t status;
-    
-    status = enter_mutex(m, &acquired);
-    if (status == APR_SUCCESS) {
-        pbl->mutex = m->lock;
-        pbl->leave = acquired? beam_leave : NULL;
-        pbl->leave_ctx = m;
-    }
-    return status;
-}
-
 static void stream_output_consumed(void *ctx, 
                                    h2_bucket_beam *beam, apr_off_t length)
 {
     h2_task *task = ctx;
-    if (length > 0 && task && task->assigned) {
-        h2_req_engine_out_consumed(task->assigned, task->c, length); 
+    int acquired;
+
+    /* engine assignment and accounting change under the mplx lock, which
+     * the beam no longer holds when calling us */
+    if (length > 0 && task && task->mplx
+        && enter_mutex(task->mplx, &acquired) == APR_SUCCESS) {
+        if (task->assigned) {
+            h2_req_engine_out_consumed(task->assigned, task->c, length);
+        }
+        leave_mutex(task->mplx, acquired);
     }
 }
 
@@ -155,17 +144,27 @@ static void stream_input_consumed(void *ctx,
 static int can_beam_file(void *ctx, h2_bucket_beam *beam,  apr_file_t *file)
 {
     h2_mplx *m = ctx;
-    if (m->tx_handles_reserved > 0) {
-        --m->tx_handles_reserved;
+    int acquired, can_beam = 0;
+    
+    /* beams no longer run inside our lock, take it for the reservation */
+    if (enter_mutex(m, &acquired) == APR_SUCCESS) {
+        if (m->tx_handles_reserved > 0) {
+            --m->tx_handles_reserved;
+            can_beam = 1;
+        }
+        leave_mutex(m, acquired);
+    }
+    if (can_beam) {
         ap_log_cerror(APLOG_MARK, APLOG_TRACE3, 0, m->c,
-                      "h2_mplx(%ld-%d): beaming file %s, tx_avail %d", 
-                      m->id, beam->id, beam->tag, m->tx_handles_reserved);
-        return 1;
+                      "h2_mplx(%ld-%d): beaming file %s", 
+                      m->id, beam->id, beam->tag);
     }
-    ap_log_cerror(APLOG_MARK, APLOG_TRACE3, 0, m->c,
-                  "h2_mplx(%ld-%d): can_beam_file denied on %s", 
-                  m->id, beam->id, beam->tag);
-    return 0;
+    else {
+        ap_log_cerror(APLOG_MARK, APLOG_TRACE3, 0, m->c,
+                      "h2_mplx(%ld-%d): can_beam_file denied on %s", 
+                      m->id, beam->id, beam->tag);
+    }
+    return can_beam;
 }
 
 static void have_out_data_for(h2_mplx *m, h2_stream *stream, int response);
@@ -296,6 +295,7 @@ h2_mplx *h2_mplx_create(conn_rec *c, apr_pool_t *parent,
         m->bucket_alloc = apr_bucket_alloc_create(m->pool);
         m->max_streams = h2_config_geti(conf, H2_CONF_MAX_STREAMS);
         m->stream_max_mem = h2_config_geti(conf, H2_CONF_STREAM_MAX_MEM);
+        m->weighted_sched = h2_config_geti(conf, H2_CONF_WEIGHTED_SCHED);
 
         m->streams = h2_ihash_create(m->pool, offsetof(h2_stream,id));
         m->shold = h2_ihash_create(m->pool, offsetof(h2_stream,id));
@@ -442,7 +442,7 @@ static void stream_done(h2_mplx *m, h2_stream *stream, int rst_error)
     /* Let anyone blocked reading know that there is no more to come */
     h2_beam_abort(stream->input);
     /* Remove mutex after, so that abort still finds cond to signal */
-    h2_beam_mutex_set(stream->input, NULL, NULL, NULL);
+    h2_beam_mutex_disable(stream->input);
     m->tx_handles_reserved += h2_beam_get_files_beamed(stream->output);
 
     task = h2_ihash_get(m->tasks, stream->id);
@@ -724,7 +724,7 @@ static apr_status_t out_open(h2_mplx *m, int stream_id, h2_bucket_beam *beam)
     }
     
     /* time to protect the beam against multi-threaded use */
-    h2_beam_mutex_set(stream->output, beam_enter, task->cond, m);
+    h2_beam_mutex_enable(stream->output);
     
     /* we might see some file buckets in the output, see
      * if we have enough handles reserved. */
@@ -813,6 +813,100 @@ static void have_out_data_for(h2_mplx *m, h2_stream *stream, int response)
     }
 }
 
+/*******************************************************************************
+ * Weighted fair scheduling of streams
+ ******************************************************************************/
+
+/* Virtual time a stream with the whole connection as its share advances
+ * the schedule by. */
+#define H2_SCHED_COST           256
+/* The least fraction of H2StreamMaxMemSize a stream may buffer */
+#define H2_SCHED_MIN_MEM_DIV    8
+
+static apr_uint64_t sched_finish(h2_stream *stream)
+{
+    apr_uint32_t share = stream->sched_share? stream->sched_share : H2_SCHED_SHARE_ONE;
+    return stream->sched_start + (H2_SCHED_COST * H2_SCHED_SHARE_ONE) / share;
+}
+
+/* Order streams by the virtual time their start would be due, which is
+ * later for streams of small share. Streams queued later than others start
+ * later in virtual time, so those of small share are delayed by the
+ * heavier ones, but never starved. */
+static int sched_cmp(int sid1, int sid2, void *ctx)
+{
+    h2_mplx *m = ctx;
+    h2_stream *s1 = h2_ihash_get(m->streams, sid1);
+    h2_stream *s2 = h2_ihash_get(m->streams, sid2);
+    apr_uint64_t f1, f2;
+    
+    if (!s1 || !s2) {
+        return s1? -1 : (s2? 1 : 0);
+    }
+    f1 = sched_finish(s1);
+    f2 = sched_finish(s2);
+    if (f1 != f2) {
+        return (f1 < f2)? -1 : 1;
+    }
+    return sid1 - sid2;
+}
+
+/* The output memory a started stream may occupy. Streams with at least an
+ * equal share among the running ones may use all of H2StreamMaxMemSize,
+ * others proportionally less. */
+static apr_size_t sched_max_mem(h2_mplx *m, h2_stream *stream)
+{
+    apr_uint64_t mem;
+    
+    if (!m->weighted_sched || !stream->sched_share) {
+        return m->stream_max_mem;
+    }
+    mem = ((apr_uint64_t)m->stream_max_mem * stream->sched_share 
+           * H2MAX(h2_ihash_count(m->tasks), 1)) / H2_SCHED_SHARE_ONE;
+    mem = H2MIN(mem, m->stream_max_mem);
+    return (apr_size_t)H2MAX(mem, m->stream_max_mem / H2_SCHED_MIN_MEM_DIV);
+}
+
+static void sched_stream_started(h2_mplx *m, h2_stream *stream)
+{
+    h2_sched_stat *stat = &m->sched_stats[stream->sched_level];
+    apr_interval_time_t delay = apr_time_now() - stream->scheduled_at;
+    
+    if (m->weighted_sched) {
+        m->sched_vtime = H2MAX(m->sched_vtime, sched_finish(stream));
+    }
+    ++stat->started;
+    stat->delay_sum += delay;
+    if (delay > stat->delay_max) {
+        stat->delay_max = delay;
+    }
+}
+
+static int update_task_mem(void *ctx, void *val)
+{
+    h2_mplx *m = ctx;
+    h2_task *task = val;
+    h2_stream *stream = h2_ihash_get(m->streams, task->stream_id);
+    
+    if (stream && stream->output && !task->worker_done) {
+        h2_beam_buffer_size_set(stream->output, sched_max_mem(m, stream));
+    }
+    return 1;
+}
+
+void h2_mplx_sched_stats(h2_mplx *m, h2_sched_stat *stats)
+{
+    int acquired;
+    
+    if (enter_mutex(m, &acquired) == APR_SUCCESS) {
+        memcpy(stats, m->sched_stats, sizeof(m->sched_stats));
+        leave_mutex(m, acquired);
+    }
+    else {
+        memset(stats, 0, sizeof(m->sched_stats));
+    }
+}
+
 apr_status_t h2_mplx_reprioritize(h2_mplx *m, h2_stream_pri_cmp *cmp, void *ctx)
 {
     apr_status_t status;
@@ -822,6 +916,12 @@ apr_status_t h2_mplx_reprioritize(h2_mplx *m, h2_stream_pri_cmp *cmp, void *ctx)
         if (m->aborted) {
             status = APR_ECONNABORTED;
         }
+        else if (m->weighted_sched) {
+            h2_iq_sort(m->q, sched_cmp, m);
+            h2_ihash_iter(m->tasks, update_task_mem, m);
+            ap_log_cerror(APLOG_MARK, APLOG_TRACE1, 0, m->c,
+                          "h2_mplx(%ld): reprioritize tasks, weighted", m->id);
+        }
         else {
             h2_iq_sort(m->q, cmp, ctx);
             ap_log_cerror(APLOG_MARK, APLOG_TRACE1, 0, m->c,
@@ -855,7 +955,14 @@ apr_status_t h2_mplx_process(h2_mplx *m, struct h2_stream *stream,
                 if (m->workers_busy < m->workers_max) {
                     do_registration = m->need_registration;
                 }
-                h2_iq_add(m->q, stream->id, cmp, ctx);                
+                stream->scheduled_at = apr_time_now();
+                if (m->weighted_sched) {
+                    stream->sched_start = m->sched_vtime;
+                    h2_iq_add(m->q, stream->id, sched_cmp, m);
+                }
+                else {
+                    h2_iq_add(m->q, stream->id, cmp, ctx);
+                }
             }
             ap_log_cerror(APLOG_MARK, APLOG_TRACE1, status, m->c,
                           "h2_mplx(%ld-%d): process", m->c->id, stream->id);
@@ -912,10 +1019,11 @@ static h2_task *next_stream_task(h2_mplx *m)
             h2_beam_timeout_set(stream->input, m->stream_timeout);
             h2_beam_on_consumed(stream->input, stream_input_consumed, m);
             h2_beam_on_file_beam(stream->input, can_beam_file, m);
-            h2_beam_mutex_set(stream->input, beam_enter, task->cond, m);
+            h2_beam_mutex_enable(stream->input);
             
-            h2_beam_buffer_size_set(stream->output, m->stream_max_mem);
+            h2_beam_buffer_size_set(stream->output, sched_max_mem(m, stream));
             h2_beam_timeout_set(stream->output, m->stream_timeout);
+            sched_stream_started(m, stream);
             ++m->workers_busy;
         }
     }
@@ -992,7 +1100,14 @@ static void task_done(h2_mplx *m, h2_task *task, h2_req_engine *ngn)
             /* reset and schedule again */
             h2_task_redo(task);
             h2_ihash_remove(m->redo_tasks, task->stream_id);
-            h2_iq_add(m->q, task->stream_id, NULL, NULL);
+            stream->scheduled_at = apr_time_now();
+            if (m->weighted_sched) {
+                stream->sched_start = m->sched_vtime;
+                h2_iq_add(m->q, task->stream_id, sched_cmp, m);
+            }
+            else {
+                h2_iq_add(m->q, task->stream_id, NULL, NULL);
+            }
             return;
         }
         
@@ -1026,7 +1141,7 @@ static void task_done(h2_mplx *m, h2_task *task, h2_req_engine *ngn)
             /* more data will not arrive, resume the stream */
             have_out_data_for(m, stream, 0);
             h2_beam_on_consumed(stream->output, NULL, NULL);
-            h2_beam_mutex_set(stream->output, NULL, NULL, NULL);
+            h2_beam_mutex_disable(stream->output);
         }
         else {
             /* stream no longer active, was it placed in hold? */
@@ -1040,7 +1155,7 @@ static void task_done(h2_mplx *m, h2_task *task, h2_req_engine *ngn)
                  * is only safe in the only thread using it (and its
                  * parent pool / allocator) */
                 h2_beam_on_consumed(stream->output, NULL, NULL);
-                h2_beam_mutex_set(stream->output, NULL, NULL, NULL);
+                h2_beam_mutex_disable(stream->output);
                 h2_ihash_remove(m->shold, stream->id);
                 h2_ihash_add(m->spurge, stream);
             }
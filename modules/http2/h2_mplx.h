@@ -53,6 +53,18 @@ struct h2_req_engine;
 
 typedef struct h2_mplx h2_mplx;
 
+/* Stream shares of a connection are fixed point, H2_SCHED_SHARE_ONE being
+ * the whole connection. */
+#define H2_SCHED_SHARE_ONE      (1 << 16)
+/* Streams are grouped by their weight into levels for queuing statistics */
+#define H2_SCHED_LEVELS         8
+
+typedef struct h2_sched_stat {
+    apr_uint32_t started;           /* # of streams started on this level */
+    apr_interval_time_t delay_sum;  /* sum of time streams spent queued */
+    apr_interval_time_t delay_max;  /* max time a stream spent queued */
+} h2_sched_stat;
+
 /**
  * Callback invoked for every stream that had input data read since
  * the last invocation.
@@ -69,6 +81,7 @@ struct h2_mplx {
 
     unsigned int aborted : 1;
     unsigned int need_registration : 1;
+    unsigned int weighted_sched : 1; /* start streams by weighted fair queuing */
 
     struct h2_ihash_t *streams;     /* all streams currently processing */
     struct h2_ihash_t *shold;       /* all streams done with task ongoing */
@@ -76,6 +89,8 @@ struct h2_mplx {
 
     struct h2_iqueue *q;            /* all stream ids that need to be started */
     struct h2_iqueue *readyq;       /* all stream ids ready for output */
+    apr_uint64_t sched_vtime;       /* virtual time of weighted scheduling */
+    h2_sched_stat sched_stats[H2_SCHED_LEVELS];
         
     struct h2_ihash_t *tasks;       /* all tasks started and not destroyed */
     struct h2_ihash_t *redo_tasks;  /* all tasks that need to be redone */
@@ -201,12 +216,26 @@ apr_status_t h2_mplx_process(h2_mplx *m, struct h2_stream *stream,
 /**
  * Stream priorities have changed, reschedule pending requests.
  * 
+ * With weighted scheduling, pending streams are ordered by the
+ * shares the session has assigned them and running tasks get their
+ * output buffers resized accordingly. Otherwise, the compare function
+ * orders them strictly.
+ *
  * @param m the multiplexer
  * @param cmp the stream priority compare function
  * @param ctx context data for the compare function
  */
 apr_status_t h2_mplx_reprioritize(h2_mplx *m, h2_stream_pri_cmp *cmp, void *ctx);
 
+/**
+ * Get the queuing statistics of the multiplexer, one entry for each
+ * of the H2_SCHED_LEVELS weight levels.
+ *
+ * @param m the multiplexer
+ * @param stats array of H2_SCHED_LEVELS entries to copy the stats into
+ */
+void h2_mplx_sched_stats(h2_mplx *m, h2_sched_stat *stats);
+
 /**
  * Register a callback for the amount of input data consumed per stream. The
  * will only ever be invoked from the thread creating this h2_mplx, e.g. when
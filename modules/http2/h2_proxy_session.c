@@ -14,7 +14,10 @@
  */
 
 #include <stddef.h>
+#include <stdlib.h>
 #include <apr_strings.h>
+#include <apr_thread_mutex.h>
+#include <apr_thread_cond.h>
 #include <nghttp2/nghttp2.h>
 
 #include <mpm_common.h>
@@ -28,6 +31,15 @@
 
 APLOG_USE_MODULE(proxy_http2);
 
+/* Response data on a shared session, handed from the thread processing
+ * the session to the one serving the request. */
+typedef struct h2_proxy_chunk h2_proxy_chunk;
+struct h2_proxy_chunk {
+    h2_proxy_chunk *next;
+    apr_size_t len;
+    char *data;                 /* malloc'ed */
+};
+
 typedef struct h2_proxy_stream {
     int id;
     apr_pool_t *pool;
@@ -42,6 +54,8 @@ typedef struct h2_proxy_stream {
     unsigned int suspended : 1;
     unsigned int waiting_on_100 : 1;
     unsigned int waiting_on_ping : 1;
+    unsigned int headers_ended : 1;
+    unsigned int rst_sent : 1;
     uint32_t error_code;
 
     apr_bucket_brigade *input;
@@ -50,6 +64,17 @@ typedef struct h2_proxy_stream {
     apr_off_t data_received;
     
     apr_table_t *saves;
+
+    /* on shared sessions, protected by the session lock */
+    int shared;
+    struct h2_proxy_stream *next;   /* next pending stream */
+    h2_proxy_chunk *chunks;         /* response data not passed on yet */
+    h2_proxy_chunk *chunks_last;
+    apr_off_t consumed;             /* data passed on, window not updated */
+    int cancel;                     /* request gave up on the stream */
+    int closed;                     /* stream is done, results below */
+    apr_status_t done_status;
+    int touched;
 } h2_proxy_stream;
 
 
@@ -161,8 +186,15 @@ static int on_frame_recv(nghttp2_session *ngh2, const nghttp2_frame *frame,
                 ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, 
                               "h2_proxy_session(%s): got interim HEADERS, status=%d",
                               session->id, r->status);
-                r->status_line = ap_get_status_line(r->status);
-                ap_send_interim_response(r, 1);
+                if (!stream->shared) {
+                    r->status_line = ap_get_status_line(r->status);
+                    ap_send_interim_response(r, 1);
+                }
+            }
+            else if (stream->shared && !stream->headers_ended) {
+                /* Once the response headers are complete, the thread serving
+                 * the request may act on them. No changes to r after this. */
+                h2_proxy_stream_end_headers_out(stream);
             }
             stream->waiting_on_100 = 0;
             stream_resume(stream);
@@ -294,6 +326,7 @@ static void h2_proxy_stream_end_headers_out(h2_proxy_stream *stream)
     request_rec *r = stream->r;
     apr_pool_t *p = r->pool;
     
+    stream->headers_ended = 1;
     /* Now, add in the cookies from the response to the ones already saved */
     apr_table_do(add_header, stream->saves, r->headers_out, "Set-Cookie", NULL);
     
@@ -348,6 +381,33 @@ static void h2_proxy_stream_end_headers_out(h2_proxy_stream *stream)
     }
 }
 
+static int shared_add_data(h2_proxy_session *session, h2_proxy_stream *stream,
+                           const char *data, apr_size_t len)
+{
+    h2_proxy_chunk *chunk;
+    
+    chunk = malloc(sizeof(*chunk));
+    if (!chunk || !(chunk->data = malloc(H2MAX(len, 1)))) {
+        free(chunk);
+        return NGHTTP2_ERR_CALLBACK_FAILURE;
+    }
+    memcpy(chunk->data, data, len);
+    chunk->len = len;
+    chunk->next = NULL;
+    
+    apr_thread_mutex_lock(session->lock);
+    if (stream->chunks_last) {
+        stream->chunks_last->next = chunk;
+    }
+    else {
+        stream->chunks = chunk;
+    }
+    stream->chunks_last = chunk;
+    apr_thread_cond_broadcast(session->changed);
+    apr_thread_mutex_unlock(session->lock);
+    return 0;
+}
+
 static int stream_response_data(nghttp2_session *ngh2, uint8_t flags,
                                 int32_t stream_id, const uint8_t *data,
                                 size_t len, void *user_data) 
@@ -366,13 +426,17 @@ static int stream_response_data(nghttp2_session *ngh2, uint8_t flags,
         return 0;
     }
     
-    if (!stream->data_received) {
+    if (!stream->headers_ended) {
         /* last chance to manipulate response headers.
          * after this, only trailers */
         h2_proxy_stream_end_headers_out(stream);
     }
     stream->data_received += len;
     
+    if (stream->shared) {
+        return shared_add_data(session, stream, (const char*)data, len);
+    }
+    
     b = apr_bucket_transient_create((const char*)data, len, 
                                     stream->r->connection->bucket_alloc);
     APR_BRIGADE_INSERT_TAIL(stream->output, b);
@@ -434,7 +498,9 @@ static int on_header(nghttp2_session *ngh2, const nghttp2_frame *frame,
     (void)session;
     if (frame->hd.type == NGHTTP2_HEADERS && nlen) {
         stream = nghttp2_session_get_stream_user_data(ngh2, frame->hd.stream_id);
-        if (stream) {
+        if (stream && !(stream->shared && stream->headers_ended)) {
+            /* trailers on shared streams are dropped, r belongs to the
+             * thread serving the request by then. */
             if (h2_proxy_stream_add_header_out(stream, n, nlen, v, vlen)) {
                 return NGHTTP2_ERR_CALLBACK_FAILURE;
             }
@@ -725,7 +791,8 @@ static apr_status_t submit_stream(h2_proxy_session *session, h2_proxy_stream *st
                                     && !APR_BUCKET_IS_EOS(APR_BRIGADE_FIRST(stream->input)));
     }
     
-    if (may_have_request_body) {
+    /* shared streams are only made for requests without body */
+    if (may_have_request_body && !stream->shared) {
         provider.source.fd = 0;
         provider.source.ptr = NULL;
         provider.read_callback = stream_request_data;
@@ -1143,6 +1210,24 @@ static void ev_stream_done(h2_proxy_session *session, int stream_id,
                       "(touched=%d, error=%d)", 
                       session->id, stream_id, touched, stream->error_code);
         
+        if (stream->shared) {
+            if (status == APR_SUCCESS && !stream->headers_ended) {
+                h2_proxy_stream_end_headers_out(stream);
+            }
+            stream->state = H2_STREAM_ST_CLOSED;
+            h2_proxy_ihash_remove(session->streams, stream_id);
+            h2_proxy_iq_remove(session->suspended, stream_id);
+            
+            /* the stream belongs to the serving thread after this */
+            apr_thread_mutex_lock(session->lock);
+            stream->done_status = status;
+            stream->touched = touched;
+            stream->closed = 1;
+            apr_thread_cond_broadcast(session->changed);
+            apr_thread_mutex_unlock(session->lock);
+            return;
+        }
+        
         if (status != APR_SUCCESS) {
             stream->r->status = 500;
         }
@@ -1339,7 +1424,10 @@ run_loop:
                     session->wait_timeout = 25;
                 }
                 else {
-                    session->wait_timeout = H2MIN(apr_time_from_msec(100), 
+                    /* on shared sessions, others may wait for us to finish
+                     * and submit their streams */
+                    session->wait_timeout = H2MIN(apr_time_from_msec(
+                                                  session->lock? 10 : 100), 
                                                   2*session->wait_timeout);
                 }
                 
@@ -1506,3 +1594,232 @@ void h2_proxy_session_update_window(h2_proxy_session *session,
     }
 }
 
+
+/*******************************************************************************
+ * shared sessions
+ ******************************************************************************/
+
+apr_status_t h2_proxy_session_share(h2_proxy_session *session)
+{
+    apr_status_t status;
+    
+    if (session->lock) {
+        return APR_SUCCESS;
+    }
+    if (!h2_proxy_ihash_empty(session->streams)) {
+        return APR_EINVAL;
+    }
+    status = apr_thread_mutex_create(&session->lock, APR_THREAD_MUTEX_DEFAULT,
+                                     session->pool);
+    if (status == APR_SUCCESS) {
+        status = apr_thread_cond_create(&session->changed, session->pool);
+    }
+    if (status != APR_SUCCESS) {
+        session->lock = NULL;
+        return status;
+    }
+    /* streams report back via the stream itself, not a callback */
+    session->done = NULL;
+    session->user_data = NULL;
+    return APR_SUCCESS;
+}
+
+static int shared_update_iter(void *udata, void *val)
+{
+    h2_proxy_session *session = udata;
+    h2_proxy_stream *stream = val;
+    
+    if (stream->cancel && !stream->rst_sent) {
+        nghttp2_submit_rst_stream(session->ngh2, NGHTTP2_FLAG_NONE, 
+                                  stream->id, NGHTTP2_CANCEL);
+        stream->rst_sent = 1;
+    }
+    if (stream->consumed > 0) {
+        nghttp2_session_consume(session->ngh2, stream->id, 
+                                (size_t)stream->consumed);
+        stream->consumed = 0;
+    }
+    return 1;
+}
+
+/* Called by the thread about to process the session, with the lock held:
+ * bring the nghttp2 session up to date with what the serving threads 
+ * have done. */
+static void shared_prepare(h2_proxy_session *session)
+{
+    h2_proxy_stream *stream;
+    
+    h2_proxy_ihash_iter(session->streams, shared_update_iter, session);
+    
+    while ((stream = session->pending)) {
+        session->pending = stream->next;
+        stream->next = NULL;
+        if (!stream->cancel
+            && (session->state == H2_PROXYS_ST_INIT 
+                || is_accepting_streams(session))
+            && submit_stream(session, stream) == APR_SUCCESS) {
+            continue;
+        }
+        stream->done_status = APR_ECONNABORTED;
+        stream->touched = 0;
+        stream->closed = 1;
+    }
+}
+
+static int shared_fail_iter(void *udata, void *val)
+{
+    h2_proxy_session *session = udata;
+    h2_proxy_stream *stream = val;
+    
+    stream->done_status = APR_ECONNABORTED;
+    stream->touched = (stream->data_sent || 
+                       stream->id <= session->last_stream_id);
+    stream->closed = 1;
+    return 1;
+}
+
+/* The session has terminated, fail all streams, with the lock held */
+static void shared_fail_all(h2_proxy_session *session)
+{
+    h2_proxy_stream *stream;
+    
+    if (!h2_proxy_ihash_empty(session->streams)) {
+        ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, session->c, APLOGNO(03495)
+                      "h2_proxy_session(%s): terminated, %d shared streams "
+                      "unfinished", session->id, 
+                      (int)h2_proxy_ihash_count(session->streams));
+        h2_proxy_ihash_iter(session->streams, shared_fail_iter, session);
+        h2_proxy_ihash_clear(session->streams);
+    }
+    while ((stream = session->pending)) {
+        session->pending = stream->next;
+        stream->next = NULL;
+        stream->done_status = APR_ECONNABORTED;
+        stream->touched = 0;
+        stream->closed = 1;
+    }
+}
+
+/* Pass response data on to the request, or discard it once the request
+ * gave up. Returns the number of bytes disposed of. */
+static apr_off_t shared_pass_chunks(h2_proxy_stream *stream, 
+                                    apr_bucket_brigade *bb,
+                                    h2_proxy_chunk *chunk, int discard,
+                                    apr_status_t *pstatus)
+{
+    h2_proxy_chunk *next;
+    apr_off_t len = 0;
+    
+    for (; chunk; chunk = next) {
+        next = chunk->next;
+        len += chunk->len;
+        if (discard) {
+            free(chunk->data);
+        }
+        else {
+            /* the bucket takes over the data */
+            APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_heap_create(chunk->data, 
+                                    chunk->len, free, bb->bucket_alloc));
+        }
+        free(chunk);
+    }
+    
+    *pstatus = APR_SUCCESS;
+    if (!APR_BRIGADE_EMPTY(bb)) {
+        APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_flush_create(bb->bucket_alloc));
+        *pstatus = ap_pass_brigade(stream->r->output_filters, bb);
+        apr_brigade_cleanup(bb);
+    }
+    return len;
+}
+
+apr_status_t h2_proxy_session_serve(h2_proxy_session *session, const char *url,
+                                    request_rec *r, 
+                                    apr_interval_time_t timeout,
+                                    int *ptouched)
+{
+    h2_proxy_stream *stream, **pnext;
+    h2_proxy_chunk *chunks;
+    apr_bucket_brigade *bb;
+    apr_time_t deadline;
+    apr_status_t status, rv;
+    apr_off_t len;
+    
+    *ptouched = 0;
+    status = open_stream(session, url, r, 0, &stream);
+    if (status != APR_SUCCESS) {
+        return status;
+    }
+    stream->shared = 1;
+    bb = apr_brigade_create(r->pool, r->connection->bucket_alloc);
+    
+    ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(03496)
+                  "h2_proxy_session(%s): shared stream for %s%s, original: %s", 
+                  session->id, stream->req->authority, stream->req->path, 
+                  r->the_request);
+    
+    apr_thread_mutex_lock(session->lock);
+    for (pnext = &session->pending; *pnext; pnext = &(*pnext)->next) {
+        /* append */
+    }
+    *pnext = stream;
+    
+    deadline = apr_time_now() + timeout;
+    while (!stream->closed || stream->chunks) {
+        if (stream->chunks) {
+            chunks = stream->chunks;
+            stream->chunks = stream->chunks_last = NULL;
+            
+            apr_thread_mutex_unlock(session->lock);
+            len = shared_pass_chunks(stream, bb, chunks, stream->cancel, &rv);
+            apr_thread_mutex_lock(session->lock);
+            
+            stream->consumed += len;
+            if (rv != APR_SUCCESS && !stream->cancel) {
+                ap_log_rerror(APLOG_MARK, APLOG_DEBUG, rv, r, APLOGNO(03497)
+                              "h2_proxy_session(%s): passing output on "
+                              "shared stream", session->id);
+                stream->cancel = 1;
+            }
+            deadline = apr_time_now() + timeout;
+        }
+        else if (!stream->closed && !session->driven) {
+            /* take our turn in processing the session */
+            session->driven = 1;
+            shared_prepare(session);
+            apr_thread_mutex_unlock(session->lock);
+            
+            rv = h2_proxy_session_process(session);
+            
+            apr_thread_mutex_lock(session->lock);
+            session->driven = 0;
+            if (rv != APR_SUCCESS) {
+                shared_fail_all(session);
+            }
+            apr_thread_cond_broadcast(session->changed);
+        }
+        else if (!stream->closed) {
+            apr_thread_cond_timedwait(session->changed, session->lock, 
+                                      apr_time_from_msec(100));
+        }
+        
+        if (!stream->cancel && !stream->closed && apr_time_now() > deadline) {
+            ap_log_rerror(APLOG_MARK, APLOG_DEBUG, APR_TIMEUP, r, APLOGNO(03498)
+                          "h2_proxy_session(%s): shared stream timed out", 
+                          session->id);
+            stream->cancel = 1;
+        }
+    }
+    apr_thread_mutex_unlock(session->lock);
+    
+    /* the stream is ours alone again */
+    status = stream->cancel? APR_ECONNABORTED : stream->done_status;
+    *ptouched = stream->touched;
+    if (status == APR_SUCCESS && !stream->data_received) {
+        /* no response body, send the headers */
+        APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_flush_create(bb->bucket_alloc));
+        APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_eos_create(bb->bucket_alloc));
+        status = ap_pass_brigade(r->output_filters, bb);
+    }
+    return status;
+}
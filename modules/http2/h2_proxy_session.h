@@ -20,8 +20,11 @@
 
 #include <nghttp2/nghttp2.h>
 
+struct apr_thread_mutex_t;
+struct apr_thread_cond_t;
 struct h2_proxy_iqueue;
 struct h2_proxy_ihash_t;
+struct h2_proxy_stream;
 
 typedef enum {
     H2_PROXYS_ST_INIT,             /* send initial SETTINGS, etc. */
@@ -82,6 +85,12 @@ struct h2_proxy_session {
     
     apr_bucket_brigade *input;
     apr_bucket_brigade *output;
+
+    /* sessions shared among threads, see h2_proxy_session_share() */
+    struct apr_thread_mutex_t *lock;
+    struct apr_thread_cond_t *changed;
+    struct h2_proxy_stream *pending; /* streams waiting to be submitted */
+    int driven;                     /* a thread is processing the session */
 };
 
 h2_proxy_session *h2_proxy_session_setup(const char *id, proxy_conn_rec *p_conn,
@@ -110,6 +119,34 @@ void h2_proxy_session_cleanup(h2_proxy_session *s, h2_proxy_request_done *done);
 void h2_proxy_session_update_window(h2_proxy_session *s, 
                                     conn_rec *c, apr_off_t bytes);
 
+/**
+ * Make the session usable by several threads at the same time, each
+ * serving its own requests via h2_proxy_session_serve(). The session
+ * must not have any streams.
+ * @param s the session to share
+ */
+apr_status_t h2_proxy_session_share(h2_proxy_session *s);
+
+/**
+ * Serve a request on a shared session. The request is sent to the
+ * backend in a new stream and its response passed on to r's output
+ * filters in the calling thread. Requests must not have a body.
+ *
+ * While waiting, the calling thread takes its turn in processing the
+ * session for all its requests.
+ *
+ * @param s the shared session
+ * @param url the url to request from the backend
+ * @param r the request to serve
+ * @param timeout max time to wait for the backend to make progress
+ * @param ptouched on return, != 0 iff the backend may have seen the request
+ * @return APR_SUCCESS when the response was passed on
+ */
+apr_status_t h2_proxy_session_serve(h2_proxy_session *s, const char *url,
+                                    request_rec *r, 
+                                    apr_interval_time_t timeout,
+                                    int *ptouched);
+
 #define H2_PROXY_REQ_URL_NOTE   "h2-proxy-req-url"
 
 #endif /* h2_proxy_session_h */
@@ -25,6 +25,7 @@ struct h2_stream;
 
 typedef struct h2_push {
     const struct h2_request *req;
+    int critical;                   /* needed before the initiating response */
 } h2_push;
 
 typedef enum {
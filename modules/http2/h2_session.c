@@ -218,10 +218,42 @@ static int stream_pri_cmp(int sid1, int sid2, void *ctx)
     return spri_cmp(sid1, s1, sid2, s2, session);
 }
 
+/*
+ * Determine the share of the connection a stream is entitled to by the
+ * dependency tree: at each level, its fraction of the weights of all
+ * siblings. Also assign the stream its weight level.
+ */
+static void stream_sched_update(h2_session *session, h2_stream *stream)
+{
+    nghttp2_stream *s, *p;
+    apr_uint64_t share = H2_SCHED_SHARE_ONE;
+    int32_t sum;
+    
+    s = nghttp2_session_find_stream(session->ngh2, stream->id);
+    if (!s) {
+        return;
+    }
+    stream->sched_level = ((nghttp2_stream_get_weight(s) - 1) * H2_SCHED_LEVELS
+                           / NGHTTP2_MAX_WEIGHT);
+    for (; (p = nghttp2_stream_get_parent(s)); s = p) {
+        sum = nghttp2_stream_get_sum_dependency_weight(p);
+        if (sum > 0) {
+            share = (share * nghttp2_stream_get_weight(s)) / sum;
+        }
+    }
+    stream->sched_share = (apr_uint32_t)H2MAX(share, 1);
+}
+
+static int stream_sched_update_iter(h2_stream *stream, void *ctx)
+{
+    stream_sched_update(ctx, stream);
+    return 1;
+}
+
 static apr_status_t stream_schedule(h2_session *session,
                                     h2_stream *stream, int eos)
 {
-    (void)session;
+    stream_sched_update(session, stream);
     return h2_stream_schedule(stream, eos, h2_session_push_enabled(session), 
                               stream_pri_cmp, session);
 }
@@ -654,6 +686,9 @@ static int on_frame_send_cb(nghttp2_session *ngh2,
                      (long)session->frames_sent);
     }
     ++session->frames_sent;
+    if (frame->hd.type == NGHTTP2_HEADERS) {
+        session->hd_octets_sent += frame->hd.length;
+    }
     return 0;
 }
 
@@ -706,11 +741,39 @@ static apr_status_t init_callbacks(conn_rec *c, nghttp2_session_callbacks **pcb)
     return APR_SUCCESS;
 }
 
+static void log_sched_stats(h2_session *session)
+{
+    h2_sched_stat stats[H2_SCHED_LEVELS];
+    const char *levels = "";
+    int i, wmax = NGHTTP2_MAX_WEIGHT / H2_SCHED_LEVELS;
+    
+    h2_mplx_sched_stats(session->mplx, stats);
+    for (i = H2_SCHED_LEVELS - 1; i >= 0; --i) {
+        if (stats[i].started) {
+            levels = apr_psprintf(session->pool, "%s weight %d-%d: %u started, "
+                                  "queued %.1f/%.1f ms (avg/max);", levels, 
+                                  i * wmax + 1, (i + 1) * wmax, stats[i].started,
+                                  (double)stats[i].delay_sum 
+                                  / stats[i].started / 1000.0,
+                                  stats[i].delay_max / 1000.0);
+        }
+    }
+    if (*levels) {
+        ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, session->c, APLOGNO(03494)
+                      "h2_session(%ld): %s scheduling,%s", session->id, 
+                      session->mplx->weighted_sched? "weighted" : "strict", 
+                      levels);
+    }
+}
+
 static void h2_session_destroy(h2_session *session)
 {
     ap_assert(session);    
 
     if (session->mplx) {
+        if (APLOGcdebug(session->c)) {
+            log_sched_stats(session);
+        }
         h2_mplx_set_consumed_cb(session->mplx, NULL, NULL);
         h2_mplx_release_and_join(session->mplx, session->iowait);
         session->mplx = NULL;
@@ -726,6 +789,17 @@ static void h2_session_destroy(h2_session *session)
         h2_ctx_clear(session->c);
     }
 
+    if (session->hd_cache && APLOGcdebug(session->c)) {
+        ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, session->c, APLOGNO(03490)
+                      "h2_session(%ld): response headers %" APR_UINT64_T_FMT 
+                      "/%" APR_UINT64_T_FMT " bytes (raw/hpack), header cache "
+                      "hits=%" APR_UINT64_T_FMT ", misses=%" APR_UINT64_T_FMT
+                      ", saved=%" APR_UINT64_T_FMT " bytes",
+                      session->id, session->hd_octets_raw, 
+                      session->hd_octets_sent, session->hd_cache->hits, 
+                      session->hd_cache->misses, 
+                      session->hd_cache->octets_saved);
+    }
     if (APLOGctrace1(session->c)) {
         ap_log_cerror(APLOG_MARK, APLOG_TRACE1, 0, session->c,
                       "h2_session(%ld): destroy", session->id);
@@ -957,6 +1031,12 @@ static h2_session *h2_session_create_int(conn_rec *c,
         /* We need to handle window updates ourself, otherwise we
          * get flooded by nghttp2. */
         nghttp2_option_set_no_auto_window_update(options, 1);
+#ifdef H2_NG2_DEFLATE_TABLE_SIZE
+        /* The client decides how large our HPACK table may be, we can only 
+         * lower that limit, trading bytes on the wire for memory. */
+        nghttp2_option_set_max_deflate_dynamic_table_size(options, 
+            (size_t)h2_config_geti(session->config, H2_CONF_HPACK_TABLE_SIZE));
+#endif
         
         if (APLOGctrace6(c)) {
             mem = apr_pcalloc(session->pool, sizeof(nghttp2_mem));
@@ -986,6 +1066,8 @@ static h2_session *h2_session_create_int(conn_rec *c,
          
         n = h2_config_geti(session->config, H2_CONF_PUSH_DIARY_SIZE);
         session->push_diary = h2_push_diary_create(session->pool, n);
+        session->hd_cache = h2_ngheader_cache_create(session->pool, 
+                               h2_config_get_hpack_no_index(session->config));
         
         if (APLOGcdebug(c)) {
             ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, c, APLOGNO(03200)
@@ -1233,6 +1315,7 @@ struct h2_stream *h2_session_push(h2_session *session, h2_stream *is,
                   
     stream = h2_session_open_stream(session, nid, is->id, push->req);
     if (stream) {
+        stream->push_critical = push->critical;
         status = stream_schedule(session, stream, 1);
         if (status != APR_SUCCESS) {
             ap_log_cerror(APLOG_MARK, APLOG_TRACE1, status, session->c,
@@ -1351,6 +1434,10 @@ apr_status_t h2_session_set_prio(h2_session *session, h2_stream *stream,
                       session->id, stream->id, ptype, 
                       ps.weight, ps.stream_id, rv);
         status = (rv < 0)? APR_EGENERAL : APR_SUCCESS;
+        if (status == APR_SUCCESS) {
+            /* shares of streams in this tree have changed */
+            session->reprioritize = 1;
+        }
     }
 #else
     (void)session;
@@ -1423,10 +1510,37 @@ static apr_status_t on_stream_headers(h2_session *session, h2_stream *stream,
                   session->id, stream->id, headers->status);
         goto leave;
     }
+    else if (!h2_headers_are_response(headers)) {
+        h2_ngheader *nh;
+        
+        /* An interim response. Pushes announced in 103 Early Hints are 
+         * started right away, while the request is still being processed.
+         * The push diary keeps the final response from pushing them again. */
+        if (headers->status == 103) {
+            if (!stream->initiated_on && h2_session_push_enabled(session)) {
+                h2_stream_submit_pushes(stream, headers);
+            }
+            if (!h2_config_geti(session->config, H2_CONF_EARLY_HINTS)) {
+                ap_log_cerror(APLOG_MARK, APLOG_TRACE1, 0, session->c,
+                              "h2_stream(%ld-%d): early hints not sent",
+                              session->id, stream->id);
+                goto leave;
+            }
+        }
+        nh = h2_util_ngheader_make_res(stream->pool, session->hd_cache,
+                                       headers->status, headers->headers);
+        ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, session->c, APLOGNO(03493)
+                      "h2_stream(%ld-%d): submit interim response %d",
+                      session->id, stream->id, headers->status);
+        rv = nghttp2_submit_headers(session->ngh2, NGHTTP2_FLAG_NONE, 
+                                    stream->id, NULL, nh->nv, nh->nvlen, NULL);
+        goto leave;
+    }
     else if (stream->has_response) {
         h2_ngheader *nh;
         
-        nh = h2_util_ngheader_make(stream->pool, headers->headers);
+        nh = h2_util_ngheader_make(stream->pool, session->hd_cache, 
+                                   headers->headers);
         ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, session->c, APLOGNO(03072)
                       "h2_stream(%ld-%d): submit %d trailers",
                       session->id, (int)stream->id,(int) nh->nvlen);
@@ -1436,6 +1550,7 @@ static apr_status_t on_stream_headers(h2_session *session, h2_stream *stream,
     else {
         nghttp2_data_provider provider, *pprovider = NULL;
         h2_ngheader *ngh;
+        apr_size_t i;
         apr_table_t *hout;
         const h2_priority *prio;
         const char *note;
@@ -1494,7 +1609,11 @@ static apr_status_t on_stream_headers(h2_session *session, h2_stream *stream,
                            apr_itoa(stream->pool, connFlowOut));
         }
         
-        ngh = h2_util_ngheader_make_res(stream->pool, headers->status, hout);
+        ngh = h2_util_ngheader_make_res(stream->pool, session->hd_cache, 
+                                        headers->status, hout);
+        for (i = 0; i < ngh->nvlen; ++i) {
+            session->hd_octets_raw += ngh->nv[i].namelen + ngh->nv[i].valuelen;
+        }
         rv = nghttp2_submit_response(session->ngh2, stream->id,
                                      ngh->nv, ngh->nvlen, pprovider);
         stream->has_response = h2_headers_are_response(headers);
@@ -2274,6 +2393,10 @@ apr_status_t h2_session_process(h2_session *session, int async)
             dispatch_event(session, H2_SESSION_EV_NGH2_DONE, 0, NULL); 
         }
         if (session->reprioritize) {
+            if (session->mplx->weighted_sched) {
+                h2_mplx_stream_do(session->mplx, stream_sched_update_iter, 
+                                  session);
+            }
             h2_mplx_reprioritize(session->mplx, stream_pri_cmp, session);
             session->reprioritize = 0;
         }
@@ -46,6 +46,7 @@ struct h2_config;
 struct h2_filter_cin;
 struct h2_ihash_t;
 struct h2_mplx;
+struct h2_ngheader_cache;
 struct h2_priority;
 struct h2_push;
 struct h2_push_diary;
@@ -101,6 +102,7 @@ typedef struct h2_session {
     apr_interval_time_t  wait_us;   /* timeout during BUSY_WAIT state, micro secs */
     
     struct h2_push_diary *push_diary; /* remember pushes, avoid duplicates */
+    struct h2_ngheader_cache *hd_cache; /* response header fields sent */
     
     int open_streams;               /* number of streams open */
     int unsent_submits;             /* number of submitted, but not yet written responses. */
@@ -114,6 +116,8 @@ typedef struct h2_session {
     
     apr_size_t frames_received;     /* number of http/2 frames received */
     apr_size_t frames_sent;         /* number of http/2 frames sent */
+    apr_uint64_t hd_octets_raw;     /* size of response headers submitted */
+    apr_uint64_t hd_octets_sent;    /* size of them, HPACK encoded */
     
     apr_size_t max_stream_count;    /* max number of open streams */
     apr_size_t max_stream_mem;      /* max buffer memory for a single stream */
@@ -757,7 +757,18 @@ const h2_priority *h2_stream_get_priority(h2_stream *stream,
                                           h2_headers *response)
 {
     if (response && stream->initiated_on) {
-        const char *ctype = apr_table_get(response->headers, "content-type");
+        const char *ctype;
+        
+        if (stream->push_critical) {
+            /* the client cannot make use of the initiating response
+             * without it, take the place of the initiating stream in
+             * the dependency tree */
+            static const h2_priority critical = {
+                H2_DEPENDANT_BEFORE, NGHTTP2_DEFAULT_WEIGHT
+            };
+            return &critical;
+        }
+        ctype = apr_table_get(response->headers, "content-type");
         if (ctype) {
             /* FIXME: Not good enough, config needs to come from request->server */
             return h2_config_get_priority(stream->session->config, ctype);
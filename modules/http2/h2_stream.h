@@ -65,8 +65,14 @@ struct h2_stream {
     unsigned int started   : 1; /* stream has started processing */
     unsigned int has_response : 1; /* response headers are known */
     unsigned int push_policy;   /* which push policy to use for this request */
+    unsigned int push_critical : 1; /* PUSHed, needed before initiating stream */
     unsigned int can_be_cleaned : 1; /* stream pool can be cleaned */
     
+    apr_time_t scheduled_at;    /* when stream was queued for processing */
+    apr_uint64_t sched_start;   /* virtual time the stream was queued at */
+    apr_uint32_t sched_share;   /* share of the connection, weighted */
+    int sched_level;            /* weight level, for queuing statistics */
+    
     apr_off_t out_data_frames;  /* # of DATA frames sent */
     apr_off_t out_data_octets;  /* # of DATA octets (payload) sent */
     apr_off_t in_data_frames;   /* # of DATA frames received */
@@ -17,7 +17,6 @@
 #include <stddef.h>
 
 #include <apr_atomic.h>
-#include <apr_thread_cond.h>
 #include <apr_strings.h>
 
 #include <httpd.h>
@@ -508,7 +507,6 @@ h2_task *h2_task_create(conn_rec *c, int stream_id, const h2_request *req,
     task->input.beam  = input;
     task->output.beam = output;
     
-    apr_thread_cond_create(&task->cond, pool);
 
     h2_ctx_create_for(c, task);
     return task;
@@ -14,6 +14,7 @@
  */
 
 #include <assert.h>
+#include <apr_hash.h>
 #include <apr_strings.h>
 
 #include <httpd.h>
@@ -1119,40 +1120,188 @@ static int add_table_header(void *ctx, const char *key, const char *value)
     return 1;
 }
 
+/* Upper bounds on what a session caches, so that a connection with ever
+ * changing header names or values cannot grow its pool without end. Once
+ * the value of a name changed H2_NGH_CACHE_MAX_MISSES times, it is
+ * considered volatile and no longer compared. */
+#define H2_NGH_CACHE_MAX_NAMES      64
+#define H2_NGH_CACHE_MAX_VALUE      128
+#define H2_NGH_CACHE_MAX_MISSES     2
 
-h2_ngheader *h2_util_ngheader_make(apr_pool_t *p, apr_table_t *header)
-{
+typedef struct {
+    const char *name;              /* lowercased name */
+    apr_size_t namelen;
+    const char *value;             /* last value seen, NULL if volatile */
+    apr_size_t valuelen;
+    uint8_t flags;                 /* NO_INDEX if never to be indexed */
+    int value_misses;              /* # of times the value changed */
+} h2_ngheader_entry;
+
+typedef struct {
     h2_ngheader *ngh;
-    size_t n;
+    h2_ngheader_cache *cache;
+} h2_ngheader_ctx;
+
+h2_ngheader_cache *h2_ngheader_cache_create(apr_pool_t *p, 
+                                            const apr_array_header_t *no_index)
+{
+    h2_ngheader_cache *cache = apr_pcalloc(p, sizeof(*cache));
+    cache->pool = p;
+    cache->entries = apr_hash_make(p);
+    cache->no_index = no_index;
+    return cache;
+}
+
+static int is_no_index(h2_ngheader_cache *cache, const char *key)
+{
+    int i;
     
-    n = 0;
-    apr_table_do(count_header, &n, header, NULL);
+    if (cache->no_index) {
+        for (i = 0; i < cache->no_index->nelts; ++i) {
+            if (!strcasecmp(APR_ARRAY_IDX(cache->no_index, i, const char*), 
+                            key)) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static h2_ngheader_entry *get_entry(h2_ngheader_cache *cache, 
+                                    const char *key, apr_size_t key_len)
+{
+    h2_ngheader_entry *e;
+    char *name;
     
-    ngh = apr_pcalloc(p, sizeof(h2_ngheader));
-    ngh->nv =  apr_pcalloc(p, n * sizeof(nghttp2_nv));
-    apr_table_do(add_table_header, ngh, header, NULL);
+    e = apr_hash_get(cache->entries, key, key_len);
+    if (e || apr_hash_count(cache->entries) >= H2_NGH_CACHE_MAX_NAMES) {
+        return e;
+    }
+    e = apr_pcalloc(cache->pool, sizeof(*e));
+    name = apr_pstrmemdup(cache->pool, key, key_len);
+    ap_str_tolower(name);
+    e->name = name;
+    e->namelen = key_len;
+    if (is_no_index(cache, name)) {
+        e->flags = NGHTTP2_NV_FLAG_NO_INDEX;
+        /* volatile by definition, do not bother remembering values */
+        e->value_misses = H2_NGH_CACHE_MAX_MISSES;
+    }
+    apr_hash_set(cache->entries, apr_pstrmemdup(cache->pool, key, key_len), 
+                 key_len, e);
+    return e;
+}
 
-    return ngh;
+static int add_cached_header(h2_ngheader_ctx *ctx, 
+                             const char *key, apr_size_t key_len,
+                             const char *value, apr_size_t val_len)
+{
+    h2_ngheader_cache *cache = ctx->cache;
+    nghttp2_nv *nv = &ctx->ngh->nv[ctx->ngh->nvlen++];
+    h2_ngheader_entry *e;
+    
+    nv->name = (uint8_t*)key;
+    nv->namelen = key_len;
+    nv->value = (uint8_t*)value;
+    nv->valuelen = val_len;
+    
+    e = get_entry(cache, key, key_len);
+    if (!e) {
+        /* cache is full, still honour the indexing policy */
+        if (is_no_index(cache, key)) {
+            nv->flags = NGHTTP2_NV_FLAG_NO_INDEX;
+        }
+        ++cache->misses;
+        return 1;
+    }
+    
+    nv->flags = e->flags;
+#ifdef H2_NG2_NO_COPY
+    /* the cached name is lowercase already and lives as long as the
+     * session, nghttp2 may use it as is */
+    nv->name = (uint8_t*)e->name;
+    nv->flags |= NGHTTP2_NV_FLAG_NO_COPY_NAME;
+    cache->octets_saved += key_len;
+#endif
+    if (e->value && e->valuelen == val_len 
+        && !memcmp(e->value, value, val_len)) {
+#ifdef H2_NG2_NO_COPY
+        nv->value = (uint8_t*)e->value;
+        nv->flags |= NGHTTP2_NV_FLAG_NO_COPY_VALUE;
+        cache->octets_saved += val_len;
+#endif
+        ++cache->hits;
+    }
+    else {
+        /* A name keeps the first value it was seen with, the pool holds
+         * at most one copy of it. */
+        if (e->value && ++e->value_misses >= H2_NGH_CACHE_MAX_MISSES) {
+            e->value = NULL;
+        }
+        else if (!e->value && e->value_misses < H2_NGH_CACHE_MAX_MISSES
+                 && val_len <= H2_NGH_CACHE_MAX_VALUE) {
+            e->value = apr_pstrmemdup(cache->pool, value, val_len);
+            e->valuelen = val_len;
+        }
+        ++cache->misses;
+    }
+    return 1;
 }
 
-h2_ngheader *h2_util_ngheader_make_res(apr_pool_t *p, 
-                                       int http_status, 
-                                       apr_table_t *header)
+static int add_cached_table_header(void *ctx, const char *key, 
+                                   const char *value)
+{
+    if (!h2_util_ignore_header(key)) {
+        add_cached_header(ctx, key, strlen(key), value, strlen(value));
+    }
+    return 1;
+}
+
+static h2_ngheader *ngheader_make(apr_pool_t *p, h2_ngheader_cache *cache,
+                                  const char *status, apr_table_t *header)
 {
     h2_ngheader *ngh;
     size_t n;
     
-    n = 1;
+    n = status? 1 : 0;
     apr_table_do(count_header, &n, header, NULL);
     
     ngh = apr_pcalloc(p, sizeof(h2_ngheader));
     ngh->nv =  apr_pcalloc(p, n * sizeof(nghttp2_nv));
-    NV_ADD_LIT_CS(ngh, ":status", apr_psprintf(p, "%d", http_status));
-    apr_table_do(add_table_header, ngh, header, NULL);
-
+    if (cache) {
+        h2_ngheader_ctx ctx;
+        
+        ctx.ngh = ngh;
+        ctx.cache = cache;
+        if (status) {
+            add_cached_header(&ctx, ":status", sizeof(":status") - 1, 
+                              status, strlen(status));
+        }
+        apr_table_do(add_cached_table_header, &ctx, header, NULL);
+    }
+    else {
+        if (status) {
+            NV_ADD_LIT_CS(ngh, ":status", status);
+        }
+        apr_table_do(add_table_header, ngh, header, NULL);
+    }
     return ngh;
 }
 
+h2_ngheader *h2_util_ngheader_make(apr_pool_t *p, h2_ngheader_cache *cache,
+                                   apr_table_t *header)
+{
+    return ngheader_make(p, cache, NULL, header);
+}
+
+h2_ngheader *h2_util_ngheader_make_res(apr_pool_t *p, 
+                                       h2_ngheader_cache *cache,
+                                       int http_status, 
+                                       apr_table_t *header)
+{
+    return ngheader_make(p, cache, apr_itoa(p, http_status), header);
+}
+
 h2_ngheader *h2_util_ngheader_make_req(apr_pool_t *p, 
                                        const struct h2_request *req)
 {
@@ -273,8 +273,33 @@ typedef struct h2_ngheader {
     apr_size_t nvlen;
 } h2_ngheader;
 
-h2_ngheader *h2_util_ngheader_make(apr_pool_t *p, apr_table_t *header);
+/**
+ * A cache of the response header fields a connection sends, so that repeated
+ * names (and values) are lowercased and copied only once for the lifetime of
+ * the session instead of once per stream. Fields can also be marked so that
+ * HPACK never adds them to its dynamic table.
+ */
+typedef struct h2_ngheader_cache {
+    apr_pool_t *pool;
+    struct apr_hash_t *entries;    /* field name as given -> cached nv */
+    const apr_array_header_t *no_index; /* lowercase names never indexed */
+    apr_uint64_t hits;             /* fields served from the cache */
+    apr_uint64_t misses;           /* fields not (yet) cached */
+    apr_uint64_t octets_saved;     /* name/value bytes nghttp2 did not copy */
+} h2_ngheader_cache;
+
+/**
+ * Create a header cache living as long as the given pool.
+ * @param p        the pool to allocate cached fields from
+ * @param no_index lowercase field names HPACK must never index, may be NULL
+ */
+h2_ngheader_cache *h2_ngheader_cache_create(apr_pool_t *p, 
+                                            const apr_array_header_t *no_index);
+
+h2_ngheader *h2_util_ngheader_make(apr_pool_t *p, h2_ngheader_cache *cache,
+                                   apr_table_t *header);
 h2_ngheader *h2_util_ngheader_make_res(apr_pool_t *p, 
+                                       h2_ngheader_cache *cache,
                                        int http_status, 
                                        apr_table_t *header);
 h2_ngheader *h2_util_ngheader_make_req(apr_pool_t *p, 
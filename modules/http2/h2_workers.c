@@ -18,6 +18,7 @@
 #include <apr_thread_mutex.h>
 #include <apr_thread_cond.h>
 
+#include <ap_mpm.h>
 #include <mpm_common.h>
 #include <httpd.h>
 #include <http_core.h>
@@ -30,6 +31,23 @@
 #include "h2_worker.h"
 #include "h2_workers.h"
 
+/* Maximum # of tasks a runner performs before it hands the MPM worker
+ * back and queues itself again. */
+#define H2_MPM_RUNNER_TASKS     8
+
+/* A runner is our share of the MPM's threads: a callback queued to the
+ * MPM that, once on a worker thread, processes tasks like a h2_worker
+ * does. The number of runners is the concurrency budget of HTTP/2 tasks.
+ */
+typedef struct h2_mpm_runner h2_mpm_runner;
+struct h2_mpm_runner {
+    h2_mpm_runner *next;
+    h2_workers *workers;
+    int id;
+    apr_pool_t *pool;
+    apr_thread_t *thread;
+};
+
 
 static int in_list(h2_workers *workers, h2_mplx *m)
 {
@@ -189,6 +207,113 @@ static apr_status_t get_mplx_next(h2_worker *worker, void *ctx,
     return *ptask? APR_SUCCESS : APR_EOF;
 }
 
+static void run_on_mpm(void *baton);
+
+/* Queue the given runner, or an idle one if NULL and the budget allows,
+ * to the MPM. Called with workers->lock held. */
+static void schedule_runner(h2_workers *workers, h2_mpm_runner *runner)
+{
+    apr_status_t status;
+    
+    if (!runner) {
+        if (!workers->runners) {
+            /* all busy, they will pick up new work before going idle */
+            return;
+        }
+        runner = workers->runners;
+        workers->runners = runner->next;
+        ++workers->runners_busy;
+    }
+    
+    status = ap_mpm_register_timed_callback(0, run_on_mpm, runner);
+    if (status != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, status, workers->s,
+                     APLOGNO(03488) "h2_workers: unable to queue runner(%d) "
+                     "to the MPM", runner->id);
+        runner->next = workers->runners;
+        workers->runners = runner;
+        --workers->runners_busy;
+    }
+}
+
+static void run_on_mpm(void *baton)
+{
+    h2_mpm_runner *runner = baton;
+    h2_workers *workers = runner->workers;
+    apr_os_thread_t tid = apr_os_thread_current();
+    h2_task *task;
+    int sticky, count = 0;
+    
+    /* The slave connections want to know the thread they run in. */
+    apr_os_thread_put(&runner->thread, &tid, runner->pool);
+    
+    apr_thread_mutex_lock(workers->lock);
+    while (!workers->aborted && (task = next_task(workers))) {
+        sticky = (workers->max_workers >= workers->mplx_count);
+        if (workers->mplx_count) {
+            /* other connections have work, spread it while we can */
+            schedule_runner(workers, NULL);
+        }
+        apr_thread_mutex_unlock(workers->lock);
+        
+        while (task) {
+            h2_task_do(task, runner->thread, runner->id);
+            ++count;
+            if (sticky && count < H2_MPM_RUNNER_TASKS) {
+                h2_mplx_task_done(task->mplx, task, &task);
+            }
+            else {
+                h2_mplx_task_done(task->mplx, task, NULL);
+                task = NULL;
+            }
+        }
+        
+        apr_thread_mutex_lock(workers->lock);
+        if (count >= H2_MPM_RUNNER_TASKS) {
+            /* Do not hog the MPM worker, HTTP/1 connections and other
+             * callbacks queued meanwhile get their turn before we
+             * continue. */
+            if (!workers->aborted && !H2_MPLX_LIST_EMPTY(&workers->mplxs)) {
+                ap_log_error(APLOG_MARK, APLOG_TRACE3, 0, workers->s,
+                             "h2_workers: runner(%d) yields", runner->id);
+                schedule_runner(workers, runner);
+                apr_thread_mutex_unlock(workers->lock);
+                return;
+            }
+            break;
+        }
+    }
+    
+    runner->next = workers->runners;
+    workers->runners = runner;
+    --workers->runners_busy;
+    apr_thread_mutex_unlock(workers->lock);
+}
+
+static apr_status_t add_runners(h2_workers *workers)
+{
+    h2_mpm_runner *runner;
+    apr_status_t status;
+    int i;
+    
+    for (i = 0; i < workers->max_workers; ++i) {
+        runner = apr_pcalloc(workers->pool, sizeof(*runner));
+        status = apr_pool_create(&runner->pool, workers->pool);
+        if (status != APR_SUCCESS) {
+            return status;
+        }
+        apr_pool_tag(runner->pool, "h2_mpm_runner");
+        runner->workers = workers;
+        runner->id = workers->next_worker_id++;
+        runner->next = workers->runners;
+        workers->runners = runner;
+    }
+    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, workers->s, APLOGNO(03487)
+                 "h2_workers: running tasks on the MPM worker threads, "
+                 "at most %d at a time", workers->max_workers);
+    return APR_SUCCESS;
+}
+
 static void worker_done(h2_worker *worker, void *ctx)
 {
     h2_workers *workers = ctx;
@@ -237,7 +362,7 @@ static apr_status_t h2_workers_start(h2_workers *workers)
 
 h2_workers *h2_workers_create(server_rec *s, apr_pool_t *server_pool,
                               int min_workers, int max_workers,
-                              apr_size_t max_tx_handles)
+                              apr_size_t max_tx_handles, int use_mpm)
 {
     apr_status_t status;
     h2_workers *workers;
@@ -260,6 +385,7 @@ h2_workers *h2_workers_create(server_rec *s, apr_pool_t *server_pool,
         workers->min_workers = min_workers;
         workers->max_workers = max_workers;
         workers->max_idle_secs = 10;
+        workers->use_mpm = !!use_mpm;
         
         workers->max_tx_handles = max_tx_handles;
         workers->spare_tx_handles = workers->max_tx_handles;
@@ -291,7 +417,8 @@ h2_workers *h2_workers_create(server_rec *s, apr_pool_t *server_pool,
         }
         
         if (status == APR_SUCCESS) {
-            status = h2_workers_start(workers);
+            status = workers->use_mpm? add_runners(workers)
+                                     : h2_workers_start(workers);
         }
         
         if (status != APR_SUCCESS) {
@@ -345,7 +472,12 @@ apr_status_t h2_workers_register(h2_workers *workers, struct h2_mplx *m)
             status = APR_SUCCESS;
         }
         
-        if (workers->idle_workers > 0) { 
+        if (workers->use_mpm) {
+            if (status == APR_SUCCESS || !workers->runners_busy) {
+                schedule_runner(workers, NULL);
+            }
+        }
+        else if (workers->idle_workers > 0) { 
             apr_thread_cond_signal(workers->mplx_added);
         }
         else if (status == APR_SUCCESS 
@@ -27,6 +27,7 @@ struct apr_thread_cond_t;
 struct h2_mplx;
 struct h2_request;
 struct h2_task;
+struct h2_mpm_runner;
 
 typedef struct h2_workers h2_workers;
 
@@ -45,6 +46,10 @@ struct h2_workers {
     apr_size_t spare_tx_handles;
     
     unsigned int aborted : 1;
+    unsigned int use_mpm : 1;     /* tasks run on the MPM's worker threads */
+
+    struct h2_mpm_runner *runners;/* idle runners, when use_mpm is set */
+    int runners_busy;             /* # of runners queued or running */
 
     apr_threadattr_t *thread_attr;
     
@@ -61,11 +66,14 @@ struct h2_workers {
 
 
 /* Create a worker pool with the given minimum and maximum number of
- * threads.
+ * threads. With use_mpm set, no threads of our own are started. Tasks
+ * are then run from callbacks queued to the MPM's worker threads, at
+ * most max_size of them at a time, and min_size is ignored. This needs
+ * an MPM that runs timed callbacks on its workers (event).
  */
 h2_workers *h2_workers_create(server_rec *s, apr_pool_t *pool,
                               int min_size, int max_size, 
-                              apr_size_t max_tx_handles);
+                              apr_size_t max_tx_handles, int use_mpm);
 
 /* Destroy the worker pool and all its threads. 
  */
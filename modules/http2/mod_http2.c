@@ -33,6 +33,7 @@
 #include "h2_filter.h"
 #include "h2_task.h"
 #include "h2_session.h"
+#include "h2_coalesce.h"
 #include "h2_config.h"
 #include "h2_ctx.h"
 #include "h2_h2.h"
@@ -183,6 +184,11 @@ static void h2_child_init(apr_pool_t *pool, server_rec *s)
         ap_log_error(APLOG_MARK, APLOG_ERR, status, s,
                      APLOGNO(02949) "initializing connection handling");
     }
+    status = h2_coalesce_child_init(pool, s);
+    if (status != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, status, s,
+                     APLOGNO(03492) "initializing request coalescing");
+    }
     
 }
 
@@ -211,6 +217,7 @@ static void h2_hooks(apr_pool_t *pool)
     h2_h2_register_hooks();
     h2_switch_register_hooks();
     h2_task_register_hooks();
+    h2_coalesce_register_hooks();
 
     h2_alt_svc_register_hooks();
     
@@ -117,6 +117,10 @@ SOURCE=./h2_bucket_eos.c
 # End Source File
 # Begin Source File
 
+SOURCE=./h2_coalesce.c
+# End Source File
+# Begin Source File
+
 SOURCE=./h2_config.c
 # End Source File
 # Begin Source File
@@ -15,7 +15,11 @@
 
 #include <nghttp2/nghttp2.h>
 
+#include <apr_strings.h>
+#include <apr_thread_mutex.h>
+
 #include <httpd.h>
+#include <http_config.h>
 #include <mod_proxy.h>
 #include "mod_http2.h"
 
@@ -27,17 +31,45 @@
 #include "h2_proxy_session.h"
 
 static void register_hook(apr_pool_t *p);
+static void *h2_proxy_create_svr(apr_pool_t *pool, server_rec *s);
+static void *h2_proxy_merge_svr(apr_pool_t *pool, void *basev, void *addv);
+static const command_rec h2_proxy_cmds[];
 
 AP_DECLARE_MODULE(proxy_http2) = {
     STANDARD20_MODULE_STUFF,
-    NULL,              /* create per-directory config structure */
-    NULL,              /* merge per-directory config structures */
-    NULL,              /* create per-server config structure */
-    NULL,              /* merge per-server config structures */
-    NULL,              /* command apr_table_t */
-    register_hook      /* register hooks */
+    NULL,                /* create per-directory config structure */
+    NULL,                /* merge per-directory config structures */
+    h2_proxy_create_svr, /* create per-server config structure */
+    h2_proxy_merge_svr,  /* merge per-server config structures */
+    h2_proxy_cmds,       /* command apr_table_t */
+    register_hook        /* register hooks */
+};
+
+typedef struct h2_proxy_svr_conf {
+    int shared_sessions;    /* share backend sessions among all requests */
+} h2_proxy_svr_conf;
+
+/* Backend sessions shared by the requests of all connections in a 
+ * child process, see H2ProxySharedSessions. A session, and its backend
+ * connection, stays with its entry until the backend closes it. */
+typedef struct h2_proxy_shared h2_proxy_shared;
+struct h2_proxy_shared {
+    h2_proxy_shared *next;
+    proxy_worker *worker;
+    const char *hostname;       /* SNI, if it varies by request */
+    const char *proxy_func;
+    server_rec *server;
+    proxy_conn_rec *p_conn;
+    h2_proxy_session *session;
+    int streams;                /* # of requests currently served */
+    int dead;                   /* session no longer accepts requests */
 };
 
+static apr_thread_mutex_t *shared_lock;
+static apr_pool_t *shared_pool;
+static h2_proxy_shared *shared_list;
+static h2_proxy_shared *shared_free;
+
 /* Optional functions from mod_http2 */
 static int (*is_h2)(conn_rec *c);
 static apr_status_t (*req_engine_push)(const char *name, request_rec *r, 
@@ -112,6 +144,54 @@ static int h2_proxy_post_config(apr_pool_t *p, apr_pool_t *plog,
     return status;
 }
 
+static void h2_proxy_child_init(apr_pool_t *pchild, server_rec *s)
+{
+    apr_status_t status;
+    
+    status = apr_thread_mutex_create(&shared_lock, APR_THREAD_MUTEX_DEFAULT,
+                                     pchild);
+    if (status == APR_SUCCESS) {
+        status = apr_pool_create(&shared_pool, pchild);
+    }
+    if (status != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, status, s, APLOGNO(03499)
+                     "mod_proxy_http2: unable to init shared sessions");
+        shared_lock = NULL;
+    }
+}
+
+static void *h2_proxy_create_svr(apr_pool_t *pool, server_rec *s)
+{
+    h2_proxy_svr_conf *conf = apr_pcalloc(pool, sizeof(*conf));
+    conf->shared_sessions = -1;
+    return conf;
+}
+
+static void *h2_proxy_merge_svr(apr_pool_t *pool, void *basev, void *addv)
+{
+    h2_proxy_svr_conf *base = basev, *add = addv;
+    h2_proxy_svr_conf *conf = apr_pcalloc(pool, sizeof(*conf));
+    conf->shared_sessions = (add->shared_sessions != -1)? 
+                            add->shared_sessions : base->shared_sessions;
+    return conf;
+}
+
+static const char *h2_proxy_set_shared_sessions(cmd_parms *cmd, void *dc,
+                                                int flag)
+{
+    h2_proxy_svr_conf *conf = ap_get_module_config(cmd->server->module_config,
+                                                   &proxy_http2_module);
+    conf->shared_sessions = flag;
+    return NULL;
+}
+
+static const command_rec h2_proxy_cmds[] = {
+    AP_INIT_FLAG("H2ProxySharedSessions", h2_proxy_set_shared_sessions, NULL,
+                 RSRC_CONF, "on to multiplex requests from all connections "
+                 "onto shared backend sessions"),
+    AP_END_CMD
+};
+
 /**
  * canonicalize the url into the request, if it is meant for us.
  * slightly modified copy from mod_http
@@ -456,6 +536,212 @@ static h2_proxy_ctx *push_request_somewhere(h2_proxy_ctx *ctx)
     return ctx;
 }
 
+/*******************************************************************************
+ * shared backend sessions
+ ******************************************************************************/
+
+static int shared_enabled(h2_proxy_ctx *ctx, const char *proxyname)
+{
+    h2_proxy_svr_conf *conf = ap_get_module_config(ctx->server->module_config,
+                                                   &proxy_http2_module);
+    request_rec *r = ctx->rbase;
+    
+    /* Request bodies are read by the thread processing the session, which
+     * serves requests of other connections as well. */
+    return (shared_lock && conf && conf->shared_sessions > 0 && !proxyname
+            && !r->expecting_100 && !r->kept_body && !ap_request_has_body(r));
+}
+
+/* The SNI a request needs, if other requests on the same worker might
+ * need another one */
+static const char *shared_hostname(h2_proxy_ctx *ctx)
+{
+    proxy_dir_conf *dconf = ap_get_module_config(ctx->rbase->per_dir_config, 
+                                                 &proxy_module);
+    return (ctx->is_ssl && dconf->preserve_host)? ctx->rbase->hostname : NULL;
+}
+
+static int shared_matches(h2_proxy_shared *e, h2_proxy_ctx *ctx, 
+                          const char *hostname)
+{
+    int max_streams;
+    
+    if (e->dead || e->worker != ctx->worker) {
+        return 0;
+    }
+    if (e->hostname? (!hostname || ap_cstr_casecmp(e->hostname, hostname))
+        : (hostname != NULL)) {
+        return 0;
+    }
+    max_streams = (e->session->remote_max_concurrent > 0)?
+                  (int)e->session->remote_max_concurrent : 100;
+    return e->streams < max_streams;
+}
+
+static h2_proxy_shared *shared_acquire(h2_proxy_ctx *ctx, char *url,
+                                       const char *proxyname, 
+                                       apr_port_t proxyport)
+{
+    const char *hostname = shared_hostname(ctx);
+    proxy_conn_rec *p_conn = NULL;
+    h2_proxy_session *session;
+    h2_proxy_shared *e;
+    char *locurl = url;
+    apr_uri_t uri;
+    
+    apr_thread_mutex_lock(shared_lock);
+    for (e = shared_list; e; e = e->next) {
+        if (shared_matches(e, ctx, hostname)) {
+            ++e->streams;
+            break;
+        }
+    }
+    apr_thread_mutex_unlock(shared_lock);
+    if (e) {
+        return e;
+    }
+    
+    /* None available, open a new backend connection to share. It is taken
+     * out of the worker's connection pool as long as the session lives. */
+    if (ap_proxy_acquire_connection(ctx->proxy_func, &p_conn, ctx->worker, 
+                                    ctx->server) != OK) {
+        return NULL;
+    }
+    p_conn->is_ssl = ctx->is_ssl;
+    if (ap_proxy_determine_connection(ctx->pool, ctx->rbase, ctx->conf, 
+                                      ctx->worker, p_conn, &uri, &locurl, 
+                                      proxyname, proxyport, 
+                                      ctx->server_portstr,
+                                      sizeof(ctx->server_portstr)) != OK
+        || ap_proxy_connect_backend(ctx->proxy_func, p_conn, ctx->worker, 
+                                    ctx->server)) {
+        goto fail;
+    }
+    if (!p_conn->connection) {
+        if (ap_proxy_connection_create_ex(ctx->proxy_func, p_conn, 
+                                          ctx->rbase) != OK) {
+            goto fail;
+        }
+        if (p_conn->ssl_hostname) {
+            apr_table_setn(p_conn->connection->notes,
+                           "proxy-request-hostname", p_conn->ssl_hostname);
+        }
+        if (ctx->is_ssl) {
+            apr_table_setn(p_conn->connection->notes,
+                           "proxy-request-alpn-protos", "h2");
+        }
+    }
+    
+    session = h2_proxy_session_setup(apr_psprintf(ctx->pool, "shared-%ld", 
+                                                  p_conn->connection->id), 
+                                     p_conn, ctx->conf, 30, 16, NULL);
+    if (!session || h2_proxy_session_share(session) != APR_SUCCESS) {
+        goto fail;
+    }
+    
+    apr_thread_mutex_lock(shared_lock);
+    if (shared_free) {
+        e = shared_free;
+        shared_free = e->next;
+        memset(e, 0, sizeof(*e));
+    }
+    else {
+        e = apr_pcalloc(shared_pool, sizeof(*e));
+    }
+    e->worker = ctx->worker;
+    e->hostname = hostname? apr_pstrdup(p_conn->scpool, hostname) : NULL;
+    e->proxy_func = ctx->proxy_func;
+    e->server = ctx->server;
+    e->p_conn = p_conn;
+    e->session = session;
+    e->streams = 1;
+    e->next = shared_list;
+    shared_list = e;
+    apr_thread_mutex_unlock(shared_lock);
+    
+    ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, ctx->owner, APLOGNO(03500)
+                  "h2_proxy_session(%s): shared for %s", session->id, 
+                  p_conn->hostname);
+    return e;
+
+fail:
+    p_conn->close = 1;
+    ap_proxy_release_connection(ctx->proxy_func, p_conn, ctx->server);
+    return NULL;
+}
+
+static void shared_release(h2_proxy_shared *e, int dead)
+{
+    proxy_conn_rec *p_conn = NULL;
+    const char *proxy_func = NULL;
+    server_rec *server = NULL;
+    h2_proxy_shared **pe;
+    
+    apr_thread_mutex_lock(shared_lock);
+    --e->streams;
+    if (dead) {
+        e->dead = 1;
+    }
+    if (e->dead && e->streams == 0) {
+        for (pe = &shared_list; *pe; pe = &(*pe)->next) {
+            if (*pe == e) {
+                *pe = e->next;
+                break;
+            }
+        }
+        p_conn = e->p_conn;
+        proxy_func = e->proxy_func;
+        server = e->server;
+        e->next = shared_free;
+        shared_free = e;
+    }
+    apr_thread_mutex_unlock(shared_lock);
+    
+    if (p_conn) {
+        p_conn->close = 1;
+        ap_proxy_release_connection(proxy_func, p_conn, server);
+    }
+}
+
+/* Serve the request on a shared backend session. Returns DECLINED if that
+ * is not possible and the backend has not seen the request. */
+static int proxy_http2_shared(h2_proxy_ctx *ctx, char *url,
+                              const char *proxyname, apr_port_t proxyport)
+{
+    h2_proxy_shared *e;
+    apr_interval_time_t timeout;
+    apr_status_t status;
+    const char *id;
+    int touched;
+    
+    e = shared_acquire(ctx, url, proxyname, proxyport);
+    if (!e) {
+        return DECLINED;
+    }
+    id = apr_pstrdup(ctx->pool, e->session->id);
+    
+    timeout = ctx->worker->s->timeout_set? 
+              ctx->worker->s->timeout : ctx->server->timeout;
+    apr_table_setn(ctx->rbase->notes, "proxy-source-port", 
+                   apr_psprintf(ctx->pool, "%hu", 
+                                e->p_conn->connection->local_addr->port));
+    status = h2_proxy_session_serve(e->session, url, ctx->rbase, timeout,
+                                    &touched);
+    /* A request failing before the backend saw it means that the session
+     * is no longer usable, most likely. */
+    shared_release(e, status != APR_SUCCESS && !touched);
+    
+    if (status == APR_SUCCESS) {
+        return OK;
+    }
+    else if (!touched) {
+        return DECLINED;
+    }
+    ap_log_rerror(APLOG_MARK, APLOG_DEBUG, status, ctx->rbase, APLOGNO(03501)
+                  "h2_proxy_session(%s): shared request not complete", id);
+    return HTTP_SERVICE_UNAVAILABLE;
+}
+
 static int proxy_http2_handler(request_rec *r, 
                                proxy_worker *worker,
                                proxy_server_conf *conf,
@@ -515,6 +801,15 @@ static int proxy_http2_handler(request_rec *r,
     ap_log_rerror(APLOG_MARK, APLOG_TRACE1, 0, ctx->rbase, 
                   "H2: serving URL %s", url);
     
+    if (shared_enabled(ctx, proxyname)) {
+        int rv = proxy_http2_shared(ctx, url, proxyname, proxyport);
+        if (rv != DECLINED) {
+            ap_set_module_config(ctx->owner->conn_config, &proxy_http2_module, 
+                                 NULL);
+            return rv;
+        }
+    }
+    
 run_connect:    
     /* Get a proxy_conn_rec from the worker, might be a new one, might
      * be one still open from another request, or it might fail if the
@@ -630,6 +925,7 @@ cleanup:
 static void register_hook(apr_pool_t *p)
 {
     ap_hook_post_config(h2_proxy_post_config, NULL, NULL, APR_HOOK_MIDDLE);
+    ap_hook_child_init(h2_proxy_child_init, NULL, NULL, APR_HOOK_MIDDLE);
 
     proxy_hook_scheme_handler(proxy_http2_handler, NULL, NULL, APR_HOOK_FIRST);
     proxy_hook_canon_handler(proxy_http2_canon, NULL, NULL, APR_HOOK_FIRST);
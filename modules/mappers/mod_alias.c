@@ -705,11 +705,74 @@ static int fixup_redir(request_rec *r)
     return DECLINED;
 }
 
+/* Whether a section, or an <If> nested in it (walked before translation
+ * too), has an Alias or Redirect
+ */
+static int alias_set_in(ap_conf_vector_t *v)
+{
+    alias_dir_conf *dirconf = ap_get_module_config(v, &alias_module);
+    core_dir_config *core_dconf = ap_get_core_module_config(v);
+    int i;
+
+    if (dirconf && (dirconf->alias_set || dirconf->redirect_set)) {
+        return 1;
+    }
+    if (core_dconf->sec_if) {
+        for (i = 0; i < core_dconf->sec_if->nelts; ++i) {
+            if (alias_set_in(APR_ARRAY_IDX(core_dconf->sec_if, i,
+                                           ap_conf_vector_t *))) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Whether an Alias or Redirect may apply when the URI of a request to
+ * the server is translated, i.e. in the server, a Location or an If
+ * section.
+ */
+static int alias_applies_to_uri(server_rec *s)
+{
+    alias_server_conf *serverconf = ap_get_module_config(s->module_config,
+                                                         &alias_module);
+    core_server_config *sconf = ap_get_core_module_config(s->module_config);
+    ap_conf_vector_t **sec = (ap_conf_vector_t **)sconf->sec_url->elts;
+    int i;
+
+    if (serverconf->aliases->nelts || serverconf->redirects->nelts) {
+        return 1;
+    }
+    if (alias_set_in(s->lookup_defaults)) {
+        return 1;
+    }
+    for (i = 0; i < sconf->sec_url->nelts; ++i) {
+        if (alias_set_in(sec[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int alias_post_config(apr_pool_t *pconf, apr_pool_t *plog,
+                             apr_pool_t *ptemp, server_rec *s)
+{
+    /* servers without any need not call translate_alias_redir() */
+    for (; s; s = s->next) {
+        if (!alias_applies_to_uri(s)) {
+            ap_hook_skip_for_server(pconf, s, ap_hook_get_translate_name(),
+                                    &alias_module);
+        }
+    }
+    return OK;
+}
+
 static void register_hooks(apr_pool_t *p)
 {
     static const char * const aszSucc[]={ "mod_userdir.c",
                                           "mod_vhost_alias.c",NULL };
 
+    ap_hook_post_config(alias_post_config, NULL, NULL, APR_HOOK_MIDDLE);
     ap_hook_translate_name(translate_alias_redir,NULL,aszSucc,APR_HOOK_MIDDLE);
     ap_hook_fixups(fixup_redir,NULL,NULL,APR_HOOK_MIDDLE);
 }
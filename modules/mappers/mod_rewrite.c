@@ -4475,12 +4475,56 @@ static int pre_config(apr_pool_t *pconf,
     return OK;
 }
 
+/* Whether the rewrite engine is on in a section, or in an <If> nested in
+ * it (walked before translation too)
+ */
+static int rewrite_engine_on_in(ap_conf_vector_t *v)
+{
+    rewrite_perdir_conf *dconf = ap_get_module_config(v, &rewrite_module);
+    core_dir_config *core_dconf = ap_get_core_module_config(v);
+    int i;
+
+    if (dconf && dconf->state == ENGINE_ENABLED) {
+        return 1;
+    }
+    if (core_dconf->sec_if) {
+        for (i = 0; i < core_dconf->sec_if->nelts; ++i) {
+            if (rewrite_engine_on_in(APR_ARRAY_IDX(core_dconf->sec_if, i,
+                                                   ap_conf_vector_t *))) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Whether the rewrite engine may be on when the URI of a request to the
+ * server is translated, i.e. in the server, a Location or an If section.
+ */
+static int rewrite_engine_on_for_uri(server_rec *s)
+{
+    core_server_config *sconf = ap_get_core_module_config(s->module_config);
+    ap_conf_vector_t **sec = (ap_conf_vector_t **)sconf->sec_url->elts;
+    int i;
+
+    if (rewrite_engine_on_in(s->lookup_defaults)) {
+        return 1;
+    }
+    for (i = 0; i < sconf->sec_url->nelts; ++i) {
+        if (rewrite_engine_on_in(sec[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 static int post_config(apr_pool_t *p,
                        apr_pool_t *plog,
                        apr_pool_t *ptemp,
                        server_rec *s)
 {
     apr_status_t rv;
+    server_rec *sp;
 
     /* check if proxy module is available */
     proxy_available = (ap_find_linked_module("mod_proxy.c") != NULL);
@@ -4493,6 +4537,14 @@ static int post_config(apr_pool_t *p,
     apr_pool_cleanup_register(p, (void *)s, rewritelock_remove,
                               apr_pool_cleanup_null);
 
+    /* hook_uri2file() has nothing to do for servers with the engine off */
+    for (sp = s; sp; sp = sp->next) {
+        if (!rewrite_engine_on_for_uri(sp)) {
+            ap_hook_skip_for_server(p, sp, ap_hook_get_translate_name(),
+                                    &rewrite_module);
+        }
+    }
+
     /* if we are not doing the initial config, step through the servers and
      * open the RewriteMap prg:xxx programs,
      */
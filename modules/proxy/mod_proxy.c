@@ -991,6 +991,83 @@ static int proxy_needsdomain(request_rec *r, const char *url, const char *domain
 /* -------------------------------------------------------------- */
 /* Invoke handler */
 
+/* What proxy_handler() keeps for ap_proxy_request_resumed() when the
+ * scheme handler suspends the request
+ */
+typedef struct {
+    proxy_worker *worker;
+    proxy_balancer *balancer;
+    proxy_server_conf *conf;
+    int attempts;
+} proxy_suspended_t;
+
+#define PROXY_SUSPENDED_KEY "proxy-suspended"
+
+static int proxy_handler_done(request_rec *r, proxy_worker *worker,
+                              proxy_balancer *balancer,
+                              proxy_server_conf *conf, int attempts,
+                              int access_status)
+{
+    int saved_status;
+
+    /*
+     * Save current r->status and set it to the value of access_status which
+     * might be different (e.g. r->status could be HTTP_OK if e.g. we override
+     * the error page on the proxy or if the error was not generated by the
+     * backend itself but by the proxy e.g. a bad gateway) in order to give
+     * ap_proxy_post_request a chance to act correctly on the status code.
+     * But only do the above if access_status is not OK and not DONE, because
+     * in this case r->status might contain the true status and overwriting
+     * it with OK or DONE would be wrong.
+     */
+    if ((access_status != OK) && (access_status != DONE)) {
+        saved_status = r->status;
+        r->status = access_status;
+        ap_proxy_post_request(worker, balancer, r, conf);
+        /*
+         * Only restore r->status if it has not been changed by
+         * ap_proxy_post_request as we assume that this change was intentional.
+         */
+        if (r->status == access_status) {
+            r->status = saved_status;
+        }
+    }
+    else {
+        ap_proxy_post_request(worker, balancer, r, conf);
+    }
+
+    proxy_run_request_status(&access_status, r);
+    AP_PROXY_RUN_FINISHED(r, attempts, access_status);
+
+    return access_status;
+}
+
+PROXY_DECLARE(int) ap_proxy_request_resumed(request_rec *r, int status)
+{
+    proxy_suspended_t *susp = NULL;
+
+    apr_pool_userdata_get((void **)&susp, PROXY_SUSPENDED_KEY, r->pool);
+    if (!susp) {
+        return status;
+    }
+    apr_pool_userdata_setn(NULL, PROXY_SUSPENDED_KEY, NULL, r->pool);
+
+    /* As proxy_handler() does for a status returned right away, except
+     * that failing over is no longer possible: the request was sent.
+     */
+    if ((status == HTTP_INTERNAL_SERVER_ERROR
+         || status == HTTP_SERVICE_UNAVAILABLE)
+            && !apr_table_get(r->notes, "proxy-error-override")
+            && susp->balancer
+            && !(susp->worker->s->status & PROXY_WORKER_IGNORE_ERRORS)) {
+        susp->worker->s->status |= PROXY_WORKER_IN_ERROR;
+        susp->worker->s->error_time = apr_time_now();
+    }
+
+    return proxy_handler_done(r, susp->worker, susp->balancer, susp->conf,
+                              susp->attempts, status);
+}
+
 static int proxy_handler(request_rec *r)
 {
     char *uri, *scheme, *p;
@@ -1008,7 +1085,6 @@ static int proxy_handler(request_rec *r)
     proxy_worker *worker = NULL;
     int attempts = 0, max_attempts = 0;
     struct dirconn_entry *list = (struct dirconn_entry *)conf->dirconn->elts;
-    int saved_status;
 
     /* is this for us? */
     if (!r->filename) {
@@ -1284,36 +1360,22 @@ static int proxy_handler(request_rec *r)
         goto cleanup;
     }
 cleanup:
-    /*
-     * Save current r->status and set it to the value of access_status which
-     * might be different (e.g. r->status could be HTTP_OK if e.g. we override
-     * the error page on the proxy or if the error was not generated by the
-     * backend itself but by the proxy e.g. a bad gateway) in order to give
-     * ap_proxy_post_request a chance to act correctly on the status code.
-     * But only do the above if access_status is not OK and not DONE, because
-     * in this case r->status might contain the true status and overwriting
-     * it with OK or DONE would be wrong.
-     */
-    if ((access_status != OK) && (access_status != DONE)) {
-        saved_status = r->status;
-        r->status = access_status;
-        ap_proxy_post_request(worker, balancer, r, conf);
-        /*
-         * Only restore r->status if it has not been changed by
-         * ap_proxy_post_request as we assume that this change was intentional.
+    if (access_status == SUSPENDED) {
+        /* The post request processing is left to ap_proxy_request_resumed(),
+         * the exchange with the backend is still in flight.
          */
-        if (r->status == access_status) {
-            r->status = saved_status;
-        }
-    }
-    else {
-        ap_proxy_post_request(worker, balancer, r, conf);
-    }
+        proxy_suspended_t *susp = apr_palloc(r->pool, sizeof(*susp));
 
-    proxy_run_request_status(&access_status, r);
-    AP_PROXY_RUN_FINISHED(r, attempts, access_status);
+        susp->worker = worker;
+        susp->balancer = balancer;
+        susp->conf = conf;
+        susp->attempts = attempts;
+        apr_pool_userdata_setn(susp, PROXY_SUSPENDED_KEY, NULL, r->pool);
+        return SUSPENDED;
+    }
 
-    return access_status;
+    return proxy_handler_done(r, worker, balancer, conf, attempts,
+                              access_status);
 }
 
 /* -------------------------------------------------------------- */
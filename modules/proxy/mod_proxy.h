@@ -912,6 +912,18 @@ PROXY_DECLARE(int) ap_proxy_post_request(proxy_worker *worker,
                                          request_rec *r,
                                          proxy_server_conf *conf);
 
+/**
+ * Complete the proxy processing of a request which the scheme handler
+ * SUSPENDED, once its response has been handled: run the post_request
+ * and request_status hooks which the proxy handler left for later.
+ * @param r       the request, as resumed
+ * @param status  the status the scheme handler would have returned
+ * @return        the status to complete the request with
+ * @note A scheme handler returning SUSPENDED must call this once, when
+ * the request is resumed and before it is finalized.
+ */
+PROXY_DECLARE(int) ap_proxy_request_resumed(request_rec *r, int status);
+
 /**
  * Determine backend hostname and port
  * @param p       memory pool used for processing
@@ -1248,6 +1260,10 @@ PROXY_DECLARE(apr_status_t) ap_proxy_buckets_lifetime_transform(request_rec *r,
  * the bucket brigade bb_o which should be created from the bucket allocator
  * associated with c_o. In order to get the buckets from bb_i to bb_o
  * ap_proxy_buckets_lifetime_transform is used.
+ * Where splice(2) is available and neither connection has filters other
+ * than the core's (and mod_logio's) the data is moved between the sockets
+ * without being copied to user space, bb_i and bb_o are then unused. This
+ * can be disabled with the "proxy-nosplice" environment variable.
  *
  * @param r     request_rec of the actual request. Used for logging purposes
  * @param c_i   inbound connection conn_rec
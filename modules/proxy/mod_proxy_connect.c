@@ -372,6 +372,11 @@ static int proxy_connect_handler(request_rec *r, proxy_worker *worker,
     r->proto_input_filters = c->input_filters;
 /*    r->sent_bodyct = 1;*/
 
+    /* The tunnel has its own lifetime, and without any filter in the way
+     * the data can be spliced between the sockets.
+     */
+    ap_remove_input_filter_byhandle(c->input_filters, "reqtimeout");
+
     do { /* Loop until done (one side closes the connection, or an error) */
         rv = apr_pollset_poll(pollset, -1, &pollcnt, &signalled);
         if (rv != APR_SUCCESS) {
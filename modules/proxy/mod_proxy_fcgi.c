@@ -18,12 +18,114 @@
 #include "util_fcgi.h"
 #include "util_script.h"
 
+#include "ap_mpm.h"
+#include "apr_thread_cond.h"
+
 module AP_MODULE_DECLARE_DATA proxy_fcgi_module;
 
 typedef struct {
     int need_dirwalk;
 } fcgi_req_config_t;
 
+typedef struct {
+    int multiplex;              /* -1: unset, 0: off, 1: on */
+} fcgi_dirconf_t;
+
+/*
+ * Parameters which only depend on the virtual host, pre-encoded once per
+ * child (see fcgi_child_init), and sent as is whenever the request's
+ * values still match them.
+ */
+static const char *const static_env_keys[] = {
+    "SERVER_SOFTWARE",
+    "SERVER_ADMIN",
+    "GATEWAY_INTERFACE",
+    "PATH",
+    NULL
+};
+#define STATIC_ENV_COUNT 4
+
+typedef struct {
+    const char *vals[STATIC_ENV_COUNT];
+    char *encoded;
+    apr_size_t encoded_len;
+} fcgi_static_env_t;
+
+#if APR_HAS_THREADS
+/*
+ * Multiplexing of requests over shared FastCGI connections, for backends
+ * that advertise FCGI_MPXS_CONNS.  Each child keeps, per worker, a list
+ * of connections on which several requests are in flight at once, each
+ * with its own request id.  Writes are serialized per record, and the
+ * records read from the backend are demultiplexed by whichever request
+ * thread currently holds the "reader" role, into the queue of the
+ * request they belong to.
+ */
+#define FCGI_MUX_UNKNOWN 0
+#define FCGI_MUX_YES     1
+#define FCGI_MUX_NO      2
+
+/* Upper bound of concurrent requests per connection, whatever the backend
+ * announces in FCGI_MAX_REQS.
+ */
+#define FCGI_MUX_MAX_REQS 256
+
+/* Bytes of records received for a request and not consumed yet beyond
+ * which the request is failed, so that a slow client does not have its
+ * whole response buffered while other requests keep the connection read.
+ */
+#define FCGI_MUX_MAX_QUEUED (1024 * 1024)
+
+typedef struct fcgi_mux_conn_t fcgi_mux_conn_t;
+
+typedef struct fcgi_mux_rec_t {
+    struct fcgi_mux_rec_t *next;
+    apr_size_t len;             /* header + content + padding */
+    char data[1];
+} fcgi_mux_rec_t;
+
+typedef struct {
+    fcgi_mux_conn_t *mc;
+    apr_uint16_t id;
+    fcgi_mux_rec_t *first, *last; /* records received for this request */
+    apr_size_t offset;          /* already consumed from first */
+    apr_size_t queued;          /* total length of the records queued */
+    unsigned int ended:1;       /* FCGI_END_REQUEST received */
+    unsigned int overflow:1;    /* FCGI_MUX_MAX_QUEUED reached, failed */
+} fcgi_mux_req_t;
+
+typedef struct {
+    int state;                  /* FCGI_MUX_* */
+    fcgi_mux_conn_t *conns;
+} fcgi_mux_worker_t;
+
+struct fcgi_mux_conn_t {
+    fcgi_mux_conn_t *next;
+    fcgi_mux_worker_t *mw;
+    apr_pool_t *pool;
+    server_rec *s;
+    proxy_conn_rec *conn;       /* held for the whole life of the mux */
+    apr_thread_mutex_t *mutex;  /* protects what follows */
+    apr_thread_mutex_t *wmutex; /* serializes the writes of records */
+    apr_thread_cond_t *cond;    /* signaled when records are delivered */
+    fcgi_mux_req_t **reqs;      /* in flight, indexed by id - 1 */
+    int max_reqs;
+    int nreqs;
+    apr_status_t rstatus;       /* read error, if any */
+    unsigned int reading:1;     /* a request thread is reading records */
+    unsigned int broken:1;      /* no more requests, close when idle */
+};
+
+static apr_thread_mutex_t *mux_mutex;   /* protects mux_workers and lists */
+static apr_hash_t *mux_workers;         /* proxy_worker* -> mux worker */
+static apr_pool_t *mux_pool;
+
+static apr_status_t fcgi_mux_read(fcgi_mux_req_t *req, char *buffer,
+                                  apr_size_t *buflen);
+static apr_status_t fcgi_mux_send(fcgi_mux_req_t *req, struct iovec *vec,
+                                  int nvec, apr_size_t *len);
+#endif /* APR_HAS_THREADS */
+
 /*
  * Canonicalise http-like URLs.
  * scheme is the scheme for the URL
@@ -144,6 +246,12 @@ static apr_status_t send_data(proxy_conn_rec *conn,
     int i, offset;
     apr_socket_t *s = conn->sock;
 
+#if APR_HAS_THREADS
+    if (conn->data) {
+        return fcgi_mux_send(conn->data, vec, nvec, len);
+    }
+#endif
+
     for (i = 0; i < nvec; i++) {
         to_write += vec[i].iov_len;
     }
@@ -183,7 +291,15 @@ static apr_status_t get_data(proxy_conn_rec *conn,
                              char *buffer,
                              apr_size_t *buflen)
 {
-    apr_status_t rv = apr_socket_recv(conn->sock, buffer, buflen);
+    apr_status_t rv;
+
+#if APR_HAS_THREADS
+    if (conn->data) {
+        return fcgi_mux_read(conn->data, buffer, buflen);
+    }
+#endif
+
+    rv = apr_socket_recv(conn->sock, buffer, buflen);
 
     if (rv == APR_SUCCESS) {
         conn->worker->s->read += *buflen;
@@ -225,8 +341,10 @@ static apr_status_t send_begin_request(proxy_conn_rec *conn,
     ap_fcgi_fill_in_header(&header, AP_FCGI_BEGIN_REQUEST, request_id,
                            sizeof(abrb), 0);
 
+    /* Multiplexed connections (conn->data) are always kept open */
     ap_fcgi_fill_in_request_body(&brb, AP_FCGI_RESPONDER,
-                                 ap_proxy_connection_reusable(conn)
+                                 (conn->data
+                                  || ap_proxy_connection_reusable(conn))
                                      ? AP_FCGI_KEEP_CONN : 0);
 
     ap_fcgi_header_to_array(&header, farray);
@@ -240,20 +358,148 @@ static apr_status_t send_begin_request(proxy_conn_rec *conn,
     return send_data(conn, vec, 2, &len);
 }
 
+/* Largest name-value pair we send, and size of our FCGI_PARAMS records,
+ * which could have been up to AP_FCGI_MAX_CONTENT_LEN.
+ */
+#define FCGI_PARAMS_RECORD_LEN (16 * 1024)
+
+static APR_INLINE apr_size_t fcgi_pair_len(apr_size_t keylen,
+                                           apr_size_t vallen)
+{
+    return ((keylen >> 7 == 0) ? 1 : 4) + keylen
+           + ((vallen >> 7 == 0) ? 1 : 4) + vallen;
+}
+
+static APR_INLINE char *fcgi_len_encode(char *itr, apr_size_t len)
+{
+    if (len >> 7 == 0) {
+        *itr++ = len & 0xff;
+    }
+    else {
+        *itr++ = ((len >> 24) & 0xff) | 0x80;
+        *itr++ = ((len >> 16) & 0xff);
+        *itr++ = ((len >> 8) & 0xff);
+        *itr++ = ((len) & 0xff);
+    }
+    return itr;
+}
+
+static APR_INLINE int fcgi_len_decode(const unsigned char **pitr,
+                                      const unsigned char *end,
+                                      apr_size_t *len)
+{
+    const unsigned char *itr = *pitr;
+
+    if (itr >= end) {
+        return 0;
+    }
+    if (*itr & 0x80) {
+        if (end - itr < 4) {
+            return 0;
+        }
+        *len = ((apr_size_t)(itr[0] & 0x7f) << 24)
+               | ((apr_size_t)itr[1] << 16)
+               | ((apr_size_t)itr[2] << 8)
+               | (apr_size_t)itr[3];
+        itr += 4;
+    }
+    else {
+        *len = *itr++;
+    }
+    *pitr = itr;
+    return 1;
+}
+
+/* Length of the encoded name-value pair at itr, which is known to be
+ * well formed (we encoded it)
+ */
+static apr_size_t fcgi_encoded_pair_len(const char *itr, const char *end)
+{
+    const unsigned char *start = (const unsigned char *)itr, *uitr = start;
+    apr_size_t keylen = 0, vallen = 0;
+
+    fcgi_len_decode(&uitr, (const unsigned char *)end, &keylen);
+    fcgi_len_decode(&uitr, (const unsigned char *)end, &vallen);
+    return (uitr - start) + keylen + vallen;
+}
+
+static char *fcgi_pair_encode(char *itr, const char *key, apr_size_t keylen,
+                              const char *val, apr_size_t vallen)
+{
+    itr = fcgi_len_encode(itr, keylen);
+    itr = fcgi_len_encode(itr, vallen);
+    memcpy(itr, key, keylen);
+    itr += keylen;
+    memcpy(itr, val, vallen);
+    return itr + vallen;
+}
+
+static int is_static_env_key(const char *key)
+{
+    int i;
+
+    for (i = 0; static_env_keys[i]; ++i) {
+        if (!strcmp(key, static_env_keys[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void build_static_env(apr_pool_t *p, server_rec *s,
+                             fcgi_static_env_t *senv)
+{
+    const char *path = getenv("PATH");
+    apr_size_t len = 0;
+    char *itr;
+    int i;
+
+    /* Same values as ap_add_common_vars() and ap_add_cgi_vars() */
+    senv->vals[0] = ap_get_server_banner();
+    senv->vals[1] = s->server_admin;
+    senv->vals[2] = "CGI/1.1";
+    senv->vals[3] = path ? path : DEFAULT_PATH;
+
+    for (i = 0; i < STATIC_ENV_COUNT; ++i) {
+        apr_size_t pair_len;
+
+        if (!senv->vals[i]) {
+            return;
+        }
+        pair_len = fcgi_pair_len(strlen(static_env_keys[i]),
+                                 strlen(senv->vals[i]));
+        if (pair_len > FCGI_PARAMS_RECORD_LEN) {
+            return;
+        }
+        len += pair_len;
+    }
+
+    itr = senv->encoded = apr_palloc(p, len);
+    for (i = 0; i < STATIC_ENV_COUNT; ++i) {
+        itr = fcgi_pair_encode(itr, static_env_keys[i],
+                               strlen(static_env_keys[i]),
+                               senv->vals[i], strlen(senv->vals[i]));
+    }
+    senv->encoded_len = len;
+}
+
 static apr_status_t send_environment(proxy_conn_rec *conn, request_rec *r,
                                      apr_pool_t *temp_pool,
                                      apr_uint16_t request_id)
 {
     const apr_array_header_t *envarr;
     const apr_table_entry_t *elts;
-    struct iovec vec[2];
+    struct iovec *vec;
     ap_fcgi_header header;
-    unsigned char farray[AP_FCGI_HEADER_LEN];
-    char *body;
+    unsigned char *farray;
+    char *body, *itr;
     apr_status_t rv;
-    apr_size_t avail_len, len, required_len;
-    int next_elem, starting_elem;
+    apr_size_t len, body_len, pair_len, keylen, vallen;
+    int i, npairs, nvec;
+    int use_static = 0;
     fcgi_req_config_t *rconf = ap_get_module_config(r->request_config, &proxy_fcgi_module);
+    fcgi_static_env_t *senv = ap_get_module_config(r->server->module_config,
+                                                   &proxy_fcgi_module);
 
     if (rconf) { 
        if (rconf->need_dirwalk) { 
@@ -296,12 +542,25 @@ static apr_status_t send_environment(proxy_conn_rec *conn, request_rec *r,
      *     not to mention allocating a totally useless array in the first
      *     place, which would suck. */
 
+    /* The pre-encoded per vhost parameters can be used only if nothing
+     * (SetEnv PATH, ...) changed them for this request.
+     */
+    if (senv && senv->encoded) {
+        use_static = 1;
+        for (i = 0; static_env_keys[i]; ++i) {
+            const char *val = apr_table_get(r->subprocess_env,
+                                            static_env_keys[i]);
+            if (!val || strcmp(val, senv->vals[i])) {
+                use_static = 0;
+                break;
+            }
+        }
+    }
+
     envarr = apr_table_elts(r->subprocess_env);
     elts = (const apr_table_entry_t *) envarr->elts;
 
     if (APLOGrtrace8(r)) {
-        int i;
-        
         for (i = 0; i < envarr->nelts; ++i) {
             ap_log_rerror(APLOG_MARK, APLOG_TRACE8, 0, r, APLOGNO(01062)
                           "sending env var '%s' value '%s'",
@@ -309,66 +568,90 @@ static apr_status_t send_environment(proxy_conn_rec *conn, request_rec *r,
         }
     }
 
-    /* Send envvars over in as many FastCGI records as it takes, */
-    next_elem = 0; /* starting with the first one */
-
-    avail_len = 16 * 1024; /* our limit per record, which could have been up
-                            * to AP_FCGI_MAX_CONTENT_LEN
-                            */
-
-    while (next_elem < envarr->nelts) {
-        starting_elem = next_elem;
-        required_len = ap_fcgi_encoded_env_len(r->subprocess_env,
-                                               avail_len,
-                                               &next_elem);
+    /* Size the whole FCGI_PARAMS stream first, ... */
+    body_len = use_static ? senv->encoded_len : 0;
+    npairs = use_static ? STATIC_ENV_COUNT : 0;
+    for (i = 0; i < envarr->nelts; ++i) {
+        if (!elts[i].key || (use_static && is_static_env_key(elts[i].key))) {
+            continue;
+        }
+        pair_len = fcgi_pair_len(strlen(elts[i].key), strlen(elts[i].val));
+        if (pair_len > FCGI_PARAMS_RECORD_LEN) {
+            ap_log_rerror(APLOG_MARK, APLOG_WARNING, 0, r,
+                          APLOGNO(02536) "couldn't encode envvar '%s' in %"
+                          APR_SIZE_T_FMT " bytes",
+                          elts[i].key, (apr_size_t)FCGI_PARAMS_RECORD_LEN);
+            /* skip this envvar and continue */
+            continue;
+        }
+        body_len += pair_len;
+        ++npairs;
+    }
 
-        if (!required_len) {
-            if (next_elem < envarr->nelts) {
-                ap_log_rerror(APLOG_MARK, APLOG_WARNING, 0, r,
-                              APLOGNO(02536) "couldn't encode envvar '%s' in %"
-                              APR_SIZE_T_FMT " bytes",
-                              elts[next_elem].key, avail_len);
-                /* skip this envvar and continue */
-                ++next_elem;
-                continue;
+    /* ... then encode it in one go ... */
+    body = itr = apr_palloc(temp_pool, body_len);
+    if (use_static) {
+        memcpy(itr, senv->encoded, senv->encoded_len);
+        itr += senv->encoded_len;
+    }
+    for (i = 0; i < envarr->nelts; ++i) {
+        if (!elts[i].key || (use_static && is_static_env_key(elts[i].key))) {
+            continue;
+        }
+        keylen = strlen(elts[i].key);
+        vallen = strlen(elts[i].val);
+        if (fcgi_pair_len(keylen, vallen) > FCGI_PARAMS_RECORD_LEN) {
+            continue;
+        }
+        itr = fcgi_pair_encode(itr, elts[i].key, keylen,
+                               elts[i].val, vallen);
+    }
+    /* compute and encode must be in sync */
+    ap_assert(itr == body + body_len);
+
+    /* ... and send it over in as many FastCGI records as it takes,
+     * followed by the empty record which says we're done, with a single
+     * write.  Although the protocol allows splitting the params stream
+     * anywhere, records end on pair boundaries since some backends
+     * (PHP-FPM) parse each record on its own.  No pair is longer than a
+     * record, so there are at most npairs + 1 of them.
+     */
+    vec = apr_palloc(temp_pool, 2 * (npairs + 1) * sizeof(struct iovec));
+    farray = apr_palloc(temp_pool, (npairs + 1) * AP_FCGI_HEADER_LEN);
+    nvec = 0;
+    for (i = 0; ; ++i) {
+        apr_size_t rec_len = 0;
+
+        while (rec_len < body_len) {
+            pair_len = fcgi_encoded_pair_len(body + rec_len, body + body_len);
+            if (rec_len + pair_len > FCGI_PARAMS_RECORD_LEN) {
+                break;
             }
-            /* only an unused element at the end of the array */
-            break;
+            rec_len += pair_len;
         }
-
-        body = apr_palloc(temp_pool, required_len);
-        rv = ap_fcgi_encode_env(r, r->subprocess_env, body, required_len,
-                                &starting_elem);
-        /* we pre-compute, so we can't run out of space */
-        ap_assert(rv == APR_SUCCESS);
-        /* compute and encode must be in sync */
-        ap_assert(starting_elem == next_elem);
-
         ap_fcgi_fill_in_header(&header, AP_FCGI_PARAMS, request_id,
-                               (apr_uint16_t)required_len, 0);
-        ap_fcgi_header_to_array(&header, farray);
-
-        vec[0].iov_base = (void *)farray;
-        vec[0].iov_len = sizeof(farray);
-        vec[1].iov_base = body;
-        vec[1].iov_len = required_len;
-
-        rv = send_data(conn, vec, 2, &len);
-        apr_pool_clear(temp_pool);
-
-        if (rv) {
-            return rv;
+                               (apr_uint16_t)rec_len, 0);
+        ap_fcgi_header_to_array(&header, farray + i * AP_FCGI_HEADER_LEN);
+
+        vec[nvec].iov_base = (void *)(farray + i * AP_FCGI_HEADER_LEN);
+        vec[nvec].iov_len = AP_FCGI_HEADER_LEN;
+        ++nvec;
+        if (rec_len) {
+            vec[nvec].iov_base = body;
+            vec[nvec].iov_len = rec_len;
+            ++nvec;
+            body += rec_len;
+            body_len -= rec_len;
+        }
+        else {
+            break;
         }
     }
 
-    /* Envvars sent, so say we're done */
-    ap_fcgi_fill_in_header(&header, AP_FCGI_PARAMS, request_id, 0, 0);
-    ap_fcgi_header_to_array(&header, farray);
-
-    vec[0].iov_base = (void *)farray;
-    vec[0].iov_len = sizeof(farray);
+    rv = send_data(conn, vec, nvec, &len);
+    apr_pool_clear(temp_pool);
 
-    return send_data(conn, vec, 1, &len);
+    return rv;
 }
 
 enum {
@@ -477,17 +760,27 @@ static apr_status_t dispatch(proxy_conn_rec *conn, proxy_dir_conf *conf,
         apr_size_t len;
         int n;
 
-        /* We need SOME kind of timeout here, or virtually anything will
-         * cause timeout errors. */
-        apr_socket_timeout_get(conn->sock, &timeout);
+        if (conn->data) {
+            /* Multiplexed connection: the socket is shared, so send all
+             * of the request body first, then read the records which were
+             * demultiplexed for us (get_data() blocks until they come).
+             */
+            pfd.rtnevents = (pfd.reqevents & APR_POLLOUT) ? APR_POLLOUT
+                                                          : APR_POLLIN;
+        }
+        else {
+            /* We need SOME kind of timeout here, or virtually anything
+             * will cause timeout errors. */
+            apr_socket_timeout_get(conn->sock, &timeout);
 
-        rv = apr_poll(&pfd, 1, &n, timeout);
-        if (rv != APR_SUCCESS) {
-            if (APR_STATUS_IS_EINTR(rv)) {
-                continue;
+            rv = apr_poll(&pfd, 1, &n, timeout);
+            if (rv != APR_SUCCESS) {
+                if (APR_STATUS_IS_EINTR(rv)) {
+                    continue;
+                }
+                *err = "polling";
+                break;
             }
-            *err = "polling";
-            break;
         }
 
         if (pfd.rtnevents & APR_POLLOUT) {
@@ -822,10 +1115,10 @@ static int fcgi_do_request(apr_pool_t *p, request_rec *r,
                            char *url, char *server_portstr)
 {
     /* Request IDs are arbitrary numbers that we assign to a
-     * single request. This would allow multiplex/pipelining of
-     * multiple requests to the same FastCGI connection, but
-     * we don't support that, and always use a value of '1' to
-     * keep things simple. */
+     * single request. This allows multiplexing of multiple requests
+     * to the same FastCGI connection, which we do only when the
+     * connection is shared (conn->data), otherwise we always use a
+     * value of '1' to keep things simple. */
     apr_uint16_t request_id = 1;
     apr_status_t rv;
     apr_pool_t *temp_pool;
@@ -833,6 +1126,12 @@ static int fcgi_do_request(apr_pool_t *p, request_rec *r,
     int bad_request = 0,
         has_responded = 0;
 
+#if APR_HAS_THREADS
+    if (conn->data) {
+        request_id = ((fcgi_mux_req_t *)conn->data)->id;
+    }
+#endif
+
     /* Step 1: Send AP_FCGI_BEGIN_REQUEST */
     rv = send_begin_request(conn, request_id);
     if (rv != APR_SUCCESS) {
@@ -888,6 +1187,555 @@ static int fcgi_do_request(apr_pool_t *p, request_rec *r,
 
 #define FCGI_SCHEME "FCGI"
 
+#if APR_HAS_THREADS
+
+/* Used when the backend multiplexes without announcing FCGI_MAX_REQS */
+#define FCGI_MUX_DEFAULT_REQS 16
+
+/*
+ * Ask the backend (FCGI_GET_VALUES) whether it can multiplex requests on
+ * a connection, and how many.  Any failure means it can't; the backend is
+ * given the worker's ping timeout (or one second) to answer.
+ */
+static void fcgi_mux_probe(proxy_conn_rec *conn, request_rec *r,
+                           int *mpxs, apr_uint16_t *max_reqs)
+{
+    struct iovec vec[2];
+    ap_fcgi_header header;
+    unsigned char farray[AP_FCGI_HEADER_LEN];
+    char body[64], *itr = body;
+    unsigned char *content = NULL;
+    const unsigned char *cur, *end;
+    unsigned char version, type, plen;
+    apr_uint16_t clen, rid;
+    apr_interval_time_t old_timeout;
+    apr_size_t len, klen, vlen;
+    apr_status_t rv;
+
+    *mpxs = 0;
+    *max_reqs = FCGI_MUX_DEFAULT_REQS;
+
+    itr = fcgi_pair_encode(itr, "FCGI_MPXS_CONNS", 15, "", 0);
+    itr = fcgi_pair_encode(itr, "FCGI_MAX_REQS", 13, "", 0);
+
+    ap_fcgi_fill_in_header(&header, AP_FCGI_GET_VALUES, 0,
+                           (apr_uint16_t)(itr - body), 0);
+    ap_fcgi_header_to_array(&header, farray);
+    vec[0].iov_base = (void *)farray;
+    vec[0].iov_len = sizeof(farray);
+    vec[1].iov_base = body;
+    vec[1].iov_len = itr - body;
+
+    apr_socket_timeout_get(conn->sock, &old_timeout);
+    apr_socket_timeout_set(conn->sock, conn->worker->s->ping_timeout_set
+                                       ? conn->worker->s->ping_timeout
+                                       : apr_time_from_sec(1));
+
+    rv = send_data(conn, vec, 2, &len);
+    if (rv == APR_SUCCESS) {
+        rv = get_data_full(conn, (char *)farray, AP_FCGI_HEADER_LEN);
+    }
+    if (rv == APR_SUCCESS) {
+        ap_fcgi_header_fields_from_array(&version, &type, &rid,
+                                         &clen, &plen, farray);
+        if (version != AP_FCGI_VERSION_1
+                || type != AP_FCGI_GET_VALUES_RESULT || rid != 0) {
+            rv = APR_EINVAL;
+        }
+        else if (clen + plen) {
+            content = apr_palloc(r->pool, clen + plen);
+            rv = get_data_full(conn, (char *)content, clen + plen);
+        }
+    }
+
+    apr_socket_timeout_set(conn->sock, old_timeout);
+
+    if (rv != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, rv, r, APLOGNO(03477)
+                      "FCGI_GET_VALUES failed for %s, not multiplexing",
+                      conn->worker->s->name);
+        return;
+    }
+
+    cur = content;
+    end = content + clen;
+    while (content && fcgi_len_decode(&cur, end, &klen)
+                   && fcgi_len_decode(&cur, end, &vlen)
+                   && (apr_size_t)(end - cur) >= klen + vlen) {
+        const char *val = apr_pstrmemdup(r->pool, (const char *)cur + klen,
+                                         vlen);
+
+        if (klen == 15 && !memcmp(cur, "FCGI_MPXS_CONNS", 15)) {
+            *mpxs = (atoi(val) == 1);
+        }
+        else if (klen == 13 && !memcmp(cur, "FCGI_MAX_REQS", 13)) {
+            int n = atoi(val);
+            if (n > 0) {
+                *max_reqs = (n < FCGI_MUX_MAX_REQS) ? n : FCGI_MUX_MAX_REQS;
+            }
+        }
+        cur += klen + vlen;
+    }
+
+    ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(03478)
+                  "%s: FCGI_MPXS_CONNS=%d, using up to %d requests "
+                  "per connection", conn->worker->s->name, *mpxs,
+                  (int)*max_reqs);
+}
+
+static void fcgi_mux_conn_destroy(fcgi_mux_conn_t *mc)
+{
+    mc->conn->close = 1;
+    ap_proxy_release_connection(FCGI_SCHEME, mc->conn, mc->s);
+    apr_pool_destroy(mc->pool);
+}
+
+/*
+ * Open a new shared connection to the worker (probing the backend the
+ * first time), returns DECLINED if the backend can't multiplex.
+ */
+static int fcgi_mux_conn_create(request_rec *r, proxy_worker *worker,
+                                proxy_server_conf *conf, char *url,
+                                const char *proxyname, apr_port_t proxyport,
+                                fcgi_mux_worker_t *mw, fcgi_mux_conn_t **pmc)
+{
+    proxy_conn_rec *backend = NULL;
+    char server_portstr[32];
+    apr_uri_t *uri;
+    apr_uint16_t max_reqs;
+    fcgi_mux_conn_t *mc;
+    apr_pool_t *pool;
+    int status, mpxs;
+
+    status = ap_proxy_acquire_connection(FCGI_SCHEME, &backend, worker,
+                                         r->server);
+    if (status != OK) {
+        if (backend) {
+            backend->close = 1;
+            ap_proxy_release_connection(FCGI_SCHEME, backend, r->server);
+        }
+        return status;
+    }
+
+    backend->is_ssl = 0;
+    backend->close = 0;
+
+    uri = apr_palloc(r->pool, sizeof(*uri));
+    status = ap_proxy_determine_connection(r->pool, r, conf, worker, backend,
+                                           uri, &url, proxyname, proxyport,
+                                           server_portstr,
+                                           sizeof(server_portstr));
+    if (status == OK
+            && ap_proxy_check_connection(FCGI_SCHEME, backend, r->server, 0,
+                                         PROXY_CHECK_CONN_EMPTY)
+            && ap_proxy_connect_backend(FCGI_SCHEME, backend, worker,
+                                        r->server)) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(03479)
+                      "failed to make connection to backend: %s",
+                      backend->hostname);
+        status = HTTP_SERVICE_UNAVAILABLE;
+    }
+    if (status != OK) {
+        backend->close = 1;
+        ap_proxy_release_connection(FCGI_SCHEME, backend, r->server);
+        return status;
+    }
+
+    fcgi_mux_probe(backend, r, &mpxs, &max_reqs);
+
+    apr_thread_mutex_lock(mux_mutex);
+    mw->state = mpxs ? FCGI_MUX_YES : FCGI_MUX_NO;
+    apr_thread_mutex_unlock(mux_mutex);
+
+    if (!mpxs) {
+        backend->close = 1;
+        ap_proxy_release_connection(FCGI_SCHEME, backend, r->server);
+        return DECLINED;
+    }
+
+    /* Not tied to any request or connection pool, the last request to
+     * leave a broken connection destroys it.
+     */
+    apr_pool_create(&pool, NULL);
+    apr_pool_tag(pool, "proxy_fcgi_mux");
+    mc = apr_pcalloc(pool, sizeof(*mc));
+    mc->pool = pool;
+    mc->mw = mw;
+    mc->s = r->server;
+    mc->conn = backend;
+    mc->max_reqs = max_reqs;
+    mc->reqs = apr_pcalloc(pool, max_reqs * sizeof(*mc->reqs));
+    apr_thread_mutex_create(&mc->mutex, APR_THREAD_MUTEX_DEFAULT, pool);
+    apr_thread_mutex_create(&mc->wmutex, APR_THREAD_MUTEX_DEFAULT, pool);
+    apr_thread_cond_create(&mc->cond, pool);
+
+    *pmc = mc;
+    return OK;
+}
+
+/* Take a request id on mc, called with mc->mutex held */
+static int fcgi_mux_take_id(fcgi_mux_conn_t *mc, fcgi_mux_req_t *req)
+{
+    int i;
+
+    for (i = 0; i < mc->max_reqs; ++i) {
+        if (!mc->reqs[i]) {
+            mc->reqs[i] = req;
+            mc->nreqs++;
+            req->mc = mc;
+            req->id = (apr_uint16_t)(i + 1);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Find (or open) a shared connection with room for one more request and
+ * attach r to it.  Returns DECLINED when the backend can't multiplex.
+ */
+static int fcgi_mux_attach(request_rec *r, proxy_worker *worker,
+                           proxy_server_conf *conf, char *url,
+                           const char *proxyname, apr_port_t proxyport,
+                           fcgi_mux_req_t **preq)
+{
+    fcgi_mux_worker_t *mw;
+    fcgi_mux_conn_t *mc, **pmc, *dead = NULL;
+    fcgi_mux_req_t *req = apr_pcalloc(r->pool, sizeof(*req));
+    int status;
+
+    apr_thread_mutex_lock(mux_mutex);
+
+    mw = apr_hash_get(mux_workers, &worker, sizeof(worker));
+    if (!mw) {
+        proxy_worker **key = apr_palloc(mux_pool, sizeof(*key));
+        *key = worker;
+        mw = apr_pcalloc(mux_pool, sizeof(*mw));
+        apr_hash_set(mux_workers, key, sizeof(*key), mw);
+    }
+    if (mw->state == FCGI_MUX_NO) {
+        apr_thread_mutex_unlock(mux_mutex);
+        return DECLINED;
+    }
+
+    pmc = &mw->conns;
+    while ((mc = *pmc)) {
+        int attached = 0;
+
+        apr_thread_mutex_lock(mc->mutex);
+        if (!mc->broken && !mc->nreqs
+                && !ap_proxy_is_socket_connected(mc->conn->sock)) {
+            /* closed by the backend while idle */
+            mc->broken = 1;
+        }
+        if (!mc->broken) {
+            attached = fcgi_mux_take_id(mc, req);
+        }
+        else if (!mc->nreqs) {
+            *pmc = mc->next;
+            mc->next = dead;
+            dead = mc;
+        }
+        apr_thread_mutex_unlock(mc->mutex);
+
+        if (attached) {
+            break;
+        }
+        if (mc != dead) {
+            pmc = &mc->next;
+        }
+    }
+
+    apr_thread_mutex_unlock(mux_mutex);
+
+    while ((mc = dead)) {
+        dead = mc->next;
+        fcgi_mux_conn_destroy(mc);
+    }
+
+    if (!req->mc) {
+        status = fcgi_mux_conn_create(r, worker, conf, url, proxyname,
+                                      proxyport, mw, &mc);
+        if (status != OK) {
+            return status;
+        }
+        fcgi_mux_take_id(mc, req);
+
+        apr_thread_mutex_lock(mux_mutex);
+        mc->next = mw->conns;
+        mw->conns = mc;
+        apr_thread_mutex_unlock(mux_mutex);
+    }
+
+    ap_log_rerror(APLOG_MARK, APLOG_TRACE2, 0, r,
+                  "FCGI: multiplexing request as id %d on %pp",
+                  (int)req->id, req->mc);
+    *preq = req;
+    return OK;
+}
+
+static void fcgi_mux_detach(fcgi_mux_req_t *req)
+{
+    fcgi_mux_conn_t *mc = req->mc, **pmc;
+    fcgi_mux_rec_t *rec;
+    int destroy = 0;
+
+    apr_thread_mutex_lock(mux_mutex);
+    apr_thread_mutex_lock(mc->mutex);
+
+    mc->reqs[req->id - 1] = NULL;
+    mc->nreqs--;
+    if (!req->ended) {
+        /* Anything the backend still sends for this id would be taken
+         * for the next request's, this connection can't be used anymore.
+         */
+        mc->broken = 1;
+    }
+    while ((rec = req->first)) {
+        req->first = rec->next;
+        free(rec);
+    }
+    req->last = NULL;
+    req->queued = 0;
+
+    if (mc->broken && !mc->nreqs) {
+        for (pmc = &mc->mw->conns; *pmc; pmc = &(*pmc)->next) {
+            if (*pmc == mc) {
+                *pmc = mc->next;
+                break;
+            }
+        }
+        destroy = 1;
+    }
+
+    apr_thread_mutex_unlock(mc->mutex);
+    apr_thread_mutex_unlock(mux_mutex);
+
+    if (destroy) {
+        fcgi_mux_conn_destroy(mc);
+    }
+}
+
+/* Read a whole record from the shared socket, by the reader only */
+static apr_status_t fcgi_mux_read_record(fcgi_mux_conn_t *mc,
+                                         fcgi_mux_rec_t **prec,
+                                         apr_uint16_t *rid,
+                                         unsigned char *type)
+{
+    unsigned char farray[AP_FCGI_HEADER_LEN];
+    unsigned char version, plen;
+    apr_uint16_t clen;
+    fcgi_mux_rec_t *rec;
+    apr_status_t rv;
+
+    rv = get_data_full(mc->conn, (char *)farray, AP_FCGI_HEADER_LEN);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    ap_fcgi_header_fields_from_array(&version, type, rid, &clen, &plen,
+                                     farray);
+    if (version != AP_FCGI_VERSION_1) {
+        return APR_EINVAL;
+    }
+
+    rec = malloc(APR_OFFSETOF(fcgi_mux_rec_t, data)
+                 + AP_FCGI_HEADER_LEN + clen + plen);
+    if (!rec) {
+        return APR_ENOMEM;
+    }
+    rec->next = NULL;
+    rec->len = AP_FCGI_HEADER_LEN + clen + plen;
+    memcpy(rec->data, farray, AP_FCGI_HEADER_LEN);
+    if (clen + plen) {
+        rv = get_data_full(mc->conn, rec->data + AP_FCGI_HEADER_LEN,
+                           clen + plen);
+        if (rv != APR_SUCCESS) {
+            free(rec);
+            return rv;
+        }
+    }
+
+    *prec = rec;
+    return APR_SUCCESS;
+}
+
+/*
+ * get_data() for multiplexed requests: return the bytes of the records
+ * demultiplexed for req, reading the socket ourselves if no other request
+ * does it already.
+ */
+static apr_status_t fcgi_mux_read(fcgi_mux_req_t *req, char *buffer,
+                                  apr_size_t *buflen)
+{
+    fcgi_mux_conn_t *mc = req->mc;
+    fcgi_mux_rec_t *rec;
+    apr_interval_time_t timeout;
+    apr_time_t deadline;
+    apr_status_t rv = APR_SUCCESS;
+    apr_size_t len;
+
+    apr_socket_timeout_get(mc->conn->sock, &timeout);
+    deadline = apr_time_now() + timeout;
+
+    apr_thread_mutex_lock(mc->mutex);
+    while (!req->first && !req->overflow) {
+        if (mc->rstatus != APR_SUCCESS) {
+            rv = mc->rstatus;
+            break;
+        }
+        if (!mc->reading) {
+            apr_uint16_t rid;
+            unsigned char type;
+
+            mc->reading = 1;
+            apr_thread_mutex_unlock(mc->mutex);
+            rv = fcgi_mux_read_record(mc, &rec, &rid, &type);
+            apr_thread_mutex_lock(mc->mutex);
+            mc->reading = 0;
+
+            if (rv != APR_SUCCESS) {
+                mc->rstatus = rv;
+                mc->broken = 1;
+            }
+            else if (rid == 0 || rid > mc->max_reqs || !mc->reqs[rid - 1]) {
+                /* management record, or the request has gone */
+                ap_log_error(APLOG_MARK, APLOG_TRACE2, 0, mc->s,
+                             "FCGI: dropping record type %d for id %d",
+                             (int)type, (int)rid);
+                free(rec);
+            }
+            else {
+                fcgi_mux_req_t *owner = mc->reqs[rid - 1];
+                fcgi_mux_rec_t *dropped;
+
+                if (type == AP_FCGI_END_REQUEST) {
+                    owner->ended = 1;
+                }
+                if (!owner->overflow
+                        && owner->queued + rec->len > FCGI_MUX_MAX_QUEUED) {
+                    ap_log_error(APLOG_MARK, APLOG_ERR, 0, mc->s,
+                                 APLOGNO(03533) "FCGI: more than %d bytes "
+                                 "of response pending for request id %d, "
+                                 "failing it", FCGI_MUX_MAX_QUEUED,
+                                 (int)rid);
+                    owner->overflow = 1;
+                    while ((dropped = owner->first)) {
+                        owner->first = dropped->next;
+                        free(dropped);
+                    }
+                    owner->last = NULL;
+                    owner->offset = 0;
+                    owner->queued = 0;
+                }
+                if (owner->overflow) {
+                    /* what the backend still sends for it is dropped */
+                    free(rec);
+                }
+                else {
+                    if (owner->last) {
+                        owner->last->next = rec;
+                    }
+                    else {
+                        owner->first = rec;
+                    }
+                    owner->last = rec;
+                    owner->queued += rec->len;
+                }
+            }
+            /* wake up the owner, and someone to take over reading */
+            apr_thread_cond_broadcast(mc->cond);
+        }
+        else if (timeout < 0) {
+            apr_thread_cond_wait(mc->cond, mc->mutex);
+        }
+        else {
+            apr_interval_time_t left = deadline - apr_time_now();
+            if (left <= 0) {
+                rv = APR_TIMEUP;
+                break;
+            }
+            apr_thread_cond_timedwait(mc->cond, mc->mutex, left);
+        }
+    }
+
+    if (req->first) {
+        rec = req->first;
+        len = rec->len - req->offset;
+        if (len > *buflen) {
+            len = *buflen;
+        }
+        memcpy(buffer, rec->data + req->offset, len);
+        req->offset += len;
+        if (req->offset == rec->len) {
+            req->first = rec->next;
+            if (!req->first) {
+                req->last = NULL;
+            }
+            req->offset = 0;
+            req->queued -= rec->len;
+            free(rec);
+        }
+        *buflen = len;
+        rv = APR_SUCCESS;
+    }
+    else if (req->overflow) {
+        rv = APR_ENOSPC;
+    }
+    apr_thread_mutex_unlock(mc->mutex);
+
+    return rv;
+}
+
+/* send_data() for multiplexed requests, whole records at once */
+static apr_status_t fcgi_mux_send(fcgi_mux_req_t *req, struct iovec *vec,
+                                  int nvec, apr_size_t *len)
+{
+    fcgi_mux_conn_t *mc = req->mc;
+    apr_status_t rv;
+
+    apr_thread_mutex_lock(mc->wmutex);
+    rv = send_data(mc->conn, vec, nvec, len);
+    apr_thread_mutex_unlock(mc->wmutex);
+
+    if (rv != APR_SUCCESS) {
+        /* a partial record may have been written */
+        apr_thread_mutex_lock(mc->mutex);
+        mc->broken = 1;
+        apr_thread_mutex_unlock(mc->mutex);
+    }
+    return rv;
+}
+
+static int fcgi_mux_handler(request_rec *r, proxy_worker *worker,
+                            proxy_server_conf *conf, char *url,
+                            const char *proxyname, apr_port_t proxyport,
+                            proxy_dir_conf *dconf)
+{
+    fcgi_mux_req_t *req = NULL;
+    proxy_conn_rec *conn;
+    int status;
+
+    status = fcgi_mux_attach(r, worker, conf, url, proxyname, proxyport,
+                             &req);
+    if (status != OK) {
+        return status;
+    }
+
+    /* A per request copy of the shared connection, so that the I/O
+     * helpers find the request's state in conn->data.
+     */
+    conn = apr_pmemdup(r->pool, req->mc->conn, sizeof(*conn));
+    conn->data = req;
+
+    status = fcgi_do_request(r->pool, r, conn, NULL, dconf, NULL, url,
+                             worker->s->name);
+
+    fcgi_mux_detach(req);
+    return status;
+}
+
+#endif /* APR_HAS_THREADS */
+
 /*
  * This handles fcgi:(dest) URLs
  */
@@ -919,6 +1767,20 @@ static int proxy_fcgi_handler(request_rec *r, proxy_worker *worker,
 
     ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(01078) "serving URL %s", url);
 
+#if APR_HAS_THREADS
+    if (mux_mutex) {
+        fcgi_dirconf_t *fconf = ap_get_module_config(r->per_dir_config,
+                                                     &proxy_fcgi_module);
+        if (fconf->multiplex == 1) {
+            status = fcgi_mux_handler(r, worker, conf, url, proxyname,
+                                      proxyport, dconf);
+            if (status != DECLINED) {
+                return status;
+            }
+        }
+    }
+#endif
+
     /* Create space for state information */
     status = ap_proxy_acquire_connection(FCGI_SCHEME, &backend, worker,
                                          r->server);
@@ -973,18 +1835,80 @@ cleanup:
     return status;
 }
 
+static void fcgi_child_init(apr_pool_t *pchild, server_rec *s)
+{
+#if APR_HAS_THREADS
+    int threaded = 0;
+
+    ap_mpm_query(AP_MPMQ_IS_THREADED, &threaded);
+    if (threaded && apr_thread_mutex_create(&mux_mutex,
+                                            APR_THREAD_MUTEX_DEFAULT,
+                                            pchild) == APR_SUCCESS) {
+        mux_workers = apr_hash_make(pchild);
+        mux_pool = pchild;
+    }
+#endif
+
+    for (; s; s = s->next) {
+        fcgi_static_env_t *senv = ap_get_module_config(s->module_config,
+                                                       &proxy_fcgi_module);
+        build_static_env(pchild, s, senv);
+    }
+}
+
+static void *create_fcgi_server_config(apr_pool_t *p, server_rec *s)
+{
+    return apr_pcalloc(p, sizeof(fcgi_static_env_t));
+}
+
+static void *create_fcgi_dir_config(apr_pool_t *p, char *path)
+{
+    fcgi_dirconf_t *a = apr_pcalloc(p, sizeof(fcgi_dirconf_t));
+
+    a->multiplex = -1;
+    return a;
+}
+
+static void *merge_fcgi_dir_config(apr_pool_t *p, void *basev, void *overridesv)
+{
+    fcgi_dirconf_t *a = apr_pcalloc(p, sizeof(fcgi_dirconf_t));
+    fcgi_dirconf_t *base = (fcgi_dirconf_t *)basev;
+    fcgi_dirconf_t *over = (fcgi_dirconf_t *)overridesv;
+
+    a->multiplex = (over->multiplex != -1) ? over->multiplex
+                                           : base->multiplex;
+    return a;
+}
+
+static const char *cmd_multiplex(cmd_parms *cmd, void *cfg, int flag)
+{
+    fcgi_dirconf_t *dconf = cfg;
+
+    dconf->multiplex = flag;
+    return NULL;
+}
+
+static const command_rec command_table[] = {
+    AP_INIT_FLAG("ProxyFCGIMultiplex", cmd_multiplex, NULL,
+                 RSRC_CONF|ACCESS_CONF,
+                 "Share connections between concurrent requests when the "
+                 "FastCGI backend supports it (FCGI_MPXS_CONNS)"),
+    {NULL}
+};
+
 static void register_hooks(apr_pool_t *p)
 {
     proxy_hook_scheme_handler(proxy_fcgi_handler, NULL, NULL, APR_HOOK_FIRST);
     proxy_hook_canon_handler(proxy_fcgi_canon, NULL, NULL, APR_HOOK_FIRST);
+    ap_hook_child_init(fcgi_child_init, NULL, NULL, APR_HOOK_MIDDLE);
 }
 
 AP_DECLARE_MODULE(proxy_fcgi) = {
     STANDARD20_MODULE_STUFF,
-    NULL,                       /* create per-directory config structure */
-    NULL,                       /* merge per-directory config structures */
-    NULL,                       /* create per-server config structure */
+    create_fcgi_dir_config,     /* create per-directory config structure */
+    merge_fcgi_dir_config,      /* merge per-directory config structures */
+    create_fcgi_server_config,  /* create per-server config structure */
     NULL,                       /* merge per-server config structures */
-    NULL,                       /* command apr_table_t */
+    command_table,              /* command apr_table_t */
     register_hooks              /* register hooks */
 };
@@ -17,6 +17,7 @@
 #include "mod_watchdog.h"
 #include "ap_slotmem.h"
 #include "ap_expr.h"
+#include "apr_poll.h"
 #if APR_HAS_THREADS
 #include "apr_thread_pool.h"
 #endif
@@ -26,6 +27,18 @@ module AP_MODULE_DECLARE_DATA proxy_hcheck_module;
 #define HCHECK_WATHCHDOG_NAME ("_proxy_hcheck_")
 #define HC_THREADPOOL_SIZE (16)
 
+/* Non-blocking probes multiplexed by the watchdog at once */
+#define HC_MAX_PROBES (1024)
+/* Most of a response we read for a GET check */
+#define HC_MAX_RESPONSE (HUGE_STRING_LEN * 8)
+/* Schedules are spread by +/- this percentage of the interval */
+#define HC_JITTER_PERCENT (10)
+/* ProxyHCAdaptive: consecutive passes before doubling the interval of a
+ * healthy worker, up to interval << HC_MAX_BACKOFF
+ */
+#define HC_STABLE_CHECKS (5)
+#define HC_MAX_BACKOFF (2)
+
 /* Why? So we can easily set/clear HC_USE_THREADS during dev testing */
 #if APR_HAS_THREADS
 #define HC_USE_THREADS 1
@@ -49,6 +62,8 @@ typedef struct {
     ap_expr_info_t *pexpr;       /* parsed expression */
 } hc_condition_t;
 
+typedef struct hc_probe_t hc_probe_t;
+
 typedef struct {
     apr_pool_t *p;
     apr_bucket_alloc_t *ba;
@@ -58,6 +73,10 @@ typedef struct {
     apr_hash_t *hcworkers;
     apr_thread_pool_t *hctp;
     int tpsize;
+    int adaptive;
+    apr_pollset_t *pollset;     /* non-blocking probes, see hc_probe_start */
+    hc_probe_t *probes;         /* in flight */
+    int nprobes;
     server_rec *s;
 } sctx_t;
 
@@ -66,15 +85,36 @@ typedef struct {
     char *path;      /* The path of the original worker URL */
     char *req;       /* pre-formatted HTTP/AJP request */
     proxy_worker *w; /* Pointer to the actual worker */
+    apr_time_t next;            /* when the next check is due */
+    int stable;                 /* consecutive passes while healthy */
+    int backoff;                /* ProxyHCAdaptive interval shift */
+    volatile int running;       /* a check is in progress */
 } wctx_t;
 
 typedef struct {
     apr_pool_t *ptemp;
     sctx_t *ctx;
     proxy_worker *worker;
+    proxy_worker *hc;           /* its health check worker */
     apr_time_t now;
 } baton_t;
 
+/* A health check run by the watchdog thread without blocking */
+struct hc_probe_t {
+    hc_probe_t *next;
+    baton_t *baton;
+    proxy_worker *hc;
+    const char *method;         /* NULL for TCP checks */
+    apr_socket_t *sock;
+    apr_pollfd_t pfd;
+    int connected;
+    const char *out;            /* request to send */
+    apr_size_t outlen;
+    char *buf;                  /* response read so far */
+    apr_size_t len;
+    apr_time_t deadline;
+};
+
 static void *hc_create_config(apr_pool_t *p, server_rec *s)
 {
     sctx_t *ctx = (sctx_t *) apr_palloc(p, sizeof(sctx_t));
@@ -84,6 +124,10 @@ static void *hc_create_config(apr_pool_t *p, server_rec *s)
     ctx->conditions = apr_table_make(p, 10);
     ctx->hcworkers = apr_hash_make(p);
     ctx->tpsize = HC_THREADPOOL_SIZE;
+    ctx->adaptive = 0;
+    ctx->pollset = NULL;
+    ctx->probes = NULL;
+    ctx->nprobes = 0;
     ctx->s = s;
 
     return ctx;
@@ -326,6 +370,20 @@ static const char *set_hc_tpsize (cmd_parms *cmd, void *dummy, const char *arg)
 }
 #endif
 
+static const char *set_hc_adaptive(cmd_parms *cmd, void *dummy, int flag)
+{
+    sctx_t *ctx;
+
+    const char *err = ap_check_cmd_context(cmd, NOT_IN_HTACCESS);
+    if (err)
+        return err;
+    ctx = (sctx_t *) ap_get_module_config(cmd->server->module_config,
+                                          &proxy_hcheck_module);
+
+    ctx->adaptive = flag;
+    return NULL;
+}
+
 /*
  * Create a dummy request rec, simply so we can use ap_expr.
  * Use our short-lived poll for bucket_alloc
@@ -406,9 +464,12 @@ static proxy_worker *hc_get_hcworker(sctx_t *ctx, proxy_worker *worker,
 {
     proxy_worker *hc = NULL;
     const char* wptr;
+    char wbuf[64];
     apr_port_t port;
 
-    wptr = apr_psprintf(ctx->p, "%pp", worker);
+    /* Looked up for every worker at each watchdog run, so don't allocate */
+    apr_snprintf(wbuf, sizeof(wbuf), "%pp", worker);
+    wptr = wbuf;
     hc = (proxy_worker *)apr_hash_get(ctx->hcworkers, wptr, APR_HASH_KEY_STRING);
     port = (worker->s->port ? worker->s->port : ap_proxy_port_of_scheme(worker->s->scheme));
     if (!hc) {
@@ -417,6 +478,8 @@ static proxy_worker *hc_get_hcworker(sctx_t *ctx, proxy_worker *worker,
         const char *url = worker->s->name;
         wctx_t *wctx = apr_pcalloc(ctx->p, sizeof(wctx_t));
 
+        wptr = apr_pstrdup(ctx->p, wbuf);
+
         ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, ctx->s, APLOGNO(03248)
                      "Creating hc worker %s for %s://%s:%d",
                      wptr, worker->s->scheme, worker->s->hostname,
@@ -455,7 +518,8 @@ static proxy_worker *hc_get_hcworker(sctx_t *ctx, proxy_worker *worker,
                      wptr, worker->s->scheme, worker->s->hostname,
                      (int)port);
         hc->s->method = worker->s->method;
-        apr_hash_set(ctx->hcworkers, wptr, APR_HASH_KEY_STRING, hc);
+        /* the pre-formatted request is method specific */
+        ((wctx_t *)hc->context)->req = NULL;
     }
     return hc;
 }
@@ -675,37 +739,14 @@ static int hc_read_body (sctx_t *ctx, request_rec *r)
 }
 
 /*
- * Send the HTTP OPTIONS, HEAD or GET request to the backend
- * server associated w/ worker. If we have Conditions,
- * then apply those to the resulting response, otherwise
- * any status code 2xx or 3xx is considered "passing"
+ * Pre-format (once) the request of hc's OPTIONS, HEAD or GET check,
+ * returns the method or NULL if hc uses none of them.
  */
-static apr_status_t hc_check_http(sctx_t *ctx, apr_pool_t *ptemp, proxy_worker *worker)
+static const char *hc_prepare_request(sctx_t *ctx, proxy_worker *hc)
 {
-    int status;
-    proxy_conn_rec *backend = NULL;
-    proxy_worker *hc;
-    conn_rec c;
-    request_rec *r;
-    wctx_t *wctx;
-    hc_condition_t *cond;
+    wctx_t *wctx = (wctx_t *)hc->context;
     const char *method = NULL;
 
-    hc = hc_get_hcworker(ctx, worker, ptemp);
-    wctx = (wctx_t *)hc->context;
-
-    if ((status = hc_get_backend("HCOH", &backend, hc, ctx)) != OK) {
-        return backend_cleanup("HCOH", backend, ctx->s, status);
-    }
-    if ((status = ap_proxy_connect_backend("HCOH", backend, hc, ctx->s)) != OK) {
-        return backend_cleanup("HCOH", backend, ctx->s, status);
-    }
-
-    if (!backend->connection) {
-        if ((status = ap_proxy_connection_create("HCOH", backend, &c, ctx->s)) != OK) {
-            return backend_cleanup("HCOH", backend, ctx->s, status);
-        }
-    }
     switch (hc->s->method) {
         case OPTIONS:
             if (!wctx->req) {
@@ -735,21 +776,20 @@ static apr_status_t hc_check_http(sctx_t *ctx, apr_pool_t *ptemp, proxy_worker *
             break;
 
         default:
-            return backend_cleanup("HCOH", backend, ctx->s, !OK);
             break;
     }
+    return method;
+}
 
-    hc_send(ctx, ptemp, wctx->req, backend);
-
-    r = create_request_rec(ptemp, backend->connection, method);
-    if ((status = hc_read_headers(ctx, r)) != OK) {
-        return backend_cleanup("HCOH", backend, ctx->s, status);
-    }
-    if (hc->s->method == GET) {
-        if ((status = hc_read_body(ctx, r)) != OK) {
-            return backend_cleanup("HCOH", backend, ctx->s, status);
-        }
-    }
+/*
+ * If we have Conditions, then apply those to the response in r,
+ * otherwise any status code 2xx or 3xx is considered "passing"
+ */
+static int hc_check_response(sctx_t *ctx, proxy_worker *worker,
+                             proxy_worker *hc, request_rec *r)
+{
+    hc_condition_t *cond;
+    int status = OK;
 
     if (*worker->s->hcexpr &&
             (cond = (hc_condition_t *)apr_table_get(ctx->conditions, worker->s->hcexpr)) != NULL) {
@@ -774,14 +814,148 @@ static apr_status_t hc_check_http(sctx_t *ctx, apr_pool_t *ptemp, proxy_worker *
     } else if (r->status < 200 || r->status > 399) {
         status = !OK;
     }
+    return status;
+}
+
+/*
+ * Send the HTTP OPTIONS, HEAD or GET request to the backend
+ * server associated w/ worker, and check the response.
+ */
+static apr_status_t hc_check_http(sctx_t *ctx, apr_pool_t *ptemp, proxy_worker *worker)
+{
+    int status;
+    proxy_conn_rec *backend = NULL;
+    proxy_worker *hc;
+    conn_rec c;
+    request_rec *r;
+    wctx_t *wctx;
+    const char *method = NULL;
+
+    hc = hc_get_hcworker(ctx, worker, ptemp);
+    wctx = (wctx_t *)hc->context;
+
+    if ((status = hc_get_backend("HCOH", &backend, hc, ctx)) != OK) {
+        return backend_cleanup("HCOH", backend, ctx->s, status);
+    }
+    if ((status = ap_proxy_connect_backend("HCOH", backend, hc, ctx->s)) != OK) {
+        return backend_cleanup("HCOH", backend, ctx->s, status);
+    }
+
+    if (!backend->connection) {
+        if ((status = ap_proxy_connection_create("HCOH", backend, &c, ctx->s)) != OK) {
+            return backend_cleanup("HCOH", backend, ctx->s, status);
+        }
+    }
+    if (!(method = hc_prepare_request(ctx, hc))) {
+        return backend_cleanup("HCOH", backend, ctx->s, !OK);
+    }
+
+    hc_send(ctx, ptemp, wctx->req, backend);
+
+    r = create_request_rec(ptemp, backend->connection, method);
+    if ((status = hc_read_headers(ctx, r)) != OK) {
+        return backend_cleanup("HCOH", backend, ctx->s, status);
+    }
+    if (hc->s->method == GET) {
+        if ((status = hc_read_body(ctx, r)) != OK) {
+            return backend_cleanup("HCOH", backend, ctx->s, status);
+        }
+    }
+
+    status = hc_check_response(ctx, worker, hc, r);
     return backend_cleanup("HCOH", backend, ctx->s, status);
 }
 
+/*
+ * The schedule is spread by +/- HC_JITTER_PERCENT of the interval, so
+ * that workers configured (or checked) at the same time don't keep
+ * being checked in bursts.
+ */
+static apr_interval_time_t hc_jitter(apr_interval_time_t interval,
+                                     const void *seed, apr_time_t now)
+{
+    apr_uint32_t rnd = (apr_uint32_t)(now ^ (now >> 32)
+                                      ^ (apr_uintptr_t)seed) * 2654435761U;
+    apr_interval_time_t span = interval * HC_JITTER_PERCENT / 100;
+
+    return interval + span * ((apr_int64_t)(rnd % 2001) - 1000) / 1000;
+}
+
+/*
+ * Record the result (rv) of the check of baton->worker, and schedule
+ * the next one.
+ */
+static void hc_check_done(baton_t *baton, apr_status_t rv, int threaded)
+{
+    sctx_t *ctx = baton->ctx;
+    server_rec *s = ctx->s;
+    proxy_worker *worker = baton->worker;
+    wctx_t *wctx = (wctx_t *)baton->hc->context;
+    apr_time_t now = baton->now;
+    apr_interval_time_t interval = worker->s->interval;
+    int was_healthy = !PROXY_WORKER_IS_HCFAILED(worker);
+
+    /* what state are we in ? */
+    if (PROXY_WORKER_IS_HCFAILED(worker)) {
+        if (rv == APR_SUCCESS) {
+            worker->s->pcount += 1;
+            if (worker->s->pcount >= worker->s->passes) {
+                ap_proxy_set_wstatus(PROXY_WORKER_HC_FAIL_FLAG, 0, worker);
+                ap_proxy_set_wstatus(PROXY_WORKER_IN_ERROR_FLAG, 0, worker);
+                worker->s->pcount = 0;
+                ap_log_error(APLOG_MARK, APLOG_INFO, 0, s, APLOGNO(03302)
+                             "%sHealth check ENABLING %s", (threaded ? "Threaded " : ""),
+                             worker->s->name);
+
+            }
+        }
+    } else {
+        if (rv != APR_SUCCESS) {
+            worker->s->error_time = now;
+            worker->s->fcount += 1;
+            if (worker->s->fcount >= worker->s->fails) {
+                ap_proxy_set_wstatus(PROXY_WORKER_HC_FAIL_FLAG, 1, worker);
+                worker->s->fcount = 0;
+                ap_log_error(APLOG_MARK, APLOG_INFO, 0, s, APLOGNO(03303)
+                             "%sHealth check DISABLING %s", (threaded ? "Threaded " : ""),
+                             worker->s->name);
+            }
+        }
+    }
+    worker->s->updated = now;
+
+    if (ctx->adaptive) {
+        if ((rv == APR_SUCCESS) != was_healthy) {
+            /* The worker is (maybe) changing state, recheck it soon */
+            wctx->stable = wctx->backoff = 0;
+            if (interval > apr_time_from_sec(HCHECK_WATHCHDOG_INTERVAL)) {
+                interval = apr_time_from_sec(HCHECK_WATHCHDOG_INTERVAL);
+            }
+        }
+        else if (was_healthy) {
+            /* Steadily healthy, check it less and less often */
+            if (++wctx->stable >= HC_STABLE_CHECKS
+                    && wctx->backoff < HC_MAX_BACKOFF) {
+                wctx->backoff++;
+                wctx->stable = 0;
+            }
+            interval <<= wctx->backoff;
+        }
+        else {
+            wctx->stable = wctx->backoff = 0;
+        }
+    }
+    now = apr_time_now();
+    wctx->next = now + hc_jitter(interval, worker, now);
+    wctx->running = 0;
+
+    apr_pool_destroy(baton->ptemp);
+}
+
 static void * APR_THREAD_FUNC hc_check(apr_thread_t *thread, void *b)
 {
     baton_t *baton = (baton_t *)b;
     sctx_t *ctx = baton->ctx;
-    apr_time_t now = baton->now;
     proxy_worker *worker = baton->worker;
     apr_pool_t *ptemp = baton->ptemp;
     server_rec *s = ctx->s;
@@ -808,39 +982,328 @@ static void * APR_THREAD_FUNC hc_check(apr_thread_t *thread, void *b)
         ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, APLOGNO(03257)
                          "Somehow tried to use unimplemented hcheck method: %d",
                          (int)worker->s->method);
+        ((wctx_t *)baton->hc->context)->running = 0;
         apr_pool_destroy(ptemp);
         return NULL;
     }
-    /* what state are we in ? */
-    if (PROXY_WORKER_IS_HCFAILED(worker)) {
+    hc_check_done(baton, rv, thread != NULL);
+    return NULL;
+}
+
+/*
+ * Non-blocking probes: the TCP checks, and the OPTIONS, HEAD and GET
+ * checks of plain HTTP workers, are all run by the watchdog thread
+ * itself, multiplexed on ctx->pollset.  The others (TLS) still use the
+ * blocking hc_check(), on the thread pool if any.
+ */
+
+static apr_status_t hc_probe_watch(sctx_t *ctx, hc_probe_t *probe,
+                                   apr_int16_t events)
+{
+    apr_pollset_remove(ctx->pollset, &probe->pfd);
+    probe->pfd.reqevents = events;
+    return apr_pollset_add(ctx->pollset, &probe->pfd);
+}
+
+static char *hc_getline(char **pos)
+{
+    char *line = *pos, *eol = strchr(line, '\n');
+
+    if (!eol) {
+        return NULL;
+    }
+    *pos = eol + 1;
+    if (eol > line && eol[-1] == '\r') {
+        --eol;
+    }
+    *eol = '\0';
+    return line;
+}
+
+/* Parse the response read by probe, and check it as hc_check_http() */
+static apr_status_t hc_probe_response(sctx_t *ctx, hc_probe_t *probe)
+{
+    apr_pool_t *ptemp = probe->baton->ptemp;
+    char *pos = probe->buf, *line, *value, *end;
+    request_rec *r;
+    conn_rec *c;
+
+    probe->buf[probe->len] = '\0';
+    ap_log_error(APLOG_MARK, APLOG_TRACE7, 0, ctx->s, "%s", probe->buf);
+
+    /* Only for ap_expr, there is no real connection here */
+    c = apr_pcalloc(ptemp, sizeof(conn_rec));
+    c->pool = ptemp;
+    c->base_server = ctx->s;
+    c->conn_config = ap_create_conn_config(ptemp);
+    c->notes = apr_table_make(ptemp, 5);
+    c->client_addr = probe->hc->cp->addr;
+    apr_sockaddr_ip_get(&c->client_ip, c->client_addr);
+    if (apr_socket_addr_get(&c->local_addr, APR_LOCAL,
+                            probe->sock) == APR_SUCCESS) {
+        apr_sockaddr_ip_get(&c->local_ip, c->local_addr);
+    }
+    r = create_request_rec(ptemp, c, probe->method);
+
+    /* for the below, see hc_read_headers() */
+    line = hc_getline(&pos);
+    if (!line || !apr_date_checkmask(line, "HTTP/#.# ###*")
+            || line[5] != '1') {
+        return APR_EGENERAL;
+    }
+    r->status = atoi(&line[9]);
+    r->status_line = apr_pstrdup(r->pool, &line[9]);
+
+    while ((line = hc_getline(&pos)) && *line) {
+        if (!(value = strchr(line, ':'))) {
+            return APR_EGENERAL;
+        }
+        *value++ = '\0';
+        while (apr_isspace(*value))
+            ++value;
+        for (end = value + strlen(value); end > value && apr_isspace(end[-1]); --end)
+            ;
+        *end = '\0';
+        apr_table_add(r->headers_out, line, value);
+    }
+
+    if (probe->hc->s->method == GET && line) {
+        apr_size_t len = probe->buf + probe->len - pos;
+        if (len) {
+            APR_BRIGADE_INSERT_TAIL(r->kept_body,
+                    apr_bucket_pool_create(pos, len, r->pool,
+                                           c->bucket_alloc));
+        }
+    }
+
+    if (hc_check_response(ctx, probe->baton->worker, probe->hc, r) != OK) {
+        return APR_EGENERAL;
+    }
+    return APR_SUCCESS;
+}
+
+static void hc_probe_finish(sctx_t *ctx, hc_probe_t *probe, apr_status_t rv)
+{
+    hc_probe_t **pp;
+
+    for (pp = &ctx->probes; *pp; pp = &(*pp)->next) {
+        if (*pp == probe) {
+            *pp = probe->next;
+            ctx->nprobes--;
+            break;
+        }
+    }
+    apr_pollset_remove(ctx->pollset, &probe->pfd);
+
+    if (rv == APR_SUCCESS && probe->method) {
+        rv = hc_probe_response(ctx, probe);
+    }
+    apr_socket_close(probe->sock);
+
+    ap_log_error(APLOG_MARK, APLOG_DEBUG, rv, ctx->s, APLOGNO(03482)
+                 "Health check %s status (%s) for %s.",
+                 ap_proxy_show_hcmethod(probe->hc->s->method),
+                 rv == APR_SUCCESS ? "pass" : "fail",
+                 probe->baton->worker->s->name);
+
+    /* this destroys probe */
+    hc_check_done(probe->baton, rv, 0);
+}
+
+/* Make progress on probe, returns APR_EAGAIN until it completes */
+static apr_status_t hc_probe_io(sctx_t *ctx, hc_probe_t *probe,
+                                apr_int16_t rtnevents)
+{
+    apr_status_t rv;
+    apr_size_t n;
+
+    if (!probe->connected) {
+        if (rtnevents & (APR_POLLERR | APR_POLLHUP | APR_POLLNVAL)) {
+            return APR_ECONNREFUSED;
+        }
+        rv = apr_socket_connect(probe->sock, probe->hc->cp->addr);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        probe->connected = 1;
+        if (!probe->method) {
+            /* TCP check passed */
+            return APR_SUCCESS;
+        }
+        probe->deadline = apr_time_now() + (probe->baton->worker->s->timeout_set
+                                            ? probe->baton->worker->s->timeout
+                                            : ctx->s->timeout);
+    }
+
+    if (probe->outlen) {
+        n = probe->outlen;
+        rv = apr_socket_send(probe->sock, probe->out, &n);
+        if (rv != APR_SUCCESS && !APR_STATUS_IS_EAGAIN(rv)) {
+            return rv;
+        }
+        probe->out += n;
+        probe->outlen -= n;
+        if (probe->outlen) {
+            return APR_EAGAIN;
+        }
+        probe->buf = apr_palloc(probe->baton->ptemp, HC_MAX_RESPONSE + 1);
+        rv = hc_probe_watch(ctx, probe, APR_POLLIN);
+        return (rv == APR_SUCCESS) ? APR_EAGAIN : rv;
+    }
+
+    n = HC_MAX_RESPONSE - probe->len;
+    rv = apr_socket_recv(probe->sock, probe->buf + probe->len, &n);
+    probe->len += n;
+    if (APR_STATUS_IS_EOF(rv) || probe->len == HC_MAX_RESPONSE) {
+        return APR_SUCCESS;
+    }
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    if (probe->hc->s->method != GET) {
+        /* the headers are enough */
+        probe->buf[probe->len] = '\0';
+        if (strstr(probe->buf, "\r\n\r\n") || strstr(probe->buf, "\n\n")) {
+            return APR_SUCCESS;
+        }
+    }
+    return APR_EAGAIN;
+}
+
+/*
+ * Start the check of baton->worker without blocking.  Returns APR_ENOTIMPL
+ * if it has to go through hc_check(), APR_EAGAIN if there are too many
+ * probes in flight already, APR_SUCCESS otherwise (the check may be over
+ * already).
+ */
+static apr_status_t hc_probe_start(sctx_t *ctx, baton_t *baton)
+{
+    proxy_worker *worker = baton->worker;
+    proxy_worker *hc = baton->hc;
+    hc_probe_t *probe;
+    const char *method = NULL;
+    apr_status_t rv;
+
+    if (hc->s->method != TCP) {
+        if (!strcmp(hc->s->scheme, "https")
+                || !(method = hc_prepare_request(ctx, hc))) {
+            return APR_ENOTIMPL;
+        }
+    }
+    if (ctx->nprobes >= HC_MAX_PROBES) {
+        return APR_EAGAIN;
+    }
+
+    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, ctx->s, APLOGNO(03483)
+                 "Health checking %s", worker->s->name);
+
+    if (hc_determine_connection(ctx, hc) != OK) {
+        hc_check_done(baton, APR_EGENERAL, 0);
+        return APR_SUCCESS;
+    }
+
+    probe = apr_pcalloc(baton->ptemp, sizeof(hc_probe_t));
+    probe->baton = baton;
+    probe->hc = hc;
+    probe->method = method;
+    if (method) {
+        probe->out = ((wctx_t *)hc->context)->req;
+        probe->outlen = strlen(probe->out);
+    }
+
+    rv = apr_socket_create(&probe->sock, hc->cp->addr->family, SOCK_STREAM,
+                           APR_PROTO_TCP, baton->ptemp);
+    if (rv == APR_SUCCESS) {
+        apr_socket_timeout_set(probe->sock, 0);
+        rv = apr_socket_connect(probe->sock, hc->cp->addr);
         if (rv == APR_SUCCESS) {
-            worker->s->pcount += 1;
-            if (worker->s->pcount >= worker->s->passes) {
-                ap_proxy_set_wstatus(PROXY_WORKER_HC_FAIL_FLAG, 0, worker);
-                ap_proxy_set_wstatus(PROXY_WORKER_IN_ERROR_FLAG, 0, worker);
-                worker->s->pcount = 0;
-                ap_log_error(APLOG_MARK, APLOG_INFO, 0, s, APLOGNO(03302)
-                             "%sHealth check ENABLING %s", (thread ? "Threaded " : ""),
-                             worker->s->name);
+            probe->connected = 1;
+        }
+        else if (APR_STATUS_IS_EINPROGRESS(rv)) {
+            rv = APR_SUCCESS;
+        }
+    }
+    if (rv == APR_SUCCESS && probe->connected && !method) {
+        /* TCP check passed already */
+        apr_socket_close(probe->sock);
+        hc_check_done(baton, APR_SUCCESS, 0);
+        return APR_SUCCESS;
+    }
+    if (rv == APR_SUCCESS) {
+        probe->deadline = apr_time_now() + (worker->s->conn_timeout_set
+                                            ? worker->s->conn_timeout
+                                            : worker->s->timeout_set
+                                              ? worker->s->timeout
+                                              : ctx->s->timeout);
+        probe->pfd.desc_type = APR_POLL_SOCKET;
+        probe->pfd.desc.s = probe->sock;
+        probe->pfd.reqevents = APR_POLLOUT;
+        probe->pfd.client_data = probe;
+        rv = apr_pollset_add(ctx->pollset, &probe->pfd);
+    }
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, rv, ctx->s, APLOGNO(03484)
+                     "Health check %s of %s failed to start",
+                     ap_proxy_show_hcmethod(hc->s->method), worker->s->name);
+        if (probe->sock) {
+            apr_socket_close(probe->sock);
+        }
+        hc_check_done(baton, rv, 0);
+        return APR_SUCCESS;
+    }
+
+    probe->next = ctx->probes;
+    ctx->probes = probe;
+    ctx->nprobes++;
+    return APR_SUCCESS;
+}
+
+/* Run the probes in flight until they are all done, or until "until" */
+static void hc_run_probes(sctx_t *ctx, apr_time_t until)
+{
+    apr_time_t now = apr_time_now();
 
+    while (ctx->probes && now < until) {
+        const apr_pollfd_t *pdesc;
+        apr_interval_time_t timeout = until - now;
+        apr_int32_t num = 0, i;
+        hc_probe_t *probe, *next;
+        apr_status_t rv;
+
+        for (probe = ctx->probes; probe; probe = probe->next) {
+            if (probe->deadline - now < timeout) {
+                timeout = probe->deadline - now;
             }
         }
-    } else {
-        if (rv != APR_SUCCESS) {
-            worker->s->error_time = now;
-            worker->s->fcount += 1;
-            if (worker->s->fcount >= worker->s->fails) {
-                ap_proxy_set_wstatus(PROXY_WORKER_HC_FAIL_FLAG, 1, worker);
-                worker->s->fcount = 0;
-                ap_log_error(APLOG_MARK, APLOG_INFO, 0, s, APLOGNO(03303)
-                             "%sHealth check DISABLING %s", (thread ? "Threaded " : ""),
-                             worker->s->name);
+        if (timeout < 0) {
+            timeout = 0;
+        }
+
+        rv = apr_pollset_poll(ctx->pollset, timeout, &num, &pdesc);
+        if (rv != APR_SUCCESS && !APR_STATUS_IS_TIMEUP(rv)
+                && !APR_STATUS_IS_EINTR(rv)) {
+            ap_log_error(APLOG_MARK, APLOG_ERR, rv, ctx->s, APLOGNO(03485)
+                         "apr_pollset_poll() failed");
+            break;
+        }
+        for (i = 0; rv == APR_SUCCESS && i < num; i++) {
+            apr_status_t prv;
+
+            probe = pdesc[i].client_data;
+            prv = hc_probe_io(ctx, probe, pdesc[i].rtnevents);
+            if (!APR_STATUS_IS_EAGAIN(prv)) {
+                hc_probe_finish(ctx, probe, prv);
+            }
+        }
+
+        now = apr_time_now();
+        for (probe = ctx->probes; probe; probe = next) {
+            next = probe->next;
+            if (now >= probe->deadline) {
+                hc_probe_finish(ctx, probe, APR_TIMEUP);
             }
         }
     }
-    worker->s->updated = now;
-    apr_pool_destroy(ptemp);
-    return NULL;
 }
 
 static apr_status_t hc_watchdog_callback(int state, void *data,
@@ -857,6 +1320,14 @@ static apr_status_t hc_watchdog_callback(int state, void *data,
             ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(03258)
                          "%s watchdog started.",
                          HCHECK_WATHCHDOG_NAME);
+            rv = apr_pollset_create(&ctx->pollset, HC_MAX_PROBES, ctx->p, 0);
+            if (rv != APR_SUCCESS) {
+                ap_log_error(APLOG_MARK, APLOG_INFO, rv, s, APLOGNO(03486)
+                             "apr_pollset_create() failed, health checks "
+                             "will block");
+                ctx->pollset = NULL;
+                rv = APR_SUCCESS;
+            }
 #if HC_USE_THREADS
             if (ctx->tpsize) {
                 rv =  apr_thread_pool_create(&ctx->hctp, ctx->tpsize,
@@ -898,48 +1369,91 @@ static apr_status_t hc_watchdog_callback(int state, void *data,
                     ap_proxy_sync_balancer(balancer, s, conf);
                     workers = (proxy_worker **)balancer->workers->elts;
                     for (n = 0; n < balancer->workers->nelts; n++) {
-                        worker = *workers;
-                        if (!PROXY_WORKER_IS(worker, PROXY_WORKER_STOPPED) &&
-                           (worker->s->method != NONE) &&
-                           (now > worker->s->updated + worker->s->interval)) {
-                            baton_t *baton;
-                            /* This pool must last the lifetime of the (possible) thread */
-                            apr_pool_t *ptemp;
-                            apr_pool_create(&ptemp, ctx->p);
-                            ap_log_error(APLOG_MARK, APLOG_TRACE2, 0, s,
-                                         "Checking %s worker: %s  [%d] (%pp)", balancer->s->name,
-                                         worker->s->name, worker->s->method, worker);
-
-                            if ((rv = hc_init_worker(ctx, worker)) != APR_SUCCESS) {
-                                return rv;
+                        proxy_worker *hc;
+                        wctx_t *wctx;
+                        baton_t *baton;
+                        /* This pool must last the lifetime of the (possible) thread */
+                        apr_pool_t *ptemp;
+
+                        worker = workers[n];
+                        if (PROXY_WORKER_IS(worker, PROXY_WORKER_STOPPED) ||
+                            (worker->s->method == NONE)) {
+                            continue;
+                        }
+                        hc = hc_get_hcworker(ctx, worker, ctx->p);
+                        wctx = (wctx_t *)hc->context;
+                        if (!wctx->next) {
+                            wctx->next = worker->s->updated
+                                         + hc_jitter(worker->s->interval,
+                                                     worker, now);
+                        }
+                        if (wctx->running || now < wctx->next) {
+                            continue;
+                        }
+
+                        ap_log_error(APLOG_MARK, APLOG_TRACE2, 0, s,
+                                     "Checking %s worker: %s  [%d] (%pp)", balancer->s->name,
+                                     worker->s->name, worker->s->method, worker);
+
+                        if ((rv = hc_init_worker(ctx, worker)) != APR_SUCCESS) {
+                            return rv;
+                        }
+                        apr_pool_create(&ptemp, ctx->p);
+                        baton = apr_palloc(ptemp, sizeof(baton_t));
+                        baton->ctx = ctx;
+                        baton->now = now;
+                        baton->worker = worker;
+                        baton->hc = hc;
+                        baton->ptemp = ptemp;
+                        wctx->running = 1;
+
+                        if (ctx->pollset) {
+                            rv = hc_probe_start(ctx, baton);
+                            if (rv == APR_SUCCESS) {
+                                continue;
                             }
-                            baton = apr_palloc(ptemp, sizeof(baton_t));
-                            baton->ctx = ctx;
-                            baton->now = now;
-                            baton->worker = worker;
-                            baton->ptemp = ptemp;
-
-                            if (!ctx->hctp) {
-                                hc_check(NULL, baton);
+                            if (APR_STATUS_IS_EAGAIN(rv)) {
+                                /* still due, at the next run */
+                                wctx->running = 0;
+                                apr_pool_destroy(ptemp);
+                                rv = APR_SUCCESS;
+                                continue;
                             }
+                            rv = APR_SUCCESS;
+                        }
+                        if (!ctx->hctp) {
+                            hc_check(NULL, baton);
+                        }
 #if HC_USE_THREADS
-                            else {
-                                rv = apr_thread_pool_push(ctx->hctp, hc_check, (void *)baton,
-                                                          APR_THREAD_TASK_PRIORITY_NORMAL, NULL);
-                            }
-#endif
+                        else {
+                            rv = apr_thread_pool_push(ctx->hctp, hc_check, (void *)baton,
+                                                      APR_THREAD_TASK_PRIORITY_NORMAL, NULL);
                         }
-                        workers++;
+#endif
                     }
                 }
                 /* s = s->next; */
             }
+            /* Leave some of the interval to the next run */
+            hc_run_probes(ctx, now + apr_time_from_sec(HCHECK_WATHCHDOG_INTERVAL) / 2);
             break;
 
         case AP_WATCHDOG_STATE_STOPPING:
             ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(03261)
                          "stopping %s watchdog.",
                          HCHECK_WATHCHDOG_NAME);
+            while (ctx->probes) {
+                hc_probe_t *probe = ctx->probes;
+                ctx->probes = probe->next;
+                apr_socket_close(probe->sock);
+                ((wctx_t *)probe->hc->context)->running = 0;
+                apr_pool_destroy(probe->baton->ptemp);
+            }
+            ctx->nprobes = 0;
+            if (ctx->pollset) {
+                apr_pollset_destroy(ctx->pollset);
+                ctx->pollset = NULL;
+            }
 #if HC_USE_THREADS
             rv =  apr_thread_pool_destroy(ctx->hctp);
             if (rv != APR_SUCCESS) {
@@ -1148,6 +1662,9 @@ static const command_rec command_table[] = {
     AP_INIT_TAKE1("ProxyHCTPsize", set_hc_tpsize, NULL, OR_FILEINFO,
                      "Set size of health check thread pool"),
 #endif
+    AP_INIT_FLAG("ProxyHCAdaptive", set_hc_adaptive, NULL, RSRC_CONF,
+                     "Check steadily healthy workers less often, and workers "
+                     "changing state more often"),
     { NULL }
 };
 
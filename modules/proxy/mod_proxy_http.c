@@ -17,12 +17,24 @@
 /* HTTP routines for Apache proxy */
 
 #include "mod_proxy.h"
+#include "proxy_http_headers.h"
 #include "ap_regex.h"
+#include "ap_mpm.h"
 
 module AP_MODULE_DECLARE_DATA proxy_http_module;
 
-static int (*ap_proxy_clear_connection_fn)(request_rec *r, apr_table_t *headers) =
-        NULL;
+typedef struct {
+    apr_time_t async_delay;         /* how long to poll the backend before
+                                     * suspending the request, < 0 if off */
+    apr_time_t async_idle_timeout;  /* how long a suspended request waits */
+    unsigned int async_delay_set:1;
+    unsigned int async_idle_timeout_set:1;
+} proxy_http_dir_conf;
+
+/* Set in post_config when the MPM can suspend requests and poll sockets
+ * on their behalf (ie. event).
+ */
+static int mpm_can_suspend = 0;
 
 static apr_status_t ap_proxy_http_cleanup(const char *scheme,
                                           request_rec *r,
@@ -1046,38 +1058,48 @@ static request_rec *make_fake_req(conn_rec *c, request_rec *r)
     return rp;
 }
 
-static void process_proxy_header(request_rec *r, proxy_dir_conf *c,
-                                 const char *key, const char *value)
+/* What ap_proxy_read_headers() noticed while scanning the headers */
+typedef struct {
+    apr_array_header_t *conn_tokens;    /* listed in Connection */
+    const char *conn_error;             /* Connection parse error */
+    unsigned int saw_warning:1;
+} backend_hdrs_scan;
+
+/*
+ * Remove the headers listed in the backend's Connection header(s).
+ * Returns -1 on error. Otherwise, returns 1 if 'Close' was seen in
+ * the Connection header tokens, and 0 if not.
+ */
+static int clear_backend_connection(request_rec *r,
+                                    const backend_hdrs_scan *scan)
 {
-    static const char *date_hdrs[]
-        = { "Date", "Expires", "Last-Modified", NULL };
-    static const struct {
-        const char *name;
-        ap_proxy_header_reverse_map_fn func;
-    } transform_hdrs[] = {
-        { "Location", ap_proxy_location_reverse_map },
-        { "Content-Location", ap_proxy_location_reverse_map },
-        { "URI", ap_proxy_location_reverse_map },
-        { "Destination", ap_proxy_location_reverse_map },
-        { "Set-Cookie", ap_proxy_cookie_reverse_map },
-        { NULL, NULL }
-    };
-    int i;
-    for (i = 0; date_hdrs[i]; ++i) {
-        if (!ap_cstr_casecmp(date_hdrs[i], key)) {
-            apr_table_add(r->headers_out, key,
-                          date_canon(r->pool, value));
-            return;
-        }
+    int i, closed = 0;
+
+    if (scan->conn_error) {
+        ap_log_rerror(APLOG_MARK, APLOG_NOTICE, 0, r, APLOGNO(03480)
+                      "Error parsing backend Connection header: %s",
+                      scan->conn_error);
+        return -1;
     }
-    for (i = 0; transform_hdrs[i].name; ++i) {
-        if (!ap_cstr_casecmp(transform_hdrs[i].name, key)) {
-            apr_table_add(r->headers_out, key,
-                          (*transform_hdrs[i].func)(r, c, value));
-            return;
-       }
+
+    if (scan->conn_tokens) {
+        for (i = 0; i < scan->conn_tokens->nelts; i++) {
+            const char *name = APR_ARRAY_IDX(scan->conn_tokens, i,
+                                             const char *);
+            if (!ap_cstr_casecmp(name, "close")) {
+                closed = 1;
+            }
+            else if (ap_cstr_casecmp(name, "keep-alive")) {
+                /* (Keep-Alive was not stored in the first place) */
+                ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(03481)
+                              "Removing header '%s' listed in Connection "
+                              "header", name);
+                apr_table_unset(r->headers_out, name);
+            }
+        }
     }
-    apr_table_add(r->headers_out, key, value);
+
+    return closed;
 }
 
 /*
@@ -1090,10 +1112,11 @@ static void process_proxy_header(request_rec *r, proxy_dir_conf *c,
  */
 static void ap_proxy_read_headers(request_rec *r, request_rec *rr,
                                   char *buffer, int size,
-                                  conn_rec *c, int *pread_len)
+                                  conn_rec *c, int *pread_len,
+                                  backend_hdrs_scan *scan)
 {
     int len;
-    char *value, *end;
+    char *value, *end, *key, *val;
     char field[MAX_STRING_LEN];
     int saw_headers = 0;
     void *sconf = r->server->module_config;
@@ -1106,6 +1129,7 @@ static void ap_proxy_read_headers(request_rec *r, request_rec *rr,
     r->headers_out = apr_table_make(r->pool, 20);
     r->trailers_out = apr_table_make(r->pool, 5);
     *pread_len = 0;
+    memset(scan, 0, sizeof(*scan));
 
     /*
      * Read header lines until we get the empty separator line, a read error,
@@ -1173,14 +1197,47 @@ static void ap_proxy_read_headers(request_rec *r, request_rec *rr,
             ++value;            /* Skip to start of value   */
 
         /* should strip trailing whitespace as well */
-        for (end = &value[strlen(value)-1]; end > value && apr_isspace(*end); --end)
-            *end = '\0';
+        for (end = value + strlen(value); end > value && apr_isspace(end[-1]); --end)
+            ;
+        *end = '\0';
+
+        /* A single copy of the line holds both the key and the value */
+        key = apr_pstrmemdup(r->pool, buffer, end - buffer);
+        val = key + (value - buffer);
 
         /* make sure we add so as not to destroy duplicated headers
          * Modify headers requiring canonicalisation and/or affected
-         * by ProxyPassReverse and family with process_proxy_header
+         * by ProxyPassReverse and family, and drop the hop-by-hop ones
+         * here rather than walking r->headers_out for each afterwards.
          */
-        process_proxy_header(r, dconf, buffer, value);
+        switch (classify_backend_header(key, strlen(key))) {
+        case BACKEND_HDR_DATE:
+            apr_table_addn(r->headers_out, key, date_canon(r->pool, val));
+            break;
+        case BACKEND_HDR_LOCATION:
+            apr_table_addn(r->headers_out, key,
+                           ap_proxy_location_reverse_map(r, dconf, val));
+            break;
+        case BACKEND_HDR_COOKIE:
+            apr_table_addn(r->headers_out, key,
+                           ap_proxy_cookie_reverse_map(r, dconf, val));
+            break;
+        case BACKEND_HDR_WARNING:
+            scan->saw_warning = 1;
+            apr_table_addn(r->headers_out, key, val);
+            break;
+        case BACKEND_HDR_CONNECTION:
+            if (!scan->conn_error) {
+                scan->conn_error = ap_parse_token_list_strict(r->pool, val,
+                                                      &scan->conn_tokens, 1);
+            }
+            break;
+        case BACKEND_HDR_HOP_BY_HOP:
+            break;
+        default:
+            apr_table_addn(r->headers_out, key, val);
+            break;
+        }
         saw_headers = 1;
 
         /* the header was too long; at the least we should skip extra data */
@@ -1261,9 +1318,7 @@ int ap_proxy_http_process_response(apr_pool_t * p, request_rec *r,
     int pread_len = 0;
     apr_table_t *save_table;
     int backend_broke = 0;
-    static const char *hop_by_hop_hdrs[] =
-        {"Keep-Alive", "Proxy-Authenticate", "TE", "Trailer", "Upgrade", NULL};
-    int i;
+    backend_hdrs_scan scan;
     const char *te = NULL;
     int original_status = r->status;
     int proxy_status = OK;
@@ -1434,7 +1489,7 @@ int ap_proxy_http_process_response(apr_pool_t * p, request_rec *r,
 
             /* shove the headers direct into r->headers_out */
             ap_proxy_read_headers(r, backend->r, buffer, sizeof(buffer), origin,
-                                  &pread_len);
+                                  &pread_len, &scan);
 
             if (r->headers_out == NULL) {
                 ap_log_rerror(APLOG_MARK, APLOG_WARNING, 0, r, APLOGNO(01106)
@@ -1453,12 +1508,10 @@ int ap_proxy_http_process_response(apr_pool_t * p, request_rec *r,
                 return r->status;
             }
 
-            /* Now, add in the just read cookies */
-            apr_table_do(addit_dammit, save_table, r->headers_out,
-                         "Set-Cookie", NULL);
-
-            /* and now load 'em all in */
+            /* Now, add in the just read cookies, and load 'em all in */
             if (!apr_is_empty_table(save_table)) {
+                apr_table_do(addit_dammit, save_table, r->headers_out,
+                             "Set-Cookie", NULL);
                 apr_table_unset(r->headers_out, "Set-Cookie");
                 r->headers_out = apr_table_overlay(r->pool,
                                                    r->headers_out,
@@ -1492,7 +1545,7 @@ int ap_proxy_http_process_response(apr_pool_t * p, request_rec *r,
             te = apr_table_get(r->headers_out, "Transfer-Encoding");
 
             /* strip connection listed hop-by-hop headers from response */
-            toclose = ap_proxy_clear_connection_fn(r, r->headers_out);
+            toclose = clear_backend_connection(r, &scan);
             if (toclose) {
                 backend->close = 1;
                 if (toclose < 0) {
@@ -1509,14 +1562,13 @@ int ap_proxy_http_process_response(apr_pool_t * p, request_rec *r,
                 ap_proxy_pre_http_request(origin, backend->r);
             }
 
-            /* Clear hop-by-hop headers */
-            for (i=0; hop_by_hop_hdrs[i]; ++i) {
-                apr_table_unset(r->headers_out, hop_by_hop_hdrs[i]);
+            /* Delete warnings with wrong date (the hop-by-hop headers
+             * were not even stored by ap_proxy_read_headers)
+             */
+            if (scan.saw_warning) {
+                r->headers_out = ap_proxy_clean_warnings(p, r->headers_out);
             }
 
-            /* Delete warnings with wrong date */
-            r->headers_out = ap_proxy_clean_warnings(p, r->headers_out);
-
             /* handle Via header in response */
             if (conf->viaopt != via_off && conf->viaopt != via_block) {
                 const char *server_name = ap_get_server_name(r);
@@ -1917,6 +1969,191 @@ apr_status_t ap_proxy_http_cleanup(const char *scheme, request_rec *r,
     return OK;
 }
 
+/*
+ * Asynchronous wait for the backend response.
+ *
+ * Once the request (and its body) has been sent, a slow or long-polling
+ * backend may take a long time to start answering.  Rather than parking
+ * the worker thread in a blocking read, the backend socket is handed to
+ * the MPM and the request is SUSPENDED; the response is then processed
+ * by whichever worker the MPM runs the callback on.
+ */
+typedef struct proxy_http_baton_t {
+    request_rec *r;
+    proxy_conn_rec *backend;
+    proxy_worker *worker;
+    proxy_server_conf *conf;
+    const char *proxy_function;
+    char *server_portstr;
+    apr_pool_t *subpool;        /* holds the poll registration */
+} proxy_http_baton_t;
+
+static void proxy_http_async_finish(proxy_http_baton_t *baton, int status)
+{
+    request_rec *r = baton->r;
+    conn_rec *c = r->connection;
+
+    if (status != OK) {
+        baton->backend->close = 1;
+    }
+    ap_proxy_http_cleanup(baton->proxy_function, r, baton->backend);
+
+    /* what proxy_handler() would have done had we not suspended */
+    status = ap_proxy_request_resumed(r, status);
+
+    if (status == OK || status == DONE) {
+        ap_finalize_request_protocol(r);
+    }
+    else {
+        r->status = HTTP_OK;
+        ap_die(status, r);
+    }
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(r->invoke_mtx);
+#endif
+    ap_process_request_after_handler(r); /* don't touch baton or r after here */
+    ap_mpm_resume_suspended(c);
+}
+
+/* Invoked by the MPM when the backend became readable */
+static void proxy_http_async_callback(void *b)
+{
+    proxy_http_baton_t *baton = (proxy_http_baton_t *)b;
+    request_rec *r = baton->r;
+    int status;
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(r->invoke_mtx);
+#endif
+    apr_pool_destroy(baton->subpool);
+
+    ap_log_rerror(APLOG_MARK, APLOG_TRACE1, 0, r,
+                  "HTTP: backend readable, resuming request");
+
+    status = ap_proxy_http_process_response(r->pool, r, &baton->backend,
+                                            baton->worker, baton->conf,
+                                            baton->server_portstr);
+    proxy_http_async_finish(baton, status);
+}
+
+/* Invoked by the MPM when the backend did not answer in time */
+static void proxy_http_async_timeout(void *b)
+{
+    proxy_http_baton_t *baton = (proxy_http_baton_t *)b;
+    request_rec *r = baton->r;
+    int status;
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(r->invoke_mtx);
+#endif
+    apr_pool_destroy(baton->subpool);
+
+    ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(03473)
+                  "HTTP: timeout waiting for response from remote "
+                  "server %s:%d", baton->backend->hostname,
+                  baton->backend->port);
+    apr_table_setn(r->notes, "proxy_timedout", "1");
+    proxy_run_detach_backend(r, baton->backend);
+    status = ap_proxyerror(r, HTTP_GATEWAY_TIME_OUT,
+                           "Error reading from remote server");
+    proxy_http_async_finish(baton, status);
+}
+
+/*
+ * Poll the backend for up to ProxyHTTPAsyncDelay and, if it still has
+ * nothing to say, register it with the MPM and return SUSPENDED.
+ * Returns OK whenever the response should be read synchronously.
+ */
+static int proxy_http_async_wait(request_rec *r, proxy_conn_rec *backend,
+                                 proxy_worker *worker,
+                                 proxy_server_conf *conf,
+                                 const char *proxy_function,
+                                 const char *server_portstr)
+{
+    conn_rec *c = r->connection;
+    proxy_http_dir_conf *dconf;
+    proxy_http_baton_t *baton;
+    apr_array_header_t *pfds;
+    apr_pollfd_t pfd, *ppfd;
+    apr_int32_t nfds;
+    apr_time_t timeout;
+    apr_status_t rv;
+
+    dconf = ap_get_module_config(r->per_dir_config, &proxy_http_module);
+    if (!dconf->async_delay_set || dconf->async_delay < 0
+            || !mpm_can_suspend) {
+        return OK;
+    }
+
+    /* Only main requests on an asynchronously processed connection can be
+     * suspended, and nothing may already be buffered on the backend side
+     * (the TLS layer may hold decrypted data the poll would not see).
+     */
+    if (r->main || r->prev || !c->cs || c->master
+            || c->clogging_input_filters || backend->is_ssl
+            || PROXY_DO_100_CONTINUE(worker, r)
+            || !APR_BRIGADE_EMPTY(backend->tmp_bb)) {
+        return OK;
+    }
+
+    memset(&pfd, 0, sizeof(pfd));
+    pfd.p = r->pool;
+    pfd.desc_type = APR_POLL_SOCKET;
+    pfd.reqevents = APR_POLLIN;
+    pfd.desc.s = backend->sock;
+    rv = apr_poll(&pfd, 1, &nfds, dconf->async_delay);
+    if (!APR_STATUS_IS_TIMEUP(rv)) {
+        /* readable (or in error), let the synchronous path handle it */
+        return OK;
+    }
+
+    if (dconf->async_idle_timeout_set) {
+        timeout = dconf->async_idle_timeout;
+    }
+    else if (worker->s->timeout_set) {
+        timeout = worker->s->timeout;
+    }
+    else {
+        timeout = r->server->timeout;
+    }
+
+    baton = apr_pcalloc(r->pool, sizeof(*baton));
+    baton->r = r;
+    baton->backend = backend;
+    baton->worker = worker;
+    baton->conf = conf;
+    baton->proxy_function = proxy_function;
+    baton->server_portstr = apr_pstrdup(r->pool, server_portstr);
+    apr_pool_create(&baton->subpool, r->pool);
+
+    pfds = apr_array_make(baton->subpool, 1, sizeof(apr_pollfd_t));
+    ppfd = apr_array_push(pfds);
+    ppfd->desc_type = APR_POLL_SOCKET;
+    ppfd->reqevents = APR_POLLIN | APR_POLLERR | APR_POLLHUP;
+    ppfd->desc.s = backend->sock;
+    ppfd->p = baton->subpool;
+
+    rv = ap_mpm_register_poll_callback_timeout(pfds,
+                                               proxy_http_async_callback,
+                                               proxy_http_async_timeout,
+                                               baton, timeout);
+    if (rv == APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_TRACE1, 0, r,
+                      "HTTP: suspending request while waiting for "
+                      "backend %s:%d", backend->hostname, backend->port);
+        return SUSPENDED;
+    }
+
+    apr_pool_destroy(baton->subpool);
+    if (!APR_STATUS_IS_ENOTIMPL(rv)) {
+        ap_log_rerror(APLOG_MARK, APLOG_WARNING, rv, r, APLOGNO(03474)
+                      "HTTP: could not register backend with the MPM, "
+                      "waiting synchronously");
+    }
+    return OK;
+}
+
 /*
  * This handles http:// URLs, and other URLs using a remote proxy over http
  * If proxyhost is NULL, then contact the server directly, otherwise
@@ -2127,7 +2364,14 @@ static int proxy_http_handler(request_rec *r, proxy_worker *worker,
             }
         }
 
-        /* Step Five: Receive the Response... Fall thru to cleanup */
+        /* Step Five: Receive the Response... Fall thru to cleanup,
+         * unless the request got suspended until the backend answers.
+         */
+        status = proxy_http_async_wait(r, backend, worker, conf,
+                                       proxy_function, server_portstr);
+        if (status == SUSPENDED) {
+            return SUSPENDED;
+        }
         status = ap_proxy_http_process_response(p, r, &backend, worker,
                                                 conf, server_portstr);
 
@@ -2155,19 +2399,82 @@ static int proxy_http_post_config(apr_pool_t *pconf, apr_pool_t *plog,
         return OK;
     }
 
-    if (!ap_proxy_clear_connection_fn) {
-        ap_proxy_clear_connection_fn =
-                APR_RETRIEVE_OPTIONAL_FN(ap_proxy_clear_connection);
-        if (!ap_proxy_clear_connection_fn) {
-            ap_log_error(APLOG_MARK, APLOG_EMERG, 0, s, APLOGNO(02477)
-                         "mod_proxy must be loaded for mod_proxy_http");
-            return !OK;
-        }
+    {
+        int can_poll = 0, is_async = 0;
+        ap_mpm_query(AP_MPMQ_CAN_POLL, &can_poll);
+        ap_mpm_query(AP_MPMQ_IS_ASYNC, &is_async);
+        mpm_can_suspend = can_poll && is_async;
     }
 
     return OK;
 }
 
+static void *create_proxy_http_dir_config(apr_pool_t *p, char *dummy)
+{
+    return apr_pcalloc(p, sizeof(proxy_http_dir_conf));
+}
+
+static void *merge_proxy_http_dir_config(apr_pool_t *p, void *basev,
+                                         void *addv)
+{
+    proxy_http_dir_conf *new = apr_pcalloc(p, sizeof(proxy_http_dir_conf));
+    proxy_http_dir_conf *base = (proxy_http_dir_conf *)basev;
+    proxy_http_dir_conf *add = (proxy_http_dir_conf *)addv;
+
+    new->async_delay = (add->async_delay_set == 0) ? base->async_delay
+                                                   : add->async_delay;
+    new->async_delay_set = add->async_delay_set || base->async_delay_set;
+    new->async_idle_timeout = (add->async_idle_timeout_set == 0)
+                              ? base->async_idle_timeout
+                              : add->async_idle_timeout;
+    new->async_idle_timeout_set = add->async_idle_timeout_set
+                                  || base->async_idle_timeout_set;
+    return new;
+}
+
+static const char *set_async_delay(cmd_parms *cmd, void *conf,
+                                   const char *val)
+{
+    proxy_http_dir_conf *dconf = conf;
+
+    dconf->async_delay_set = 1;
+    if (!ap_cstr_casecmp(val, "off")) {
+        dconf->async_delay = -1;
+        return NULL;
+    }
+    if (ap_timeout_parameter_parse(val, &dconf->async_delay, "ms")
+            != APR_SUCCESS || dconf->async_delay < 0) {
+        return "ProxyHTTPAsyncDelay timeout has wrong format";
+    }
+    return NULL;
+}
+
+static const char *set_async_idle_timeout(cmd_parms *cmd, void *conf,
+                                          const char *val)
+{
+    proxy_http_dir_conf *dconf = conf;
+
+    if (ap_timeout_parameter_parse(val, &dconf->async_idle_timeout, "s")
+            != APR_SUCCESS || dconf->async_idle_timeout <= 0) {
+        return "ProxyHTTPAsyncIdleTimeout timeout has wrong format";
+    }
+    dconf->async_idle_timeout_set = 1;
+    return NULL;
+}
+
+static const command_rec proxy_http_cmds[] =
+{
+    AP_INIT_TAKE1("ProxyHTTPAsyncDelay", set_async_delay, NULL,
+                  RSRC_CONF|ACCESS_CONF,
+                  "time to wait for the backend response before releasing "
+                  "the worker thread (async MPMs only), or 'off'"),
+    AP_INIT_TAKE1("ProxyHTTPAsyncIdleTimeout", set_async_idle_timeout, NULL,
+                  RSRC_CONF|ACCESS_CONF,
+                  "maximum time a released request waits for the backend "
+                  "response, defaults to the worker/server timeout"),
+    {NULL}
+};
+
 static void ap_proxy_http_register_hook(apr_pool_t *p)
 {
     ap_hook_post_config(proxy_http_post_config, NULL, NULL, APR_HOOK_MIDDLE);
@@ -2178,11 +2485,11 @@ static void ap_proxy_http_register_hook(apr_pool_t *p)
 
 AP_DECLARE_MODULE(proxy_http) = {
     STANDARD20_MODULE_STUFF,
-    NULL,              /* create per-directory config structure */
-    NULL,              /* merge per-directory config structures */
+    create_proxy_http_dir_config, /* create per-directory config structure */
+    merge_proxy_http_dir_config,  /* merge per-directory config structures */
     NULL,              /* create per-server config structure */
     NULL,              /* merge per-server config structures */
-    NULL,              /* command apr_table_t */
+    proxy_http_cmds,   /* command apr_table_t */
     ap_proxy_http_register_hook/* register hooks */
 };
 
@@ -156,6 +156,8 @@ static void proxy_wstunnel_finish(ws_baton_t *baton) {
     baton->proxy_connrec->close = 1; /* new handshake expected on each back-conn */
     baton->r->connection->keepalive = AP_CONN_CLOSE;
     ap_proxy_release_connection(baton->scheme, baton->proxy_connrec, baton->r->server);
+    /* what proxy_handler() left to do when we suspended the request */
+    ap_proxy_request_resumed(baton->r, OK);
     ap_finalize_request_protocol(baton->r);
     ap_lingering_close(baton->r->connection);
     apr_socket_close(baton->client_soc);
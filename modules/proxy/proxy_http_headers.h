@@ -0,0 +1,101 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROXY_HTTP_HEADERS_H_
+#define PROXY_HTTP_HEADERS_H_
+
+/**
+ * @file  proxy_http_headers.h
+ * @brief Classification of the backend response headers, private to
+ * mod_proxy_http (and test/bench_proxy_headers.c).
+ *
+ * @ingroup MOD_PROXY
+ * @{
+ */
+
+#include "httpd.h"
+
+/* How mod_proxy_http handles the headers received from the backend */
+#define BACKEND_HDR_PLAIN       0   /* stored as is */
+#define BACKEND_HDR_DATE        1   /* canonicalised date */
+#define BACKEND_HDR_LOCATION    2   /* ProxyPassReverse */
+#define BACKEND_HDR_COOKIE      3   /* ProxyPassReverseCookie{Domain,Path} */
+#define BACKEND_HDR_WARNING     4   /* stored, cleaned up if dated wrongly */
+#define BACKEND_HDR_CONNECTION  5   /* tokens recorded, not stored */
+#define BACKEND_HDR_HOP_BY_HOP  6   /* not stored */
+
+/*
+ * Find out what to do with the header named key (of length len), without
+ * comparing it against every name we care about.
+ */
+static APR_INLINE int classify_backend_header(const char *key, apr_size_t len)
+{
+#define HDR_IS(name) (!ap_cstr_casecmp(key, name))
+    switch (len) {
+    case 2:
+        return HDR_IS("TE") ? BACKEND_HDR_HOP_BY_HOP : BACKEND_HDR_PLAIN;
+    case 3:
+        return HDR_IS("URI") ? BACKEND_HDR_LOCATION : BACKEND_HDR_PLAIN;
+    case 4:
+        return HDR_IS("Date") ? BACKEND_HDR_DATE : BACKEND_HDR_PLAIN;
+    case 7:
+        if (HDR_IS("Expires")) {
+            return BACKEND_HDR_DATE;
+        }
+        if (HDR_IS("Warning")) {
+            return BACKEND_HDR_WARNING;
+        }
+        if (HDR_IS("Trailer") || HDR_IS("Upgrade")) {
+            return BACKEND_HDR_HOP_BY_HOP;
+        }
+        break;
+    case 8:
+        return HDR_IS("Location") ? BACKEND_HDR_LOCATION : BACKEND_HDR_PLAIN;
+    case 10:
+        if (HDR_IS("Set-Cookie")) {
+            return BACKEND_HDR_COOKIE;
+        }
+        if (HDR_IS("Connection")) {
+            return BACKEND_HDR_CONNECTION;
+        }
+        if (HDR_IS("Keep-Alive")) {
+            return BACKEND_HDR_HOP_BY_HOP;
+        }
+        break;
+    case 11:
+        return HDR_IS("Destination") ? BACKEND_HDR_LOCATION
+                                     : BACKEND_HDR_PLAIN;
+    case 13:
+        return HDR_IS("Last-Modified") ? BACKEND_HDR_DATE : BACKEND_HDR_PLAIN;
+    case 16:
+        if (HDR_IS("Content-Location")) {
+            return BACKEND_HDR_LOCATION;
+        }
+        if (HDR_IS("Proxy-Connection")) {
+            return BACKEND_HDR_HOP_BY_HOP;
+        }
+        break;
+    case 18:
+        return HDR_IS("Proxy-Authenticate") ? BACKEND_HDR_HOP_BY_HOP
+                                            : BACKEND_HDR_PLAIN;
+    }
+    return BACKEND_HDR_PLAIN;
+#undef HDR_IS
+}
+
+/** @} */
+
+#endif /* PROXY_HTTP_HEADERS_H_ */
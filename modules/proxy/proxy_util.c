@@ -36,6 +36,10 @@
 #if APR_HAVE_SYS_UN_H
 #include <sys/un.h>
 #endif
+#if HAVE_SPLICE
+#include <fcntl.h>          /* for splice() */
+#include <errno.h>
+#endif
 #if (APR_MAJOR_VERSION < 2)
 #include "apr_support.h"        /* for apr_wait_for_io_or_timeout() */
 #endif
@@ -3832,6 +3836,174 @@ PROXY_DECLARE(apr_status_t) ap_proxy_buckets_lifetime_transform(request_rec *r,
     return rv;
 }
 
+#if HAVE_SPLICE
+/*
+ * Zero-copy tunneling: when nothing but the core (and mod_logio, which
+ * we account for here) sits on both filter chains, move the bytes from
+ * one socket to the other through a pipe with splice(2), so that they
+ * never get copied to user space.
+ */
+static APR_OPTIONAL_FN_TYPE(ap_logio_add_bytes_in) *proxy_logio_add_bytes_in;
+static APR_OPTIONAL_FN_TYPE(ap_logio_add_bytes_out) *proxy_logio_add_bytes_out;
+
+typedef struct {
+    int fds[2];
+} proxy_splice_pipe_t;
+
+static apr_status_t proxy_splice_pipe_cleanup(void *data)
+{
+    proxy_splice_pipe_t *sp = data;
+
+    close(sp->fds[0]);
+    close(sp->fds[1]);
+    return APR_SUCCESS;
+}
+
+/* The pipe is per inbound connection, kept in its proxy conn_config slot */
+static proxy_splice_pipe_t *proxy_splice_pipe_get(conn_rec *c)
+{
+    proxy_splice_pipe_t *sp = ap_get_module_config(c->conn_config,
+                                                   &proxy_module);
+    if (!sp) {
+        sp = apr_palloc(c->pool, sizeof(*sp));
+        if (pipe2(sp->fds, O_NONBLOCK | O_CLOEXEC) != 0) {
+            return NULL;
+        }
+        apr_pool_cleanup_register(c->pool, sp, proxy_splice_pipe_cleanup,
+                                  apr_pool_cleanup_null);
+        ap_set_module_config(c->conn_config, &proxy_module, sp);
+    }
+    return sp;
+}
+
+static int proxy_splice_eligible(request_rec *r, conn_rec *c_i,
+                                 conn_rec *c_o)
+{
+    ap_filter_t *f;
+
+    if (apr_table_get(r->subprocess_env, "proxy-nosplice")) {
+        return 0;
+    }
+    for (f = c_i->input_filters; f; f = f->next) {
+        if (f->frec != ap_core_input_filter_handle
+                && ap_cstr_casecmp(f->frec->name, "log_input_output")) {
+            return 0;
+        }
+    }
+    if (ap_filter_input_pending(c_i) == OK) {
+        return 0;
+    }
+    for (f = c_o->output_filters; f; f = f->next) {
+        if (f->frec != ap_core_output_filter_handle
+                || (f->bb && !APR_BRIGADE_EMPTY(f->bb))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Wait for the outbound socket to be writable, within its timeout */
+static apr_status_t proxy_splice_wait(apr_socket_t *sock, apr_pool_t *p)
+{
+    apr_interval_time_t timeout;
+    apr_pollfd_t pfd;
+    apr_int32_t nfds;
+    apr_status_t rv;
+
+    apr_socket_timeout_get(sock, &timeout);
+    memset(&pfd, 0, sizeof(pfd));
+    pfd.p = p;
+    pfd.desc_type = APR_POLL_SOCKET;
+    pfd.reqevents = APR_POLLOUT;
+    pfd.desc.s = sock;
+    do {
+        rv = apr_poll(&pfd, 1, &nfds, timeout);
+    } while (APR_STATUS_IS_EINTR(rv));
+    return rv;
+}
+
+static apr_status_t proxy_splice_transfer(request_rec *r, conn_rec *c_i,
+                                          conn_rec *c_o,
+                                          proxy_splice_pipe_t *sp,
+                                          const char *name, int *sent,
+                                          apr_off_t bsize)
+{
+    apr_socket_t *sock_i = ap_get_conn_socket(c_i);
+    apr_socket_t *sock_o = ap_get_conn_socket(c_o);
+    apr_os_sock_t fd_i, fd_o;
+    apr_status_t rv = APR_SUCCESS;
+    ssize_t n, pending;
+
+    apr_os_sock_get(&fd_i, sock_i);
+    apr_os_sock_get(&fd_o, sock_o);
+
+    for (;;) {
+        n = splice(fd_i, NULL, sp->fds[1], NULL, (size_t)bsize,
+                   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n == 0) {
+            rv = APR_EOF;
+            break;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                rv = APR_FROM_OS_ERROR(errno);
+                ap_log_rerror(APLOG_MARK, APLOG_DEBUG, rv, r, APLOGNO(03475)
+                              "ap_proxy_transfer_between_connections: "
+                              "error on %s - splice in", name);
+            }
+            break;
+        }
+        if (proxy_logio_add_bytes_in) {
+            proxy_logio_add_bytes_in(c_i, n);
+        }
+
+        /* Drain the pipe entirely before reading more, so that it is
+         * always empty when we return.
+         */
+        pending = n;
+        while (pending > 0) {
+            n = splice(sp->fds[0], NULL, fd_o, NULL, (size_t)pending,
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n > 0) {
+                pending -= n;
+                if (proxy_logio_add_bytes_out) {
+                    proxy_logio_add_bytes_out(c_o, n);
+                }
+                continue;
+            }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && errno == EAGAIN) {
+                rv = proxy_splice_wait(sock_o, r->pool);
+                if (rv == APR_SUCCESS) {
+                    continue;
+                }
+            }
+            else {
+                rv = (n < 0) ? APR_FROM_OS_ERROR(errno) : APR_EPIPE;
+            }
+            ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(03476)
+                          "ap_proxy_transfer_between_connections: "
+                          "error on %s - splice out", name);
+            c_o->aborted = 1;
+            return rv;
+        }
+        if (sent) {
+            *sent = 1;
+        }
+    }
+
+    ap_log_rerror(APLOG_MARK, APLOG_TRACE2, rv, r,
+                  "ap_proxy_transfer_between_connections (splice) complete");
+
+    return rv;
+}
+#endif /* HAVE_SPLICE */
+
 PROXY_DECLARE(apr_status_t) ap_proxy_transfer_between_connections(
                                                        request_rec *r,
                                                        conn_rec *c_i,
@@ -3848,6 +4020,18 @@ PROXY_DECLARE(apr_status_t) ap_proxy_transfer_between_connections(
     apr_off_t len;
 #endif
 
+#if HAVE_SPLICE
+    if (proxy_splice_eligible(r, c_i, c_o)) {
+        proxy_splice_pipe_t *sp = proxy_splice_pipe_get(c_i);
+        if (sp) {
+            if (c_o->aborted) {
+                return APR_EPIPE;
+            }
+            return proxy_splice_transfer(r, c_i, c_o, sp, name, sent, bsize);
+        }
+    }
+#endif
+
     do {
         apr_brigade_cleanup(bb_i);
         rv = ap_get_brigade(c_i->input_filters, bb_i, AP_MODE_READBYTES,
@@ -3927,8 +4111,21 @@ PROXY_DECLARE (const char *) ap_proxy_show_hcmethod(hcmethod_t method)
     return "???";
 }
 
+#if HAVE_SPLICE
+static int proxy_util_post_config(apr_pool_t *pconf, apr_pool_t *plog,
+                                  apr_pool_t *ptemp, server_rec *s)
+{
+    proxy_logio_add_bytes_in = APR_RETRIEVE_OPTIONAL_FN(ap_logio_add_bytes_in);
+    proxy_logio_add_bytes_out = APR_RETRIEVE_OPTIONAL_FN(ap_logio_add_bytes_out);
+    return OK;
+}
+#endif
+
 void proxy_util_register_hooks(apr_pool_t *p)
 {
     APR_REGISTER_OPTIONAL_FN(ap_proxy_retry_worker);
     APR_REGISTER_OPTIONAL_FN(ap_proxy_clear_connection);
+#if HAVE_SPLICE
+    ap_hook_post_config(proxy_util_post_config, NULL, NULL, APR_HOOK_MIDDLE);
+#endif
 }
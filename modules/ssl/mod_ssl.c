@@ -111,6 +111,9 @@ static const command_rec ssl_config_cmds[] = {
     SSL_CMD_SRV(SessionTicketKeyFile, TAKE1,
                 "TLS session ticket encryption/decryption key file (RFC 5077) "
                 "('/path/to/file' - file with 48 bytes of random data)")
+    SSL_CMD_SRV(SessionTicketKeyRotation, TAKE1,
+                "Rotation interval of automatically generated TLS session "
+                "ticket keys ('N' - number of seconds, or 'off')")
 #endif
     SSL_CMD_ALL(CACertificatePath, TAKE1,
                 "SSL CA Certificate path "
@@ -162,6 +165,23 @@ static const command_rec ssl_config_cmds[] = {
     SSL_CMD_SRV(SessionTickets, FLAG,
                 "Enable or disable TLS session tickets"
                 "(`on', `off')")
+    SSL_CMD_SRV(LazyInit, FLAG,
+                "Build the SSL context of the server on its first use "
+                "(`on', `off')")
+    SSL_CMD_SRV(LazyInitCacheSize, TAKE1,
+                "Maximum number of SSL contexts built on their first use "
+                "kept by a child process ('N' - number of contexts, 0 for "
+                "no limit)")
+    SSL_CMD_SRV(RecordWarmUpSize, TAKE1,
+                "Number of bytes a connection writes in small TLS records "
+                "before using full sized ones ('N' - bytes, 0 to always "
+                "use full sized records)")
+    SSL_CMD_SRV(RecordCoolDown, TAKE1,
+                "Idle time after which a connection goes back to small TLS "
+                "records (seconds, or with a 'ms' suffix; 0 to disable)")
+    SSL_CMD_SRV(KernelTLS, FLAG,
+                "Let the kernel encrypt the data sent to clients, where "
+                "supported (`on', `off')")
     SSL_CMD_SRV(InsecureRenegotiation, FLAG,
                 "Enable support for insecure renegotiation")
     SSL_CMD_ALL(UserName, TAKE1,
@@ -289,6 +309,9 @@ static const command_rec ssl_config_cmds[] = {
                 "SSL stapling option for OCSP Response Error Cache Lifetime")
     SSL_CMD_SRV(StaplingForceURL, TAKE1,
                 "SSL stapling option to Force the OCSP Stapling URL")
+    SSL_CMD_SRV(StaplingBackgroundRefresh, FLAG,
+                "SSL stapling switch to refresh OCSP responses in the "
+                "background rather than during handshakes (`on', `off')")
 #endif
 
 #ifdef HAVE_SSL_CONF_CMD
@@ -517,6 +540,7 @@ int ssl_init_ssl_connection(conn_rec *c, request_rec *r)
     int rc;
     modssl_ctx_t *mctx;
     server_rec *server;
+    SSL_CTX *ctx;
 
     /*
      * Create or retrieve SSL context
@@ -538,7 +562,10 @@ int ssl_init_ssl_connection(conn_rec *c, request_rec *r)
      * attach this to the socket. Additionally we register this attachment
      * so we can detach later.
      */
-    if (!(sslconn->ssl = ssl = SSL_new(mctx->ssl_ctx))) {
+    ctx = ssl_init_lazy_ctx_acquire(server, mctx);
+    sslconn->ssl = ssl = ctx ? SSL_new(ctx) : NULL;
+    ssl_init_lazy_ctx_release(mctx, ctx);
+    if (!ssl) {
         ap_log_cerror(APLOG_MARK, APLOG_ERR, 0, c, APLOGNO(01962)
                       "Unable to create a new SSL connection from the SSL "
                       "context");
@@ -74,6 +74,11 @@ SSLModConfigRec *ssl_config_global_create(server_rec *s)
     mc->stapling_cache_mutex   = NULL;
     mc->stapling_refresh_mutex = NULL;
 #endif
+#ifdef HAVE_TLS_SESSION_TICKETS
+    mc->ticket_keys_shm        = NULL;
+    mc->ticket_keys            = NULL;
+#endif
+    mc->lazy_cache             = NULL;
 
     apr_pool_userdata_set(mc, SSL_MOD_CONFIG_KEY,
                           apr_pool_cleanup_null,
@@ -103,6 +108,7 @@ static void modssl_ctx_init(modssl_ctx_t *mctx, apr_pool_t *p)
     mctx->sc                  = NULL; /* set during module init */
 
     mctx->ssl_ctx             = NULL; /* set during module init */
+    mctx->lazy                = NULL; /* set during module init */
 
     mctx->pks                 = NULL;
     mctx->pkp                 = NULL;
@@ -208,6 +214,17 @@ static SSLSrvConfigRec *ssl_config_server_new(apr_pool_t *p)
     sc->compression            = UNSET;
 #endif
     sc->session_tickets        = UNSET;
+#ifdef HAVE_TLS_SESSION_TICKETS
+    sc->ticket_key_rotation    = UNSET;
+#endif
+    sc->lazy_init              = UNSET;
+    sc->lazy_cache_size        = UNSET;
+    sc->record_warmup_size     = UNSET;
+    sc->record_cooldown        = UNSET;
+    sc->ktls                   = UNSET;
+#ifdef HAVE_OCSP_STAPLING
+    sc->stapling_background    = UNSET;
+#endif
 
     modssl_ctx_init_server(sc, p);
 
@@ -336,6 +353,17 @@ void *ssl_config_server_merge(apr_pool_t *p, void *basev, void *addv)
     cfgMergeBool(compression);
 #endif
     cfgMergeBool(session_tickets);
+#ifdef HAVE_TLS_SESSION_TICKETS
+    cfgMergeInt(ticket_key_rotation);
+#endif
+    cfgMergeBool(lazy_init);
+    cfgMergeInt(lazy_cache_size);
+    cfgMergeInt(record_warmup_size);
+    cfgMergeInt(record_cooldown);
+    cfgMergeBool(ktls);
+#ifdef HAVE_OCSP_STAPLING
+    cfgMergeBool(stapling_background);
+#endif
 
     modssl_ctx_cfg_merge_server(p, base->server, add->server, mrg->server);
 
@@ -786,6 +814,73 @@ const char *ssl_cmd_SSLSessionTickets(cmd_parms *cmd, void *dcfg, int flag)
     return NULL;
 }
 
+const char *ssl_cmd_SSLLazyInit(cmd_parms *cmd, void *dcfg, int flag)
+{
+    SSLSrvConfigRec *sc = mySrvConfig(cmd->server);
+
+    sc->lazy_init = flag ? TRUE : FALSE;
+
+    return NULL;
+}
+
+const char *ssl_cmd_SSLLazyInitCacheSize(cmd_parms *cmd, void *dcfg,
+                                         const char *arg)
+{
+    SSLSrvConfigRec *sc = mySrvConfig(cmd->server);
+    const char *err;
+
+    if ((err = ap_check_cmd_context(cmd, GLOBAL_ONLY))) {
+        return err;
+    }
+
+    sc->lazy_cache_size = atoi(arg);
+
+    if (sc->lazy_cache_size < 0) {
+        return "SSLLazyInitCacheSize: Invalid argument";
+    }
+
+    return NULL;
+}
+
+const char *ssl_cmd_SSLRecordWarmUpSize(cmd_parms *cmd, void *dcfg,
+                                        const char *arg)
+{
+    SSLSrvConfigRec *sc = mySrvConfig(cmd->server);
+    char *end;
+
+    if (apr_strtoff(&sc->record_warmup_size, arg, &end, 10) != APR_SUCCESS
+        || *end || sc->record_warmup_size < 0) {
+        return "SSLRecordWarmUpSize: Invalid argument";
+    }
+
+    return NULL;
+}
+
+const char *ssl_cmd_SSLRecordCoolDown(cmd_parms *cmd, void *dcfg,
+                                      const char *arg)
+{
+    SSLSrvConfigRec *sc = mySrvConfig(cmd->server);
+
+    if (ap_timeout_parameter_parse(arg, &sc->record_cooldown, "s")
+        != APR_SUCCESS || sc->record_cooldown < 0) {
+        return "SSLRecordCoolDown: Invalid argument";
+    }
+
+    return NULL;
+}
+
+const char *ssl_cmd_SSLKernelTLS(cmd_parms *cmd, void *dcfg, int flag)
+{
+#ifdef HAVE_KTLS
+    SSLSrvConfigRec *sc = mySrvConfig(cmd->server);
+    sc->ktls = flag ? TRUE : FALSE;
+    return NULL;
+#else
+    return "The SSLKernelTLS directive is not available on this platform "
+        "or with this SSL library";
+#endif
+}
+
 const char *ssl_cmd_SSLInsecureRenegotiation(cmd_parms *cmd, void *dcfg, int flag)
 {
 #ifdef SSL_OP_ALLOW_UNSAFE_LEGACY_RENEGOTIATION
@@ -884,6 +979,30 @@ const char *ssl_cmd_SSLSessionTicketKeyFile(cmd_parms *cmd,
 
     return NULL;
 }
+
+const char *ssl_cmd_SSLSessionTicketKeyRotation(cmd_parms *cmd,
+                                                void *dcfg,
+                                                const char *arg)
+{
+    SSLSrvConfigRec *sc = mySrvConfig(cmd->server);
+    const char *err;
+
+    if ((err = ap_check_cmd_context(cmd, GLOBAL_ONLY))) {
+        return err;
+    }
+
+    if (strcEQ(arg, "off")) {
+        sc->ticket_key_rotation = 0;
+    }
+    else {
+        sc->ticket_key_rotation = atoi(arg);
+        if (sc->ticket_key_rotation <= 0) {
+            return "SSLSessionTicketKeyRotation: Invalid argument";
+        }
+    }
+
+    return NULL;
+}
 #endif
 
 #define NO_PER_DIR_SSL_CA \
@@ -1882,6 +2001,20 @@ const char *ssl_cmd_SSLStaplingForceURL(cmd_parms *cmd, void *dcfg,
     return NULL;
 }
 
+const char *ssl_cmd_SSLStaplingBackgroundRefresh(cmd_parms *cmd, void *dcfg,
+                                                int flag)
+{
+    SSLSrvConfigRec *sc = mySrvConfig(cmd->server);
+    const char *err;
+
+    if ((err = ap_check_cmd_context(cmd, GLOBAL_ONLY))) {
+        return err;
+    }
+
+    sc->stapling_background = flag ? TRUE : FALSE;
+    return NULL;
+}
+
 #endif /* HAVE_OCSP_STAPLING */
 
 #ifdef HAVE_SSL_CONF_CMD
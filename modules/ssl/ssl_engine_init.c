@@ -242,6 +242,14 @@ apr_status_t ssl_init_Module(apr_pool_t *p, apr_pool_t *plog,
             sc->session_cache_timeout = SSL_SESSION_CACHE_TIMEOUT;
         }
 
+        if (sc->record_warmup_size == UNSET) {
+            sc->record_warmup_size = SSL_RECORD_WARMUP_SIZE;
+        }
+
+        if (sc->record_cooldown == UNSET) {
+            sc->record_cooldown = SSL_RECORD_COOLDOWN;
+        }
+
         if (sc->server && sc->server->pphrase_dialog_type == SSL_PPTYPE_UNSET) {
             sc->server->pphrase_dialog_type = SSL_PPTYPE_BUILTIN;
         }
@@ -315,8 +323,20 @@ apr_status_t ssl_init_Module(apr_pool_t *p, apr_pool_t *plog,
         return rv;
     }
 
+#ifdef HAVE_TLS_SESSION_TICKETS
+    /*
+     * initialize automatic session ticket keys
+     */
+    if ((rv = ssl_ticket_keys_init(base_server, p)) != APR_SUCCESS) {
+        return rv;
+    }
+#endif
+
     pphrases = apr_array_make(ptemp, 2, sizeof(char *));
 
+    /* rebuilt for every configuration */
+    mc->lazy_cache = NULL;
+
     /*
      *  initialize servers
      */
@@ -354,12 +374,23 @@ apr_status_t ssl_init_Module(apr_pool_t *p, apr_pool_t *plog,
         return rv;
     }
 
+#ifdef HAVE_OCSP_STAPLING
+    /*
+     * refresh the OCSP responses of the certificates configured above
+     * in the background
+     */
+    if ((rv = ssl_stapling_refresh_init(base_server, p)) != APR_SUCCESS) {
+        return rv;
+    }
+#endif
+
     for (s = base_server; s; s = s->next) {
         SSLDirConfigRec *sdc = ap_get_module_config(s->lookup_defaults,
                                                     &ssl_module);
 
         sc = mySrvConfig(s);
-        if (sc->enabled == SSL_ENABLED_TRUE || sc->enabled == SSL_ENABLED_OPTIONAL) {
+        if ((sc->enabled == SSL_ENABLED_TRUE || sc->enabled == SSL_ENABLED_OPTIONAL)
+            && !sc->server->lazy) {
             if ((rv = ssl_run_init_server(s, p, 0, sc->server->ssl_ctx)) != APR_SUCCESS) {
                 return rv;
             }
@@ -697,6 +728,16 @@ static apr_status_t ssl_init_ctx_protocol(server_rec *s,
     }
 #endif
 
+#ifdef HAVE_KTLS
+    /*
+     * Have OpenSSL hand the keys to the output BIO once the handshake
+     * is done, which installs them into the client's socket.
+     */
+    if (sc->ktls == TRUE && !mctx->pkp) {
+        SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+    }
+#endif
+
 #ifdef SSL_OP_ALLOW_UNSAFE_LEGACY_RENEGOTIATION
     if (sc->insecure_reneg == TRUE) {
         SSL_CTX_set_options(ctx, SSL_OP_ALLOW_UNSAFE_LEGACY_RENEGOTIATION);
@@ -1217,8 +1258,13 @@ static apr_status_t ssl_init_server_certs(server_rec *s,
 
             ERR_clear_error();
 
-            /* perhaps it's an encrypted private key, so try again */
-            ssl_load_encrypted_pkey(s, ptemp, i, keyfile, &pphrases);
+            /* perhaps it's an encrypted private key, so try again, unless
+             * built on demand (no pass phrase dialog then, only the keys
+             * decrypted at an earlier startup can be used)
+             */
+            if (pphrases) {
+                ssl_load_encrypted_pkey(s, ptemp, i, keyfile, &pphrases);
+            }
 
             if (!(asn1 = ssl_asn1_table_get(mc->tPrivateKey, key_id)) ||
                 !(ptr = asn1->cpData) ||
@@ -1354,6 +1400,25 @@ static apr_status_t ssl_init_ticket_key(server_rec *s,
     modssl_ticket_key_t *ticket_key = mctx->ticket_key;
 
     if (!ticket_key->file_path) {
+        if (mctx->sc->ticket_key_rotation <= 0
+            || mctx->sc->session_tickets == FALSE
+            || !myModConfig(s)->ticket_keys) {
+            return APR_SUCCESS;
+        }
+
+        if (!SSL_CTX_set_tlsext_ticket_key_cb(mctx->ssl_ctx,
+                                              ssl_callback_SessionTicket)) {
+            ap_log_error(APLOG_MARK, APLOG_EMERG, 0, s, APLOGNO(03509)
+                         "Unable to initialize TLS session ticket key "
+                         "callback (incompatible OpenSSL version?)");
+            ssl_log_ssl_error(SSLLOG_MARK, APLOG_EMERG, s);
+            return ssl_die(s);
+        }
+
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(03510)
+                     "TLS session ticket keys for %s are generated and "
+                     "rotated automatically", mctx->sc->vhost_id);
+
         return APR_SUCCESS;
     }
 
@@ -1665,6 +1730,13 @@ static apr_status_t ssl_init_server_ctx(server_rec *s,
     }
 
 #ifdef HAVE_SSL_CONF_CMD
+    if (!cctx) {
+        /* built again on demand, the one from the config is gone */
+        cctx = SSL_CONF_CTX_new();
+        SSL_CONF_CTX_set_flags(cctx, SSL_CONF_FLAG_FILE);
+        SSL_CONF_CTX_set_flags(cctx, SSL_CONF_FLAG_SERVER);
+        SSL_CONF_CTX_set_flags(cctx, SSL_CONF_FLAG_CERTIFICATE);
+    }
     SSL_CONF_CTX_set_ssl_ctx(cctx, sc->server->ssl_ctx);
     for (i = 0; i < sc->server->ssl_ctx_param->nelts; i++, param++) {
         ERR_clear_error();
@@ -1684,10 +1756,12 @@ static apr_status_t ssl_init_server_ctx(server_rec *s,
             ap_log_error(APLOG_MARK, APLOG_EMERG, 0, s, APLOGNO(02547)
                          "SSL_CONF_CTX_finish() failed");
             SSL_CONF_CTX_free(cctx);
+            sc->server->ssl_ctx_config = NULL;
             ssl_log_ssl_error(SSLLOG_MARK, APLOG_EMERG, s);
             return ssl_die(s);
     }
     SSL_CONF_CTX_free(cctx);
+    sc->server->ssl_ctx_config = NULL;
 #endif
 
     if (SSL_CTX_check_private_key(sc->server->ssl_ctx) != 1) {
@@ -1741,6 +1815,274 @@ static apr_status_t ssl_init_server_ctx(server_rec *s,
 /*
  * Configure a particular server
  */
+/*
+ * SSLLazyInit: the SSL_CTX of such a server is built by each child on the
+ * first connection needing it, and freed again when more than
+ * SSLLazyInitCacheSize others have been used since.  Connections hold a
+ * reference to the SSL_CTX they use, so it only goes away with the last
+ * of them, and with it the (unmanaged) pool it was built from.
+ */
+static int lazy_ctx_pool_idx = -1;
+
+static void ssl_init_lazy_ctx_free(void *parent, void *ptr,
+                                   CRYPTO_EX_DATA *ad, int idx,
+                                   long argl, void *argp)
+{
+    if (ptr) {
+        apr_pool_destroy((apr_pool_t *)ptr);
+    }
+}
+
+static BOOL ssl_init_lazy_eligible(server_rec *s, SSLSrvConfigRec *sc)
+{
+    if (sc->lazy_init != TRUE) {
+        return FALSE;
+    }
+#ifdef HAVE_OCSP_STAPLING
+    if (sc->server->stapling_enabled == TRUE) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, 0, s, APLOGNO(03512)
+                     "SSLLazyInit does not apply to %s, which uses "
+                     "SSLUseStapling", sc->vhost_id);
+        return FALSE;
+    }
+#endif
+#ifdef HAVE_SRP
+    if (sc->server->srp_vfile) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, 0, s, APLOGNO(03513)
+                     "SSLLazyInit does not apply to %s, which uses "
+                     "SSLSRPVerifierFile", sc->vhost_id);
+        return FALSE;
+    }
+#endif
+    return TRUE;
+}
+
+/* Check that the private key loaded for key_id matches the (first)
+ * certificate of certfile
+ */
+static apr_status_t ssl_init_lazy_check_pair(server_rec *s,
+                                             const char *key_id,
+                                             const char *certfile,
+                                             const char *keyfile)
+{
+    SSLModConfigRec *mc = myModConfig(s);
+    ssl_asn1_t *asn1 = ssl_asn1_table_get(mc->tPrivateKey, key_id);
+    const unsigned char *ptr;
+    EVP_PKEY *pkey = NULL;
+    X509 *cert = NULL;
+    BIO *bio;
+    int ok;
+
+    ERR_clear_error();
+    if (asn1 && (ptr = asn1->cpData)) {
+        pkey = d2i_AutoPrivateKey(NULL, &ptr, asn1->nData);
+    }
+    if ((bio = BIO_new_file(certfile, "r"))) {
+        cert = PEM_read_bio_X509(bio, NULL, NULL, NULL);
+        BIO_free(bio);
+    }
+    ok = (pkey && cert && X509_check_private_key(cert, pkey) == 1);
+    EVP_PKEY_free(pkey);
+    X509_free(cert);
+
+    if (!ok) {
+        ap_log_error(APLOG_MARK, APLOG_EMERG, 0, s, APLOGNO(03531)
+                     "Certificate and private key %s from %s and %s "
+                     "could not be loaded or do not match", key_id,
+                     certfile, keyfile);
+        ssl_log_ssl_error(SSLLOG_MARK, APLOG_EMERG, s);
+        return APR_EGENERAL;
+    }
+    return APR_SUCCESS;
+}
+
+static apr_status_t ssl_init_lazy_server(server_rec *s, apr_pool_t *p,
+                                         apr_pool_t *ptemp,
+                                         SSLSrvConfigRec *sc,
+                                         apr_array_header_t *pphrases)
+{
+    SSLModConfigRec *mc = myModConfig(s);
+    modssl_lazy_cache_t *cache = mc->lazy_cache;
+    modssl_ctx_t *mctx = sc->server;
+    modssl_lazy_ctx_t *lc;
+    const char *certfile, *keyfile, *key_id;
+    apr_status_t rv;
+    int i;
+
+    /* The children build the context once running as User, which usually
+     * can't read the private keys.  Load them now, as the pass phrase
+     * dialog would, into the table ssl_init_server_certs() falls back to,
+     * and check that each one matches its certificate.
+     */
+    for (i = 0; (i < mctx->pks->cert_files->nelts) &&
+                (certfile = APR_ARRAY_IDX(mctx->pks->cert_files, i,
+                                          const char *));
+         i++) {
+        if (i < mctx->pks->key_files->nelts) {
+            keyfile = APR_ARRAY_IDX(mctx->pks->key_files, i, const char *);
+        }
+        else {
+            keyfile = certfile;
+        }
+        key_id = apr_psprintf(ptemp, "%s:%d", sc->vhost_id, i);
+
+        if ((rv = ssl_load_encrypted_pkey(s, ptemp, i, keyfile, &pphrases))
+                != APR_SUCCESS
+            || (rv = ssl_init_lazy_check_pair(s, key_id, certfile, keyfile))
+                != APR_SUCCESS) {
+            return rv;
+        }
+    }
+
+    if (!cache) {
+        cache = apr_pcalloc(p, sizeof(*cache));
+        cache->max = (sc->lazy_cache_size == UNSET) ?
+                     SSL_LAZY_CACHE_SIZE : sc->lazy_cache_size;
+#if APR_HAS_THREADS
+        if (apr_thread_mutex_create(&cache->mutex, APR_THREAD_MUTEX_DEFAULT,
+                                    p) != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_EMERG, 0, s, APLOGNO(03514)
+                         "Cannot create the mutex for SSLLazyInit");
+            return ssl_die(s);
+        }
+#endif
+        if (lazy_ctx_pool_idx < 0) {
+            lazy_ctx_pool_idx = SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL,
+                                                         ssl_init_lazy_ctx_free);
+        }
+        mc->lazy_cache = cache;
+    }
+
+    lc = apr_pcalloc(p, sizeof(*lc));
+    lc->s = s;
+    lc->mctx = sc->server;
+    sc->server->lazy = lc;
+
+    return APR_SUCCESS;
+}
+
+static void ssl_init_lazy_unlink(modssl_lazy_cache_t *cache,
+                                 modssl_lazy_ctx_t *lc)
+{
+    if (lc->prev) {
+        lc->prev->next = lc->next;
+    }
+    else {
+        cache->first = lc->next;
+    }
+    if (lc->next) {
+        lc->next->prev = lc->prev;
+    }
+    else {
+        cache->last = lc->prev;
+    }
+    lc->prev = lc->next = NULL;
+}
+
+static apr_status_t ssl_init_lazy_build(modssl_lazy_ctx_t *lc)
+{
+    modssl_ctx_t *mctx = lc->mctx;
+    apr_pool_t *pool, *ptemp;
+    apr_status_t rv;
+
+    /* not a subpool, the last connection using the SSL_CTX frees it */
+    rv = apr_pool_create_unmanaged_ex(&pool, NULL, NULL);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    apr_pool_tag(pool, "mod_ssl_lazy_ctx");
+    apr_pool_create(&ptemp, pool);
+
+    rv = ssl_init_server_ctx(lc->s, pool, ptemp, mctx->sc, NULL);
+    if (rv == APR_SUCCESS) {
+        rv = ssl_run_init_server(lc->s, pool, 0, mctx->ssl_ctx);
+    }
+    apr_pool_destroy(ptemp);
+
+    if (rv != APR_SUCCESS) {
+        ssl_init_ctx_cleanup(mctx);
+        apr_pool_destroy(pool);
+        return rv;
+    }
+
+    SSL_CTX_set_ex_data(mctx->ssl_ctx, lazy_ctx_pool_idx, pool);
+    return APR_SUCCESS;
+}
+
+/*
+ * Returns the SSL_CTX of mctx, building it if needed, with a reference to
+ * give back with ssl_init_lazy_ctx_release() once SSL_new() or
+ * SSL_set_SSL_CTX() took theirs.
+ */
+SSL_CTX *ssl_init_lazy_ctx_acquire(server_rec *s, modssl_ctx_t *mctx)
+{
+    modssl_lazy_cache_t *cache = myModConfig(s)->lazy_cache;
+    modssl_lazy_ctx_t *lc = mctx->lazy, *victim;
+    SSL_CTX *ctx = NULL;
+    apr_status_t rv;
+
+    if (!lc) {
+        return mctx->ssl_ctx;
+    }
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(cache->mutex);
+#endif
+
+    if (mctx->ssl_ctx) {
+        ssl_init_lazy_unlink(cache, lc);
+    }
+    else if ((rv = ssl_init_lazy_build(lc)) == APR_SUCCESS) {
+        ++cache->count;
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, lc->s, APLOGNO(03515)
+                     "SSL context of %s built on demand (%d in use)",
+                     mctx->sc->vhost_id, cache->count);
+    }
+    else {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, lc->s, APLOGNO(03516)
+                     "Unable to build the SSL context of %s on demand",
+                     mctx->sc->vhost_id);
+        goto leave;
+    }
+
+    /* most recently used first */
+    lc->next = cache->first;
+    if (cache->first) {
+        cache->first->prev = lc;
+    }
+    else {
+        cache->last = lc;
+    }
+    cache->first = lc;
+
+    while (cache->max && cache->count > cache->max) {
+        victim = cache->last;
+        ssl_init_lazy_unlink(cache, victim);
+        --cache->count;
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, victim->s, APLOGNO(03517)
+                     "SSL context of %s released, least recently used",
+                     victim->mctx->sc->vhost_id);
+        SSL_CTX_free(victim->mctx->ssl_ctx);
+        victim->mctx->ssl_ctx = NULL;
+    }
+
+    ctx = mctx->ssl_ctx;
+    SSL_CTX_up_ref(ctx);
+
+leave:
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(cache->mutex);
+#endif
+    return ctx;
+}
+
+void ssl_init_lazy_ctx_release(modssl_ctx_t *mctx, SSL_CTX *ctx)
+{
+    if (mctx->lazy && ctx) {
+        SSL_CTX_free(ctx);
+    }
+}
+
 apr_status_t ssl_init_ConfigureServer(server_rec *s,
                                       apr_pool_t *p,
                                       apr_pool_t *ptemp,
@@ -1754,11 +2096,22 @@ apr_status_t ssl_init_ConfigureServer(server_rec *s,
     /* Initialize the server if SSL is enabled or optional.
      */
     if ((sc->enabled == SSL_ENABLED_TRUE) || (sc->enabled == SSL_ENABLED_OPTIONAL)) {
-        ap_log_error(APLOG_MARK, APLOG_INFO, 0, s, APLOGNO(01914)
-                     "Configuring server %s for SSL protocol", sc->vhost_id);
-        if ((rv = ssl_init_server_ctx(s, p, ptemp, sc, pphrases))
-            != APR_SUCCESS) {
-            return rv;
+        if (ssl_init_lazy_eligible(s, sc)) {
+            ap_log_error(APLOG_MARK, APLOG_INFO, 0, s, APLOGNO(03511)
+                         "Configuring server %s for SSL protocol on demand",
+                         sc->vhost_id);
+            if ((rv = ssl_init_lazy_server(s, p, ptemp, sc, pphrases))
+                != APR_SUCCESS) {
+                return rv;
+            }
+        }
+        else {
+            ap_log_error(APLOG_MARK, APLOG_INFO, 0, s, APLOGNO(01914)
+                         "Configuring server %s for SSL protocol", sc->vhost_id);
+            if ((rv = ssl_init_server_ctx(s, p, ptemp, sc, pphrases))
+                != APR_SUCCESS) {
+                return rv;
+            }
         }
     }
 
@@ -31,6 +31,19 @@
 #include "mod_ssl.h"
 #include "mod_ssl_openssl.h"
 #include "apr_date.h"
+#include "apr_poll.h"
+
+#ifdef HAVE_KTLS
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <linux/tls.h>
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#endif
 
 APR_IMPLEMENT_OPTIONAL_HOOK_RUN_ALL(ssl, SSL, int, proxy_post_handshake,
                                     (conn_rec *c,SSL *ssl),
@@ -109,6 +122,12 @@ typedef struct {
     ap_filter_t        *pInputFilter;
     ap_filter_t        *pOutputFilter;
     SSLConnRec         *config;
+    apr_size_t          record_size;    /* max. bytes per SSL_write, 0: any */
+    apr_off_t           record_bytes;   /* bytes written since warm up began */
+    apr_time_t          record_last;    /* time of the last write */
+    apr_size_t          records_small;  /* records written, per size class */
+    apr_size_t          records_medium;
+    apr_size_t          records_full;
 } ssl_filter_ctx_t;
 
 typedef struct {
@@ -116,6 +135,10 @@ typedef struct {
     conn_rec *c;
     apr_bucket_brigade *bb;    /* Brigade used as a buffer. */
     apr_status_t rc;
+#ifdef HAVE_KTLS
+    int ktls_send;             /* The kernel encrypts what we send */
+    int ktls_record_type;      /* Type of the next record, if not data */
+#endif
 } bio_filter_out_ctx_t;
 
 static bio_filter_out_ctx_t *bio_filter_out_ctx_new(ssl_filter_ctx_t *filter_ctx,
@@ -126,6 +149,10 @@ static bio_filter_out_ctx_t *bio_filter_out_ctx_new(ssl_filter_ctx_t *filter_ctx
     outctx->filter_ctx = filter_ctx;
     outctx->c = c;
     outctx->bb = apr_brigade_create(c->pool, c->bucket_alloc);
+#ifdef HAVE_KTLS
+    outctx->ktls_send = 0;
+    outctx->ktls_record_type = 0;
+#endif
 
     return outctx;
 }
@@ -160,6 +187,162 @@ static int bio_filter_out_flush(BIO *bio)
     return bio_filter_out_pass(outctx);
 }
 
+#ifdef HAVE_KTLS
+/*
+ * Kernel TLS (SSLKernelTLS).
+ *
+ * With SSL_OP_ENABLE_KTLS, OpenSSL offers the write keys to the output
+ * BIO once the handshake switches to them.  Installing them into the
+ * socket makes the kernel encrypt everything written to it from then on:
+ * OpenSSL only writes plaintext records through the BIO, and
+ * ssl_io_filter_output() passes the response buckets down untouched, so
+ * the core output filter can use sendfile() again.
+ *
+ * Records other than application data (alerts, post-handshake messages)
+ * need their type passed in a control message, so these are sent on the
+ * socket directly once all pending output has been flushed.
+ */
+static long bio_filter_out_ktls_start(bio_filter_out_ctx_t *outctx,
+                                      struct tls_crypto_info *info)
+{
+    apr_socket_t *sock = ap_get_conn_socket(outctx->c);
+    apr_os_sock_t fd;
+    socklen_t len;
+
+    switch (info->cipher_type) {
+    case TLS_CIPHER_AES_GCM_128:
+        len = sizeof(struct tls12_crypto_info_aes_gcm_128);
+        break;
+#ifdef TLS_CIPHER_AES_GCM_256
+    case TLS_CIPHER_AES_GCM_256:
+        len = sizeof(struct tls12_crypto_info_aes_gcm_256);
+        break;
+#endif
+#ifdef TLS_CIPHER_AES_CCM_128
+    case TLS_CIPHER_AES_CCM_128:
+        len = sizeof(struct tls12_crypto_info_aes_ccm_128);
+        break;
+#endif
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+    case TLS_CIPHER_CHACHA20_POLY1305:
+        len = sizeof(struct tls12_crypto_info_chacha20_poly1305);
+        break;
+#endif
+    default:
+        /* unknown to this kernel, stay in userspace */
+        return 0;
+    }
+
+    if (!sock || apr_os_sock_get(&fd, sock) != APR_SUCCESS) {
+        return 0;
+    }
+
+    if (outctx->ktls_send) {
+        /* New write keys (TLS 1.3 KeyUpdate) on a connection the kernel
+         * already encrypts: the ULP is in place, and if the kernel
+         * refuses the keys it would keep encrypting with the old ones,
+         * so there is no falling back to userspace.
+         */
+        if (setsockopt(fd, SOL_TLS, TLS_TX, info, len) < 0) {
+            ap_log_cerror(APLOG_MARK, APLOG_ERR, apr_get_netos_error(),
+                          outctx->c, APLOGNO(03532)
+                          "kernel TLS refused the updated keys, "
+                          "closing the connection");
+            outctx->rc = APR_EGENERAL;
+            outctx->c->aborted = 1;
+            return 0;
+        }
+        ap_log_cerror(APLOG_MARK, APLOG_TRACE1, 0, outctx->c,
+                      "kernel TLS keys updated for sending");
+        return 1;
+    }
+
+    if (setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) < 0
+        || setsockopt(fd, SOL_TLS, TLS_TX, info, len) < 0) {
+        ap_log_cerror(APLOG_MARK, APLOG_DEBUG, apr_get_netos_error(),
+                      outctx->c, APLOGNO(03519)
+                      "kernel TLS not available for this connection, "
+                      "encrypting in userspace");
+        return 0;
+    }
+
+    outctx->ktls_send = 1;
+    ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, outctx->c, APLOGNO(03520)
+                  "kernel TLS enabled for sending");
+    return 1;
+}
+
+/* Send a record of type outctx->ktls_record_type on the socket; returns
+ * inl on success, -1 on failure. */
+static int bio_filter_out_ktls_record(BIO *bio, const char *in, int inl)
+{
+    bio_filter_out_ctx_t *outctx = (bio_filter_out_ctx_t *)BIO_get_data(bio);
+    apr_socket_t *sock = ap_get_conn_socket(outctx->c);
+    apr_interval_time_t timeout;
+    apr_os_sock_t fd;
+    char cbuf[CMSG_SPACE(sizeof(unsigned char))];
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    int sent = 0;
+
+    /* Whatever the core holds must go out before this record */
+    if (bio_filter_out_flush(bio) < 0) {
+        return -1;
+    }
+
+    apr_os_sock_get(&fd, sock);
+    apr_socket_timeout_get(sock, &timeout);
+
+    while (sent < inl) {
+        ssize_t rv;
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = cbuf;
+        msg.msg_controllen = sizeof(cbuf);
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_TLS;
+        cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+        *CMSG_DATA(cmsg) = (unsigned char)outctx->ktls_record_type;
+        msg.msg_controllen = cmsg->cmsg_len;
+        iov.iov_base = (void *)(in + sent);
+        iov.iov_len = inl - sent;
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+
+        rv = sendmsg(fd, &msg, 0);
+        if (rv < 0) {
+            apr_status_t status = apr_get_netos_error();
+
+            if (APR_STATUS_IS_EINTR(status)) {
+                continue;
+            }
+            if (APR_STATUS_IS_EAGAIN(status) && timeout != 0) {
+                apr_pollfd_t pfd;
+                apr_int32_t nsds;
+
+                memset(&pfd, 0, sizeof(pfd));
+                pfd.p = outctx->c->pool;
+                pfd.desc_type = APR_POLL_SOCKET;
+                pfd.reqevents = APR_POLLOUT;
+                pfd.desc.s = sock;
+                status = apr_poll(&pfd, 1, &nsds, timeout);
+                if (status == APR_SUCCESS) {
+                    continue;
+                }
+            }
+            outctx->rc = status;
+            return -1;
+        }
+        sent += rv;
+    }
+
+    outctx->ktls_record_type = 0;
+    return inl;
+}
+#endif
+
 static int bio_filter_create(BIO *bio)
 {
     BIO_set_shutdown(bio, 1);
@@ -210,6 +393,13 @@ static int bio_filter_out_write(BIO *bio, const char *in, int inl)
         return -1;
     }
 
+#ifdef HAVE_KTLS
+    if (outctx->ktls_record_type) {
+        BIO_clear_retry_flags(bio);
+        return bio_filter_out_ktls_record(bio, in, inl);
+    }
+#endif
+
     /* when handshaking we'll have a small number of bytes.
      * max size SSL will pass us here is about 16k.
      * (16413 bytes to be exact)
@@ -278,6 +468,21 @@ static long bio_filter_out_ctrl(BIO *bio, int cmd, long num, void *ptr)
       case BIO_CTRL_DUP:
         ret = 1;
         break;
+#ifdef HAVE_KTLS
+      case BIO_CTRL_SET_KTLS:
+        /* num is non-zero for the write keys, the only ones we take */
+        ret = num ? bio_filter_out_ktls_start(outctx, ptr) : 0;
+        break;
+      case BIO_CTRL_GET_KTLS_SEND:
+        ret = outctx->ktls_send;
+        break;
+      case BIO_CTRL_SET_KTLS_TX_SEND_CTRL_MSG:
+        outctx->ktls_record_type = (int)num;
+        break;
+      case BIO_CTRL_CLEAR_KTLS_TX_CTRL_MSG:
+        outctx->ktls_record_type = 0;
+        break;
+#endif
         /* N/A */
       case BIO_C_SET_BUF_MEM:
       case BIO_C_GET_BUF_MEM_PTR:
@@ -571,6 +776,12 @@ static int bio_filter_in_gets(BIO *bio, char *buf, int size)
 static long bio_filter_in_ctrl(BIO *bio, int cmd, long num, void *ptr)
 {
     bio_filter_in_ctx_t *inctx = (bio_filter_in_ctx_t *)BIO_get_data(bio);
+#ifdef HAVE_KTLS
+    /* Decryption always happens in userspace, see SSLKernelTLS */
+    if (cmd == BIO_CTRL_SET_KTLS || cmd == BIO_CTRL_GET_KTLS_RECV) {
+        return 0;
+    }
+#endif
     ap_log_cerror(APLOG_MARK, APLOG_TRACE1, 0, inctx->f->c,
                   "BUG: %s() should not be called", "bio_filter_in_ctrl");
     AP_DEBUG_ASSERT(0);
@@ -853,6 +1064,84 @@ static apr_status_t ssl_io_input_getline(bio_filter_in_ctx_t *inctx,
 }
 
 
+/*
+ * Dynamic TLS record sizing.
+ *
+ * A TLS record can only be decrypted once all of it has arrived, so a
+ * full sized record spanning several TCP segments delays the first bytes
+ * of a response until all of them went through, which hurts most on a
+ * fresh connection still in TCP slow start.  Small records on the other
+ * hand cost framing overhead and a cipher operation each, which only pays
+ * off while the congestion window is small.
+ *
+ * So a connection starts out writing records which fit into a single
+ * TCP segment and switches to full sized ones once SSLRecordWarmUpSize
+ * bytes went out.  After having been idle for SSLRecordCoolDown, it
+ * starts over with small records.
+ */
+
+/* Calculated like this: assuming MTU 1500 bytes
+ * 1500 - 40 (IP) - 20 (TCP) - 40 (TCP options)
+ *      - TLS overhead (60-100)
+ * ~= 1300 bytes */
+#define SSL_RECORD_SIZE_SMALL (1300)
+#define SSL_RECORD_SIZE_FULL  (16 * 1024)
+
+/* Called before writing out the data passed to the output filter: go
+ * back to small records if the connection has been idle for too long, or
+ * skip them if the server does not want any. */
+static void ssl_io_record_check(ssl_filter_ctx_t *filter_ctx, conn_rec *c)
+{
+    SSLSrvConfigRec *sc = mySrvConfig(mySrvFromConn(c));
+
+    if (filter_ctx->record_size) {
+        if (filter_ctx->record_bytes >= sc->record_warmup_size) {
+            filter_ctx->record_size = 0;
+        }
+    }
+    else if (sc->record_warmup_size > 0 && sc->record_cooldown > 0
+             && filter_ctx->record_last
+             && apr_time_now() - filter_ctx->record_last
+                >= sc->record_cooldown) {
+        filter_ctx->record_size = SSL_RECORD_SIZE_SMALL;
+        filter_ctx->record_bytes = 0;
+        ap_log_cerror(APLOG_MARK, APLOG_TRACE4, 0, c,
+                      "connection idle, record size reset to %d",
+                      SSL_RECORD_SIZE_SMALL);
+    }
+}
+
+/* Account for len bytes written by SSL_write and switch to full sized
+ * records once the connection is warmed up. */
+static void ssl_io_record_written(ssl_filter_ctx_t *filter_ctx,
+                                  conn_rec *c, apr_size_t len)
+{
+    /* OpenSSL splits the data into records of at most
+     * SSL_RECORD_SIZE_FULL bytes */
+    apr_size_t rest = len % SSL_RECORD_SIZE_FULL;
+
+    filter_ctx->records_full += len / SSL_RECORD_SIZE_FULL;
+    if (rest > SSL_RECORD_SIZE_SMALL) {
+        filter_ctx->records_medium++;
+    }
+    else if (rest > 0) {
+        filter_ctx->records_small++;
+    }
+
+    if (filter_ctx->record_size) {
+        SSLSrvConfigRec *sc = mySrvConfig(mySrvFromConn(c));
+
+        filter_ctx->record_bytes += len;
+        if (filter_ctx->record_bytes >= sc->record_warmup_size) {
+            filter_ctx->record_size = 0;
+            ap_log_cerror(APLOG_MARK, APLOG_TRACE4, 0, c,
+                          "connection warmed up after %" APR_OFF_T_FMT
+                          " bytes, using full sized records",
+                          filter_ctx->record_bytes);
+        }
+    }
+}
+
 static apr_status_t ssl_filter_write(ap_filter_t *f,
                                      const char *data,
                                      apr_size_t len)
@@ -930,6 +1219,9 @@ static apr_status_t ssl_filter_write(ap_filter_t *f,
 
         outctx->rc = APR_EGENERAL;
     }
+    else {
+        ssl_io_record_written(filter_ctx, f->c, len);
+    }
     return outctx->rc;
 }
 
@@ -1123,6 +1415,11 @@ static void ssl_filter_io_shutdown(ssl_filter_ctx_t *filter_ctx,
                        logno, c->id, type,
                        ssl_util_vhostid(c->pool, mySrvFromConn(c)));
     }
+    ap_log_cserror(APLOG_MARK, APLOG_DEBUG, 0, c, mySrvFromConn(c),
+                   APLOGNO(03518) "TLS records written: %" APR_SIZE_T_FMT
+                   " small, %" APR_SIZE_T_FMT " medium, %" APR_SIZE_T_FMT
+                   " full", filter_ctx->records_small,
+                   filter_ctx->records_medium, filter_ctx->records_full);
 
     /* deallocate the SSL connection */
     if (sslconn->client_cert) {
@@ -1746,6 +2043,39 @@ static apr_status_t ssl_io_filter_coalesce(ap_filter_t *f,
     return ap_pass_brigade(f->next, bb);
 }
 
+#ifdef HAVE_KTLS
+/* Output once the kernel encrypts: everything but EOC goes down the
+ * filter stack as it is.  EOC terminates the SSL layer, which must
+ * happen after what precedes it has been passed down. */
+static apr_status_t ssl_io_filter_ktls_output(ap_filter_t *f,
+                                              apr_bucket_brigade *bb)
+{
+    ssl_filter_ctx_t *filter_ctx = f->ctx;
+    apr_bucket_brigade *rest;
+    apr_status_t status;
+    apr_bucket *e;
+
+    for (e = APR_BRIGADE_FIRST(bb);
+         e != APR_BRIGADE_SENTINEL(bb);
+         e = APR_BUCKET_NEXT(e)) {
+        if (AP_BUCKET_IS_EOC(e)) {
+            break;
+        }
+    }
+    if (e == APR_BRIGADE_SENTINEL(bb)) {
+        return ap_pass_brigade(f->next, bb);
+    }
+
+    rest = apr_brigade_split_ex(bb, e, NULL);
+    status = ap_pass_brigade(f->next, bb);
+    if (status == APR_SUCCESS) {
+        ssl_filter_io_shutdown(filter_ctx, f->c, 0);
+        status = ap_pass_brigade(f->next, rest);
+    }
+    return status;
+}
+#endif
+
 static apr_status_t ssl_io_filter_output(ap_filter_t *f,
                                          apr_bucket_brigade *bb)
 {
@@ -1755,6 +2085,7 @@ static apr_status_t ssl_io_filter_output(ap_filter_t *f,
     bio_filter_out_ctx_t *outctx;
     apr_bucket *flush_upto = NULL;
     apr_read_type_e rblock = APR_NONBLOCK_READ;
+    int written = 0;
 
     if (f->c->aborted) {
         apr_brigade_cleanup(bb);
@@ -1783,6 +2114,14 @@ static apr_status_t ssl_io_filter_output(ap_filter_t *f,
         return ssl_io_filter_error(f, bb, status, 0);
     }
 
+#ifdef HAVE_KTLS
+    if (outctx->ktls_send) {
+        return ssl_io_filter_ktls_output(f, bb);
+    }
+#endif
+
+    ssl_io_record_check(filter_ctx, f->c);
+
     while (!APR_BRIGADE_EMPTY(bb) && status == APR_SUCCESS) {
         apr_bucket *bucket = APR_BRIGADE_FIRST(bb);
 
@@ -1841,12 +2180,25 @@ static apr_status_t ssl_io_filter_output(ap_filter_t *f,
                 break;
             }
 
+            /* While warming up, leave what does not fit into a small
+             * record for the next round. */
+            if (filter_ctx->record_size && len > filter_ctx->record_size
+                && apr_bucket_split(bucket, filter_ctx->record_size)
+                   == APR_SUCCESS) {
+                len = filter_ctx->record_size;
+            }
+
             status = ssl_filter_write(f, data, len);
             apr_bucket_delete(bucket);
+            written = 1;
         }
 
     }
 
+    if (written) {
+        filter_ctx->record_last = apr_time_now();
+    }
+
     if (APR_STATUS_IS_EOF(status) || (status == APR_SUCCESS)) {
         return ap_filter_setaside_brigade(f, bb);
     }
@@ -2096,6 +2448,14 @@ void ssl_io_filter_init(conn_rec *c, request_rec *r, SSL *ssl)
 
     filter_ctx->config          = myConnConfig(c);
 
+    /* start out with small records, see ssl_io_record_check() */
+    filter_ctx->record_size     = SSL_RECORD_SIZE_SMALL;
+    filter_ctx->record_bytes    = 0;
+    filter_ctx->record_last     = 0;
+    filter_ctx->records_small   = 0;
+    filter_ctx->records_medium  = 0;
+    filter_ctx->records_full    = 0;
+
     ap_add_output_filter(ssl_io_coalesce, NULL, r, c);
 
     filter_ctx->pOutputFilter   = ap_add_output_filter(ssl_io_filter,
@@ -35,7 +35,7 @@
 
 static void ssl_configure_env(request_rec *r, SSLConnRec *sslconn);
 #ifdef HAVE_TLSEXT
-static int ssl_find_vhost(void *servername, conn_rec *c, server_rec *s);
+static int ssl_set_vhost(conn_rec *c, server_rec *s);
 #endif
 
 #define SWITCH_STATUS_LINE "HTTP/1.1 101 Switching Protocols"
@@ -2135,8 +2135,9 @@ static apr_status_t init_vhost(conn_rec *c, SSL *ssl)
         
         servername = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
         if (servername) {
-            if (ap_vhost_iterate_given_conn(c, ssl_find_vhost,
-                                            (void *)servername)) {
+            server_rec *s = ap_vhost_find_given_name(c, servername);
+
+            if (s && ssl_set_vhost(c, s)) {
                 ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, c, APLOGNO(02043)
                               "SSL virtual host for servername %s found",
                               servername);
@@ -2187,30 +2188,37 @@ int ssl_callback_ServerNameIndication(SSL *ssl, int *al, modssl_ctx_t *mctx)
 }
 
 /*
- * Find a (name-based) SSL virtual host where either the ServerName
- * or one of the ServerAliases matches the supplied name (to be used
- * with ap_vhost_iterate_given_conn())
+ * Switch the connection to the (name-based) SSL virtual host whose
+ * ServerName or one of whose ServerAliases matched the server name
+ * indication, as found by ap_vhost_find_given_name()
  */
-static int ssl_find_vhost(void *servername, conn_rec *c, server_rec *s)
+static int ssl_set_vhost(conn_rec *c, server_rec *s)
 {
     SSLSrvConfigRec *sc;
     SSL *ssl;
-    BOOL found;
+    SSL_CTX *ctx;
     SSLConnRec *sslcon;
 
-    found = ssl_util_vhost_matches(servername, s);
-
-    /* set SSL_CTX (if matched) */
+    /* set SSL_CTX (built now if SSLLazyInit) */
     sslcon = myConnConfig(c);
-    if (found && (ssl = sslcon->ssl) &&
-        (sc = mySrvConfig(s))) {
-        SSL_CTX *ctx = SSL_set_SSL_CTX(ssl, sc->server->ssl_ctx);
+    if ((ssl = sslcon->ssl) &&
+        (sc = mySrvConfig(s)) &&
+        (ctx = ssl_init_lazy_ctx_acquire(s, sc->server))) {
+        SSL_set_SSL_CTX(ssl, ctx);
+        /* the SSL holds its own reference now */
+        ssl_init_lazy_ctx_release(sc->server, ctx);
         /*
          * SSL_set_SSL_CTX() only deals with the server cert,
          * so we need to duplicate a few additional settings
          * from the ctx by hand
          */
         SSL_set_options(ssl, SSL_CTX_get_options(ctx));
+#ifdef HAVE_KTLS
+        if (!(SSL_CTX_get_options(ctx) & SSL_OP_ENABLE_KTLS)) {
+            /* SSLKernelTLS is off for this host */
+            SSL_clear_options(ssl, SSL_OP_ENABLE_KTLS);
+        }
+#endif
         if ((SSL_get_verify_mode(ssl) == SSL_VERIFY_NONE) ||
             (SSL_num_renegotiations(ssl) == 0)) {
            /*
@@ -2277,8 +2285,9 @@ static int ssl_find_vhost(void *servername, conn_rec *c, server_rec *s)
 #ifdef HAVE_TLS_SESSION_TICKETS
 /*
  * This callback function is executed when OpenSSL needs a key for encrypting/
- * decrypting a TLS session ticket (RFC 5077) and a ticket key file has been
- * configured through SSLSessionTicketKeyFile.
+ * decrypting a TLS session ticket (RFC 5077) and either a ticket key file has
+ * been configured through SSLSessionTicketKeyFile, or keys are rotated
+ * automatically per SSLSessionTicketKeyRotation.
  */
 int ssl_callback_SessionTicket(SSL *ssl,
                                unsigned char *keyname,
@@ -2293,6 +2302,8 @@ int ssl_callback_SessionTicket(SSL *ssl,
     SSLConnRec *sslconn = myConnConfig(c);
     modssl_ctx_t *mctx = myCtxConfig(sslconn, sc);
     modssl_ticket_key_t *ticket_key = mctx->ticket_key;
+    modssl_ticket_key_t rotated_key;
+    int rc = 1;
 
     if (mode == 1) {
         /* 
@@ -2304,14 +2315,22 @@ int ssl_callback_SessionTicket(SSL *ssl,
             /* should never happen, but better safe than sorry */
             return -1;
         }
+        if (!ticket_key->file_path) {
+            if (!ssl_ticket_keys_get(s, NULL, &rotated_key)) {
+                return -1;
+            }
+            ticket_key = &rotated_key;
+        }
 
         memcpy(keyname, ticket_key->key_name, 16);
         if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1) {
+            OPENSSL_cleanse(&rotated_key, sizeof(rotated_key));
             return -1;
         }
         EVP_EncryptInit_ex(cipher_ctx, EVP_aes_128_cbc(), NULL,
                            ticket_key->aes_key, iv);
         HMAC_Init_ex(hctx, ticket_key->hmac_secret, 16, tlsext_tick_md(), NULL);
+        OPENSSL_cleanse(&rotated_key, sizeof(rotated_key));
 
         ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, c, APLOGNO(02289)
                       "TLS session ticket key for %s successfully set, "
@@ -2326,19 +2345,31 @@ int ssl_callback_SessionTicket(SSL *ssl,
          */
 
         /* check key name */
-        if (ticket_key == NULL || memcmp(keyname, ticket_key->key_name, 16)) {
+        if (ticket_key == NULL) {
+            return 0;
+        }
+        if (!ticket_key->file_path) {
+            /* the previous and next keys are good, but call for renewal */
+            if (!(rc = ssl_ticket_keys_get(s, keyname, &rotated_key))) {
+                return 0;
+            }
+            ticket_key = &rotated_key;
+        }
+        else if (memcmp(keyname, ticket_key->key_name, 16)) {
             return 0;
         }
 
         EVP_DecryptInit_ex(cipher_ctx, EVP_aes_128_cbc(), NULL,
                            ticket_key->aes_key, iv);
         HMAC_Init_ex(hctx, ticket_key->hmac_secret, 16, tlsext_tick_md(), NULL);
+        OPENSSL_cleanse(&rotated_key, sizeof(rotated_key));
 
         ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, c, APLOGNO(02290)
                       "TLS session ticket key for %s successfully set, "
-                      "decrypting existing session ticket", sc->vhost_id);
+                      "decrypting existing session ticket%s", sc->vhost_id,
+                      rc == 2 ? " (to be renewed)" : "");
 
-        return 1;
+        return rc;
     }
 
     /* OpenSSL is not expected to call us with modes other than 1 or 0 */
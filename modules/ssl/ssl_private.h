@@ -51,6 +51,7 @@
 #include "apr_strings.h"
 #include "apr_global_mutex.h"
 #include "apr_optional.h"
+#include "apr_shm.h"
 #include "ap_socache.h"
 #include "mod_auth.h"
 
@@ -214,6 +215,8 @@
 #define BIO_get_shutdown(x)        (x->shutdown)
 #define BIO_set_shutdown(x,v)      (x->shutdown=v)
 #define DH_bits(x)                 (BN_num_bits(x->p))
+#define SSL_CTX_up_ref(x)          CRYPTO_add(&(x)->references, 1, \
+                                              CRYPTO_LOCK_SSL_CTX)
 #else
 void init_bio_methods(void);
 void free_bio_methods(void);
@@ -229,6 +232,13 @@ void free_bio_methods(void);
 #endif
 #endif
 
+/* Kernel TLS offload (SSLKernelTLS): OpenSSL passes the keys to the
+ * output BIO, which installs them into the socket (Linux only) */
+#if defined(__linux__) && OPENSSL_VERSION_NUMBER >= 0x30000000L \
+    && !defined(OPENSSL_NO_KTLS) && defined(SSL_OP_ENABLE_KTLS)
+#define HAVE_KTLS
+#endif
+
 /* mod_ssl headers */
 #include "ssl_util_ssl.h"
 
@@ -299,6 +309,22 @@ APLOG_USE_MODULE(ssl);
 #define SSL_SESSION_CACHE_TIMEOUT  300
 #endif
 
+/* Default for the number of SSL contexts built on demand (SSLLazyInit) */
+#ifndef SSL_LAZY_CACHE_SIZE
+#define SSL_LAZY_CACHE_SIZE 512
+#endif
+
+/* Defaults for the dynamic TLS record sizing: bytes written in small records
+ * before switching to full sized ones, and idle time after which a
+ * connection starts over with small records (SSLRecordWarmUpSize and
+ * SSLRecordCoolDown) */
+#ifndef SSL_RECORD_WARMUP_SIZE
+#define SSL_RECORD_WARMUP_SIZE (1024 * 1024)
+#endif
+#ifndef SSL_RECORD_COOLDOWN
+#define SSL_RECORD_COOLDOWN apr_time_from_sec(1)
+#endif
+
 /* Default setting for per-dir reneg buffer. */
 #ifndef DEFAULT_RENEG_BUFFER_SIZE
 #define DEFAULT_RENEG_BUFFER_SIZE (128 * 1024)
@@ -566,6 +592,15 @@ typedef struct {
     apr_global_mutex_t   *stapling_cache_mutex;
     apr_global_mutex_t   *stapling_refresh_mutex;
 #endif
+
+    /* Per configuration, NULL unless SSLLazyInit is used */
+    struct modssl_lazy_cache_t *lazy_cache;
+
+#ifdef HAVE_TLS_SESSION_TICKETS
+    /* Automatically generated ticket keys, kept across restarts */
+    apr_shm_t             *ticket_keys_shm;
+    struct modssl_ticket_keys_t *ticket_keys;
+#endif
 } SSLModConfigRec;
 
 /** Structure representing configured filenames for certs and keys for
@@ -612,6 +647,22 @@ typedef struct {
     unsigned char hmac_secret[16];
     unsigned char aes_key[16];
 } modssl_ticket_key_t;
+
+/** Number of slots in the ring of automatically generated ticket keys */
+#define MODSSL_TICKET_KEY_SLOTS 4
+
+/**
+ * Ring of automatically generated ticket keys, in memory shared by all
+ * child processes. The current key is in slot (generation % SLOTS), the
+ * previous and the next one in the slots before and after it. Only the
+ * rotating watchdog writes, into the fourth slot which nobody reads until
+ * the generation is incremented.
+ */
+typedef struct modssl_ticket_keys_t {
+    apr_uint32_t generation;
+    apr_time_t rotated;
+    modssl_ticket_key_t keys[MODSSL_TICKET_KEY_SLOTS];
+} modssl_ticket_keys_t;
 #endif
 
 #ifdef HAVE_SSL_CONF_CMD
@@ -621,10 +672,16 @@ typedef struct {
 } ssl_ctx_param_t;
 #endif
 
+/** SSL_CTX built on demand, linked in the least recently used order */
+typedef struct modssl_lazy_ctx_t modssl_lazy_ctx_t;
+
 typedef struct {
     SSLSrvConfigRec *sc; /** pointer back to server config */
     SSL_CTX *ssl_ctx;
 
+    /** non-NULL if ssl_ctx is built on demand, and may be NULL */
+    modssl_lazy_ctx_t *lazy;
+
     /** we are one or the other */
     modssl_pk_server_t *pks;
     modssl_pk_proxy_t  *pkp;
@@ -688,6 +745,24 @@ typedef struct {
     BOOL ssl_check_peer_expire;
 } modssl_ctx_t;
 
+struct modssl_lazy_ctx_t {
+    modssl_lazy_ctx_t *prev;
+    modssl_lazy_ctx_t *next;
+    server_rec *s;
+    modssl_ctx_t *mctx;
+};
+
+/** The SSL_CTXs built on demand by a child (SSLLazyInit) */
+typedef struct modssl_lazy_cache_t {
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *mutex;
+#endif
+    modssl_lazy_ctx_t *first; /* most recently used */
+    modssl_lazy_ctx_t *last;
+    int count;
+    int max;
+} modssl_lazy_cache_t;
+
 struct SSLSrvConfigRec {
     SSLModConfigRec *mc;
     ssl_enabled_t    enabled;
@@ -707,6 +782,17 @@ struct SSLSrvConfigRec {
     BOOL             compression;
 #endif
     BOOL             session_tickets;
+#ifdef HAVE_TLS_SESSION_TICKETS
+    int              ticket_key_rotation;
+#endif
+    BOOL             lazy_init;
+    int              lazy_cache_size;
+    apr_off_t        record_warmup_size;
+    apr_interval_time_t record_cooldown;
+    BOOL             ktls;
+#ifdef HAVE_OCSP_STAPLING
+    BOOL             stapling_background;
+#endif
 };
 
 /**
@@ -766,6 +852,11 @@ const char  *ssl_cmd_SSLCARevocationCheck(cmd_parms *, void *, const char *);
 const char  *ssl_cmd_SSLHonorCipherOrder(cmd_parms *cmd, void *dcfg, int flag);
 const char  *ssl_cmd_SSLCompression(cmd_parms *, void *, int flag);
 const char  *ssl_cmd_SSLSessionTickets(cmd_parms *, void *, int flag);
+const char  *ssl_cmd_SSLLazyInit(cmd_parms *, void *, int flag);
+const char  *ssl_cmd_SSLLazyInitCacheSize(cmd_parms *, void *, const char *);
+const char  *ssl_cmd_SSLRecordWarmUpSize(cmd_parms *, void *, const char *);
+const char  *ssl_cmd_SSLRecordCoolDown(cmd_parms *, void *, const char *);
+const char  *ssl_cmd_SSLKernelTLS(cmd_parms *, void *, int flag);
 const char  *ssl_cmd_SSLVerifyClient(cmd_parms *, void *, const char *);
 const char  *ssl_cmd_SSLVerifyDepth(cmd_parms *, void *, const char *);
 const char  *ssl_cmd_SSLSessionCache(cmd_parms *, void *, const char *);
@@ -794,6 +885,7 @@ const char  *ssl_cmd_SSLProxyMachineCertificateFile(cmd_parms *, void *, const c
 const char  *ssl_cmd_SSLProxyMachineCertificateChainFile(cmd_parms *, void *, const char *);
 #ifdef HAVE_TLS_SESSION_TICKETS
 const char *ssl_cmd_SSLSessionTicketKeyFile(cmd_parms *cmd, void *dcfg, const char *arg);
+const char *ssl_cmd_SSLSessionTicketKeyRotation(cmd_parms *cmd, void *dcfg, const char *arg);
 #endif
 const char  *ssl_cmd_SSLProxyCheckPeerExpire(cmd_parms *cmd, void *dcfg, int flag);
 const char  *ssl_cmd_SSLProxyCheckPeerCN(cmd_parms *cmd, void *dcfg, int flag);
@@ -832,6 +924,8 @@ STACK_OF(X509_NAME)
             *ssl_init_FindCAList(server_rec *, apr_pool_t *, const char *, const char *);
 void         ssl_init_Child(apr_pool_t *, server_rec *);
 apr_status_t ssl_init_ModuleKill(void *data);
+SSL_CTX     *ssl_init_lazy_ctx_acquire(server_rec *, modssl_ctx_t *);
+void         ssl_init_lazy_ctx_release(modssl_ctx_t *, SSL_CTX *);
 
 /**  Apache API hooks  */
 int          ssl_hook_Auth(request_rec *);
@@ -879,6 +973,13 @@ SSL_SESSION *ssl_scache_retrieve(server_rec *, IDCONST UCHAR *, int, apr_pool_t
 void         ssl_scache_remove(server_rec *, IDCONST UCHAR *, int,
                                apr_pool_t *);
 
+/** Automatic TLS Session Ticket Keys */
+#ifdef HAVE_TLS_SESSION_TICKETS
+apr_status_t ssl_ticket_keys_init(server_rec *, apr_pool_t *);
+int          ssl_ticket_keys_get(server_rec *, const unsigned char *,
+                                 modssl_ticket_key_t *);
+#endif
+
 /** OCSP Stapling Support */
 #ifdef HAVE_OCSP_STAPLING
 const char *ssl_cmd_SSLStaplingCache(cmd_parms *, void *, const char *);
@@ -891,10 +992,12 @@ const char *ssl_cmd_SSLStaplingReturnResponderErrors(cmd_parms *, void *, int);
 const char *ssl_cmd_SSLStaplingFakeTryLater(cmd_parms *, void *, int);
 const char *ssl_cmd_SSLStaplingResponderTimeout(cmd_parms *, void *, const char *);
 const char *ssl_cmd_SSLStaplingForceURL(cmd_parms *, void *, const char *);
+const char *ssl_cmd_SSLStaplingBackgroundRefresh(cmd_parms *, void *, int);
 apr_status_t modssl_init_stapling(server_rec *, apr_pool_t *, apr_pool_t *, modssl_ctx_t *);
 void         ssl_stapling_certinfo_hash_init(apr_pool_t *);
 int          ssl_stapling_init_cert(server_rec *, apr_pool_t *, apr_pool_t *,
                                     modssl_ctx_t *, X509 *);
+apr_status_t ssl_stapling_refresh_init(server_rec *, apr_pool_t *);
 #endif
 #ifdef HAVE_SRP
 int          ssl_callback_SRPServerParams(SSL *, int *, void *);
@@ -925,8 +1028,6 @@ void         ssl_util_thread_setup(apr_pool_t *);
 #endif
 int          ssl_init_ssl_connection(conn_rec *c, request_rec *r);
 
-BOOL         ssl_util_vhost_matches(const char *servername, server_rec *s);
-
 /**  Pass Phrase Support  */
 apr_status_t ssl_load_encrypted_pkey(server_rec *, apr_pool_t *, int,
                                      const char *, apr_array_header_t **);
@@ -30,6 +30,9 @@
                                                  -- Unknown         */
 #include "ssl_private.h"
 #include "mod_status.h"
+#include "mod_watchdog.h"
+
+#include "apr_atomic.h"
 
 /*  _________________________________________________________________
 **
@@ -189,6 +192,199 @@ void ssl_scache_remove(server_rec *s, IDCONST UCHAR *id, int idlen,
     }
 }
 
+#ifdef HAVE_TLS_SESSION_TICKETS
+/*  _________________________________________________________________
+**
+**  Session Tickets: Automatically Generated and Rotated Keys
+**  _________________________________________________________________
+*/
+
+#define SSL_TICKET_KEYS_WATCHDOG_NAME "_ssl_ticket_keys_"
+
+#define TICKET_KEY_SLOT(keys, gen) \
+    (&(keys)->keys[(gen) % MODSSL_TICKET_KEY_SLOTS])
+
+static int ssl_ticket_key_generate(modssl_ticket_key_t *key)
+{
+    unsigned char buf[TLSEXT_TICKET_KEY_LEN];
+
+    if (RAND_bytes(buf, sizeof(buf)) != 1) {
+        return 0;
+    }
+
+    key->file_path = NULL;
+    memcpy(key->key_name, buf, 16);
+    memcpy(key->hmac_secret, buf + 16, 16);
+    memcpy(key->aes_key, buf + 32, 16);
+    OPENSSL_cleanse(buf, sizeof(buf));
+
+    return 1;
+}
+
+/*
+ * Only ever called by the watchdog, which runs in a single child at a time.
+ * The new next key goes to the slot after it, which readers do not look at
+ * before the generation is incremented; the former previous key is dropped.
+ */
+static void ssl_ticket_keys_rotate(server_rec *s, modssl_ticket_keys_t *keys)
+{
+    apr_uint32_t gen = apr_atomic_read32(&keys->generation);
+
+    if (!ssl_ticket_key_generate(TICKET_KEY_SLOT(keys, gen + 2))) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, APLOGNO(03502)
+                     "Unable to generate TLS session ticket key, "
+                     "keeping the current ones");
+        ssl_log_ssl_error(SSLLOG_MARK, APLOG_ERR, s);
+        return;
+    }
+    keys->rotated = apr_time_now();
+    apr_atomic_inc32(&keys->generation);
+
+    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(03503)
+                 "TLS session ticket keys rotated (generation %u)", gen + 1);
+}
+
+static apr_status_t ssl_ticket_keys_watchdog(int state, void *data,
+                                             apr_pool_t *pool)
+{
+    server_rec *s = data;
+    SSLModConfigRec *mc = myModConfig(s);
+    SSLSrvConfigRec *sc = mySrvConfig(s);
+
+    if (state == AP_WATCHDOG_STATE_RUNNING && mc->ticket_keys
+        && apr_time_now() - mc->ticket_keys->rotated
+           >= apr_time_from_sec(sc->ticket_key_rotation)) {
+        ssl_ticket_keys_rotate(s, mc->ticket_keys);
+    }
+
+    return APR_SUCCESS;
+}
+
+apr_status_t ssl_ticket_keys_init(server_rec *s, apr_pool_t *p)
+{
+    SSLModConfigRec *mc = myModConfig(s);
+    SSLSrvConfigRec *sc = mySrvConfig(s);
+    APR_OPTIONAL_FN_TYPE(ap_watchdog_get_instance) *wd_get_instance;
+    APR_OPTIONAL_FN_TYPE(ap_watchdog_register_callback) *wd_register_callback;
+    ap_watchdog_t *watchdog;
+    modssl_ticket_keys_t *keys;
+    apr_status_t rv;
+    int i;
+
+    if (sc->ticket_key_rotation <= 0) {
+        return APR_SUCCESS;
+    }
+
+    wd_get_instance = APR_RETRIEVE_OPTIONAL_FN(ap_watchdog_get_instance);
+    wd_register_callback = APR_RETRIEVE_OPTIONAL_FN(ap_watchdog_register_callback);
+    if (!wd_get_instance || !wd_register_callback) {
+        ap_log_error(APLOG_MARK, APLOG_EMERG, 0, s, APLOGNO(03504)
+                     "SSLSessionTicketKeyRotation requires mod_watchdog");
+        return ssl_die(s);
+    }
+
+    /*
+     * The keys are allocated once from the process pool, like the rest of
+     * SSLModConfigRec, so that tickets remain valid across restarts.
+     */
+    if (!mc->ticket_keys) {
+        rv = apr_shm_create(&mc->ticket_keys_shm, sizeof(*keys), NULL,
+                            mc->pPool);
+        if (rv == APR_SUCCESS) {
+            keys = apr_shm_baseaddr_get(mc->ticket_keys_shm);
+        }
+        else if (APR_STATUS_IS_ENOTIMPL(rv)) {
+            /* no anonymous shm, fine for a single child process only */
+            keys = apr_palloc(mc->pPool, sizeof(*keys));
+        }
+        else {
+            ap_log_error(APLOG_MARK, APLOG_EMERG, rv, s, APLOGNO(03505)
+                         "Cannot allocate shared memory for TLS session "
+                         "ticket keys");
+            return ssl_die(s);
+        }
+
+        memset(keys, 0, sizeof(*keys));
+        keys->generation = 1;
+        for (i = 0; i < MODSSL_TICKET_KEY_SLOTS - 1; ++i) {
+            if (!ssl_ticket_key_generate(TICKET_KEY_SLOT(keys, i))) {
+                ap_log_error(APLOG_MARK, APLOG_EMERG, 0, s, APLOGNO(03506)
+                             "Unable to generate TLS session ticket keys");
+                ssl_log_ssl_error(SSLLOG_MARK, APLOG_EMERG, s);
+                return ssl_die(s);
+            }
+        }
+        keys->rotated = apr_time_now();
+        mc->ticket_keys = keys;
+    }
+
+    /* A singleton child watchdog, parent ones are not available with
+     * forked MPMs; it checks every second whether rotation is due so that
+     * a taking over child does not start the interval anew.
+     */
+    rv = wd_get_instance(&watchdog, SSL_TICKET_KEYS_WATCHDOG_NAME, 0, 1, p);
+    if (rv == APR_SUCCESS) {
+        rv = wd_register_callback(watchdog, AP_WD_TM_INTERVAL, s,
+                                  ssl_ticket_keys_watchdog);
+    }
+    if (rv != APR_SUCCESS && !APR_STATUS_IS_EEXIST(rv)) {
+        ap_log_error(APLOG_MARK, APLOG_EMERG, rv, s, APLOGNO(03507)
+                     "Failed to register the TLS session ticket keys "
+                     "watchdog (%s)", SSL_TICKET_KEYS_WATCHDOG_NAME);
+        return ssl_die(s);
+    }
+
+    ap_log_error(APLOG_MARK, APLOG_INFO, 0, s, APLOGNO(03508)
+                 "TLS session ticket keys rotated every %d seconds",
+                 sc->ticket_key_rotation);
+
+    return APR_SUCCESS;
+}
+
+/*
+ * Copies the current key, or the one named key_name, into *key. Returns 0
+ * if there is no such key, 1 for the current key and 2 for the previous or
+ * next one, which is what the ticket key callback returns when tickets
+ * should be renewed. Lockless: the copy is retried should the keys have
+ * been rotated meanwhile.
+ */
+int ssl_ticket_keys_get(server_rec *s, const unsigned char *key_name,
+                        modssl_ticket_key_t *key)
+{
+    modssl_ticket_keys_t *keys = myModConfig(s)->ticket_keys;
+    apr_uint32_t gen;
+    int rc;
+
+    if (!keys) {
+        return 0;
+    }
+
+    do {
+        gen = apr_atomic_read32(&keys->generation);
+        if (!key_name
+            || !memcmp(key_name, TICKET_KEY_SLOT(keys, gen)->key_name, 16)) {
+            *key = *TICKET_KEY_SLOT(keys, gen);
+            rc = 1;
+        }
+        else if (!memcmp(key_name, TICKET_KEY_SLOT(keys, gen - 1)->key_name,
+                         16)) {
+            *key = *TICKET_KEY_SLOT(keys, gen - 1);
+            rc = 2;
+        }
+        else if (!memcmp(key_name, TICKET_KEY_SLOT(keys, gen + 1)->key_name,
+                         16)) {
+            *key = *TICKET_KEY_SLOT(keys, gen + 1);
+            rc = 2;
+        }
+        else {
+            rc = 0;
+        }
+    } while (apr_atomic_read32(&keys->generation) != gen);
+
+    return rc;
+}
+#endif /* HAVE_TLS_SESSION_TICKETS */
+
 /*  _________________________________________________________________
 **
 **  SSL Extension to mod_status
@@ -31,6 +31,7 @@
 #include "ssl_private.h"
 #include "ap_mpm.h"
 #include "apr_thread_mutex.h"
+#include "mod_watchdog.h"
 
 #ifdef HAVE_OCSP_STAPLING
 
@@ -54,6 +55,11 @@ typedef struct {
     OCSP_CERTID *cid;
     /* URI of the OCSP responder */
     char *uri;
+    /* Server and settings the response is refreshed with in the background */
+    server_rec *s;
+    modssl_ctx_t *mctx;
+    /* When this process' background refresh looks at it again */
+    apr_time_t next_refresh;
 } certinfo;
 
 static apr_status_t ssl_stapling_certid_free(void *data)
@@ -69,6 +75,10 @@ static apr_status_t ssl_stapling_certid_free(void *data)
 
 static apr_hash_t *stapling_certinfo;
 
+/* Whether responses are refreshed in the background (by a watchdog) rather
+ * than during handshakes */
+static int stapling_refresh_async;
+
 void ssl_stapling_certinfo_hash_init(apr_pool_t *p)
 {
     stapling_certinfo = apr_hash_make(p);
@@ -136,6 +146,11 @@ int ssl_stapling_init_cert(server_rec *s, apr_pool_t *p, apr_pool_t *ptemp,
                            "configured for server %s", mctx->sc->vhost_id);
             return 0;
         }
+        if (!cinf->uri && !cinf->mctx->stapling_force_url) {
+            /* refresh with the settings of a server which can */
+            cinf->s = s;
+            cinf->mctx = mctx;
+        }
         return 1;
     }
 
@@ -168,6 +183,8 @@ int ssl_stapling_init_cert(server_rec *s, apr_pool_t *p, apr_pool_t *ptemp,
     cinf = apr_pcalloc(p, sizeof(certinfo));
     memcpy (cinf->idx, idx, sizeof(idx));
     cinf->cid = cid;
+    cinf->s = s;
+    cinf->mctx = mctx;
     /* make sure cid is also freed at pool cleanup */
     apr_pool_cleanup_register(p, cid, ssl_stapling_certid_free,
                               apr_pool_cleanup_null);
@@ -212,7 +229,15 @@ static certinfo *stapling_get_certinfo(server_rec *s, modssl_ctx_t *mctx,
  *
  * The key for the cache is the hash of the certificate the response
  * is for.
+ *
+ * Responses stored by this version have STAPLING_CACHE_TIMED set in the
+ * flag and the time they were stored (8 bytes, most significant first)
+ * between the flag and the response, for the background refresh to know
+ * when they are due.
  */
+#define STAPLING_CACHE_TIMED    0x80
+#define STAPLING_CACHE_TIME_LEN 8
+
 static BOOL stapling_cache_response(server_rec *s, modssl_ctx_t *mctx,
                                     OCSP_RESPONSE *rsp, certinfo *cinf,
                                     BOOL ok, apr_pool_t *pool)
@@ -220,9 +245,9 @@ static BOOL stapling_cache_response(server_rec *s, modssl_ctx_t *mctx,
     SSLModConfigRec *mc = myModConfig(s);
     unsigned char resp_der[MAX_STAPLING_DER]; /* includes one-byte flag + response */
     unsigned char *p;
-    int resp_derlen, stored_len;
+    int resp_derlen, stored_len, i;
     BOOL rv;
-    apr_time_t expiry;
+    apr_time_t expiry, now;
 
     resp_derlen = i2d_OCSP_RESPONSE(rsp, NULL);
 
@@ -232,7 +257,7 @@ static BOOL stapling_cache_response(server_rec *s, modssl_ctx_t *mctx,
         return FALSE;
     }
 
-    stored_len = resp_derlen + 1; /* response + ok flag */
+    stored_len = resp_derlen + 1 + STAPLING_CACHE_TIME_LEN; /* response + ok flag + time */
     if (stored_len > sizeof resp_der) {
         ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, APLOGNO(01928)
                      "OCSP stapling response too big (%u bytes)", resp_derlen);
@@ -243,15 +268,21 @@ static BOOL stapling_cache_response(server_rec *s, modssl_ctx_t *mctx,
 
     /* TODO: potential optimization; _timeout members as apr_interval_time_t */
     if (ok == TRUE) {
-        *p++ = 1;
+        *p++ = STAPLING_CACHE_TIMED | 1;
         expiry = apr_time_from_sec(mctx->stapling_cache_timeout);
     }
     else {
-        *p++ = 0;
+        *p++ = STAPLING_CACHE_TIMED;
         expiry = apr_time_from_sec(mctx->stapling_errcache_timeout);
     }
 
-    expiry += apr_time_now();
+    now = apr_time_now();
+    expiry += now;
+    for (i = STAPLING_CACHE_TIME_LEN - 1; i >= 0; i--) {
+        p[i] = (unsigned char)(now & 0xff);
+        now >>= 8;
+    }
+    p += STAPLING_CACHE_TIME_LEN;
 
     i2d_OCSP_RESPONSE(rsp, &p);
 
@@ -272,8 +303,8 @@ static BOOL stapling_cache_response(server_rec *s, modssl_ctx_t *mctx,
 }
 
 static void stapling_get_cached_response(server_rec *s, OCSP_RESPONSE **prsp,
-                                         BOOL *pok, certinfo *cinf,
-                                         apr_pool_t *pool)
+                                         BOOL *pok, apr_time_t *pstored,
+                                         certinfo *cinf, apr_pool_t *pool)
 {
     SSLModConfigRec *mc = myModConfig(s);
     apr_status_t rv;
@@ -303,12 +334,35 @@ static void stapling_get_cached_response(server_rec *s, OCSP_RESPONSE **prsp,
         return;
     }
     p = resp_der;
-    if (*p) /* valid when stored */
+    if (*p & ~STAPLING_CACHE_TIMED) /* valid when stored */
         *pok = TRUE;
     else
         *pok = FALSE;
-    p++;
-    resp_derlen--;
+    if (pstored) {
+        *pstored = 0;
+    }
+    if (*p++ & STAPLING_CACHE_TIMED) {
+        /* stored by this version, with the time */
+        int i;
+
+        resp_derlen--;
+        if (resp_derlen <= STAPLING_CACHE_TIME_LEN) {
+            ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, APLOGNO(03521)
+                         "stapling_get_cached_response: response length "
+                         "invalid??");
+            return;
+        }
+        for (i = 0; i < STAPLING_CACHE_TIME_LEN; i++) {
+            if (pstored) {
+                *pstored = (*pstored << 8) | *p;
+            }
+            p++;
+        }
+        resp_derlen -= STAPLING_CACHE_TIME_LEN;
+    }
+    else {
+        resp_derlen--;
+    }
     rsp = d2i_OCSP_RESPONSE(NULL, &p, resp_derlen);
     if (!rsp) {
         ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, APLOGNO(01932)
@@ -432,15 +486,17 @@ static int stapling_check_response(server_rec *s, modssl_ctx_t *mctx,
     return rv;
 }
 
-static BOOL stapling_renew_response(server_rec *s, modssl_ctx_t *mctx, SSL *ssl,
+/* Query the responder for a new response and cache it. The extensions
+ * of the client's status request, if any, are added to the query. */
+static BOOL stapling_renew_response(server_rec *s, modssl_ctx_t *mctx,
+                                    conn_rec *conn,
+                                    STACK_OF(X509_EXTENSION) *exts,
                                     certinfo *cinf, OCSP_RESPONSE **prsp,
                                     BOOL *pok, apr_pool_t *pool)
 {
-    conn_rec *conn      = (conn_rec *)SSL_get_app_data(ssl);
     apr_pool_t *vpool;
     OCSP_REQUEST *req = NULL;
     OCSP_CERTID *id = NULL;
-    STACK_OF(X509_EXTENSION) *exts;
     int i;
     BOOL rv = TRUE;
     const char *ocspuri;
@@ -461,7 +517,6 @@ static BOOL stapling_renew_response(server_rec *s, modssl_ctx_t *mctx, SSL *ssl,
         goto err;
     id = NULL;
     /* Add any extensions to the request */
-    SSL_get_tlsext_status_exts(ssl, &exts);
     for (i = 0; i < sk_X509_EXTENSION_num(exts); i++) {
         X509_EXTENSION *ext = sk_X509_EXTENSION_value(exts, i);
         if (!OCSP_REQUEST_add_ext(req, ext, -1))
@@ -481,7 +536,7 @@ static BOOL stapling_renew_response(server_rec *s, modssl_ctx_t *mctx, SSL *ssl,
     }
 
     /* Create a temporary pool to constrain memory use */
-    apr_pool_create(&vpool, conn->pool);
+    apr_pool_create(&vpool, pool);
 
     if (apr_uri_parse(vpool, ocspuri, &uri) != APR_SUCCESS) {
         ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, APLOGNO(01939)
@@ -696,7 +751,7 @@ static int get_and_check_cached_response(server_rec *s, modssl_ctx_t *mctx,
     AP_DEBUG_ASSERT(*rsp == NULL);
 
     /* Check to see if we already have a response for this certificate */
-    stapling_get_cached_response(s, rsp, &ok, cinf, p);
+    stapling_get_cached_response(s, rsp, &ok, NULL, cinf, p);
 
     if (*rsp) {
         /* see if response is acceptable */
@@ -737,7 +792,7 @@ static int get_and_check_cached_response(server_rec *s, modssl_ctx_t *mctx,
  *
  * Check for cached responses in session cache. If valid send back to
  * client.  If absent or no longer valid, query responder and update
- * cache.
+ * cache, unless responses are refreshed in the background.
  */
 static int stapling_cb(SSL *ssl, void *arg)
 {
@@ -773,7 +828,16 @@ static int stapling_cb(SSL *ssl, void *arg)
         return rv;
     }
 
-    if (rsp == NULL) {
+    if (rsp == NULL && stapling_refresh_async) {
+        /* never wait for the responder here, the watchdog will */
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(03522)
+                     "stapling_cb: no usable cached response, waiting for "
+                     "the background refresh");
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+    else if (rsp == NULL) {
+        STACK_OF(X509_EXTENSION) *exts;
+
         ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(01954)
                      "stapling_cb: renewing cached response");
         stapling_refresh_mutex_on(s);
@@ -799,8 +863,9 @@ static int stapling_cb(SSL *ssl, void *arg)
             ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(03238)
                          "stapling_cb: still must refresh cached response "
                          "after obtaining refresh mutex");
-            rv = stapling_renew_response(s, mctx, ssl, cinf, &rsp, &ok,
-                                         conn->pool);
+            SSL_get_tlsext_status_exts(ssl, &exts);
+            rv = stapling_renew_response(s, mctx, conn, exts, cinf, &rsp,
+                                         &ok, conn->pool);
             stapling_refresh_mutex_off(s);
 
             if (rv == TRUE) {
@@ -829,6 +894,166 @@ static int stapling_cb(SSL *ssl, void *arg)
 
 }
 
+/*
+ * Background refresh of the OCSP responses (SSLStaplingBackgroundRefresh).
+ *
+ * A singleton child watchdog looks at the certificates every second and
+ * queries the responder for those whose cached response is about to
+ * expire, so that handshakes only ever read from the cache. Which child
+ * runs the watchdog can change, so whether a response is due is determined
+ * from the time it was stored in the (shared) cache.
+ */
+
+#define SSL_STAPLING_WATCHDOG_NAME "_ssl_stapling_refresh_"
+
+/* When a response stored at the given time is due for a refresh: after
+ * three quarters of its cache lifetime, minus a random part of up to an
+ * eighth so that certificates do not keep being refreshed all at once. */
+static apr_time_t stapling_refresh_due(modssl_ctx_t *mctx, BOOL ok,
+                                       apr_time_t stored)
+{
+    int lifetime = (ok == TRUE) ? mctx->stapling_cache_timeout
+                                : mctx->stapling_errcache_timeout;
+
+    return stored + apr_time_from_sec(lifetime) * 3 / 4
+                  - apr_time_from_sec(ap_random_pick(0, lifetime / 8));
+}
+
+/* modssl_dispatch_ocsp_request() works on behalf of a connection, give it
+ * one with what it needs. */
+static conn_rec *stapling_refresh_conn(server_rec *s, apr_pool_t *p)
+{
+    conn_rec *c = apr_pcalloc(p, sizeof(*c));
+    SSLConnRec *sslconn = apr_pcalloc(p, sizeof(*sslconn));
+
+    c->pool = p;
+    c->base_server = s;
+    c->client_ip = "-";
+    c->bucket_alloc = apr_bucket_alloc_create(p);
+    c->conn_config = ap_create_conn_config(p);
+    c->notes = apr_table_make(p, 1);
+    sslconn->server = s;
+    myConnConfigSet(c, sslconn);
+
+    return c;
+}
+
+static void stapling_refresh(certinfo *cinf, apr_time_t now, apr_pool_t *p)
+{
+    server_rec *s = cinf->s;
+    modssl_ctx_t *mctx = cinf->mctx;
+    OCSP_RESPONSE *rsp = NULL;
+    apr_time_t stored = 0;
+    BOOL ok = TRUE;
+
+    /* The watchdog may have been running in another child before */
+    stapling_get_cached_response(s, &rsp, &ok, &stored, cinf, p);
+    if (rsp) {
+        OCSP_RESPONSE_free(rsp);
+        rsp = NULL;
+        if (stored) {
+            cinf->next_refresh = stapling_refresh_due(mctx, ok, stored);
+            if (cinf->next_refresh > now) {
+                return;
+            }
+        }
+    }
+
+    ok = TRUE;
+    if (stapling_renew_response(s, mctx, stapling_refresh_conn(s, p), NULL,
+                                cinf, &rsp, &ok, p) == TRUE && rsp) {
+        cinf->next_refresh = stapling_refresh_due(mctx, ok, now);
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(03523)
+                     "stapling_refresh: response renewed for server %s, "
+                     "next refresh in %" APR_TIME_T_FMT " seconds",
+                     mctx->sc->vhost_id,
+                     apr_time_sec(cinf->next_refresh - now));
+        OCSP_RESPONSE_free(rsp);
+    }
+    else {
+        /* nothing cached, try again like after an error response */
+        cinf->next_refresh = stapling_refresh_due(mctx, FALSE, now);
+        ap_log_error(APLOG_MARK, APLOG_WARNING, 0, s, APLOGNO(03524)
+                     "stapling_refresh: failed to renew response for "
+                     "server %s, retrying in %" APR_TIME_T_FMT " seconds",
+                     mctx->sc->vhost_id,
+                     apr_time_sec(cinf->next_refresh - now));
+    }
+}
+
+static apr_status_t stapling_refresh_watchdog(int state, void *data,
+                                              apr_pool_t *pool)
+{
+    apr_hash_index_t *hi;
+    apr_pool_t *p;
+    apr_time_t now;
+
+    /* Not when starting, ssl_init_Child() may still be reinitializing the
+     * stapling cache mutex. */
+    if (state != AP_WATCHDOG_STATE_RUNNING) {
+        return APR_SUCCESS;
+    }
+
+    now = apr_time_now();
+    apr_pool_create(&p, pool);
+    for (hi = apr_hash_first(NULL, stapling_certinfo); hi;
+         hi = apr_hash_next(hi)) {
+        void *val;
+        certinfo *cinf;
+
+        apr_hash_this(hi, NULL, NULL, &val);
+        cinf = val;
+        if (cinf->next_refresh <= now) {
+            stapling_refresh(cinf, now, p);
+            apr_pool_clear(p);
+        }
+    }
+    apr_pool_destroy(p);
+
+    return APR_SUCCESS;
+}
+
+apr_status_t ssl_stapling_refresh_init(server_rec *s, apr_pool_t *p)
+{
+    SSLSrvConfigRec *sc = mySrvConfig(s);
+    APR_OPTIONAL_FN_TYPE(ap_watchdog_get_instance) *wd_get_instance;
+    APR_OPTIONAL_FN_TYPE(ap_watchdog_register_callback) *wd_register_callback;
+    ap_watchdog_t *watchdog;
+    apr_status_t rv;
+
+    stapling_refresh_async = 0;
+    if (sc->stapling_background == FALSE
+        || apr_hash_count(stapling_certinfo) == 0) {
+        return APR_SUCCESS;
+    }
+
+    wd_get_instance = APR_RETRIEVE_OPTIONAL_FN(ap_watchdog_get_instance);
+    wd_register_callback = APR_RETRIEVE_OPTIONAL_FN(ap_watchdog_register_callback);
+    if (!wd_get_instance || !wd_register_callback) {
+        ap_log_error(APLOG_MARK, sc->stapling_background == TRUE
+                                 ? APLOG_WARNING : APLOG_INFO, 0, s,
+                     APLOGNO(03525) "OCSP stapling responses are renewed "
+                     "during handshakes, refreshing them in the background "
+                     "requires mod_watchdog");
+        return APR_SUCCESS;
+    }
+
+    rv = wd_get_instance(&watchdog, SSL_STAPLING_WATCHDOG_NAME, 0, 1, p);
+    if (rv == APR_SUCCESS) {
+        rv = wd_register_callback(watchdog, AP_WD_TM_INTERVAL, s,
+                                  stapling_refresh_watchdog);
+    }
+    if (rv != APR_SUCCESS && !APR_STATUS_IS_EEXIST(rv)) {
+        ap_log_error(APLOG_MARK, APLOG_EMERG, rv, s, APLOGNO(03526)
+                     "Failed to register the OCSP stapling refresh "
+                     "watchdog (%s)", SSL_STAPLING_WATCHDOG_NAME);
+        return ssl_die(s);
+    }
+
+    stapling_refresh_async = 1;
+    return APR_SUCCESS;
+}
+
 apr_status_t modssl_init_stapling(server_rec *s, apr_pool_t *p,
                                   apr_pool_t *ptemp, modssl_ctx_t *mctx)
 {
@@ -34,6 +34,9 @@
 #include "apr_portable.h"
 #include "apr_file_io.h"
 #include "apr_fnmatch.h"
+#include "apr_hash.h"
+#include "apr_ring.h"
+#include "apr_thread_mutex.h"
 
 #define APR_WANT_STDIO
 #define APR_WANT_STRFUNC
@@ -83,8 +86,9 @@ APR_HOOK_STRUCT(
            APR_HOOK_LINK(open_htaccess)
 )
 
-AP_IMPLEMENT_HOOK_RUN_ALL(int, header_parser,
-                          (request_rec *r), (r), OK, DECLINED)
+AP_IMPLEMENT_SERVER_HOOK_RUN_ALL(int, header_parser,
+                                 (request_rec *r), (r), r->server,
+                                 OK, DECLINED)
 
 AP_IMPLEMENT_HOOK_RUN_ALL(int, pre_config,
                           (apr_pool_t *pconf, apr_pool_t *plog,
@@ -309,6 +313,267 @@ AP_CORE_DECLARE(ap_conf_vector_t *) ap_merge_per_dir_configs(apr_pool_t *p,
     return (ap_conf_vector_t *)conf_vector;
 }
 
+/*
+ * The per child cache of merged per-dir configs (MergeCacheSize).
+ *
+ * The walks in request.c merge the same sections in the same order for
+ * most requests to the same area of a vhost. Results are remembered by
+ * the pair of configs they were merged from, as long as both live as long
+ * as the server configuration (its sections and the vhosts' defaults,
+ * collected at child init) or are results of this cache themselves. So a
+ * whole sequence of matched sections maps to one chain of entries, and
+ * pointers of configs that may go away (htaccess files, merges into the
+ * request's pool) never become keys.
+ *
+ * Results are allocated from the current generation's pool. Once it holds
+ * MergeCacheSize entries, a new generation is started and the old one is
+ * destroyed as soon as no request uses its results anymore. Results of an
+ * old generation are not accepted as keys of the new one.
+ */
+typedef struct {
+    const ap_conf_vector_t *base;
+    const ap_conf_vector_t *new_conf;
+} merge_cache_key_t;
+
+typedef struct {
+    apr_pool_t *pool;
+    apr_hash_t *merged;     /* merge_cache_key_t -> result */
+    apr_hash_t *results;    /* result -> result */
+    int count;
+    int refs;
+    int retired;
+} merge_cache_gen_t;
+
+typedef struct {
+    apr_pool_t *pool;
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *mutex;
+#endif
+    apr_hash_t *sections;   /* configs living as long as the configuration */
+    merge_cache_gen_t *gen;
+    int max;
+} merge_cache_t;
+
+static merge_cache_t *merge_cache;
+
+#define MERGE_CACHE_NOTE "ap_merge_cache_gen"
+
+static void merge_cache_lock(merge_cache_t *cache)
+{
+#if APR_HAS_THREADS
+    if (cache->mutex) {
+        apr_thread_mutex_lock(cache->mutex);
+    }
+#endif
+}
+
+static void merge_cache_unlock(merge_cache_t *cache)
+{
+#if APR_HAS_THREADS
+    if (cache->mutex) {
+        apr_thread_mutex_unlock(cache->mutex);
+    }
+#endif
+}
+
+static merge_cache_gen_t *merge_cache_gen_make(merge_cache_t *cache)
+{
+    merge_cache_gen_t *gen;
+    apr_pool_t *p;
+
+    apr_pool_create(&p, cache->pool);
+    apr_pool_tag(p, "merge_cache");
+    gen = apr_pcalloc(p, sizeof(*gen));
+    gen->pool = p;
+    gen->merged = apr_hash_make(p);
+    gen->results = apr_hash_make(p);
+    return gen;
+}
+
+static apr_status_t merge_cache_cleanup(void *data)
+{
+    merge_cache = NULL;
+    return APR_SUCCESS;
+}
+
+static apr_status_t merge_cache_release(void *data)
+{
+    merge_cache_t *cache = merge_cache;
+    merge_cache_gen_t *gen = data;
+
+    if (cache) {
+        merge_cache_lock(cache);
+        if (--gen->refs == 0 && gen->retired) {
+            apr_pool_destroy(gen->pool);
+        }
+        merge_cache_unlock(cache);
+    }
+    return APR_SUCCESS;
+}
+
+/* call with the cache locked */
+static ap_conf_vector_t *merge_cache_use(merge_cache_gen_t *gen,
+                                         ap_conf_vector_t *result,
+                                         request_rec *r)
+{
+    void *note = NULL;
+
+    /* hold the generation until the request is done, once is enough */
+    apr_pool_userdata_get(&note, MERGE_CACHE_NOTE, r->pool);
+    if (note != gen) {
+        ++gen->refs;
+        apr_pool_userdata_setn(gen, MERGE_CACHE_NOTE, NULL, r->pool);
+        apr_pool_cleanup_register(r->pool, gen, merge_cache_release,
+                                  apr_pool_cleanup_null);
+    }
+    return result;
+}
+
+static int merge_cache_knows(merge_cache_t *cache, const ap_conf_vector_t *v)
+{
+    return apr_hash_get(cache->sections, &v, sizeof(v)) != NULL
+           || apr_hash_get(cache->gen->results, &v, sizeof(v)) != NULL;
+}
+
+AP_CORE_DECLARE(ap_conf_vector_t *) ap_merge_per_dir_configs_cached(
+                                           request_rec *r,
+                                           ap_conf_vector_t *base,
+                                           ap_conf_vector_t *new_conf)
+{
+    merge_cache_t *cache = merge_cache;
+    merge_cache_gen_t *gen;
+    merge_cache_key_t key, *pkey;
+    ap_conf_vector_t *result;
+
+    if (!cache) {
+        return ap_merge_per_dir_configs(r->pool, base, new_conf);
+    }
+
+    merge_cache_lock(cache);
+
+    gen = cache->gen;
+    if (gen->count >= cache->max) {
+        if (gen->refs) {
+            gen->retired = 1;
+        }
+        else {
+            apr_pool_destroy(gen->pool);
+        }
+        gen = cache->gen = merge_cache_gen_make(cache);
+    }
+
+    if (!merge_cache_knows(cache, base) || !merge_cache_knows(cache, new_conf)) {
+        merge_cache_unlock(cache);
+        return ap_merge_per_dir_configs(r->pool, base, new_conf);
+    }
+
+    key.base = base;
+    key.new_conf = new_conf;
+    result = apr_hash_get(gen->merged, &key, sizeof(key));
+    if (!result) {
+        result = ap_merge_per_dir_configs(gen->pool, base, new_conf);
+        pkey = apr_pmemdup(gen->pool, &key, sizeof(key));
+        apr_hash_set(gen->merged, pkey, sizeof(*pkey), result);
+        apr_hash_set(gen->results,
+                     apr_pmemdup(gen->pool, &result, sizeof(result)),
+                     sizeof(result), result);
+        ++gen->count;
+    }
+    result = merge_cache_use(gen, result, r);
+
+    merge_cache_unlock(cache);
+    return result;
+}
+
+static void merge_cache_add_sections(apr_hash_t *sections, apr_pool_t *p,
+                                     ap_conf_vector_t *v)
+{
+    core_dir_config *dconf;
+    int i;
+
+    if (!v || apr_hash_get(sections, &v, sizeof(v))) {
+        return;
+    }
+    apr_hash_set(sections, apr_pmemdup(p, &v, sizeof(v)), sizeof(v), v);
+
+    /* <Files> and <If> nested in it */
+    dconf = ap_get_core_module_config(v);
+    if (dconf->sec_file) {
+        for (i = 0; i < dconf->sec_file->nelts; ++i) {
+            merge_cache_add_sections(sections, p,
+                APR_ARRAY_IDX(dconf->sec_file, i, ap_conf_vector_t *));
+        }
+    }
+    if (dconf->sec_if) {
+        for (i = 0; i < dconf->sec_if->nelts; ++i) {
+            merge_cache_add_sections(sections, p,
+                APR_ARRAY_IDX(dconf->sec_if, i, ap_conf_vector_t *));
+        }
+    }
+}
+
+AP_CORE_DECLARE(void) ap_merge_cache_init(apr_pool_t *pchild, server_rec *s)
+{
+    core_server_config *conf = ap_get_core_module_config(s->module_config);
+    apr_allocator_t *allocator;
+    merge_cache_t *cache;
+    server_rec *vs;
+    apr_pool_t *p;
+    int i;
+
+    if (conf->merge_cache_size <= 0) {
+        return;
+    }
+
+    /* The cache's pools are only ever used with its lock held */
+    apr_allocator_create(&allocator);
+    apr_pool_create_ex(&p, pchild, NULL, allocator);
+    apr_allocator_owner_set(allocator, p);
+    apr_pool_tag(p, "merge_cache");
+
+    cache = apr_pcalloc(p, sizeof(*cache));
+    cache->pool = p;
+    cache->max = conf->merge_cache_size;
+    cache->sections = apr_hash_make(p);
+
+#if APR_HAS_THREADS
+    {
+        int threaded_mpm = 0;
+
+        ap_mpm_query(AP_MPMQ_IS_THREADED, &threaded_mpm);
+        if (threaded_mpm
+            && apr_thread_mutex_create(&cache->mutex,
+                                       APR_THREAD_MUTEX_DEFAULT, p)
+               != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, APLOGNO(03529)
+                         "MergeCacheSize ignored, unable to create mutex");
+            apr_pool_destroy(p);
+            return;
+        }
+    }
+#endif
+
+    for (vs = s; vs; vs = vs->next) {
+        core_server_config *sconf =
+            ap_get_core_module_config(vs->module_config);
+
+        merge_cache_add_sections(cache->sections, p, vs->lookup_defaults);
+        for (i = 0; i < sconf->sec_dir->nelts; ++i) {
+            merge_cache_add_sections(cache->sections, p,
+                APR_ARRAY_IDX(sconf->sec_dir, i, ap_conf_vector_t *));
+        }
+        for (i = 0; i < sconf->sec_url->nelts; ++i) {
+            merge_cache_add_sections(cache->sections, p,
+                APR_ARRAY_IDX(sconf->sec_url, i, ap_conf_vector_t *));
+        }
+    }
+    cache->gen = merge_cache_gen_make(cache);
+
+    apr_pool_cleanup_register(p, NULL, merge_cache_cleanup,
+                              apr_pool_cleanup_null);
+    merge_cache = cache;
+}
+
 static ap_conf_vector_t *create_server_config(apr_pool_t *p, server_rec *s)
 {
     void **conf_vector = apr_pcalloc(p, sizeof(void *) * conf_vector_length);
@@ -1100,6 +1365,14 @@ static const char *execute_now(char *cmd_line, const char *args,
                                ap_directive_t **sub_tree,
                                ap_directive_t *parent);
 
+/* the ConfigReloadCache, and whether the tree of the file it is parsing
+ * depends on more than the file's content
+ */
+typedef struct config_cache_t config_cache_t;
+static config_cache_t *config_cache = NULL;
+static int config_impure = 0;
+#define CONFIG_CACHE_READING() (config_cache && config_cache->pconf)
+
 static const char *ap_build_config_sub(apr_pool_t *p, apr_pool_t *temp_pool,
                                        const char *l, cmd_parms *parms,
                                        ap_directive_t **current,
@@ -1119,6 +1392,9 @@ static const char *ap_build_config_sub(apr_pool_t *p, apr_pool_t *temp_pool,
 #if RESOLVE_ENV_PER_TOKEN
     args = l;
 #else
+    if (CONFIG_CACHE_READING() && ap_strstr_c(l, "${")) {
+        config_impure++;
+    }
     args = ap_resolve_env(temp_pool, l);
 #endif
 
@@ -1155,6 +1431,9 @@ static const char *ap_build_config_sub(apr_pool_t *p, apr_pool_t *temp_pool,
         if (cmd->req_override & EXEC_ON_READ) {
             ap_directive_t *sub_tree = NULL;
 
+            if (CONFIG_CACHE_READING()) {
+                config_impure++;
+            }
             parms->err_directive = newdir;
             retval = execute_now(cmd_name, args, parms, p, temp_pool,
                                  &sub_tree, *curr_parent);
@@ -1845,6 +2124,265 @@ static void dump_config_name(const char *fname, apr_pool_t *p)
     apr_file_printf(out, " %s\n", fname);
 }
 
+/*
+ * ConfigReloadCache: the parse trees of configuration files are kept
+ * from one configuration generation to the next, so that on restart the
+ * files which did not change are neither read nor parsed again.  Only
+ * trees which depend on nothing but the content of their file are kept,
+ * i.e. of files without directives executed while reading (Include,
+ * Define, <IfModule>, <IfDefine>, ...) and without ${VAR} references.
+ *
+ * The trees of a generation live in their own pool, the ones of files
+ * which did not change are copied over from the previous generation,
+ * which is then destroyed.  The configuration gets copies of the nodes
+ * made in pconf, since modules store data in them, while the strings
+ * remain those of the cache; pconf is always cleared before the cache
+ * pool they live in is destroyed.
+ */
+typedef struct {
+    apr_time_t mtime;
+    apr_off_t size;
+    apr_ino_t inode;
+    apr_dev_t device;
+    ap_directive_t *tree;
+} config_cache_file;
+
+struct config_cache_t {
+    apr_pool_t *pool;
+    apr_hash_t *files;          /* config_cache_file by file name */
+    apr_pool_t *prev_pool;      /* the previous generation, until the */
+    apr_hash_t *prev_files;     /* configuration has been read */
+    apr_pool_t *pconf;          /* the configuration being read */
+    int reused;
+    int parsed;
+};
+
+/* ConfigReloadCache setting of the last configuration processed */
+static int config_cache_enabled = 0;
+
+/* copy a tree with its strings to pool p, for the cache */
+static ap_directive_t *config_cache_copy(apr_pool_t *p,
+                                         const ap_directive_t *tree,
+                                         ap_directive_t *parent)
+{
+    ap_directive_t *first = NULL, **last = &first, *dir;
+    const char *filename = NULL, *copied = NULL;
+
+    for (; tree; tree = tree->next) {
+        dir = apr_pcalloc(p, sizeof(*dir));
+        dir->directive = apr_pstrdup(p, tree->directive);
+        dir->args = apr_pstrdup(p, tree->args);
+        if (tree->filename != filename) {
+            filename = tree->filename;
+            copied = apr_pstrdup(p, filename);
+        }
+        dir->filename = copied;
+        dir->line_num = tree->line_num;
+        dir->parent = parent;
+        dir->first_child = config_cache_copy(p, tree->first_child, dir);
+        *last = dir;
+        last = &dir->next;
+    }
+    return first;
+}
+
+/* copy the nodes of a cached tree to pconf, or fail if one of its
+ * directives is now executed while reading
+ */
+static ap_directive_t *config_cache_use(apr_pool_t *p,
+                                        const ap_directive_t *tree,
+                                        ap_directive_t *parent, int *failed)
+{
+    ap_directive_t *first = NULL, **last = &first, *dir;
+    const command_rec *cmd;
+    module *mod;
+
+    for (; tree && !*failed; tree = tree->next) {
+        dir = apr_pcalloc(p, sizeof(*dir));
+        mod = ap_top_module;
+        if ((cmd = ap_find_command_in_modules(tree->directive, &mod))) {
+            if (cmd->req_override & EXEC_ON_READ) {
+                *failed = 1;
+                break;
+            }
+            dir->directive = cmd->name;
+        }
+        else {
+            dir->directive = tree->directive;
+        }
+        dir->args = tree->args;
+        dir->filename = tree->filename;
+        dir->line_num = tree->line_num;
+        dir->parent = parent;
+        dir->first_child = config_cache_use(p, tree->first_child, dir,
+                                            failed);
+        *last = dir;
+        last = &dir->next;
+    }
+    return first;
+}
+
+/* append a tree to the configuration, as ap_build_config() does */
+static void config_cache_append(ap_directive_t **conftree,
+                                ap_directive_t *tree)
+{
+    ap_directive_t *current = *conftree;
+
+    if (!tree) {
+        return;
+    }
+    if (!current) {
+        *conftree = tree;
+        return;
+    }
+    if (current->last) {
+        current = current->last;
+    }
+    while (current->next) {
+        current = current->next;
+    }
+    (*conftree)->last = current;
+    current->next = tree;
+}
+
+static config_cache_file *config_cache_lookup(const char *fname,
+                                              const apr_finfo_t *finfo)
+{
+    config_cache_file *file, *prev;
+
+    file = apr_hash_get(config_cache->files, fname, APR_HASH_KEY_STRING);
+    if (!file && config_cache->prev_files) {
+        prev = apr_hash_get(config_cache->prev_files, fname,
+                            APR_HASH_KEY_STRING);
+        if (prev) {
+            /* carry it over to this generation */
+            file = apr_pmemdup(config_cache->pool, prev, sizeof(*file));
+            file->tree = config_cache_copy(config_cache->pool, prev->tree,
+                                           NULL);
+            apr_hash_set(config_cache->files,
+                         apr_pstrdup(config_cache->pool, fname),
+                         APR_HASH_KEY_STRING, file);
+        }
+    }
+    if (file && (file->mtime != finfo->mtime || file->size != finfo->size
+                 || file->inode != finfo->inode
+                 || file->device != finfo->device)) {
+        apr_hash_set(config_cache->files, fname, APR_HASH_KEY_STRING, NULL);
+        file = NULL;
+    }
+    return file;
+}
+
+static const char *config_cache_process(const char *fname,
+                                        ap_directive_t **conftree,
+                                        cmd_parms *parms, apr_pool_t *p,
+                                        apr_pool_t *ptemp)
+{
+    config_cache_file *file = NULL;
+    ap_configfile_t *cfp;
+    ap_directive_t *tree;
+    apr_finfo_t finfo;
+    apr_status_t rv;
+    const char *error;
+    int impure = config_impure, have_finfo, failed = 0;
+
+    have_finfo = (apr_stat(&finfo, fname, APR_FINFO_MTIME | APR_FINFO_SIZE
+                                          | APR_FINFO_INODE | APR_FINFO_DEV,
+                           ptemp) == APR_SUCCESS);
+    if (have_finfo && (file = config_cache_lookup(fname, &finfo))) {
+        tree = config_cache_use(p, file->tree, NULL, &failed);
+        if (!failed) {
+            if (ap_exists_config_define("DUMP_INCLUDES")) {
+                dump_config_name(fname, p);
+            }
+            config_cache_append(conftree, tree);
+            config_cache->reused++;
+            return NULL;
+        }
+        apr_hash_set(config_cache->files, fname, APR_HASH_KEY_STRING, NULL);
+    }
+
+    rv = ap_pcfg_openfile(&cfp, p, fname);
+    if (rv != APR_SUCCESS) {
+        return apr_psprintf(p, "Could not open configuration file %s: %pm",
+                            fname, &rv);
+    }
+
+    if (ap_exists_config_define("DUMP_INCLUDES")) {
+        dump_config_name(fname, p);
+    }
+
+    config_impure = 0;
+    tree = NULL;
+    parms->config_file = cfp;
+    error = ap_build_config(parms, p, ptemp, &tree);
+    ap_cfg_closefile(cfp);
+    if (error) {
+        return error;
+    }
+    config_cache->parsed++;
+
+    if (!config_impure && have_finfo) {
+        file = apr_palloc(config_cache->pool, sizeof(*file));
+        file->mtime = finfo.mtime;
+        file->size = finfo.size;
+        file->inode = finfo.inode;
+        file->device = finfo.device;
+        file->tree = config_cache_copy(config_cache->pool, tree, NULL);
+        apr_hash_set(config_cache->files,
+                     apr_pstrdup(config_cache->pool, fname),
+                     APR_HASH_KEY_STRING, file);
+    }
+    config_impure += impure;
+
+    config_cache_append(conftree, tree);
+    return NULL;
+}
+
+/* start the cache for the configuration about to be read into pconf */
+static void config_cache_start(process_rec *process)
+{
+    config_cache_t *prev = config_cache;
+    apr_pool_t *pool;
+
+    config_cache = NULL;
+    if (!config_cache_enabled) {
+        if (prev) {
+            apr_pool_destroy(prev->pool);
+        }
+        return;
+    }
+
+    apr_pool_create(&pool, process->pool);
+    apr_pool_tag(pool, "config_cache");
+    config_cache = apr_pcalloc(pool, sizeof(*config_cache));
+    config_cache->pool = pool;
+    config_cache->files = apr_hash_make(pool);
+    config_cache->pconf = process->pconf;
+    if (prev) {
+        config_cache->prev_pool = prev->pool;
+        config_cache->prev_files = prev->files;
+    }
+}
+
+/* the configuration has been read, files not used anymore are dropped */
+static void config_cache_finish(void)
+{
+    if (!config_cache) {
+        return;
+    }
+    if (config_cache->prev_pool) {
+        ap_log_error(APLOG_MARK, APLOG_INFO, 0, NULL, APLOGNO(03530)
+                     "ConfigReloadCache: %d configuration files unchanged, "
+                     "%d read", config_cache->reused, config_cache->parsed);
+        apr_pool_destroy(config_cache->prev_pool);
+        config_cache->prev_pool = NULL;
+        config_cache->prev_files = NULL;
+    }
+    config_cache->pconf = NULL;
+    config_cache->reused = config_cache->parsed = 0;
+}
+
 AP_DECLARE(const char *) ap_process_resource_config(server_rec *s,
                                                     const char *fname,
                                                     ap_directive_t **conftree,
@@ -1863,6 +2401,11 @@ AP_DECLARE(const char *) ap_process_resource_config(server_rec *s,
     parms.override = (RSRC_CONF | OR_ALL) & ~(OR_AUTHCFG | OR_LIMIT);
     parms.override_opts = OPT_ALL | OPT_SYM_OWNER | OPT_MULTI;
 
+    if (config_cache && p == config_cache->pconf) {
+        error = config_cache_process(fname, conftree, &parms, p, ptemp);
+        goto done;
+    }
+
     rv = ap_pcfg_openfile(&cfp, p, fname);
     if (rv != APR_SUCCESS) {
         return apr_psprintf(p, "Could not open configuration file %s: %pm",
@@ -1877,6 +2420,8 @@ AP_DECLARE(const char *) ap_process_resource_config(server_rec *s,
     error = ap_build_config(&parms, p, ptemp, conftree);
     ap_cfg_closefile(cfp);
 
+done:
+
     if (error) {
         if (parms.err_directive)
             /* note: this may not be a 'syntactic' error per se.
@@ -2124,6 +2669,7 @@ AP_DECLARE(int) ap_process_config_tree(server_rec *s,
 {
     const char *errmsg;
     cmd_parms parms;
+    core_server_config *conf;
 
     parms = default_parms;
     parms.pool = p;
@@ -2144,6 +2690,10 @@ AP_DECLARE(int) ap_process_config_tree(server_rec *s,
         return HTTP_INTERNAL_SERVER_ERROR;
     }
 
+    /* ConfigReloadCache applies the next time the configuration is read */
+    conf = ap_get_core_module_config(s->module_config);
+    config_cache_enabled = conf->config_reload_cache;
+
     return OK;
 }
 
@@ -2156,35 +2706,22 @@ apr_status_t ap_open_htaccess(request_rec *r, const char *dir_name,
     return ap_pcfg_openfile(conffile, r->pool, *full_name);
 }
 
-AP_CORE_DECLARE(int) ap_parse_htaccess(ap_conf_vector_t **result,
-                                       request_rec *r, int override,
-                                       int override_opts, apr_table_t *override_list,
-                                       const char *d, const char *access_names)
+/*
+ * Read the first htaccess file found in directory d into a new per-dir
+ * config allocated from p. *result stays NULL if there is none.
+ */
+static int htaccess_read(ap_conf_vector_t **result, request_rec *r,
+                         cmd_parms *parms, const char *d,
+                         const char *access_names, apr_pool_t *p)
 {
     ap_configfile_t *f = NULL;
-    cmd_parms parms;
     const char *filename;
-    const struct htaccess_result *cache;
-    struct htaccess_result *new;
-    ap_conf_vector_t *dc = NULL;
+    ap_conf_vector_t *dc;
     apr_status_t status;
 
-    /* firstly, search cache */
-    for (cache = r->htaccess; cache != NULL; cache = cache->next) {
-        if (cache->override == override && strcmp(cache->dir, d) == 0) {
-            *result = cache->htaccess;
-            return OK;
-        }
-    }
-
-    parms = default_parms;
-    parms.override = override;
-    parms.override_opts = override_opts;
-    parms.override_list = override_list;
-    parms.pool = r->pool;
-    parms.temp_pool = r->pool;
-    parms.server = r->server;
-    parms.path = apr_pstrdup(r->pool, d);
+    parms->pool = p;
+    parms->temp_pool = p;
+    parms->path = apr_pstrdup(p, d);
 
     /* loop through the access names and find the first one */
     while (access_names[0]) {
@@ -2196,12 +2733,12 @@ AP_CORE_DECLARE(int) ap_parse_htaccess(ap_conf_vector_t **result,
             const char *errmsg;
             ap_directive_t *temptree = NULL;
 
-            dc = ap_create_per_dir_config(r->pool);
+            dc = ap_create_per_dir_config(p);
 
-            parms.config_file = f;
-            errmsg = ap_build_config(&parms, r->pool, r->pool, &temptree);
+            parms->config_file = f;
+            errmsg = ap_build_config(parms, p, p, &temptree);
             if (errmsg == NULL)
-                errmsg = ap_walk_config(temptree, &parms, dc);
+                errmsg = ap_walk_config(temptree, parms, dc);
 
             ap_cfg_closefile(f);
 
@@ -2230,9 +2767,375 @@ AP_CORE_DECLARE(int) ap_parse_htaccess(ap_conf_vector_t **result,
         }
     }
 
+    return OK;
+}
+
+/*
+ * The per child cache of parsed htaccess files (AccessFileCache).
+ *
+ * Entries are keyed by everything the parse depends on: the server, the
+ * allowed overrides, the access file names and the directory. Each one
+ * remembers what stat() said about the candidate files when it was
+ * parsed, and is checked against that again once it is older than
+ * AccessFileCacheRevalidate. Directories without an htaccess file are
+ * cached as well.
+ *
+ * Every entry has its own pool, holding the parsed config. Requests using
+ * it hold a reference until their pool goes away, so that entries evicted
+ * in the meantime (least recently used first) are destroyed only once
+ * they are no longer in use.
+ */
+typedef struct {
+    apr_filetype_e filetype;    /* APR_NOFILE if there is no such file */
+    apr_ino_t inode;
+    apr_dev_t device;
+    apr_time_t mtime;
+    apr_off_t size;
+} htaccess_stat_t;
+
+typedef struct htaccess_entry_t htaccess_entry_t;
+struct htaccess_entry_t {
+    APR_RING_ENTRY(htaccess_entry_t) link;
+    const char *key;
+    apr_pool_t *pool;
+    ap_conf_vector_t *dc;       /* NULL if there is no htaccess file */
+    apr_array_header_t *stats;  /* htaccess_stat_t per access name tried */
+    apr_time_t checked;
+    int refs;
+    int evicted;
+};
+
+typedef struct {
+    apr_pool_t *pool;
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *mutex;
+#endif
+    apr_hash_t *entries;
+    APR_RING_HEAD(htaccess_lru_t, htaccess_entry_t) lru;
+    int count;
+    int max;
+    apr_interval_time_t revalidate;
+} htaccess_cache_t;
+
+static htaccess_cache_t *htaccess_cache;
+
+static void htaccess_cache_lock(htaccess_cache_t *cache)
+{
+#if APR_HAS_THREADS
+    if (cache->mutex) {
+        apr_thread_mutex_lock(cache->mutex);
+    }
+#endif
+}
+
+static void htaccess_cache_unlock(htaccess_cache_t *cache)
+{
+#if APR_HAS_THREADS
+    if (cache->mutex) {
+        apr_thread_mutex_unlock(cache->mutex);
+    }
+#endif
+}
+
+static apr_status_t htaccess_cache_cleanup(void *data)
+{
+    htaccess_cache = NULL;
+    return APR_SUCCESS;
+}
+
+static apr_status_t htaccess_cache_release(void *data)
+{
+    htaccess_cache_t *cache = htaccess_cache;
+    htaccess_entry_t *e = data;
+
+    if (cache) {
+        htaccess_cache_lock(cache);
+        if (--e->refs == 0 && e->evicted) {
+            apr_pool_destroy(e->pool);
+        }
+        htaccess_cache_unlock(cache);
+    }
+    return APR_SUCCESS;
+}
+
+/* call with the cache locked */
+static void htaccess_cache_evict(htaccess_cache_t *cache, htaccess_entry_t *e)
+{
+    apr_hash_set(cache->entries, e->key, APR_HASH_KEY_STRING, NULL);
+    APR_RING_REMOVE(e, link);
+    --cache->count;
+    if (e->refs) {
+        e->evicted = 1;
+    }
+    else {
+        apr_pool_destroy(e->pool);
+    }
+}
+
+/* call with the cache locked */
+static ap_conf_vector_t *htaccess_cache_use(htaccess_cache_t *cache,
+                                            htaccess_entry_t *e,
+                                            request_rec *r)
+{
+    APR_RING_REMOVE(e, link);
+    APR_RING_INSERT_HEAD(&cache->lru, e, htaccess_entry_t, link);
+    if (e->dc) {
+        ++e->refs;
+        apr_pool_cleanup_register(r->pool, e, htaccess_cache_release,
+                                  apr_pool_cleanup_null);
+    }
+    return e->dc;
+}
+
+/*
+ * stat() the htaccess files of directory d in the order ap_open_htaccess()
+ * tries them, up to the first one that exists. Anything unusual (no
+ * permission, not a regular file, ...) is left to the uncached path to
+ * report.
+ */
+static apr_status_t htaccess_stat(apr_array_header_t **pstats, request_rec *r,
+                                  const char *d, const char *access_names)
+{
+    apr_array_header_t *stats;
+    apr_finfo_t finfo;
+    apr_status_t rv;
+
+    stats = apr_array_make(r->pool, 1, sizeof(htaccess_stat_t));
+    while (access_names[0]) {
+        const char *access_name = ap_getword_conf(r->pool, &access_names);
+        htaccess_stat_t *st = apr_array_push(stats);
+
+        memset(st, 0, sizeof(*st));
+        rv = apr_stat(&finfo, ap_make_full_path(r->pool, d, access_name),
+                      APR_FINFO_TYPE | APR_FINFO_IDENT | APR_FINFO_MTIME
+                      | APR_FINFO_SIZE, r->pool);
+        if (APR_STATUS_IS_ENOENT(rv) || APR_STATUS_IS_ENOTDIR(rv)) {
+            st->filetype = APR_NOFILE;
+            continue;
+        }
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        if (finfo.filetype != APR_REG) {
+            return APR_EGENERAL;
+        }
+        st->filetype = finfo.filetype;
+        st->inode = finfo.inode;
+        st->device = finfo.device;
+        st->mtime = finfo.mtime;
+        st->size = finfo.size;
+        break;
+    }
+
+    *pstats = stats;
+    return APR_SUCCESS;
+}
+
+static int htaccess_stats_match(const apr_array_header_t *a,
+                                const apr_array_header_t *b)
+{
+    int i;
+
+    if (a->nelts != b->nelts) {
+        return 0;
+    }
+    for (i = 0; i < a->nelts; ++i) {
+        const htaccess_stat_t *sa = &APR_ARRAY_IDX(a, i, htaccess_stat_t);
+        const htaccess_stat_t *sb = &APR_ARRAY_IDX(b, i, htaccess_stat_t);
+
+        if (sa->filetype != sb->filetype
+            || sa->inode != sb->inode
+            || sa->device != sb->device
+            || sa->mtime != sb->mtime
+            || sa->size != sb->size) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int htaccess_cache_get(ap_conf_vector_t **result, request_rec *r,
+                              cmd_parms *parms, const char *d,
+                              const char *access_names)
+{
+    htaccess_cache_t *cache = htaccess_cache;
+    htaccess_entry_t *e, *old;
+    apr_array_header_t *stats;
+    apr_time_t now = apr_time_now();
+    ap_conf_vector_t *dc = NULL;
+    const char *key;
+    apr_pool_t *p;
+    int rv;
+
+    key = apr_psprintf(r->pool, "%pp:%d:%d:%pp:%s:%s", r->server,
+                       parms->override, parms->override_opts,
+                       parms->override_list, access_names, d);
+
+    htaccess_cache_lock(cache);
+    e = apr_hash_get(cache->entries, key, APR_HASH_KEY_STRING);
+    if (e && now - e->checked < cache->revalidate) {
+        *result = htaccess_cache_use(cache, e, r);
+        htaccess_cache_unlock(cache);
+        return OK;
+    }
+    htaccess_cache_unlock(cache);
+
+    if (htaccess_stat(&stats, r, d, access_names) != APR_SUCCESS) {
+        return htaccess_read(result, r, parms, d, access_names, r->pool);
+    }
+
+    htaccess_cache_lock(cache);
+    e = apr_hash_get(cache->entries, key, APR_HASH_KEY_STRING);
+    if (e) {
+        if (htaccess_stats_match(e->stats, stats)) {
+            e->checked = now;
+            *result = htaccess_cache_use(cache, e, r);
+            htaccess_cache_unlock(cache);
+            return OK;
+        }
+        ap_log_rerror(APLOG_MARK, APLOG_TRACE2, 0, r,
+                      "htaccess cache: %s changed", d);
+        htaccess_cache_evict(cache, e);
+    }
+    htaccess_cache_unlock(cache);
+
+    /* Parse outside of the lock, the cache's allocator is thread safe */
+    apr_pool_create(&p, cache->pool);
+    apr_pool_tag(p, "htaccess_cache");
+    rv = htaccess_read(&dc, r, parms, d, access_names, p);
+    if (rv != OK) {
+        apr_pool_destroy(p);
+        return rv;
+    }
+
+    e = apr_pcalloc(p, sizeof(*e));
+    e->key = apr_pstrdup(p, key);
+    e->pool = p;
+    e->dc = dc;
+    e->stats = apr_array_copy(p, stats);
+    e->checked = now;
+
+    htaccess_cache_lock(cache);
+    /* someone else may have been parsing it at the same time */
+    old = apr_hash_get(cache->entries, e->key, APR_HASH_KEY_STRING);
+    if (old) {
+        htaccess_cache_evict(cache, old);
+    }
+    while (cache->count >= cache->max) {
+        htaccess_cache_evict(cache, APR_RING_LAST(&cache->lru));
+    }
+    apr_hash_set(cache->entries, e->key, APR_HASH_KEY_STRING, e);
+    APR_RING_INSERT_HEAD(&cache->lru, e, htaccess_entry_t, link);
+    ++cache->count;
+    *result = htaccess_cache_use(cache, e, r);
+    ap_log_rerror(APLOG_MARK, APLOG_TRACE2, 0, r,
+                  "htaccess cache: added %s (%d entries)", d, cache->count);
+    htaccess_cache_unlock(cache);
+
+    return OK;
+}
+
+AP_CORE_DECLARE(void) ap_htaccess_cache_init(apr_pool_t *pchild,
+                                             server_rec *s)
+{
+    core_server_config *conf = ap_get_core_module_config(s->module_config);
+    apr_array_header_t *hooks = ap_hook_get_open_htaccess();
+    apr_allocator_t *allocator;
+    htaccess_cache_t *cache;
+    apr_pool_t *p;
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *mutex;
+    int threaded_mpm = 0;
+#endif
+
+    if (!conf->access_cache) {
+        return;
+    }
+
+    /* The cache validates entries with stat(), which is only right for
+     * the files the core's open_htaccess hook opens.
+     */
+    if (!hooks || hooks->nelts != 1) {
+        ap_log_error(APLOG_MARK, APLOG_INFO, 0, s, APLOGNO(03527)
+                     "AccessFileCache disabled, htaccess files are opened "
+                     "by a module");
+        return;
+    }
+
+    apr_allocator_create(&allocator);
+    apr_pool_create_ex(&p, pchild, NULL, allocator);
+    apr_allocator_owner_set(allocator, p);
+    apr_pool_tag(p, "htaccess_cache");
+
+    cache = apr_pcalloc(p, sizeof(*cache));
+    cache->pool = p;
+    cache->entries = apr_hash_make(p);
+    APR_RING_INIT(&cache->lru, htaccess_entry_t, link);
+    cache->max = conf->access_cache_size;
+    cache->revalidate = conf->access_cache_revalidate;
+
+#if APR_HAS_THREADS
+    ap_mpm_query(AP_MPMQ_IS_THREADED, &threaded_mpm);
+    if (threaded_mpm) {
+        if (apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT, p)
+            != APR_SUCCESS
+            || apr_thread_mutex_create(&cache->mutex,
+                                       APR_THREAD_MUTEX_DEFAULT, p)
+               != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, APLOGNO(03528)
+                         "AccessFileCache disabled, unable to create mutex");
+            apr_pool_destroy(p);
+            return;
+        }
+        /* entries are parsed into sub pools concurrently */
+        apr_allocator_mutex_set(allocator, mutex);
+    }
+#endif
+
+    apr_pool_cleanup_register(p, NULL, htaccess_cache_cleanup,
+                              apr_pool_cleanup_null);
+    htaccess_cache = cache;
+}
+
+AP_CORE_DECLARE(int) ap_parse_htaccess(ap_conf_vector_t **result,
+                                       request_rec *r, int override,
+                                       int override_opts, apr_table_t *override_list,
+                                       const char *d, const char *access_names)
+{
+    cmd_parms parms;
+    const struct htaccess_result *cache;
+    struct htaccess_result *new;
+    ap_conf_vector_t *dc = NULL;
+    int rv;
+
+    /* firstly, search cache */
+    for (cache = r->htaccess; cache != NULL; cache = cache->next) {
+        if (cache->override == override && strcmp(cache->dir, d) == 0) {
+            *result = cache->htaccess;
+            return OK;
+        }
+    }
+
+    parms = default_parms;
+    parms.override = override;
+    parms.override_opts = override_opts;
+    parms.override_list = override_list;
+    parms.server = r->server;
+
+    if (htaccess_cache) {
+        rv = htaccess_cache_get(&dc, r, &parms, d, access_names);
+    }
+    else {
+        rv = htaccess_read(&dc, r, &parms, d, access_names, r->pool);
+    }
+    if (rv != OK) {
+        return rv;
+    }
+    *result = dc;
+
     /* cache it */
     new = apr_palloc(r->pool, sizeof(struct htaccess_result));
-    new->dir = parms.path;
+    new->dir = apr_pstrdup(r->pool, d);
     new->override = override;
     new->override_opts = override_opts;
     new->htaccess = dc;
@@ -2467,6 +3370,8 @@ AP_DECLARE(server_rec*) ap_read_config(process_rec *process, apr_pool_t *ptemp,
         return s;
     }
 
+    config_cache_start(process);
+
     init_config_globals(p);
 
     if (ap_exists_config_define("DUMP_INCLUDES")) {
@@ -2523,6 +3428,8 @@ AP_DECLARE(server_rec*) ap_read_config(process_rec *process, apr_pool_t *ptemp,
         return NULL;
     }
 
+    config_cache_finish();
+
     return s;
 }
 
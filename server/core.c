@@ -362,10 +362,12 @@ static void *merge_core_dir_configs(apr_pool_t *a, void *basev, void *newv)
 
     if (new->output_filters) {
         conf->output_filters = new->output_filters;
+        conf->output_filter_chain = new->output_filter_chain;
     }
 
     if (new->input_filters) {
         conf->input_filters = new->input_filters;
+        conf->input_filter_chain = new->input_filter_chain;
     }
 
     /*
@@ -458,6 +460,9 @@ static void *create_core_server_config(apr_pool_t *a, server_rec *s)
     if (!is_virtual) {
         conf->ap_document_root = DOCUMENT_LOCATION;
         conf->access_name = DEFAULT_ACCESS_FNAME;
+        conf->access_cache_size = AP_DEFAULT_ACCESS_CACHE_SIZE;
+        conf->access_cache_revalidate =
+            apr_time_from_sec(AP_DEFAULT_ACCESS_CACHE_REVALIDATE);
 
         /* A mapping only makes sense in the global context */
         conf->accf_map = apr_table_make(a, 5);
@@ -1349,6 +1354,92 @@ static const char *set_access_name(cmd_parms *cmd, void *dummy,
     return NULL;
 }
 
+static const char *set_access_cache(cmd_parms *cmd, void *dummy, int arg)
+{
+    void *sconf = cmd->server->module_config;
+    core_server_config *conf = ap_get_core_module_config(sconf);
+
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    if (err != NULL) {
+        return err;
+    }
+
+    conf->access_cache = arg;
+    return NULL;
+}
+
+static const char *set_access_cache_size(cmd_parms *cmd, void *dummy,
+                                         const char *arg)
+{
+    void *sconf = cmd->server->module_config;
+    core_server_config *conf = ap_get_core_module_config(sconf);
+
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    if (err != NULL) {
+        return err;
+    }
+
+    conf->access_cache_size = atoi(arg);
+    if (conf->access_cache_size <= 0) {
+        return "AccessFileCacheSize must be a positive number of entries";
+    }
+    return NULL;
+}
+
+static const char *set_merge_cache_size(cmd_parms *cmd, void *dummy,
+                                        const char *arg)
+{
+    void *sconf = cmd->server->module_config;
+    core_server_config *conf = ap_get_core_module_config(sconf);
+
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    if (err != NULL) {
+        return err;
+    }
+
+    conf->merge_cache_size = atoi(arg);
+    if (conf->merge_cache_size < 0) {
+        return "MergeCacheSize must be a number of entries, or 0 to disable";
+    }
+    return NULL;
+}
+
+static const char *set_config_reload_cache(cmd_parms *cmd, void *dummy,
+                                           int arg)
+{
+    void *sconf = cmd->server->module_config;
+    core_server_config *conf = ap_get_core_module_config(sconf);
+
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    if (err != NULL) {
+        return err;
+    }
+
+    conf->config_reload_cache = arg;
+    return NULL;
+}
+
+static const char *set_access_cache_revalidate(cmd_parms *cmd, void *dummy,
+                                               const char *arg)
+{
+    void *sconf = cmd->server->module_config;
+    core_server_config *conf = ap_get_core_module_config(sconf);
+    apr_interval_time_t timeout;
+
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    if (err != NULL) {
+        return err;
+    }
+
+    if (ap_timeout_parameter_parse(arg, &timeout, "s") != APR_SUCCESS
+        || timeout < 0) {
+        return "AccessFileCacheRevalidate must be a non-negative time "
+               "interval";
+    }
+    conf->access_cache_revalidate = timeout;
+    return NULL;
+}
+
 AP_DECLARE(const char *) ap_resolve_env(apr_pool_t *p, const char * word)
 {
 # define SMALL_EXPANSION 5
@@ -2109,6 +2200,24 @@ static const char *set_sethandler(cmd_parms *cmd,
     return NULL;
 }
 
+static const char *set_filters(cmd_parms *cmd, void *d_, const char *arg)
+{
+    core_dir_config *dirconf = d_;
+    ap_filter_direction_e direction = (ap_filter_direction_e)(long)cmd->info;
+    ap_filter_chain_t *chain = ap_filter_chain_make(cmd->pool, arg,
+                                                    direction);
+
+    if (direction == AP_FILTER_INPUT) {
+        dirconf->input_filters = arg;
+        dirconf->input_filter_chain = chain;
+    }
+    else {
+        dirconf->output_filters = arg;
+        dirconf->output_filter_chain = chain;
+    }
+    return NULL;
+}
+
 /*
  * Note what data should be used when forming file ETag values.
  * It would be nicer to do this as an ITERATE, but then we couldn't
@@ -4499,6 +4608,18 @@ AP_INIT_RAW_ARGS("<Else", ifsection, COND_ELSE, OR_ALL,
 
 AP_INIT_RAW_ARGS("AccessFileName", set_access_name, NULL, RSRC_CONF,
   "Name(s) of per-directory config files (default: .htaccess)"),
+AP_INIT_FLAG("AccessFileCache", set_access_cache, NULL, RSRC_CONF,
+  "Whether parsed per-directory config files are kept across requests"),
+AP_INIT_TAKE1("AccessFileCacheSize", set_access_cache_size, NULL, RSRC_CONF,
+  "Maximum number of cached per-directory config files per child process"),
+AP_INIT_TAKE1("AccessFileCacheRevalidate", set_access_cache_revalidate, NULL,
+  RSRC_CONF, "Time a cached per-directory config file is used before "
+  "checking it for changes"),
+AP_INIT_TAKE1("MergeCacheSize", set_merge_cache_size, NULL, RSRC_CONF,
+  "Maximum number of merged per-directory configurations cached per child "
+  "process, 0 to disable"),
+AP_INIT_FLAG("ConfigReloadCache", set_config_reload_cache, NULL, RSRC_CONF,
+  "Whether the parsed configuration files are kept for restarts"),
 AP_INIT_TAKE1("DocumentRoot", set_document_root, NULL, RSRC_CONF,
   "Root directory of the document tree"),
 AP_INIT_TAKE2("ErrorDocument", set_error_document, NULL, OR_FILEINFO,
@@ -4650,11 +4771,11 @@ AP_INIT_TAKE1("ForceType", ap_set_string_slot_lower,
      "a mime type that overrides other configured type"),
 AP_INIT_TAKE1("SetHandler", set_sethandler, NULL, OR_FILEINFO,
    "a handler name that overrides any other configured handler"),
-AP_INIT_TAKE1("SetOutputFilter", ap_set_string_slot,
-       (void *)APR_OFFSETOF(core_dir_config, output_filters), OR_FILEINFO,
+AP_INIT_TAKE1("SetOutputFilter", set_filters, (void *)AP_FILTER_OUTPUT,
+       OR_FILEINFO,
    "filter (or ; delimited list of filters) to be run on the request content"),
-AP_INIT_TAKE1("SetInputFilter", ap_set_string_slot,
-       (void *)APR_OFFSETOF(core_dir_config, input_filters), OR_FILEINFO,
+AP_INIT_TAKE1("SetInputFilter", set_filters, (void *)AP_FILTER_INPUT,
+       OR_FILEINFO,
    "filter (or ; delimited list of filters) to be run on the request body"),
 AP_INIT_TAKE1("AllowEncodedSlashes", set_allow2f, NULL, RSRC_CONF,
              "Allow URLs containing '/' encoded as '%2F'"),
@@ -5107,19 +5228,13 @@ static void core_insert_filter(request_rec *r)
 {
     core_dir_config *conf = (core_dir_config *)
                             ap_get_core_module_config(r->per_dir_config);
-    const char *filter, *filters = conf->output_filters;
 
-    if (filters) {
-        while (*filters && (filter = ap_getword(r->pool, &filters, ';'))) {
-            ap_add_output_filter(filter, NULL, r, r->connection);
-        }
+    if (conf->output_filter_chain) {
+        ap_add_filter_chain(conf->output_filter_chain, r, r->connection);
     }
 
-    filters = conf->input_filters;
-    if (filters) {
-        while (*filters && (filter = ap_getword(r->pool, &filters, ';'))) {
-            ap_add_input_filter(filter, NULL, r, r->connection);
-        }
+    if (conf->input_filter_chain) {
+        ap_add_filter_chain(conf->input_filter_chain, r, r->connection);
     }
 }
 
@@ -5372,6 +5487,9 @@ static void core_child_init(apr_pool_t *pchild, server_rec *s)
      */
     proc.pid = getpid();
     apr_random_after_fork(&proc);
+
+    ap_htaccess_cache_init(pchild, s);
+    ap_merge_cache_init(pchild, s);
 }
 
 static void core_optional_fn_retrieve(void)
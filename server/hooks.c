@@ -0,0 +1,114 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Per server dispatch of hooks: modules tell which of their hook functions
+ * have nothing to do for a server, and the runners of the hooks implemented
+ * with AP_IMPLEMENT_SERVER_HOOK_RUN_* skip them for calls made for that
+ * server.  Each server keeps, for the hooks it has functions left out of,
+ * a copy of the hook's sorted array without them.
+ */
+
+#include "apr_strings.h"
+#include "apr_tables.h"
+
+#include "httpd.h"
+#include "http_config.h"
+#include "http_core.h"
+
+/* the layout shared by the ap_LINK_<name>_t of all hooks */
+typedef struct {
+    void (*pFunc)(void);
+    const char *szName;
+    const char * const *aszPredecessors;
+    const char * const *aszSuccessors;
+    int nOrder;
+} hook_link_t;
+
+typedef struct {
+    const apr_array_header_t *links;    /* all the functions of the hook */
+    apr_array_header_t *server_links;   /* the ones called for the server */
+} hook_server_links_t;
+
+AP_DECLARE(void) ap_hook_skip_for_server(apr_pool_t *p, server_rec *s,
+                                         const apr_array_header_t *links,
+                                         const module *m)
+{
+    core_server_config *conf = ap_get_core_module_config(s->module_config);
+    hook_server_links_t *hl = NULL;
+    apr_array_header_t *server_links;
+    int i, n;
+
+    if (!links || !links->nelts) {
+        return;
+    }
+
+    if (!conf->hook_links) {
+        conf->hook_links = apr_array_make(p, 4, sizeof(hook_server_links_t));
+    }
+    for (i = 0; i < conf->hook_links->nelts; ++i) {
+        hook_server_links_t *e = &APR_ARRAY_IDX(conf->hook_links, i,
+                                                hook_server_links_t);
+        if (e->links == links) {
+            hl = e;
+            break;
+        }
+    }
+    if (!hl) {
+        hl = apr_array_push(conf->hook_links);
+        hl->links = links;
+        hl->server_links = apr_array_copy(p, links);
+    }
+
+    server_links = hl->server_links;
+    for (i = n = 0; i < server_links->nelts; ++i) {
+        char *elt = server_links->elts + i * server_links->elt_size;
+        const char *name = ((hook_link_t *)elt)->szName;
+
+        if (name && !strcmp(name, m->name)) {
+            continue;
+        }
+        if (n != i) {
+            memcpy(server_links->elts + n * server_links->elt_size, elt,
+                   server_links->elt_size);
+        }
+        ++n;
+    }
+    server_links->nelts = n;
+}
+
+AP_DECLARE(const apr_array_header_t *) ap_hook_server_links(
+                                           const server_rec *s,
+                                           const apr_array_header_t *links)
+{
+    const core_server_config *conf;
+    const hook_server_links_t *hl;
+    int i;
+
+    if (!s || !links) {
+        return links;
+    }
+    conf = ap_get_core_module_config(s->module_config);
+    if (conf->hook_links) {
+        hl = (const hook_server_links_t *)conf->hook_links->elts;
+        for (i = 0; i < conf->hook_links->nelts; ++i) {
+            if (hl[i].links == links) {
+                return hl[i].server_links;
+            }
+        }
+    }
+    return links;
+}
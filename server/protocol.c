@@ -2352,10 +2352,12 @@ AP_DECLARE(int) ap_is_allowed_protocol(conn_rec *c, request_rec *r,
 AP_IMPLEMENT_HOOK_VOID(pre_read_request,
                        (request_rec *r, conn_rec *c),
                        (r, c))
-AP_IMPLEMENT_HOOK_RUN_ALL(int,post_read_request,
-                          (request_rec *r), (r), OK, DECLINED)
-AP_IMPLEMENT_HOOK_RUN_ALL(int,log_transaction,
-                          (request_rec *r), (r), OK, DECLINED)
+AP_IMPLEMENT_SERVER_HOOK_RUN_ALL(int,post_read_request,
+                                 (request_rec *r), (r), r->server,
+                                 OK, DECLINED)
+AP_IMPLEMENT_SERVER_HOOK_RUN_ALL(int,log_transaction,
+                                 (request_rec *r), (r), r->server,
+                                 OK, DECLINED)
 AP_IMPLEMENT_HOOK_RUN_FIRST(const char *,http_scheme,
                             (const request_rec *r), (r), NULL)
 AP_IMPLEMENT_HOOK_RUN_FIRST(unsigned short,default_port,
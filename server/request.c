@@ -74,32 +74,45 @@ APR_HOOK_STRUCT(
     APR_HOOK_LINK(force_authn)
 )
 
-AP_IMPLEMENT_HOOK_RUN_FIRST(int,translate_name,
-                            (request_rec *r), (r), DECLINED)
-AP_IMPLEMENT_HOOK_RUN_FIRST(int,map_to_storage,
-                            (request_rec *r), (r), DECLINED)
-AP_IMPLEMENT_HOOK_RUN_FIRST(int,check_user_id,
-                            (request_rec *r), (r), DECLINED)
-AP_IMPLEMENT_HOOK_RUN_ALL(int,fixups,
-                          (request_rec *r), (r), OK, DECLINED)
-AP_IMPLEMENT_HOOK_RUN_FIRST(int,type_checker,
-                            (request_rec *r), (r), DECLINED)
-AP_IMPLEMENT_HOOK_RUN_ALL(int,access_checker,
-                          (request_rec *r), (r), OK, DECLINED)
-AP_IMPLEMENT_HOOK_RUN_FIRST(int,access_checker_ex,
-                          (request_rec *r), (r), DECLINED)
-AP_IMPLEMENT_HOOK_RUN_FIRST(int,auth_checker,
-                            (request_rec *r), (r), DECLINED)
+/* the hooks run for requests skip the functions left out for their
+ * server, see ap_hook_skip_for_server()
+ */
+AP_IMPLEMENT_SERVER_HOOK_RUN_FIRST(int,translate_name,
+                                   (request_rec *r), (r), r->server,
+                                   DECLINED)
+AP_IMPLEMENT_SERVER_HOOK_RUN_FIRST(int,map_to_storage,
+                                   (request_rec *r), (r), r->server,
+                                   DECLINED)
+AP_IMPLEMENT_SERVER_HOOK_RUN_FIRST(int,check_user_id,
+                                   (request_rec *r), (r), r->server,
+                                   DECLINED)
+AP_IMPLEMENT_SERVER_HOOK_RUN_ALL(int,fixups,
+                                 (request_rec *r), (r), r->server,
+                                 OK, DECLINED)
+AP_IMPLEMENT_SERVER_HOOK_RUN_FIRST(int,type_checker,
+                                   (request_rec *r), (r), r->server,
+                                   DECLINED)
+AP_IMPLEMENT_SERVER_HOOK_RUN_ALL(int,access_checker,
+                                 (request_rec *r), (r), r->server,
+                                 OK, DECLINED)
+AP_IMPLEMENT_SERVER_HOOK_RUN_FIRST(int,access_checker_ex,
+                                   (request_rec *r), (r), r->server,
+                                   DECLINED)
+AP_IMPLEMENT_SERVER_HOOK_RUN_FIRST(int,auth_checker,
+                                   (request_rec *r), (r), r->server,
+                                   DECLINED)
 AP_IMPLEMENT_HOOK_VOID(insert_filter, (request_rec *r), (r))
 AP_IMPLEMENT_HOOK_RUN_ALL(int, create_request,
                           (request_rec *r), (r), OK, DECLINED)
-AP_IMPLEMENT_HOOK_RUN_ALL(int, post_perdir_config,
-                          (request_rec *r), (r), OK, DECLINED)
+AP_IMPLEMENT_SERVER_HOOK_RUN_ALL(int, post_perdir_config,
+                                 (request_rec *r), (r), r->server,
+                                 OK, DECLINED)
 AP_IMPLEMENT_HOOK_RUN_FIRST(apr_status_t,dirwalk_stat,
                             (apr_finfo_t *finfo, request_rec *r, apr_int32_t wanted),
                             (finfo, r, wanted), AP_DECLINED)
-AP_IMPLEMENT_HOOK_RUN_FIRST(int,force_authn,
-                            (request_rec *r), (r), DECLINED)
+AP_IMPLEMENT_SERVER_HOOK_RUN_FIRST(int,force_authn,
+                                   (request_rec *r), (r), r->server,
+                                   DECLINED)
 
 static int auth_internal_per_conf = 0;
 static int auth_internal_per_conf_hooks = 0;
@@ -986,9 +999,9 @@ AP_DECLARE(int) ap_directory_walk(request_rec *r)
                 }
 
                 if (now_merged) {
-                    now_merged = ap_merge_per_dir_configs(r->pool,
-                                                          now_merged,
-                                                          sec_ent[sec_idx]);
+                    now_merged =
+                        ap_merge_per_dir_configs_cached(r, now_merged,
+                                                        sec_ent[sec_idx]);
                 }
                 else {
                     now_merged = sec_ent[sec_idx];
@@ -1294,9 +1307,8 @@ AP_DECLARE(int) ap_directory_walk(request_rec *r)
             }
 
             if (now_merged) {
-                now_merged = ap_merge_per_dir_configs(r->pool,
-                                                      now_merged,
-                                                      sec_ent[sec_idx]);
+                now_merged = ap_merge_per_dir_configs_cached(r, now_merged,
+                                                             sec_ent[sec_idx]);
             }
             else {
                 now_merged = sec_ent[sec_idx];
@@ -1373,9 +1385,9 @@ AP_DECLARE(int) ap_directory_walk(request_rec *r)
      * and note the end result to (potentially) skip this step next time.
      */
     if (now_merged) {
-        r->per_dir_config = ap_merge_per_dir_configs(r->pool,
-                                                     r->per_dir_config,
-                                                     now_merged);
+        r->per_dir_config = ap_merge_per_dir_configs_cached(r,
+                                                            r->per_dir_config,
+                                                            now_merged);
     }
     cache->per_dir_result = r->per_dir_config;
 
@@ -1533,9 +1545,8 @@ AP_DECLARE(int) ap_location_walk(request_rec *r)
             }
 
             if (now_merged) {
-                now_merged = ap_merge_per_dir_configs(r->pool,
-                                                      now_merged,
-                                                      sec_ent[sec_idx]);
+                now_merged = ap_merge_per_dir_configs_cached(r, now_merged,
+                                                             sec_ent[sec_idx]);
             }
             else {
                 now_merged = sec_ent[sec_idx];
@@ -1576,9 +1587,9 @@ AP_DECLARE(int) ap_location_walk(request_rec *r)
      * and note the end result to (potentially) skip this step next time.
      */
     if (now_merged) {
-        r->per_dir_config = ap_merge_per_dir_configs(r->pool,
-                                                     r->per_dir_config,
-                                                     now_merged);
+        r->per_dir_config = ap_merge_per_dir_configs_cached(r,
+                                                            r->per_dir_config,
+                                                            now_merged);
     }
     cache->per_dir_result = r->per_dir_config;
 
@@ -1729,9 +1740,8 @@ AP_DECLARE(int) ap_file_walk(request_rec *r)
             }
 
             if (now_merged) {
-                now_merged = ap_merge_per_dir_configs(r->pool,
-                                                      now_merged,
-                                                      sec_ent[sec_idx]);
+                now_merged = ap_merge_per_dir_configs_cached(r, now_merged,
+                                                             sec_ent[sec_idx]);
             }
             else {
                 now_merged = sec_ent[sec_idx];
@@ -1772,9 +1782,9 @@ AP_DECLARE(int) ap_file_walk(request_rec *r)
      * and note the end result to (potentially) skip this step next time.
      */
     if (now_merged) {
-        r->per_dir_config = ap_merge_per_dir_configs(r->pool,
-                                                     r->per_dir_config,
-                                                     now_merged);
+        r->per_dir_config = ap_merge_per_dir_configs_cached(r,
+                                                            r->per_dir_config,
+                                                            now_merged);
     }
     cache->per_dir_result = r->per_dir_config;
 
@@ -1866,9 +1876,8 @@ AP_DECLARE(int) ap_if_walk(request_rec *r)
         }
 
         if (now_merged) {
-            now_merged = ap_merge_per_dir_configs(r->pool,
-                                                  now_merged,
-                                                  sec_ent[sec_idx]);
+            now_merged = ap_merge_per_dir_configs_cached(r, now_merged,
+                                                         sec_ent[sec_idx]);
         }
         else {
             now_merged = sec_ent[sec_idx];
@@ -1904,9 +1913,9 @@ AP_DECLARE(int) ap_if_walk(request_rec *r)
      * and note the end result to (potentially) skip this step next time.
      */
     if (now_merged) {
-        r->per_dir_config = ap_merge_per_dir_configs(r->pool,
-                                                     r->per_dir_config,
-                                                     now_merged);
+        r->per_dir_config = ap_merge_per_dir_configs_cached(r,
+                                                            r->per_dir_config,
+                                                            now_merged);
     }
     cache->per_dir_result = r->per_dir_config;
 
@@ -62,6 +62,9 @@ static const char *ap_expr_eval_re_backref(ap_expr_eval_ctx_t *ctx,
 static const char *ap_expr_eval_var(ap_expr_eval_ctx_t *ctx,
                                     ap_expr_var_func_t *func,
                                     const void *data);
+static ap_expr_t *ap_expr_compile(ap_expr_parse_ctx_t *ctx, ap_expr_t *tree);
+static int ap_expr_run(ap_expr_eval_ctx_t *ctx, const ap_expr_t *node,
+                       const char **result);
 
 /* define AP_EXPR_DEBUG to log the parse tree when parsing an expression */
 #ifdef AP_EXPR_DEBUG
@@ -438,7 +441,7 @@ AP_DECLARE(const char *) ap_expr_parse(apr_pool_t *pool, apr_pool_t *ptemp,
         expr_dump_tree(ctx.expr, NULL, APLOG_NOTICE, 2);
 #endif
 
-    info->root_node = ctx.expr;
+    info->root_node = ap_expr_compile(&ctx, ctx.expr);
 
     return NULL;
 }
@@ -848,6 +851,656 @@ out:
     return result;
 }
 
+/*
+ * Compiled expressions
+ *
+ * After parsing, the tree is compiled into a flat program which
+ * ap_expr_exec_ctx() runs in a single loop instead of recursing through
+ * the tree. Words are evaluated on a stack of strings; conditions set a
+ * flag which the jumps compiled for && and || test, so short-circuiting
+ * needs no recursion either. Variables, functions and operators are
+ * called through the pointers found when parsing, regexes are the ones
+ * compiled when parsing.
+ *
+ * Constants are folded while compiling: adjacent constant parts of
+ * concatenations are joined, comparisons and matches of constants are
+ * decided, and && / || with a constant left operand (or a neutral right
+ * one) are reduced to the operand that matters.
+ *
+ * Trees the compiler can't handle, or nested deeper than the recursion
+ * limit of the tree evaluation, are left as they are and evaluated as
+ * before.
+ */
+typedef enum {
+    ins_Const,          /* push p1 */
+    ins_Var,            /* push p1(ctx, p2) */
+    ins_Backref,        /* push $arg */
+    ins_Concat,         /* pop arg words, push their concatenation */
+    ins_StringFunc,     /* pop a word, push p1(ctx, p2, word) */
+    ins_StringListFunc, /* pop arg words, push p1(ctx, p2, words) */
+    ins_True,           /* flag = 1 */
+    ins_False,          /* flag = 0 */
+    ins_Not,            /* flag = !flag */
+    ins_Comp,           /* pop 2 words, flag = comparison op_* arg */
+    ins_CompCompat,     /* same with ssl_expr semantics */
+    ins_Regex,          /* pop a word, flag = word matches p1 */
+    ins_NotRegex,       /* pop a word, flag = word doesn't match p1 */
+    ins_InElem,         /* pop a word, flag = it equals the one below */
+    ins_Pop,            /* pop a word */
+    ins_InFunc,         /* pop 2 words, flag = first in p1(ctx, p2, second) */
+    ins_UnaryOp,        /* pop a word, flag = p1(ctx, p2, word) */
+    ins_BinaryOp,       /* pop 2 words, flag = p1(ctx, p2, word1, word2) */
+    ins_JumpIfTrue,     /* continue at arg if flag */
+    ins_JumpIfFalse     /* continue at arg unless flag */
+} ap_expr_ins_e;
+
+typedef struct {
+    ap_expr_ins_e op;
+    int arg;
+    const void *p1;
+    const void *p2;
+} ap_expr_ins_t;
+
+typedef struct {
+    const ap_expr_ins_t *code;
+    int ncode;
+    int max_stack;
+    int string_result;
+} ap_expr_program_t;
+
+typedef struct {
+    ap_expr_parse_ctx_t *ctx;
+    apr_array_header_t *code;
+    int stack;
+    int max_stack;
+    int reclvl;
+    int compat;
+    int failed;
+} ap_expr_compiler_t;
+
+/* words on the stack up to which no pool memory is used when running */
+#define AP_EXPR_STACK_SIZE      16
+
+static int expr_emit(ap_expr_compiler_t *cc, ap_expr_ins_e op, int arg,
+                     const void *p1, const void *p2, int pop, int push)
+{
+    ap_expr_ins_t *ins = apr_array_push(cc->code);
+
+    ins->op = op;
+    ins->arg = arg;
+    ins->p1 = p1;
+    ins->p2 = p2;
+    cc->stack += push - pop;
+    if (cc->stack > cc->max_stack) {
+        cc->max_stack = cc->stack;
+    }
+    return cc->code->nelts - 1;
+}
+
+/* count the same levels inc_rec() does when evaluating the tree */
+static int expr_compile_enter(ap_expr_compiler_t *cc)
+{
+    if (cc->failed || cc->reclvl >= AP_EXPR_MAX_RECURSION) {
+        cc->failed = 1;
+        return 1;
+    }
+    cc->reclvl++;
+    return 0;
+}
+
+/* The value of a constant word, NULL if it is not constant */
+static const char *expr_const_word(ap_expr_compiler_t *cc,
+                                   const ap_expr_t *node)
+{
+    switch (node->node_op) {
+    case op_Digit:
+    case op_String:
+        return node->node_arg1;
+    case op_Concat: {
+        const char *s1 = expr_const_word(cc, node->node_arg1);
+        const char *s2 = s1 ? expr_const_word(cc, node->node_arg2) : NULL;
+        if (!s2)
+            return NULL;
+        return !*s1 ? s2 : !*s2 ? s1 : apr_pstrcat(cc->ctx->pool, s1, s2, NULL);
+    }
+    default:
+        return NULL;
+    }
+}
+
+static int expr_compare(int op, int compat, const char *s1, const char *s2)
+{
+    int rc;
+
+    if (compat) {
+        rc = strcmplex(s1, s2);
+    }
+    else if (op >= op_EQ && op <= op_GE) {
+        rc = intstrcmp(s1, s2);
+    }
+    else {
+        rc = strcmp(s1, s2);
+    }
+    switch (op) {
+    case op_EQ:
+    case op_STR_EQ:
+        return rc == 0;
+    case op_NE:
+    case op_STR_NE:
+        return rc != 0;
+    case op_LT:
+    case op_STR_LT:
+        return rc < 0;
+    case op_LE:
+    case op_STR_LE:
+        return rc <= 0;
+    case op_GT:
+    case op_STR_GT:
+        return rc > 0;
+    default:
+        return rc >= 0;
+    }
+}
+
+/* The value of a constant condition, -1 if it is not constant */
+static int expr_const_cond(ap_expr_compiler_t *cc, const ap_expr_t *node)
+{
+    const ap_expr_t *e1 = node->node_arg1;
+    const ap_expr_t *e2 = node->node_arg2;
+    const char *s1, *s2;
+    int c1, c2;
+
+    switch (node->node_op) {
+    case op_True:
+        return 1;
+    case op_False:
+        return 0;
+    case op_Not:
+        c1 = expr_const_cond(cc, e1);
+        return c1 < 0 ? -1 : !c1;
+    case op_And:
+    case op_Or:
+        c1 = expr_const_cond(cc, e1);
+        if (c1 == (node->node_op == op_Or)) {
+            return c1;
+        }
+        c2 = expr_const_cond(cc, e2);
+        return c1 < 0 ? -1 : c2;
+    case op_Comp:
+        break;
+    default:
+        return -1;
+    }
+
+    /* op_Comp */
+    node = e1;
+    e1 = node->node_arg1;
+    e2 = node->node_arg2;
+    switch (node->node_op) {
+    case op_IN:
+        if (e2->node_op != op_ListElement
+            || !(s1 = expr_const_word(cc, e1))) {
+            return -1;
+        }
+        for (c1 = 0; e2; e2 = e2->node_arg2) {
+            if (!(s2 = expr_const_word(cc, e2->node_arg1))) {
+                return -1;
+            }
+            c1 |= (strcmp(s1, s2) == 0);
+        }
+        return c1;
+    case op_REG:
+    case op_NRE: {
+        const ap_regex_t *regex = e2->node_arg1;
+
+        /* matches with captures set the backreferences */
+        if (regex->re_nsub > 0 || !(s1 = expr_const_word(cc, e1))) {
+            return -1;
+        }
+        c1 = (ap_regexec(regex, s1, 0, NULL, 0) == 0);
+        return node->node_op == op_REG ? c1 : !c1;
+    }
+    default:
+        if (node->node_op < op_EQ || node->node_op > op_STR_GE
+            || !(s1 = expr_const_word(cc, e1))
+            || !(s2 = expr_const_word(cc, e2))) {
+            return -1;
+        }
+        return expr_compare(node->node_op, cc->compat, s1, s2);
+    }
+}
+
+static void expr_compile_word(ap_expr_compiler_t *cc, const ap_expr_t *node);
+
+/* push the parts of nested concatenations, joining adjacent constants */
+static int expr_compile_concat(ap_expr_compiler_t *cc, const ap_expr_t *node,
+                               const char **pending)
+{
+    const char *s;
+    int n = 0;
+
+    if (node->node_op == op_Concat) {
+        n += expr_compile_concat(cc, node->node_arg1, pending);
+        n += expr_compile_concat(cc, node->node_arg2, pending);
+        return n;
+    }
+    if ((s = expr_const_word(cc, node)) != NULL) {
+        if (*pending && *s) {
+            *pending = apr_pstrcat(cc->ctx->pool, *pending, s, NULL);
+        }
+        else if (*s) {
+            *pending = s;
+        }
+        return 0;
+    }
+    if (*pending) {
+        expr_emit(cc, ins_Const, 0, *pending, NULL, 0, 1);
+        *pending = NULL;
+        n++;
+    }
+    expr_compile_word(cc, node);
+    return n + 1;
+}
+
+static void expr_compile_word(ap_expr_compiler_t *cc, const ap_expr_t *node)
+{
+    if (expr_compile_enter(cc))
+        return;
+
+    switch (node->node_op) {
+    case op_Digit:
+    case op_String:
+        expr_emit(cc, ins_Const, 0, node->node_arg1, NULL, 0, 1);
+        break;
+    case op_Var:
+        expr_emit(cc, ins_Var, 0, node->node_arg1, node->node_arg2, 0, 1);
+        break;
+    case op_RegexBackref:
+        expr_emit(cc, ins_Backref, *(const unsigned int *)node->node_arg1,
+                  NULL, NULL, 0, 1);
+        break;
+    case op_Concat: {
+        const char *pending = NULL;
+        int n = expr_compile_concat(cc, node, &pending);
+        if (pending || !n) {
+            expr_emit(cc, ins_Const, 0, pending ? pending : "", NULL, 0, 1);
+            n++;
+        }
+        if (n > 1) {
+            expr_emit(cc, ins_Concat, n, NULL, NULL, n, 1);
+        }
+        break;
+    }
+    case op_StringFuncCall: {
+        const ap_expr_t *info = node->node_arg1;
+        const ap_expr_t *arg = node->node_arg2;
+        if (arg->node_op == op_ListElement) {
+            int n = 0;
+            do {
+                expr_compile_word(cc, arg->node_arg1);
+                n++;
+                arg = arg->node_arg2;
+            } while (arg != NULL);
+            expr_emit(cc, ins_StringListFunc, n, info->node_arg1,
+                      info->node_arg2, n, 1);
+        }
+        else {
+            expr_compile_word(cc, arg);
+            expr_emit(cc, ins_StringFunc, 0, info->node_arg1,
+                      info->node_arg2, 1, 1);
+        }
+        break;
+    }
+    default:
+        cc->failed = 1;
+        break;
+    }
+    cc->reclvl--;
+}
+
+static void expr_compile_comp(ap_expr_compiler_t *cc, const ap_expr_t *node)
+{
+    const ap_expr_t *e1 = node->node_arg1;
+    const ap_expr_t *e2 = node->node_arg2;
+
+    switch (node->node_op) {
+    case op_IN:
+        expr_compile_word(cc, e1);
+        if (e2->node_op == op_ListElement) {
+            /* compare with each element in turn, and stop at the first
+             * match as the tree evaluation does, not evaluating the others
+             */
+            apr_array_header_t *jumps = apr_array_make(cc->ctx->ptemp, 4,
+                                                       sizeof(int));
+            int i;
+            do {
+                expr_compile_word(cc, e2->node_arg1);
+                expr_emit(cc, ins_InElem, 0, NULL, NULL, 1, 0);
+                e2 = e2->node_arg2;
+                if (e2) {
+                    APR_ARRAY_PUSH(jumps, int) =
+                        expr_emit(cc, ins_JumpIfTrue, 0, NULL, NULL, 0, 0);
+                }
+            } while (e2 != NULL);
+            for (i = 0; i < jumps->nelts; i++) {
+                APR_ARRAY_IDX(cc->code, APR_ARRAY_IDX(jumps, i, int),
+                              ap_expr_ins_t).arg = cc->code->nelts;
+            }
+            expr_emit(cc, ins_Pop, 0, NULL, NULL, 1, 0);
+        }
+        else if (e2->node_op == op_ListFuncCall) {
+            const ap_expr_t *info = e2->node_arg1;
+            expr_compile_word(cc, e2->node_arg2);
+            expr_emit(cc, ins_InFunc, 0, info->node_arg1, info->node_arg2,
+                      2, 0);
+        }
+        else {
+            cc->failed = 1;
+        }
+        break;
+    case op_REG:
+    case op_NRE:
+        expr_compile_word(cc, e1);
+        expr_emit(cc, node->node_op == op_REG ? ins_Regex : ins_NotRegex,
+                  0, e2->node_arg1, NULL, 1, 0);
+        break;
+    default:
+        if (node->node_op < op_EQ || node->node_op > op_STR_GE) {
+            cc->failed = 1;
+            break;
+        }
+        expr_compile_word(cc, e1);
+        expr_compile_word(cc, e2);
+        expr_emit(cc, cc->compat ? ins_CompCompat : ins_Comp,
+                  node->node_op, NULL, NULL, 2, 0);
+        break;
+    }
+}
+
+static void expr_compile_cond(ap_expr_compiler_t *cc, const ap_expr_t *node)
+{
+    const ap_expr_t *e1 = node->node_arg1;
+    const ap_expr_t *e2 = node->node_arg2;
+    int c, jump;
+
+    if (expr_compile_enter(cc))
+        return;
+
+    c = expr_const_cond(cc, node);
+    if (c >= 0) {
+        expr_emit(cc, c ? ins_True : ins_False, 0, NULL, NULL, 0, 0);
+        cc->reclvl--;
+        return;
+    }
+
+    switch (node->node_op) {
+    case op_Not:
+        expr_compile_cond(cc, e1);
+        expr_emit(cc, ins_Not, 0, NULL, NULL, 0, 0);
+        break;
+    case op_And:
+    case op_Or:
+        /* a constant left side decides or doesn't matter, and neither
+         * does a right side that can't change the result
+         */
+        c = (node->node_op == op_Or) ? 0 : 1;
+        if (expr_const_cond(cc, e1) == c) {
+            expr_compile_cond(cc, e2);
+            break;
+        }
+        expr_compile_cond(cc, e1);
+        if (expr_const_cond(cc, e2) == c) {
+            break;
+        }
+        jump = expr_emit(cc, c ? ins_JumpIfFalse : ins_JumpIfTrue, 0,
+                         NULL, NULL, 0, 0);
+        expr_compile_cond(cc, e2);
+        APR_ARRAY_IDX(cc->code, jump, ap_expr_ins_t).arg = cc->code->nelts;
+        break;
+    case op_Comp:
+        expr_compile_comp(cc, e1);
+        break;
+    case op_UnaryOpCall:
+        expr_compile_word(cc, e2);
+        expr_emit(cc, ins_UnaryOp, 0, e1->node_arg1, e1->node_arg2, 1, 0);
+        break;
+    case op_BinaryOpCall:
+        expr_compile_word(cc, e2->node_arg1);
+        expr_compile_word(cc, e2->node_arg2);
+        expr_emit(cc, ins_BinaryOp, 0, e1->node_arg1, e1->node_arg2, 2, 0);
+        break;
+    default:
+        cc->failed = 1;
+        break;
+    }
+    cc->reclvl--;
+}
+
+static ap_expr_t *ap_expr_compile(ap_expr_parse_ctx_t *ctx, ap_expr_t *tree)
+{
+    ap_expr_compiler_t cc;
+    ap_expr_program_t *prog;
+    int string_result = (ctx->flags & AP_EXPR_FLAG_STRING_RESULT) != 0;
+
+    if (!tree) {
+        return tree;
+    }
+
+    memset(&cc, 0, sizeof(cc));
+    cc.ctx = ctx;
+    cc.code = apr_array_make(ctx->ptemp, 16, sizeof(ap_expr_ins_t));
+    cc.compat = (ctx->flags & AP_EXPR_FLAG_SSL_EXPR_COMPAT) != 0;
+
+    if (string_result) {
+        const char *s = expr_const_word(&cc, tree);
+        if (s) {
+            /* ap_expr_str_exec_re() takes a short-cut for these */
+            return ap_expr_make(op_String, s, NULL, ctx);
+        }
+        expr_compile_word(&cc, tree);
+    }
+    else {
+        expr_compile_cond(&cc, tree);
+    }
+    if (cc.failed) {
+        return tree;
+    }
+
+    prog = apr_palloc(ctx->pool, sizeof(*prog));
+    prog->code = apr_pmemdup(ctx->pool, cc.code->elts,
+                             cc.code->nelts * sizeof(ap_expr_ins_t));
+    prog->ncode = cc.code->nelts;
+    prog->max_stack = cc.max_stack;
+    prog->string_result = string_result;
+
+    return ap_expr_make(op_Program, prog, tree, ctx);
+}
+
+static const char *expr_run_concat(ap_expr_eval_ctx_t *ctx,
+                                   const char **words, int n)
+{
+    struct iovec vec_buf[AP_EXPR_STACK_SIZE], *vec = vec_buf;
+    int i, nvec = 0;
+
+    if (n > AP_EXPR_STACK_SIZE) {
+        vec = apr_palloc(ctx->p, n * sizeof(struct iovec));
+    }
+    for (i = 0; i < n; i++) {
+        if (*words[i]) {
+            vec[nvec].iov_base = (void *)words[i];
+            vec[nvec].iov_len = strlen(words[i]);
+            nvec++;
+        }
+    }
+    if (nvec == 0) {
+        return "";
+    }
+    if (nvec == 1) {
+        return vec[0].iov_base;
+    }
+    return apr_pstrcatv(ctx->p, vec, nvec, NULL);
+}
+
+static int expr_run_program(ap_expr_eval_ctx_t *ctx,
+                            const ap_expr_program_t *prog,
+                            const char **result)
+{
+    const char *stack_buf[AP_EXPR_STACK_SIZE], **stack = stack_buf, **sp;
+    const ap_expr_ins_t *ins = prog->code;
+    const ap_expr_ins_t *end = ins + prog->ncode;
+    int flag = FALSE;
+    int i;
+
+    if (prog->max_stack > AP_EXPR_STACK_SIZE) {
+        stack = apr_palloc(ctx->p, prog->max_stack * sizeof(const char *));
+    }
+    sp = stack;
+
+    while (ins < end) {
+        switch (ins->op) {
+        case ins_Const:
+            *sp++ = ins->p1;
+            break;
+        case ins_Var:
+            *sp = ap_expr_eval_var(ctx, (ap_expr_var_func_t *)ins->p1,
+                                   ins->p2);
+            if (!*sp)
+                *sp = "";
+            sp++;
+            break;
+        case ins_Backref:
+            *sp++ = ap_expr_eval_re_backref(ctx, ins->arg);
+            break;
+        case ins_Concat:
+            sp -= ins->arg;
+            *sp = expr_run_concat(ctx, sp, ins->arg);
+            sp++;
+            break;
+        case ins_StringFunc: {
+            ap_expr_string_func_t *func = (ap_expr_string_func_t *)ins->p1;
+            sp[-1] = (*func)(ctx, ins->p2, sp[-1]);
+            if (!sp[-1])
+                sp[-1] = "";
+            break;
+        }
+        case ins_StringListFunc: {
+            ap_expr_string_list_func_t *func =
+                (ap_expr_string_list_func_t *)ins->p1;
+            apr_array_header_t *args = apr_array_make(ctx->p, ins->arg,
+                                                      sizeof(char *));
+            sp -= ins->arg;
+            for (i = 0; i < ins->arg; i++) {
+                APR_ARRAY_PUSH(args, const char *) = sp[i];
+            }
+            *sp = (*func)(ctx, ins->p2, args);
+            if (!*sp)
+                *sp = "";
+            sp++;
+            break;
+        }
+        case ins_True:
+            flag = TRUE;
+            break;
+        case ins_False:
+            flag = FALSE;
+            break;
+        case ins_Not:
+            flag = !flag;
+            break;
+        case ins_Comp:
+        case ins_CompCompat:
+            sp -= 2;
+            flag = expr_compare(ins->arg, ins->op == ins_CompCompat,
+                                sp[0], sp[1]);
+            break;
+        case ins_Regex:
+        case ins_NotRegex: {
+            const ap_regex_t *regex = ins->p1;
+            const char *word = *--sp;
+
+            /* as in ap_expr_eval_comp() */
+            if (regex->re_nsub > 0) {
+                flag = (0 == ap_regexec(regex, word, ctx->re_nmatch,
+                                        ctx->re_pmatch, 0));
+                *ctx->re_source = flag ? word : NULL;
+            }
+            else {
+                flag = (0 == ap_regexec(regex, word, 0, NULL, 0));
+            }
+            if (ins->op == ins_NotRegex)
+                flag = !flag;
+            break;
+        }
+        case ins_InElem:
+            sp--;
+            flag = (strcmp(sp[-1], sp[0]) == 0);
+            break;
+        case ins_Pop:
+            sp--;
+            break;
+        case ins_InFunc: {
+            ap_expr_list_func_t *func = (ap_expr_list_func_t *)ins->p1;
+            apr_array_header_t *haystack;
+
+            sp -= 2;
+            haystack = (*func)(ctx, ins->p2, sp[1]);
+            flag = haystack && ap_array_str_contains(haystack, sp[0]);
+            break;
+        }
+        case ins_UnaryOp: {
+            ap_expr_op_unary_t *op_func = (ap_expr_op_unary_t *)ins->p1;
+            sp--;
+            flag = (*op_func)(ctx, ins->p2, sp[0]);
+            break;
+        }
+        case ins_BinaryOp: {
+            ap_expr_op_binary_t *op_func = (ap_expr_op_binary_t *)ins->p1;
+            sp -= 2;
+            flag = (*op_func)(ctx, ins->p2, sp[0], sp[1]);
+            break;
+        }
+        case ins_JumpIfTrue:
+            if (flag) {
+                ins = prog->code + ins->arg;
+                continue;
+            }
+            break;
+        case ins_JumpIfFalse:
+            if (!flag) {
+                ins = prog->code + ins->arg;
+                continue;
+            }
+            break;
+        }
+        ins++;
+    }
+
+    if (result) {
+        *result = (sp > stack) ? sp[-1] : "";
+    }
+    return flag;
+}
+
+/* evaluate the root node of an expression, compiled or not */
+static int ap_expr_run(ap_expr_eval_ctx_t *ctx, const ap_expr_t *node,
+                       const char **result)
+{
+    if (node->node_op == op_Program) {
+        const ap_expr_program_t *prog = node->node_arg1;
+
+        if (prog->string_result == (result != NULL)) {
+            return expr_run_program(ctx, prog, result);
+        }
+        /* flags changed since parsing, use the tree */
+        node = node->node_arg2;
+    }
+    if (result) {
+        *result = ap_expr_eval_word(ctx, node);
+        return 1;
+    }
+    return ap_expr_eval(ctx, node);
+}
+
 AP_DECLARE(int) ap_expr_exec(request_rec *r, const ap_expr_info_t *info,
                              const char **err)
 {
@@ -873,7 +1526,7 @@ AP_DECLARE(int) ap_expr_exec_ctx(ap_expr_eval_ctx_t *ctx)
 
     *ctx->err = NULL;
     if (ctx->info->flags & AP_EXPR_FLAG_STRING_RESULT) {
-        *ctx->result_string = ap_expr_eval_word(ctx, ctx->info->root_node);
+        ap_expr_run(ctx, ctx->info->root_node, ctx->result_string);
         if (*ctx->err != NULL) {
             ap_log_rerror(LOG_MARK(ctx->info), APLOG_ERR, 0, ctx->r,
                           APLOGNO(03298)
@@ -889,7 +1542,7 @@ AP_DECLARE(int) ap_expr_exec_ctx(ap_expr_eval_ctx_t *ctx)
         }
     }
     else {
-        rc = ap_expr_eval(ctx, ctx->info->root_node);
+        rc = ap_expr_run(ctx, ctx->info->root_node, NULL);
         if (*ctx->err != NULL) {
             ap_log_rerror(LOG_MARK(ctx->info), APLOG_ERR, 0, ctx->r,
                           APLOGNO(03299)
@@ -286,6 +286,51 @@ AP_DECLARE(ap_filter_rec_t *) ap_register_output_filter_protocol(
     return ret ;
 }
 
+/* Link a filter, whose frec, r and c are set, into the list *outf is the
+ * place for, keeping the request and protocol lists' heads up to date
+ */
+static void link_filter(ap_filter_t *f, request_rec *r, ap_filter_t **outf,
+                        ap_filter_t **r_filters, ap_filter_t **p_filters,
+                        ap_filter_t **c_filters)
+{
+    if (INSERT_BEFORE(f, *outf)) {
+        f->next = *outf;
+
+        if (*outf) {
+            ap_filter_t *first = NULL;
+
+            if (r) {
+                /* If we are adding our first non-connection filter,
+                 * Then don't try to find the right location, it is
+                 * automatically first.
+                 */
+                if (*r_filters != *c_filters) {
+                    first = *r_filters;
+                    while (first && (first->next != (*outf))) {
+                        first = first->next;
+                    }
+                }
+            }
+            if (first && first != (*outf)) {
+                first->next = f;
+            }
+        }
+        *outf = f;
+    }
+    else {
+        ap_filter_t *fscan = *outf;
+        while (!INSERT_BEFORE(f, fscan->next))
+            fscan = fscan->next;
+
+        f->next = fscan->next;
+        fscan->next = f;
+    }
+
+    if (f->frec->ftype < AP_FTYPE_CONNECTION && (*r_filters == *c_filters)) {
+        *r_filters = *p_filters;
+    }
+}
+
 static ap_filter_t *add_any_filter_handle(ap_filter_rec_t *frec, void *ctx,
                                           request_rec *r, conn_rec *c,
                                           ap_filter_t **r_filters,
@@ -329,42 +374,7 @@ static ap_filter_t *add_any_filter_handle(ap_filter_rec_t *frec, void *ctx,
     f->bb = NULL;
     f->deferred_pool = NULL;
 
-    if (INSERT_BEFORE(f, *outf)) {
-        f->next = *outf;
-
-        if (*outf) {
-            ap_filter_t *first = NULL;
-
-            if (r) {
-                /* If we are adding our first non-connection filter,
-                 * Then don't try to find the right location, it is
-                 * automatically first.
-                 */
-                if (*r_filters != *c_filters) {
-                    first = *r_filters;
-                    while (first && (first->next != (*outf))) {
-                        first = first->next;
-                    }
-                }
-            }
-            if (first && first != (*outf)) {
-                first->next = f;
-            }
-        }
-        *outf = f;
-    }
-    else {
-        ap_filter_t *fscan = *outf;
-        while (!INSERT_BEFORE(f, fscan->next))
-            fscan = fscan->next;
-
-        f->next = fscan->next;
-        fscan->next = f;
-    }
-
-    if (frec->ftype < AP_FTYPE_CONNECTION && (*r_filters == *c_filters)) {
-        *r_filters = *p_filters;
-    }
+    link_filter(f, r, outf, r_filters, p_filters, c_filters);
     return f;
 }
 
@@ -451,6 +461,94 @@ AP_DECLARE(ap_filter_t *) ap_add_output_filter_handle(ap_filter_rec_t *f,
                                  &c->output_filters);
 }
 
+struct ap_filter_chain_t {
+    const char *names;                /* as configured */
+    ap_filter_direction_e direction;
+    /* The filters to copy for each request, in order, or none when some
+     * name could not be resolved or is that of a connection filter, and
+     * the names are to be added one by one.
+     */
+    const ap_filter_t *tmpl;
+    int nfilters;
+};
+
+AP_DECLARE(ap_filter_chain_t *) ap_filter_chain_make(apr_pool_t *p,
+                                            const char *names,
+                                            ap_filter_direction_e direction)
+{
+    ap_filter_chain_t *chain = apr_pcalloc(p, sizeof(*chain));
+    const filter_trie_node *reg_filter_set;
+    apr_array_header_t *tmpl;
+    const char *filter, *filters = names;
+
+    chain->names = names;
+    chain->direction = direction;
+
+    reg_filter_set = (direction == AP_FILTER_INPUT) ? registered_input_filters
+                                                    : registered_output_filters;
+    tmpl = apr_array_make(p, 2, sizeof(ap_filter_t));
+    while (*filters && (filter = ap_getword(p, &filters, ';'))) {
+        ap_filter_rec_t *frec = get_filter_handle(filter, reg_filter_set);
+        ap_filter_t *f;
+
+        if (!frec || frec->ftype >= AP_FTYPE_CONNECTION) {
+            return chain;
+        }
+        f = apr_array_push(tmpl);
+        memset(f, 0, sizeof(*f));
+        f->frec = frec;
+    }
+
+    chain->tmpl = (const ap_filter_t *)tmpl->elts;
+    chain->nfilters = tmpl->nelts;
+    return chain;
+}
+
+AP_DECLARE(void) ap_add_filter_chain(const ap_filter_chain_t *chain,
+                                     request_rec *r, conn_rec *c)
+{
+    ap_filter_t **r_filters, **p_filters, **c_filters;
+
+    if (chain->direction == AP_FILTER_INPUT) {
+        r_filters = r ? &r->input_filters : NULL;
+        p_filters = r ? &r->proto_input_filters : NULL;
+        c_filters = &c->input_filters;
+    }
+    else {
+        r_filters = r ? &r->output_filters : NULL;
+        p_filters = r ? &r->proto_output_filters : NULL;
+        c_filters = &c->output_filters;
+    }
+
+    if (r && chain->nfilters) {
+        ap_filter_t *f = apr_pmemdup(r->pool, chain->tmpl,
+                                     chain->nfilters * sizeof(*f));
+        int i;
+
+        for (i = 0; i < chain->nfilters; i++, f++) {
+            f->r = r;
+            f->c = c;
+            link_filter(f, r,
+                        f->frec->ftype < AP_FTYPE_PROTOCOL ? r_filters
+                                                           : p_filters,
+                        r_filters, p_filters, c_filters);
+        }
+    }
+    else {
+        const filter_trie_node *reg_filter_set;
+        const char *filter, *filters = chain->names;
+        apr_pool_t *p = r ? r->pool : c->pool;
+
+        reg_filter_set = (chain->direction == AP_FILTER_INPUT)
+                         ? registered_input_filters
+                         : registered_output_filters;
+        while (*filters && (filter = ap_getword(p, &filters, ';'))) {
+            add_any_filter(filter, NULL, r, c, reg_filter_set,
+                           r_filters, p_filters, c_filters);
+        }
+    }
+}
+
 static void remove_any_filter(ap_filter_t *f, ap_filter_t **r_filt, ap_filter_t **p_filt,
                               ap_filter_t **c_filt)
 {
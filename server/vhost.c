@@ -57,6 +57,39 @@ struct name_chain {
     server_addr_rec *sar;       /* the record causing it to be in
                                  * this chain (needed for port comparisons) */
     server_rec *server;         /* the server to use on a match */
+    int pos;                    /* position in the chain, set when indexed */
+};
+
+/* a wildcard ServerAlias which needs ap_strcasecmp_match() */
+typedef struct {
+    const char *pattern;
+    name_chain *nc;
+} name_wildcard;
+
+/* trie of the wildcard ServerAliases ending in a literal domain, by the
+ * labels of that domain from right to left.  The node for "example.com"
+ * holds the aliases "*.example.com", "www*.example.com" etc.
+ */
+typedef struct name_trie name_trie;
+struct name_trie {
+    apr_hash_t *labels;         /* the child nodes, by the label to the left */
+    name_chain *any;            /* first entry with alias *.<domain> */
+    apr_array_header_t *wild;   /* other wildcards ending in .<domain>, in
+                                 * chain order */
+};
+
+/* index of the names of the name-vhosts sharing an address, so that they
+ * need not be matched one after the other.  Each key maps to the first
+ * name_chain entry matching it.
+ */
+typedef struct name_index name_index;
+struct name_index {
+    apr_hash_t *names;          /* ServerName and ServerAlias */
+    name_trie *wild_trie;       /* wildcards ending in a literal domain */
+    apr_array_header_t *wild_others;  /* other wildcards, in chain order */
+    apr_hash_t *virthosts;      /* names from the VirtualHost line */
+    int trie_nodes;             /* statistics for -S */
+    int trie_wilds;
 };
 
 /* meta-list of ip addresses.  Each server_rec can be in possibly multiple
@@ -73,6 +106,8 @@ struct ipaddr_chain {
                                  * sharing this address */
     name_chain *initialnames;   /* no runtime use, temporary storage of first
                                  * NVH'es names */
+    name_index *index;          /* if non-NULL then an index of names, used
+                                 * instead of walking names */
 };
 
 /* This defines the size of the hash table used for hashing ip addresses
@@ -117,7 +152,10 @@ static int vhost_check_config(apr_pool_t *p, apr_pool_t *plog,
  * ipaddr_chain record.  We tuck away the ipaddr_chain record in the
  * conn_rec field vhost_lookup_data.  Later on after the headers we get a
  * second chance, and we use the name_chain to figure out what name-vhost
- * matches the headers.
+ * matches the headers.  When all the names on the chain share the same
+ * port, the name_index built at the end of the config is looked up for
+ * it instead, with the same result.  The SNI name sent by TLS clients is
+ * looked up the same way.
  *
  * If there was no ip address match in the iphash_table then do a lookup
  * in the default_list.
@@ -357,6 +395,7 @@ static ipaddr_chain *new_ipaddr_chain(apr_pool_t *p,
     new = apr_palloc(p, sizeof(*new));
     new->names = NULL;
     new->initialnames = NULL;
+    new->index = NULL;
     new->server = s;
     new->sar = sar;
     new->next = NULL;
@@ -373,6 +412,7 @@ static name_chain *new_name_chain(apr_pool_t *p,
     new->server = s;
     new->sar = sar;
     new->next = NULL;
+    new->pos = 0;
     return new;
 }
 
@@ -431,6 +471,21 @@ static ipaddr_chain *find_default_server(apr_port_t port)
 #define IS_IN6_ANYADDR(ad) (0)
 #endif
 
+static void dump_name_index(apr_file_t *f, ipaddr_chain *ic)
+{
+    name_index *ni = ic->index;
+
+    if (!ni) {
+        apr_file_printf(f, "%8s names not indexed (ports differ)\n", "");
+        return;
+    }
+    apr_file_printf(f, "%8s name index: %u names, %u VirtualHost names, "
+                    "%d wildcards in %d trie nodes, %d other wildcards\n",
+                    "", apr_hash_count(ni->names),
+                    apr_hash_count(ni->virthosts), ni->trie_wilds,
+                    ni->trie_nodes, ni->wild_others->nelts);
+}
+
 static void dump_a_vhost(apr_file_t *f, ipaddr_chain *ic)
 {
     name_chain *nc;
@@ -459,6 +514,7 @@ static void dump_a_vhost(apr_file_t *f, ipaddr_chain *ic)
                     "%8s default server %s (%s:%u)\n",
                     buf, "", ic->server->server_hostname,
                     ic->server->defn_name, ic->server->defn_line_number);
+    dump_name_index(f, ic);
     for (nc = ic->names; nc; nc = nc->next) {
         if (nc->sar->host_port) {
             apr_file_printf(f, "%8s port %u ", "", nc->sar->host_port);
@@ -551,6 +607,160 @@ static void add_name_vhost_config(apr_pool_t *p, server_rec *main_s,
    }
 }
 
+static void add_name_index(apr_pool_t *p, apr_hash_t *ht, const char *name,
+                           name_chain *nc)
+{
+    char *key;
+
+    if (!name) {
+        return;
+    }
+    key = apr_pstrdup(p, name);
+    ap_str_tolower(key);
+    /* only the first match is used */
+    if (!apr_hash_get(ht, key, APR_HASH_KEY_STRING)) {
+        apr_hash_set(ht, key, APR_HASH_KEY_STRING, nc);
+    }
+}
+
+/* add a wildcard alias to the trie, at the node of the literal domain
+ * following its last wildcard character.  Returns 0 if there's no such
+ * domain.
+ */
+static int add_name_trie(apr_pool_t *p, name_index *ni, const char *pattern,
+                         name_chain *nc)
+{
+    name_trie *node = ni->wild_trie, *child;
+    const char *domain, *end, *label;
+    char *key;
+    apr_size_t i;
+
+    for (i = strlen(pattern); i > 0; --i) {
+        if (pattern[i - 1] == '*' || pattern[i - 1] == '?') {
+            break;
+        }
+    }
+    if (!(domain = strchr(pattern + i, '.'))) {
+        return 0;
+    }
+
+    for (end = pattern + strlen(pattern); end > domain; end = label - 1) {
+        for (label = end; label[-1] != '.'; --label)
+            ;
+        key = apr_pstrmemdup(p, label, end - label);
+        ap_str_tolower(key);
+        if (!node->labels) {
+            node->labels = apr_hash_make(p);
+        }
+        child = apr_hash_get(node->labels, key, end - label);
+        if (!child) {
+            child = apr_pcalloc(p, sizeof(*child));
+            apr_hash_set(node->labels, key, end - label, child);
+            ni->trie_nodes++;
+        }
+        node = child;
+    }
+
+    if (domain == pattern + 1 && pattern[0] == '*') {
+        /* only the first match is used */
+        if (!node->any) {
+            node->any = nc;
+        }
+    }
+    else {
+        name_wildcard *w;
+        if (!node->wild) {
+            node->wild = apr_array_make(p, 1, sizeof(name_wildcard));
+        }
+        w = apr_array_push(node->wild);
+        w->pattern = pattern;
+        w->nc = nc;
+    }
+    ni->trie_wilds++;
+    return 1;
+}
+
+/* index the names of a NameVirtualHost chain, see check_hostalias() for
+ * the order in which they are matched
+ */
+static void build_name_index(apr_pool_t *p, ipaddr_chain *ic)
+{
+    name_index *ni;
+    name_chain *nc;
+    server_rec *last_s = NULL;
+    apr_array_header_t *names;
+    char **name;
+    int i, pos = 0;
+
+    /* The port is checked per name_chain entry, so we can only do
+     * without them if it's the same for all of them.
+     */
+    for (nc = ic->names; nc; nc = nc->next) {
+        if (nc->sar->host_port != ic->names->sar->host_port) {
+            return;
+        }
+    }
+
+    ni = apr_pcalloc(p, sizeof(*ni));
+    ni->names = apr_hash_make(p);
+    ni->wild_trie = apr_pcalloc(p, sizeof(*ni->wild_trie));
+    ni->wild_others = apr_array_make(p, 1, sizeof(name_wildcard));
+    ni->virthosts = apr_hash_make(p);
+
+    for (nc = ic->names; nc; nc = nc->next) {
+        nc->pos = pos++;
+        add_name_index(p, ni->virthosts, nc->sar->virthost, nc);
+
+        /* the names of a server are only matched at its first entry */
+        if (nc->server == last_s) {
+            continue;
+        }
+        last_s = nc->server;
+
+        add_name_index(p, ni->names, nc->server->server_hostname, nc);
+        if ((names = nc->server->names)) {
+            name = (char **)names->elts;
+            for (i = 0; i < names->nelts; ++i) {
+                add_name_index(p, ni->names, name[i], nc);
+            }
+        }
+        if ((names = nc->server->wild_names)) {
+            name = (char **)names->elts;
+            for (i = 0; i < names->nelts; ++i) {
+                if (!name[i]) {
+                    continue;
+                }
+                if (!add_name_trie(p, ni, name[i], nc)) {
+                    name_wildcard *w = apr_array_push(ni->wild_others);
+                    w->pattern = name[i];
+                    w->nc = nc;
+                }
+            }
+        }
+    }
+
+    ic->index = ni;
+}
+
+static void build_name_indexes(apr_pool_t *p)
+{
+    ipaddr_chain *ic;
+    int i;
+
+    for (i = 0; i < IPHASH_TABLE_SIZE; ++i) {
+        for (ic = iphash_table[i]; ic; ic = ic->next) {
+            if (ic->names) {
+                build_name_index(p, ic);
+            }
+        }
+    }
+    for (ic = default_list; ic; ic = ic->next) {
+        if (ic->names) {
+            build_name_index(p, ic);
+        }
+    }
+}
+
 /* compile the tables and such we need to do the run-time vhost lookups */
 AP_DECLARE(void) ap_fini_vhost_config(apr_pool_t *p, server_rec *main_s)
 {
@@ -667,6 +877,8 @@ AP_DECLARE(void) ap_fini_vhost_config(apr_pool_t *p, server_rec *main_s)
         }
     }
 
+    build_name_indexes(p);
+
 #ifdef IPHASH_STATISTICS
     dump_iphash_statistics(main_s);
 #endif
@@ -976,6 +1188,65 @@ AP_DECLARE(int) ap_matches_request_vhost(request_rec *r, const char *host,
 }
 
 
+/* Find the first name_chain entry whose ServerName or ServerAlias matches
+ * the lowercase host, using the name_index.
+ */
+static name_chain *find_indexed_alias(name_index *ni, const char *host)
+{
+    name_chain *found;
+    name_trie *node;
+    name_wildcard *w;
+    const char *end, *label;
+    int i;
+
+    found = apr_hash_get(ni->names, host, APR_HASH_KEY_STRING);
+
+    /* Walk down the trie by the labels of the host from right to left;
+     * the wildcards at a node apply if there's a '.' left of the label,
+     * i.e. "*.example.com" matches whatever ends with ".example.com".
+     */
+    node = ni->wild_trie;
+    for (end = host + strlen(host); end > host; end = label - 1) {
+        for (label = end; label > host && label[-1] != '.'; --label)
+            ;
+        if (label == host || !node->labels) {
+            break;
+        }
+        node = apr_hash_get(node->labels, label, end - label);
+        if (!node) {
+            break;
+        }
+        if (node->any && (!found || node->any->pos < found->pos)) {
+            found = node->any;
+        }
+        if (node->wild) {
+            w = (name_wildcard *)node->wild->elts;
+            for (i = 0; i < node->wild->nelts; ++i) {
+                if (found && w[i].nc->pos >= found->pos) {
+                    break;
+                }
+                if (!ap_strcasecmp_match(host, w[i].pattern)) {
+                    found = w[i].nc;
+                    break;
+                }
+            }
+        }
+    }
+
+    w = (name_wildcard *)ni->wild_others->elts;
+    for (i = 0; i < ni->wild_others->nelts; ++i) {
+        if (found && w[i].nc->pos >= found->pos) {
+            break;
+        }
+        if (!ap_strcasecmp_match(host, w[i].pattern)) {
+            found = w[i].nc;
+            break;
+        }
+    }
+
+    return found;
+}
+
 static void check_hostalias(request_rec *r)
 {
     /*
@@ -996,13 +1267,33 @@ static void check_hostalias(request_rec *r)
     server_rec *s;
     server_rec *virthost_s;
     server_rec *last_s;
+    ipaddr_chain *ic;
     name_chain *src;
+    server_addr_rec *sar;
 
     virthost_s = NULL;
     last_s = NULL;
 
     port = r->connection->local_addr->port;
 
+    ic = r->connection->vhost_lookup_data;
+    if (ic->index) {
+        sar = ic->names->sar;
+        if (sar->host_port != 0 && port != sar->host_port) {
+            return;
+        }
+        src = find_indexed_alias(ic->index, host);
+        if (!src) {
+            /* Fallback: does it match the virthost from a sar? */
+            src = apr_hash_get(ic->index->virthosts, host,
+                               APR_HASH_KEY_STRING);
+        }
+        if (src) {
+            r->server = src->server;
+        }
+        return;
+    }
+
     /* Recall that the name_chain is a list of server_addr_recs, some of
      * whose ports may not match.  Also each server may appear more than
      * once in the chain -- specifically, it will appear once for each
@@ -1012,9 +1303,7 @@ static void check_hostalias(request_rec *r)
      * a single server are adjacent to each other.
      */
 
-    for (src = r->connection->vhost_lookup_data; src; src = src->next) {
-        server_addr_rec *sar;
-
+    for (src = ic->names; src; src = src->next) {
         /* We only consider addresses on the name_chain which have a matching
          * port
          */
@@ -1065,6 +1354,7 @@ static void check_serverpath(request_rec *r)
 {
     server_rec *s;
     server_rec *last_s;
+    ipaddr_chain *ic;
     name_chain *src;
     apr_port_t port;
 
@@ -1079,7 +1369,8 @@ static void check_serverpath(request_rec *r)
      */
 
     last_s = NULL;
-    for (src = r->connection->vhost_lookup_data; src; src = src->next) {
+    ic = r->connection->vhost_lookup_data;
+    for (src = ic->names; src; src = src->next) {
         /* We only consider addresses on the name_chain which have a matching
          * port
          */
@@ -1198,10 +1489,12 @@ AP_DECLARE(int) ap_vhost_iterate_given_conn(conn_rec *conn,
     int rv = 0;
 
     if (conn->vhost_lookup_data) {
+        ipaddr_chain *ic = conn->vhost_lookup_data;
+
         last_s = NULL;
         port = conn->local_addr->port;
 
-        for (src = conn->vhost_lookup_data; src; src = src->next) {
+        for (src = ic->names; src; src = src->next) {
             server_addr_rec *sar;
 
             /* We only consider addresses on the name_chain which have a
@@ -1235,6 +1528,54 @@ AP_DECLARE(int) ap_vhost_iterate_given_conn(conn_rec *conn,
     return rv;
 }
 
+AP_DECLARE(server_rec *) ap_vhost_find_given_name(conn_rec *conn,
+                                                  const char *name)
+{
+    ipaddr_chain *ic = conn->vhost_lookup_data;
+    server_rec *last_s;
+    name_chain *src;
+    apr_port_t port;
+    char buf[256], *host;
+    apr_size_t len;
+
+    if (!ic) {
+        return matches_aliases(conn->base_server, name) ?
+               conn->base_server : NULL;
+    }
+
+    port = conn->local_addr->port;
+
+    if (ic->index) {
+        if (ic->names->sar->host_port != 0
+            && port != ic->names->sar->host_port) {
+            return NULL;
+        }
+        /* DNS names are 253 characters at most */
+        len = strlen(name);
+        host = (len < sizeof(buf)) ? buf : apr_palloc(conn->pool, len + 1);
+        memcpy(host, name, len + 1);
+        ap_str_tolower(host);
+
+        src = find_indexed_alias(ic->index, host);
+        return src ? src->server : NULL;
+    }
+
+    last_s = NULL;
+    for (src = ic->names; src; src = src->next) {
+        if (src->sar->host_port != 0 && port != src->sar->host_port) {
+            continue;
+        }
+        if (src->server != last_s) {
+            last_s = src->server;
+            if (matches_aliases(last_s, name)) {
+                return last_s;
+            }
+        }
+    }
+
+    return NULL;
+}
+
 /* Called for a new connection which has a known local_addr.  Note that the
  * new connection is assumed to have conn->server == main server.
  */
@@ -1247,8 +1588,8 @@ AP_DECLARE(void) ap_update_vhost_given_ip(conn_rec *conn)
     trav = find_ipaddr(conn->local_addr);
 
     if (trav) {
-        /* save the name_chain for later in case this is a name-vhost */
-        conn->vhost_lookup_data = trav->names;
+        /* save the chain for later in case this is a name-vhost */
+        conn->vhost_lookup_data = trav->names ? trav : NULL;
         conn->base_server = trav->server;
         return;
     }
@@ -1260,7 +1601,7 @@ AP_DECLARE(void) ap_update_vhost_given_ip(conn_rec *conn)
 
     trav = find_default_server(port);
     if (trav) {
-        conn->vhost_lookup_data = trav->names;
+        conn->vhost_lookup_data = trav->names ? trav : NULL;
         conn->base_server = trav->server;
         return;
     }
@@ -0,0 +1,198 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * bench_expr: measures the evaluation of ap_expr expressions of the kinds
+ * found in <If>, Require expr, SetEnvIfExpr, Header and RewriteCond expr
+ * configurations, once with the compiled program ap_expr_parse() produces
+ * and once walking the parse tree it was compiled from. Both results are
+ * compared, a mismatch is reported as FAILED.
+ *
+ * The request is a bare one, with no configuration but empty core ones,
+ * and no module hooked in besides the expression functions of the core.
+ *
+ *   make bench
+ *   ./bench_expr [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apr_general.h"
+#include "apr_hooks.h"
+#include "apr_time.h"
+
+#include "httpd.h"
+#include "http_config.h"
+#include "http_core.h"
+#include "http_log.h"
+#include "ap_expr.h"
+#include "util_expr_private.h"
+
+/*
+ * The expressions, collected from typical configurations
+ */
+typedef struct {
+    const char *name;
+    const char *expr;
+    unsigned int flags;
+} bench_expr;
+
+static const bench_expr exprs[] = {
+    { "path prefix",
+      "%{REQUEST_URI} =~ m#^/static/#", 0 },
+    { "host and method",
+      "%{HTTP_HOST} == 'www.example.com' "
+      "&& %{REQUEST_METHOD} in { 'GET', 'HEAD' }", 0 },
+    { "method, last of list",
+      "%{REQUEST_METHOD} in { 'POST', 'PUT', 'DELETE', 'GET' }", 0 },
+    { "header or query",
+      "-n %{HTTP:X-Forwarded-For} || %{QUERY_STRING} =~ /(^|&)debug=1/", 0 },
+    { "not php, not root",
+      "!(%{REQUEST_URI} =~ /\\.php$/) && %{REQUEST_URI} != '/'", 0 },
+    { "constant guard",
+      "'production' == 'production' && %{REQUEST_METHOD} == 'GET' "
+      "&& %{REMOTE_ADDR} != '127.0.0.1'", 0 },
+    { "mixed case accept",
+      "tolower(%{HTTP:Accept}) =~ /json/ || %{HTTP:Accept} == '*/*'", 0 },
+    { "redirect url",
+      "%{REQUEST_SCHEME}://%{HTTP_HOST}%{REQUEST_URI}",
+      AP_EXPR_FLAG_STRING_RESULT },
+    { "cache key",
+      "%{HTTP_HOST}:%{SERVER_PORT}%{REQUEST_URI}?%{QUERY_STRING}",
+      AP_EXPR_FLAG_STRING_RESULT },
+    { "constant header",
+      "max-age=3600, public", AP_EXPR_FLAG_STRING_RESULT },
+};
+
+#define BENCH_BATCH 1000
+
+static request_rec *make_request(apr_pool_t *p)
+{
+    request_rec *r = apr_pcalloc(p, sizeof(*r));
+    conn_rec *c = apr_pcalloc(p, sizeof(*c));
+    server_rec *s = apr_pcalloc(p, sizeof(*s));
+    void **sconf = apr_pcalloc(p, sizeof(void *));
+    void **dconf = apr_pcalloc(p, sizeof(void *));
+
+    sconf[AP_CORE_MODULE_INDEX] = apr_pcalloc(p, sizeof(core_server_config));
+    dconf[AP_CORE_MODULE_INDEX] = apr_pcalloc(p, sizeof(core_dir_config));
+    s->module_config = (ap_conf_vector_t *)sconf;
+    s->log.level = APLOG_WARNING;
+    s->port = 443;
+    c->base_server = s;
+    c->pool = p;
+    c->client_ip = "192.0.2.17";
+    r->connection = c;
+    r->server = s;
+    r->per_dir_config = (ap_conf_vector_t *)dconf;
+    r->method = "GET";
+    r->protocol = "HTTP/1.1";
+    r->uri = "/static/css/site.css";
+    r->args = "v=3&debug=1";
+    r->useragent_ip = c->client_ip;
+    r->headers_in = apr_table_make(p, 8);
+    r->headers_out = apr_table_make(p, 4);
+    r->err_headers_out = apr_table_make(p, 4);
+    r->notes = apr_table_make(p, 4);
+    r->subprocess_env = apr_table_make(p, 4);
+    apr_table_setn(r->headers_in, "Host", "www.example.com");
+    apr_table_setn(r->headers_in, "Accept", "Application/JSON");
+    apr_table_setn(r->headers_in, "User-Agent", "Mozilla/5.0");
+    return r;
+}
+
+static double run(request_rec *r, apr_pool_t *p, const ap_expr_info_t *info,
+                  int iterations, const char **result)
+{
+    const char *err = NULL;
+    apr_time_t start;
+    int i;
+
+    start = apr_time_now();
+    for (i = 0; i < iterations; ++i) {
+        if (i % BENCH_BATCH == 0) {
+            apr_pool_clear(p);
+        }
+        r->pool = p;
+        if (info->flags & AP_EXPR_FLAG_STRING_RESULT) {
+            *result = ap_expr_str_exec(r, info, &err);
+        }
+        else {
+            *result = ap_expr_exec(r, info, &err) > 0 ? "true" : "false";
+        }
+    }
+    start = apr_time_now() - start;
+    *result = apr_pstrdup(r->connection->pool, err ? err : *result);
+    return (double)start * 1000 / iterations;
+}
+
+int main(int argc, const char *const argv[])
+{
+    apr_pool_t *pool, *rpool;
+    request_rec *r;
+    int iterations = argc > 1 ? atoi(argv[1]) : 1000000;
+    int failed = 0;
+    unsigned int i;
+
+    apr_app_initialize(&argc, &argv, NULL);
+    apr_pool_create(&pool, NULL);
+    apr_pool_create(&rpool, pool);
+    apr_hook_global_pool = pool;
+    ap_expr_init(pool);
+    apr_hook_sort_all();
+
+    r = make_request(pool);
+
+    printf("%-20s %10s %10s %8s\n", "expression", "tree ns", "compiled", "speedup");
+    for (i = 0; i < sizeof(exprs) / sizeof(exprs[0]); ++i) {
+        ap_expr_info_t info, tree;
+        const char *err, *res_tree, *res_prog;
+        double t_tree, t_prog;
+
+        memset(&info, 0, sizeof(info));
+        info.filename = "bench";
+        info.flags = exprs[i].flags | AP_EXPR_FLAG_DONT_VARY;
+        err = ap_expr_parse(pool, pool, &info, exprs[i].expr, NULL);
+        if (err) {
+            printf("%-20s parse error: %s\n", exprs[i].name, err);
+            ++failed;
+            continue;
+        }
+        tree = info;
+        if (info.root_node->node_op == op_Program) {
+            tree.root_node = (ap_expr_t *)info.root_node->node_arg2;
+        }
+
+        t_tree = run(r, rpool, &tree, iterations, &res_tree);
+        t_prog = run(r, rpool, &info, iterations, &res_prog);
+
+        printf("%-20s %10.1f %10.1f %7.2fx%s\n", exprs[i].name, t_tree,
+               t_prog, t_prog > 0 ? t_tree / t_prog : 0.0,
+               info.root_node->node_op == op_Program ? "" :
+               info.root_node->node_op == op_String ? "  (folded)" :
+               "  (not compiled)");
+        if (strcmp(res_tree, res_prog)) {
+            printf("%-20s FAILED: tree gave '%s', compiled '%s'\n",
+                   exprs[i].name, res_tree, res_prog);
+            ++failed;
+        }
+    }
+
+    apr_terminate();
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,246 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * bench_h2_beam: measures the throughput of mod_http2's bucket beams, the
+ * way response data travels from a stream's task thread to the master
+ * connection. Each stream gets a producer thread sending buckets through
+ * its beam with blocking sends and a consumer thread receiving and reading
+ * them, with the beam's mutex enabled as h2_mplx does.
+ *
+ * Heap buckets are passed as they are, transient ones are copied by the
+ * beam and mmap buckets are passed without their data ever being copied.
+ *
+ * Linked against mod_http2's objects, so mod_http2 must have been built:
+ *
+ *   make bench
+ *   ./bench_h2_beam [streams] [MB per stream] [bucket size]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apr_general.h"
+#include "apr_buckets.h"
+#include "apr_file_io.h"
+#include "apr_mmap.h"
+#include "apr_thread_proc.h"
+#include "apr_time.h"
+
+#include "h2_bucket_beam.h"
+
+typedef enum {
+    BENCH_HEAP,
+    BENCH_TRANSIENT,
+    BENCH_MMAP
+} bench_type;
+
+static const char *const type_names[] = { "heap", "transient", "mmap" };
+
+#define BENCH_BUF_SIZE      (64 * 1024)
+#define BENCH_PER_SEND      8
+
+typedef struct {
+    h2_bucket_beam *beam;
+    apr_pool_t *send_pool;
+    apr_pool_t *recv_pool;
+    bench_type type;
+    const char *data;
+    const char *fname;
+    apr_size_t bsize;
+    apr_off_t total;
+    apr_off_t received;
+    apr_status_t status;
+} bench_stream;
+
+static void * APR_THREAD_FUNC producer(apr_thread_t *thd, void *data)
+{
+    bench_stream *s = data;
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(s->send_pool);
+    apr_bucket_brigade *bb = apr_brigade_create(s->send_pool, ba);
+    apr_mmap_t *mm = NULL;
+    apr_file_t *fd;
+    apr_bucket *b;
+    apr_off_t sent = 0;
+    int i;
+
+    if (s->type == BENCH_MMAP) {
+        s->status = apr_file_open(&fd, s->fname, APR_FOPEN_READ,
+                                  APR_OS_DEFAULT, s->send_pool);
+        if (s->status == APR_SUCCESS) {
+            s->status = apr_mmap_create(&mm, fd, 0, s->bsize, APR_MMAP_READ,
+                                        s->send_pool);
+        }
+        if (s->status != APR_SUCCESS) {
+            h2_beam_abort(s->beam);
+            return NULL;
+        }
+    }
+
+    while (sent < s->total) {
+        for (i = 0; i < BENCH_PER_SEND && sent < s->total; ++i) {
+            switch (s->type) {
+            case BENCH_HEAP:
+                b = apr_bucket_heap_create(s->data, s->bsize, NULL, ba);
+                break;
+            case BENCH_TRANSIENT:
+                b = apr_bucket_transient_create(s->data, s->bsize, ba);
+                break;
+            default:
+                b = apr_bucket_mmap_create(mm, 0, s->bsize, ba);
+                break;
+            }
+            APR_BRIGADE_INSERT_TAIL(bb, b);
+            sent += s->bsize;
+        }
+        if (sent >= s->total) {
+            APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_eos_create(ba));
+        }
+        while (!APR_BRIGADE_EMPTY(bb)) {
+            s->status = h2_beam_send(s->beam, bb, APR_BLOCK_READ);
+            if (s->status != APR_SUCCESS && !APR_STATUS_IS_EAGAIN(s->status)) {
+                return NULL;
+            }
+        }
+    }
+    /* wait for the green side to let go of all our buckets */
+    while (!h2_beam_empty(s->beam) || h2_beam_holds_proxies(s->beam)) {
+        h2_beam_send(s->beam, NULL, APR_NONBLOCK_READ);
+        apr_sleep(100);
+    }
+    return NULL;
+}
+
+static void * APR_THREAD_FUNC consumer(apr_thread_t *thd, void *data)
+{
+    bench_stream *s = data;
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(s->recv_pool);
+    apr_bucket_brigade *bb = apr_brigade_create(s->recv_pool, ba);
+    apr_status_t status;
+    apr_bucket *b;
+    const char *str;
+    apr_size_t len;
+    unsigned long sum = 0;
+
+    for (;;) {
+        status = h2_beam_receive(s->beam, bb, APR_BLOCK_READ, 0);
+        if (status != APR_SUCCESS) {
+            break;
+        }
+        for (b = APR_BRIGADE_FIRST(bb);
+             b != APR_BRIGADE_SENTINEL(bb);
+             b = APR_BUCKET_NEXT(b)) {
+            if (!APR_BUCKET_IS_METADATA(b)
+                && apr_bucket_read(b, &str, &len, APR_BLOCK_READ)
+                   == APR_SUCCESS) {
+                /* touch the data, as writing it out would */
+                sum += (unsigned char)str[0] + (unsigned char)str[len - 1];
+                s->received += len;
+            }
+        }
+        apr_brigade_cleanup(bb);
+    }
+    if (!APR_STATUS_IS_EOF(status)) {
+        s->status = status;
+    }
+    return (void *)sum;
+}
+
+static int run(apr_pool_t *pool, bench_type type, int nstreams,
+               apr_off_t total, apr_size_t bsize, const char *data,
+               const char *fname)
+{
+    bench_stream *streams = apr_pcalloc(pool, nstreams * sizeof(*streams));
+    apr_thread_t **threads = apr_pcalloc(pool, 2 * nstreams * sizeof(*threads));
+    apr_status_t rv;
+    apr_time_t start;
+    apr_off_t bytes = 0;
+    int i, failed = 0;
+
+    for (i = 0; i < nstreams; ++i) {
+        bench_stream *s = &streams[i];
+        s->type = type;
+        s->data = data;
+        s->fname = fname;
+        s->bsize = bsize;
+        s->total = total;
+        apr_pool_create(&s->send_pool, NULL);
+        apr_pool_create(&s->recv_pool, NULL);
+        h2_beam_create(&s->beam, s->recv_pool, i, "bench",
+                       H2_BEAM_OWNER_RECV, BENCH_BUF_SIZE);
+        h2_beam_mutex_enable(s->beam);
+    }
+
+    start = apr_time_now();
+    for (i = 0; i < nstreams; ++i) {
+        apr_thread_create(&threads[2*i], NULL, consumer, &streams[i], pool);
+        apr_thread_create(&threads[2*i+1], NULL, producer, &streams[i], pool);
+    }
+    for (i = 0; i < 2 * nstreams; ++i) {
+        apr_thread_join(&rv, threads[i]);
+    }
+    start = apr_time_now() - start;
+
+    for (i = 0; i < nstreams; ++i) {
+        bench_stream *s = &streams[i];
+        if (s->status != APR_SUCCESS || s->received != s->total) {
+            ++failed;
+        }
+        bytes += s->received;
+        h2_beam_mutex_disable(s->beam);
+        apr_pool_destroy(s->recv_pool);
+        apr_pool_destroy(s->send_pool);
+    }
+
+    printf("%-10s %3d streams  %8.1f MB/s%s\n", type_names[type], nstreams,
+           (double)bytes / (1024 * 1024) / ((double)start / APR_USEC_PER_SEC),
+           failed? "  (FAILED)" : "");
+    return failed;
+}
+
+int main(int argc, const char *const argv[])
+{
+    apr_pool_t *pool;
+    apr_file_t *f;
+    char *data, fname[] = "/tmp/bench_h2_beam.XXXXXX";
+    int nstreams = argc > 1 ? atoi(argv[1]) : 8;
+    apr_off_t total = (apr_off_t)(argc > 2 ? atoi(argv[2]) : 256) * 1024 * 1024;
+    apr_size_t bsize = argc > 3 ? atoi(argv[3]) : 16 * 1024;
+    apr_size_t written;
+    int failed = 0;
+
+    apr_app_initialize(&argc, &argv, NULL);
+    apr_pool_create(&pool, NULL);
+
+    data = apr_palloc(pool, bsize);
+    memset(data, 'x', bsize);
+    if (apr_file_mktemp(&f, fname, APR_FOPEN_CREATE | APR_FOPEN_READ
+                        | APR_FOPEN_WRITE | APR_FOPEN_EXCL, pool) != APR_SUCCESS
+        || apr_file_write_full(f, data, bsize, &written) != APR_SUCCESS) {
+        fprintf(stderr, "unable to create %s\n", fname);
+        return 1;
+    }
+    apr_file_close(f);
+
+    failed += run(pool, BENCH_HEAP, nstreams, total, bsize, data, fname);
+    failed += run(pool, BENCH_TRANSIENT, nstreams, total, bsize, data, fname);
+    failed += run(pool, BENCH_MMAP, nstreams, total, bsize, data, fname);
+
+    apr_file_remove(fname, pool);
+    apr_terminate();
+    return failed? 1 : 0;
+}
@@ -0,0 +1,185 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * bench_hooks: measures the cost of running the request hooks with the
+ * per server runners of AP_IMPLEMENT_SERVER_HOOK_RUN_ALL/_FIRST, for a
+ * server where nothing was left out, which runs the hooks' global arrays
+ * as the stock runners did, and for one where most modules left their
+ * functions out with ap_hook_skip_for_server(), as mod_rewrite and
+ * mod_alias do where they are not configured.
+ *
+ * Each simulated request runs five phases (translate_name, access_checker,
+ * type_checker, fixups and log_transaction) through httpd's own runners,
+ * with a function of each of the modules hooked in, plus one returning OK
+ * last, as the core does.  Reported are the hook functions called and the
+ * time, and on x86 the cycles, per request.
+ *
+ *   make bench
+ *   ./bench_hooks [requests] [modules] [modules left out]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apr_general.h"
+#include "apr_hooks.h"
+#include "apr_strings.h"
+#include "apr_time.h"
+
+#include "httpd.h"
+#include "http_config.h"
+#include "http_core.h"
+#include "http_protocol.h"
+#include "http_request.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLES() __rdtsc()
+#else
+#define BENCH_CYCLES() 0
+#endif
+
+#define BENCH_MAX_MODULES 64
+
+static module bench_modules[BENCH_MAX_MODULES + 1];
+static unsigned long calls;
+
+/* what the function of a module not configured for the server does */
+static int bench_decline(request_rec *r)
+{
+    ++calls;
+    return DECLINED;
+}
+
+/* the core's function, last */
+static int bench_core(request_rec *r)
+{
+    ++calls;
+    return OK;
+}
+
+static void bench_register(int nmodules)
+{
+    int i;
+
+    for (i = 0; i <= nmodules; ++i) {
+        int last = (i == nmodules);
+        int (*pf)(request_rec *) = last ? bench_core : bench_decline;
+
+        bench_modules[i].name = apr_psprintf(apr_hook_global_pool,
+                                             last ? "core.c" : "mod_bench%d.c",
+                                             i);
+        apr_hook_debug_current = bench_modules[i].name;
+        ap_hook_translate_name(pf, NULL, NULL, APR_HOOK_MIDDLE + last);
+        ap_hook_access_checker(pf, NULL, NULL, APR_HOOK_MIDDLE + last);
+        ap_hook_type_checker(pf, NULL, NULL, APR_HOOK_MIDDLE + last);
+        ap_hook_fixups(pf, NULL, NULL, APR_HOOK_MIDDLE + last);
+        ap_hook_log_transaction(pf, NULL, NULL, APR_HOOK_MIDDLE + last);
+    }
+    apr_hook_sort_all();
+}
+
+static void bench_skip(apr_pool_t *p, server_rec *s, int nskip)
+{
+    int i;
+
+    for (i = 0; i < nskip; ++i) {
+        ap_hook_skip_for_server(p, s, ap_hook_get_translate_name(),
+                                &bench_modules[i]);
+        ap_hook_skip_for_server(p, s, ap_hook_get_access_checker(),
+                                &bench_modules[i]);
+        ap_hook_skip_for_server(p, s, ap_hook_get_type_checker(),
+                                &bench_modules[i]);
+        ap_hook_skip_for_server(p, s, ap_hook_get_fixups(),
+                                &bench_modules[i]);
+        ap_hook_skip_for_server(p, s, ap_hook_get_log_transaction(),
+                                &bench_modules[i]);
+    }
+}
+
+static server_rec *make_server(apr_pool_t *p)
+{
+    server_rec *s = apr_pcalloc(p, sizeof(*s));
+    void **config = apr_pcalloc(p, sizeof(void *));
+
+    config[AP_CORE_MODULE_INDEX] = apr_pcalloc(p, sizeof(core_server_config));
+    s->module_config = (ap_conf_vector_t *)config;
+    return s;
+}
+
+static int run(const char *name, request_rec *r, int requests)
+{
+    apr_time_t start;
+    apr_uint64_t cycles;
+    int i, rv = OK;
+
+    calls = 0;
+    start = apr_time_now();
+    cycles = BENCH_CYCLES();
+    for (i = 0; i < requests && rv == OK; ++i) {
+        rv = ap_run_translate_name(r);
+        rv = (rv == OK) ? ap_run_access_checker(r) : rv;
+        rv = (rv == OK) ? ap_run_type_checker(r) : rv;
+        rv = (rv == OK) ? ap_run_fixups(r) : rv;
+        rv = (rv == OK) ? ap_run_log_transaction(r) : rv;
+    }
+    cycles = BENCH_CYCLES() - cycles;
+    start = apr_time_now() - start;
+
+    printf("%-8s %6.1f calls  %8.1f ns  %8.1f cycles per request%s\n", name,
+           (double)calls / requests, (double)start * 1000 / requests,
+           (double)cycles / requests, rv == OK ? "" : "  (FAILED)");
+    return rv == OK ? 0 : 1;
+}
+
+int main(int argc, const char *const argv[])
+{
+    apr_pool_t *pool;
+    request_rec *r;
+    server_rec *all, *skipping;
+    int requests = argc > 1 ? atoi(argv[1]) : 10000000;
+    int nmodules = argc > 2 ? atoi(argv[2]) : 24;
+    int nskip = argc > 3 ? atoi(argv[3]) : nmodules * 3 / 4;
+    int failed = 0;
+
+    if (nmodules > BENCH_MAX_MODULES || nskip > nmodules) {
+        fprintf(stderr, "at most %d modules, no more left out than there are\n",
+                BENCH_MAX_MODULES);
+        return 1;
+    }
+
+    apr_app_initialize(&argc, &argv, NULL);
+    apr_pool_create(&pool, NULL);
+    apr_hook_global_pool = pool;
+
+    bench_register(nmodules);
+    all = make_server(pool);
+    skipping = make_server(pool);
+    bench_skip(pool, skipping, nskip);
+    r = apr_pcalloc(pool, sizeof(*r));
+
+    printf("%d modules, %d of them left out for the server\n",
+           nmodules, nskip);
+    r->server = all;
+    failed += run("all", r, requests);
+    r->server = skipping;
+    failed += run("server", r, requests);
+
+    apr_terminate();
+    return failed ? 1 : 0;
+}